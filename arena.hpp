@@ -0,0 +1,92 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+
+#define ARENA_HUGEPAGE (2ULL << 20) // size granularity
+
+/**
+ * @brief Large anonymous mapping that is resident before it is used.
+ *
+ * Huge pages are used if the system has them reserved (transparent huge pages
+ * otherwise), the pages are faulted in up front and locked into RAM if
+ * RLIMIT_MEMLOCK allows, so that writing to the arena from the camera
+ * callback never faults. Starts out zeroed.
+ */
+class Arena
+{
+private:
+    uint8_t *mem = nullptr;
+    size_t len = 0;
+    bool huge = false;
+    bool locked = false;
+
+public:
+    ~Arena()
+    {
+        free();
+    }
+
+    /**
+     * @brief Map at least size bytes, this can take a while for large sizes.
+     *
+     * @return 0 or an errno value.
+     */
+    int alloc(size_t size)
+    {
+        free();
+        len = (size + ARENA_HUGEPAGE - 1) / ARENA_HUGEPAGE * ARENA_HUGEPAGE;
+        void *m = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_POPULATE, -1, 0);
+        huge = m != MAP_FAILED;
+        if (!huge) // no huge pages reserved, ask for transparent ones
+        {
+            m = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (m == MAP_FAILED)
+            {
+                int err = errno;
+                len = 0;
+                return err;
+            }
+            madvise(m, len, MADV_HUGEPAGE);
+            memset(m, 0, len); // fault it in now rather than in the camera callback
+        }
+        mem = (uint8_t *)m;
+        locked = mlock(mem, len) == 0;
+        return 0;
+    }
+
+    void free()
+    {
+        if (mem)
+        {
+            if (locked)
+                munlock(mem, len);
+            munmap(mem, len);
+        }
+        mem = nullptr;
+        len = 0;
+        huge = false;
+        locked = false;
+    }
+
+    uint8_t *data() const
+    {
+        return mem;
+    }
+
+    size_t size() const
+    {
+        return len;
+    }
+
+    bool huge_pages() const
+    {
+        return huge;
+    }
+
+    bool memory_locked() const
+    {
+        return locked;
+    }
+};
@@ -0,0 +1,118 @@
+// Bayer demosaic throughput at 12 MP for 1 .. N threads, on a synthetic
+// mosaic of a smooth colour gradient with noise, after checking the threaded
+// (and AVX2) output against the scalar reference for every pattern and method.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../demosaic.hpp"
+
+static double now_ms()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+template <typename T>
+static void mosaic(std::vector<T> &img, uint32_t width, uint32_t height, uint32_t maxval)
+{
+    img.resize((size_t)width * height);
+    for (uint32_t y = 0; y < height; y++)
+        for (uint32_t x = 0; x < width; x++)
+        {
+            uint32_t c = (y & 1) * 2 + (x & 1); // RGGB
+            uint32_t v = c == 0 ? x * maxval / width : c == 3 ? y * maxval / height : maxval / 2;
+            v += rand() % 16;
+            img[(size_t)y * width + x] = v > maxval ? maxval : v;
+        }
+}
+
+template <typename T>
+static double run(ThreadPool &pool, T *dst, const T *src, uint32_t width, uint32_t height, DemosaicMethod method, bool superpixel, int niter,
+                  void (*full)(ThreadPool &, T *, const T *, uint32_t, uint32_t, BayerPattern, DemosaicMethod),
+                  void (*half)(ThreadPool &, T *, const T *, uint32_t, uint32_t, BayerPattern))
+{
+    double start = now_ms();
+    for (int i = 0; i < niter; i++)
+    {
+        if (superpixel)
+            half(pool, dst, src, width, height, BAYER_RG);
+        else
+            full(pool, dst, src, width, height, BAYER_RG, method);
+    }
+    return (now_ms() - start) / niter;
+}
+
+// threaded output against the scalar rows, odd sizes leave SIMD remainders
+template <typename T>
+static bool check(ThreadPool &pool, uint32_t maxval,
+                  void (*full)(ThreadPool &, T *, const T *, uint32_t, uint32_t, BayerPattern, DemosaicMethod),
+                  void (*ref)(T *, const T *, uint32_t, uint32_t, BayerPattern, DemosaicMethod, uint32_t, uint32_t))
+{
+    static const uint32_t sizes[][2] = {{2, 2}, {3, 3}, {17, 5}, {33, 7}, {101, 67}, {1001, 513}};
+    static const char *patterns[] = {"RG", "GR", "GB", "BG"};
+    static const char *methods[] = {"bilinear", "edge"};
+    std::vector<T> src, out, expect;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        uint32_t width = sizes[s][0], height = sizes[s][1];
+        src.resize((size_t)width * height);
+        for (size_t i = 0; i < src.size(); i++)
+            src[i] = rand() % 8 == 0 ? maxval : rand() % (maxval + 1); // saturated runs catch rounding overflows
+        out.resize(src.size() * 3);
+        expect.resize(src.size() * 3);
+        for (int p = 0; p < 4; p++)
+            for (int m = 0; m < 2; m++)
+            {
+                full(pool, out.data(), src.data(), width, height, (BayerPattern)p, (DemosaicMethod)m);
+                ref(expect.data(), src.data(), width, height, (BayerPattern)p, (DemosaicMethod)m, 0, height);
+                if (memcmp(out.data(), expect.data(), out.size() * sizeof(T)))
+                {
+                    fprintf(stderr, "Mismatch against the scalar reference: %zu bit, %u x %u, Bayer%s, %s\n", sizeof(T) * 8, width, height, patterns[p], methods[m]);
+                    return false;
+                }
+            }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    const uint32_t width = 4096, height = 3000;
+    int niter = argc > 1 ? atoi(argv[1]) : 20;
+    if (niter < 1)
+        niter = 1;
+    uint32_t maxthreads = std::thread::hardware_concurrency();
+    if (maxthreads < 1)
+        maxthreads = 1;
+    {
+        ThreadPool pool(maxthreads > 1 ? maxthreads - 1 : 1); // split into bands even on one core
+        if (!check<uint8_t>(pool, 0xff, demosaic_u8, demosaic_rows_u8_scalar) || !check<uint16_t>(pool, 0xfff, demosaic_u16, demosaic_rows_u16_scalar) || !check<uint16_t>(pool, 0xffff, demosaic_u16, demosaic_rows_u16_scalar))
+            return 1;
+        printf("Output matches the scalar reference\n");
+    }
+    std::vector<uint8_t> src8, dst8((size_t)width * height * 3);
+    std::vector<uint16_t> src16, dst16((size_t)width * height * 3);
+    mosaic(src8, width, height, 0xff);
+    mosaic(src16, width, height, 0xfff);
+    printf("%u x %u, %d iterations, %u hardware threads\n", width, height, niter, maxthreads);
+    printf("%8s %12s %12s %12s %12s %12s %12s\n", "Threads", "8b bilin ms", "8b edge ms", "8b super ms", "16b bilin ms", "16b edge ms", "16b super ms");
+    for (uint32_t threads = 1; threads <= maxthreads; threads *= 2)
+    {
+        ThreadPool pool(threads - 1); // the caller runs parts as well, alone for 1 thread
+        double t[6];
+        t[0] = run<uint8_t>(pool, dst8.data(), src8.data(), width, height, DEMOSAIC_BILINEAR, false, niter, demosaic_u8, demosaic_superpixel_u8);
+        t[1] = run<uint8_t>(pool, dst8.data(), src8.data(), width, height, DEMOSAIC_EDGE, false, niter, demosaic_u8, demosaic_superpixel_u8);
+        t[2] = run<uint8_t>(pool, dst8.data(), src8.data(), width, height, DEMOSAIC_BILINEAR, true, niter, demosaic_u8, demosaic_superpixel_u8);
+        t[3] = run<uint16_t>(pool, dst16.data(), src16.data(), width, height, DEMOSAIC_BILINEAR, false, niter, demosaic_u16, demosaic_superpixel_u16);
+        t[4] = run<uint16_t>(pool, dst16.data(), src16.data(), width, height, DEMOSAIC_EDGE, false, niter, demosaic_u16, demosaic_superpixel_u16);
+        t[5] = run<uint16_t>(pool, dst16.data(), src16.data(), width, height, DEMOSAIC_BILINEAR, true, niter, demosaic_u16, demosaic_superpixel_u16);
+        printf("%8u %12.2f %12.2f %12.2f %12.2f %12.2f %12.2f\n", threads, t[0], t[1], t[2], t[3], t[4], t[5]);
+        if (threads < maxthreads && threads * 2 > maxthreads)
+            threads = maxthreads / 2; // always include the full machine
+    }
+    printf("60 fps needs %.2f ms per frame\n", 1000.0 / 60);
+    return 0;
+}
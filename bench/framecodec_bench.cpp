@@ -0,0 +1,82 @@
+// Lossless frame codec ratio and throughput at 12 MP for 1 .. N threads, on a
+// synthetic scene (smooth gradient with sensor noise) in Mono8, Mono12,
+// Mono16 and BayerRG12.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../framecodec.hpp"
+#include "../pixfmt.hpp"
+
+static double now_ms()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void scene(std::vector<uint8_t> &img, const FrameCodec &fc, uint32_t bits)
+{
+    uint32_t maxval = (1u << bits) - 1;
+    img.resize(framecodec_raw_size(fc));
+    for (uint32_t y = 0; y < fc.rows; y++)
+        for (uint32_t x = 0; x < fc.row_samples; x++)
+        {
+            double v = (0.5 + 0.4 * sin(x * 0.003) * cos(y * 0.004)) * maxval;
+            v += (rand() % 64 - 32) * (maxval / 4095.0 + 0.1); // a few codes of noise
+            uint32_t s = v < 0 ? 0 : v > maxval ? maxval : (uint32_t)v;
+            size_t i = (size_t)y * fc.row_samples + x;
+            if (fc.bytes == 1)
+                img[i] = s;
+            else
+                ((uint16_t *)img.data())[i] = s;
+        }
+}
+
+int main(int argc, char *argv[])
+{
+    const uint32_t width = 4096, height = 3000;
+    int niter = argc > 1 ? atoi(argv[1]) : 10;
+    if (niter < 1)
+        niter = 1;
+    uint32_t maxthreads = std::thread::hardware_concurrency();
+    if (maxthreads < 1)
+        maxthreads = 1;
+    static const VmbPixelFormat_t formats[] = {VmbPixelFormatMono8, VmbPixelFormatMono12, VmbPixelFormatMono16, VmbPixelFormatBayerRG12};
+    printf("%u x %u, %d iterations, %u hardware threads\n", width, height, niter, maxthreads);
+    printf("%-10s %8s %8s %14s %14s\n", "Format", "Ratio", "Threads", "Compress MB/s", "Decode MB/s");
+    for (VmbPixelFormat_t pfmt : formats)
+    {
+        FrameCodec fc;
+        framecodec_init(fc, pfmt, width, height);
+        std::vector<uint8_t> src, out(framecodec_raw_size(fc)), packed(framecodec_bound(fc));
+        scene(src, fc, pixfmt_bit_depth(pfmt));
+        for (uint32_t threads = 2;; threads *= 2) // a pool always has a worker besides the caller
+        {
+            ThreadPool pool(threads - 1);
+            size_t size = 0;
+            double start = now_ms();
+            for (int i = 0; i < niter; i++)
+                size = framecodec_compress(pool, fc, src.data(), packed.data());
+            double tc = (now_ms() - start) / niter;
+            start = now_ms();
+            bool ok = true;
+            for (int i = 0; i < niter; i++)
+                ok &= framecodec_decompress(pool, fc, packed.data(), size, out.data());
+            double td = (now_ms() - start) / niter;
+            if (!ok || memcmp(src.data(), out.data(), src.size()) != 0)
+            {
+                printf("%s: decoded frame differs\n", pixfmt_to_string(pfmt));
+                return 1;
+            }
+            printf("%-10s %8.2f %8u %14.1f %14.1f\n", pixfmt_to_string(pfmt), (double)src.size() / size, threads, src.size() / tc / 1e3, src.size() / td / 1e3);
+            if (threads >= maxthreads)
+                break;
+            if (threads * 2 > maxthreads)
+                threads = maxthreads / 2; // always include the full machine
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,160 @@
+// Per-frame statistics cost at 12 MP for 1 .. N threads, against the scalar
+// single threaded reference, after checking the threaded (and AVX2) results
+// against the references at 8 to 16 bits and odd sample counts. The 1 ms per
+// 12 MP frame target assumes FRAMESTATS_TARGET_THREADS cores: the histogram
+// increments cost about 5 ms on one core and only scale with the band count.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../framestats.hpp"
+
+#define FRAMESTATS_TARGET_MS 1.0
+#define FRAMESTATS_TARGET_THREADS 8
+
+static double now_ms()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// naive 8 bit reference, the library has no scalar framestats_u8
+static void framestats_u8_ref(FrameStats &st, const uint8_t *src, size_t n)
+{
+    st.bits = 8;
+    st.nbins = 256;
+    st.bin_shift = 0;
+    st.count = n;
+    st.min = n ? 255 : 0;
+    st.max = 0;
+    st.saturated = 0;
+    memset(st.hist, 0, sizeof(st.hist));
+    uint64_t sum = 0, sumsq = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t v = src[i];
+        st.hist[v]++;
+        st.min = std::min(st.min, v);
+        st.max = std::max(st.max, v);
+        st.saturated += v == 255;
+        sum += v;
+        sumsq += (uint64_t)v * v;
+    }
+    st.mean = n ? (double)sum / n : 0;
+    double var = n ? (double)sumsq / n - st.mean * st.mean : 0;
+    st.stddev = var > 0 ? sqrt(var) : 0;
+}
+
+static bool same(const FrameStats &a, const FrameStats &b)
+{
+    return a.bits == b.bits && a.nbins == b.nbins && a.bin_shift == b.bin_shift && a.count == b.count && a.min == b.min && a.max == b.max && a.saturated == b.saturated && a.mean == b.mean && a.stddev == b.stddev && !memcmp(a.hist, b.hist, a.nbins * sizeof(uint32_t));
+}
+
+// threaded results against the references, bands split unevenly and below the threading threshold
+static bool check(uint32_t maxthreads)
+{
+    static const size_t counts[] = {1, 7, 4097, 65535, 65537, 1000003};
+    static const uint32_t depths[] = {8, 10, 12, 14, 16};
+    static FrameStats st, ref;
+    std::vector<uint8_t> src8;
+    std::vector<uint16_t> src16;
+    for (uint32_t threads = 2;; threads = std::min(threads * 2, maxthreads))
+    {
+        ThreadPool pool(threads - 1);
+        for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++)
+        {
+            size_t n = counts[c];
+            for (size_t d = 0; d < sizeof(depths) / sizeof(depths[0]); d++)
+            {
+                uint32_t bits = depths[d], maxcode = (1u << bits) - 1;
+                src16.resize(n);
+                for (size_t i = 0; i < n; i++)
+                    src16[i] = rand() % 50 == 0 ? maxcode : rand() & maxcode;
+                if (bits == 8)
+                {
+                    src8.assign(src16.begin(), src16.end());
+                    framestats_u8(pool, st, src8.data(), n);
+                    framestats_u8_ref(ref, src8.data(), n);
+                }
+                else
+                {
+                    framestats_u16(pool, st, src16.data(), n, bits);
+                    framestats_u16_scalar(ref, src16.data(), n, bits);
+                }
+                if (!same(st, ref))
+                {
+                    fprintf(stderr, "Mismatch against the reference: %u bits, %zu samples, %u threads\n", bits, n, threads);
+                    return false;
+                }
+            }
+        }
+        if (threads >= maxthreads)
+            break;
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    const size_t n = 4096 * 3000;
+    int niter = argc > 1 ? atoi(argv[1]) : 20;
+    if (niter < 1)
+        niter = 1;
+    uint32_t maxthreads = std::thread::hardware_concurrency();
+    if (maxthreads < 2)
+        maxthreads = 2; // a pool always has a worker besides the caller
+    if (!check(maxthreads))
+        return 1;
+    printf("Threaded results match the references at 8 - 16 bits\n");
+    // a noisy scene around mid grey with a few saturated pixels
+    std::vector<uint8_t> src8(n);
+    std::vector<uint16_t> src16(n);
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t v = 0x8000 + (rand() % 0x2000) - 0x1000;
+        if (rand() % 1000 == 0)
+            v = 0xffff;
+        src16[i] = v;
+        src8[i] = v >> 8;
+    }
+    std::vector<uint16_t> src12(n);
+    for (size_t i = 0; i < n; i++)
+        src12[i] = src16[i] >> 4;
+    static FrameStats st;
+    double start = now_ms();
+    for (int i = 0; i < niter; i++)
+        framestats_u16_scalar(st, src16.data(), n, 16);
+    double scalar = (now_ms() - start) / niter;
+    printf("4096 x 3000, %d iterations, %u hardware threads\n", niter, maxthreads);
+    printf("Scalar reference, 16 bit: %.3f ms\n", scalar);
+    printf("%8s %10s %10s %10s\n", "Threads", "8 bit ms", "12 bit ms", "16 bit ms");
+    for (uint32_t threads = 2;; threads *= 2) // a pool always has a worker besides the caller
+    {
+        ThreadPool pool(threads - 1); // the caller runs a band as well
+        double t[3];
+        start = now_ms();
+        for (int i = 0; i < niter; i++)
+            framestats_u8(pool, st, src8.data(), n);
+        t[0] = (now_ms() - start) / niter;
+        start = now_ms();
+        for (int i = 0; i < niter; i++)
+            framestats_u16(pool, st, src12.data(), n, 12);
+        t[1] = (now_ms() - start) / niter;
+        start = now_ms();
+        for (int i = 0; i < niter; i++)
+            framestats_u16(pool, st, src16.data(), n, 16);
+        t[2] = (now_ms() - start) / niter;
+        printf("%8u %10.3f %10.3f %10.3f\n", threads, t[0], t[1], t[2]);
+        if (threads >= maxthreads)
+            break;
+        if (threads * 2 > maxthreads)
+            threads = maxthreads / 2; // always include the full machine
+    }
+    printf("Target: %.1f ms per frame with %d threads\n", FRAMESTATS_TARGET_MS, FRAMESTATS_TARGET_THREADS);
+    printf("Last frame: min %u, max %u, mean %.1f, std dev %.1f, saturated %llu\n", st.min, st.max, st.mean, st.stddev, (unsigned long long)st.saturated);
+    return 0;
+}
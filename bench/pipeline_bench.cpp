@@ -0,0 +1,387 @@
+// Benchmarks of the stages that bound the frame rate, on 0.3 to 20 MP frames
+// in mono and color formats, with the results as JSON to track regressions
+// between releases:
+//  - Image::update() on the ImageGenerator thread, alone and while this thread
+//    uploads with Image::get_texture() (needs an OpenGL context, else skipped)
+//  - CaptureStat::update() alone and while other threads read summaries
+//  - the bit shift, unpack and demosaic kernels
+//  - the recording writer fed by ImageGenerator, raw and bit packed
+//  - StringHasher::get_hash() on camera ID strings
+//
+// pipeline_bench [ms per case] [recording directory] > results.json
+//
+// The JSON goes to stdout and a line per case to stderr as they run.
+// Throughput (gbs) is in GB/s of frame data.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../imagetexture.hpp"
+#include "../imggen.hpp"
+#include "../recorder.hpp"
+#include "../capturestat.hpp"
+#include "../stringhasher.hpp"
+#include "../string_format.hpp"
+#include "../crc32c.hpp"
+
+#ifndef BENCH_REVISION
+#define BENCH_REVISION "unknown"
+#endif
+
+#define BENCH_CASE_MS 500 // default time spent on each case
+
+static const struct
+{
+    uint32_t width;
+    uint32_t height;
+} sizes[] = {{640, 480}, {1456, 1088}, {2464, 2056}, {4096, 3000}, {5472, 3648}};
+
+static const VmbPixelFormat_t display_formats[] = {VmbPixelFormatMono8, VmbPixelFormatMono12, VmbPixelFormatMono12p, VmbPixelFormatBayerRG8, VmbPixelFormatBayerRG12, VmbPixelFormatRgb8};
+
+static double case_ms = BENCH_CASE_MS;
+static std::vector<std::string> results;
+
+static double now_ms()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// ms per call of fn, run for case_ms after a warm up call
+template <typename F>
+static double time_ms(F fn)
+{
+    fn();
+    int n = 0;
+    double start = now_ms(), elapsed;
+    do
+    {
+        fn();
+        n++;
+    } while ((elapsed = now_ms() - start) < case_ms || n < 3);
+    return elapsed / n;
+}
+
+static void result(const char *bench, const char *format, uint32_t width, uint32_t height, const std::string &metrics)
+{
+    std::string r = string_format("{\"bench\": \"%s\"", bench);
+    if (format)
+        r += string_format(", \"format\": \"%s\"", format);
+    if (width)
+        r += string_format(", \"width\": %u, \"height\": %u, \"mpix\": %.2f", width, height, width * height * 1e-6);
+    r += ", " + metrics + "}";
+    results.push_back(r);
+    std::string size = width ? string_format("%5u x %-5u", width, height) : "";
+    fprintf(stderr, "%-14s %-12s %-13s %s\n", bench, format ? format : "", size.c_str(), metrics.c_str());
+}
+
+// one generated frame in pfmt, packed formats from their unpacked samples
+static std::vector<uint8_t> make_frame(VmbPixelFormat_t pfmt, uint32_t width, uint32_t height)
+{
+    FramegenSpec spec;
+    framegen_spec(spec, pixfmt_unpacked(pfmt), width, height, FRAMEGEN_NOISE, 1);
+    std::vector<uint8_t> frame(framegen_size(spec));
+    framegen_fill(ThreadPool::shared(), spec, 0, frame.data());
+    if (pixfmt_is_packed(pfmt))
+    {
+        std::vector<uint8_t> packed(pixfmt_image_size(pfmt, width, height));
+        pixfmt_pack(pfmt, packed.data(), (const uint16_t *)frame.data(), (size_t)width * height);
+        return packed;
+    }
+    return frame;
+}
+
+static GLFWwindow *gl_context()
+{
+    if (!glfwInit())
+        return nullptr;
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow *window = glfwCreateWindow(64, 64, "pipeline_bench", NULL, NULL);
+    if (window == nullptr)
+    {
+        glfwTerminate();
+        return nullptr;
+    }
+    glfwMakeContextCurrent(window);
+    return window;
+}
+
+struct DisplayCase
+{
+    FramePool pool;
+    Image img;
+    double update_ms = 0; // generator thread
+    uint64_t frames = 0;
+};
+
+static void DisplayFrame(VmbFrame_t *frame, void *user_data)
+{
+    DisplayCase *dc = (DisplayCase *)user_data;
+    FrameHandle fh = dc->pool.copy(frame);
+    double start = now_ms();
+    dc->img.update(fh);
+    dc->update_ms += now_ms() - start;
+    dc->frames++;
+}
+
+static void bench_display(bool upload)
+{
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        for (size_t f = 0; f < sizeof(display_formats) / sizeof(display_formats[0]); f++)
+        {
+            uint32_t width = sizes[s].width, height = sizes[s].height;
+            VmbPixelFormat_t pfmt = display_formats[f];
+            std::string metrics;
+            for (int pass = 0; pass < (upload ? 2 : 1); pass++) // without and with uploads
+            {
+                DisplayCase *dc = new DisplayCase;
+                dc->pool.reserve(pixfmt_image_size(pfmt, width, height));
+                dc->img.reserve(width, height, pfmt);
+                ImageGenerator *gen = new ImageGenerator(width, height, pfmt, &DisplayFrame, dc);
+                double upload_ms = 0; // get_texture() calls without a new frame return at once
+                double start = now_ms();
+                gen->start();
+                while (now_ms() - start < case_ms)
+                {
+                    if (pass == 0)
+                    {
+                        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                        continue;
+                    }
+                    GLuint tex;
+                    uint32_t w, h;
+                    double t = now_ms();
+                    dc->img.get_texture(tex, w, h);
+                    glFinish(); // count the upload, not just queueing it
+                    upload_ms += now_ms() - t;
+                }
+                gen->join();
+                double elapsed = now_ms() - start;
+                uint64_t frames = std::max(dc->frames, (uint64_t)1);
+                if (pass == 0)
+                {
+                    metrics = string_format("\"update_ms\": %.4f, \"update_fps\": %.1f", dc->update_ms / frames, dc->frames / elapsed * 1e3);
+                }
+                else
+                {
+                    uint64_t shown = dc->frames - std::min(dc->frames, dc->img.superseded.load());
+                    metrics += string_format(", \"contended_update_ms\": %.4f, \"contended_update_fps\": %.1f, \"displayed_fps\": %.1f, \"upload_ms\": %.4f", dc->update_ms / frames, dc->frames / elapsed * 1e3, shown / elapsed * 1e3, upload_ms / std::max(shown, (uint64_t)1));
+                }
+                delete gen;
+                dc->img.clear();
+                delete dc;
+            }
+            result("image_update", pixfmt_to_string(pfmt), width, height, metrics);
+        }
+    }
+}
+
+static void bench_capture_stat()
+{
+    for (uint32_t readers = 0; readers <= 2; readers++)
+    {
+        CaptureStat stat;
+        const uint64_t calls = 200000;
+        std::atomic<bool> done{false};
+        std::atomic<uint64_t> reads{0};
+        std::vector<std::thread> workers;
+        for (uint32_t t = 0; t < readers; t++)
+        {
+            workers.push_back(std::thread([&]()
+                                          {
+                                              CaptureSummary sum;
+                                              while (!done)
+                                              {
+                                                  stat.get_summary(CAPSTAT_10S, sum);
+                                                  reads++;
+                                              }
+                                          }));
+        }
+        double start = now_ms();
+        for (uint64_t i = 0; i < calls; i++)
+            stat.update();
+        double elapsed = now_ms() - start;
+        done = true;
+        for (auto &w : workers)
+            w.join();
+        result("capture_stat", nullptr, 0, 0, string_format("\"readers\": %u, \"ns_per_update\": %.1f, \"summaries\": %llu", readers, elapsed * 1e6 / calls, (unsigned long long)reads.load())); // the camera callback is the only writer
+    }
+}
+
+static void bench_kernels()
+{
+    ThreadPool &pool = ThreadPool::shared();
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        uint32_t width = sizes[s].width, height = sizes[s].height;
+        size_t n = (size_t)width * height;
+        std::vector<uint16_t> out16(n * 3);
+        std::vector<uint8_t> out8(n * 3);
+
+        std::vector<uint8_t> mono12 = make_frame(VmbPixelFormatMono12, width, height);
+        double t = time_ms([&]()
+                           { pixconv_shift_u16(out16.data(), (const uint16_t *)mono12.data(), n, 4); });
+        result("shift_u16", "Mono12", width, height, string_format("\"ms\": %.4f, \"gbs\": %.2f", t, n * 2 / t * 1e-6));
+
+        static const VmbPixelFormat_t packed[] = {VmbPixelFormatMono10p, VmbPixelFormatMono12p, VmbPixelFormatMono12Packed};
+        for (size_t f = 0; f < sizeof(packed) / sizeof(packed[0]); f++)
+        {
+            std::vector<uint8_t> src = make_frame(packed[f], width, height);
+            t = time_ms([&]()
+                        { pixfmt_unpack(packed[f], out16.data(), src.data(), n); });
+            result("unpack", pixfmt_to_string(packed[f]), width, height, string_format("\"ms\": %.4f, \"gbs\": %.2f", t, src.size() / t * 1e-6));
+        }
+
+        static const char *methods[] = {"bilinear", "edge"};
+        static const DemosaicMethod method_ids[] = {DEMOSAIC_BILINEAR, DEMOSAIC_EDGE};
+        std::vector<uint8_t> bayer8 = make_frame(VmbPixelFormatBayerRG8, width, height);
+        std::vector<uint8_t> bayer12 = make_frame(VmbPixelFormatBayerRG12, width, height);
+        for (int m = 0; m < 2; m++)
+        {
+            t = time_ms([&]()
+                        { demosaic_u8(pool, out8.data(), bayer8.data(), width, height, BAYER_RG, method_ids[m]); });
+            result("demosaic", "BayerRG8", width, height, string_format("\"method\": \"%s\", \"ms\": %.4f, \"gbs\": %.2f", methods[m], t, bayer8.size() / t * 1e-6));
+            t = time_ms([&]()
+                        { demosaic_u16(pool, out16.data(), (const uint16_t *)bayer12.data(), width, height, BAYER_RG, method_ids[m]); });
+            result("demosaic", "BayerRG12", width, height, string_format("\"method\": \"%s\", \"ms\": %.4f, \"gbs\": %.2f", methods[m], t, bayer12.size() / t * 1e-6));
+        }
+    }
+}
+
+struct RecordCase
+{
+    FramePool pool;
+    Recorder rec;
+    uint64_t frames = 0;
+    uint64_t pool_drops = 0; // recorder fell behind by more than the pool
+};
+
+static void RecordFrame(VmbFrame_t *frame, void *user_data)
+{
+    RecordCase *rc = (RecordCase *)user_data;
+    rc->frames++;
+    FrameHandle fh = rc->pool.copy(frame);
+    if (!fh)
+    {
+        rc->pool_drops++;
+        return;
+    }
+    RecFrameHeader hdr;
+    hdr.host_ns = recfile_now_ns();
+    rc->rec.push(fh, hdr);
+}
+
+static void bench_recorder(const std::string &dir)
+{
+    static const struct
+    {
+        VmbPixelFormat_t pfmt;
+        uint32_t pack_bits;
+    } modes[] = {{VmbPixelFormatMono8, 0}, {VmbPixelFormatMono12, 0}, {VmbPixelFormatMono12, 12}, {VmbPixelFormatRgb8, 0}};
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        for (size_t m = 0; m < sizeof(modes) / sizeof(modes[0]); m++)
+        {
+            uint32_t width = sizes[s].width, height = sizes[s].height;
+            VmbPixelFormat_t pfmt = modes[m].pfmt;
+            size_t size = pixfmt_image_size(pfmt, width, height);
+            RecordCase *rc = new RecordCase;
+            uint64_t count = std::max((uint64_t)FRAMEPOOL_SLABS, std::min((uint64_t)RECORDER_POOL_MAX_SLABS, (uint64_t)(RECORDER_POOL_BUDGET / size)));
+            rc->pool.reserve(size, count);
+            RecFileHeader hdr;
+            hdr.pixelFormat = pfmt;
+            hdr.width = width;
+            hdr.height = height;
+            hdr.bit_depth = pixfmt_bit_depth(pfmt);
+            hdr.frame_size = size;
+            snprintf(hdr.model, sizeof(hdr.model), "pipeline_bench");
+            rc->rec.set_packing(modes[m].pack_bits);
+            std::string path = dir + "/pipeline_bench" + RECFILE_EXT;
+            if (!rc->rec.start(path, hdr))
+            {
+                fprintf(stderr, "%s: %s\n", path.c_str(), rc->rec.error().c_str());
+                delete rc;
+                return;
+            }
+            ImageGenerator *gen = new ImageGenerator(width, height, pfmt, &RecordFrame, rc);
+            double start = now_ms();
+            gen->start();
+            std::this_thread::sleep_for(std::chrono::milliseconds((int)case_ms));
+            gen->join();
+            rc->rec.stop(); // the queue is written out before the file is closed
+            double elapsed = now_ms() - start;
+            uint64_t written = rc->rec.frames_written;
+            result("recorder", pixfmt_to_string(pfmt), width, height,
+                   string_format("\"pack_bits\": %u, \"direct_io\": %s, \"written_fps\": %.1f, \"gbs\": %.3f, \"stored_gbs\": %.3f, \"dropped\": %llu",
+                                 modes[m].pack_bits, rc->rec.direct_io() ? "true" : "false", written / elapsed * 1e3, written * size / elapsed * 1e-6,
+                                 rc->rec.bytes_written / elapsed * 1e-6, (unsigned long long)(rc->frames - written)));
+            delete gen;
+            delete rc;
+            unlink(path.c_str());
+            unlink((path + RECFILE_INDEX_EXT).c_str());
+        }
+    }
+}
+
+static void bench_string_hasher()
+{
+    static const char *ids[] = {"VIRTUAL-0", "DEV_1AB22C00E3F1", "DEV_1AB22C00E3F1@169.254.100.1:3956/GigE-Interface-00"};
+    StringHasher hasher;
+    for (size_t i = 0; i < sizeof(ids) / sizeof(ids[0]); i++)
+    {
+        std::string id = ids[i];
+        volatile uint32_t sink = 0;
+        const int calls = 100000;
+        double t = time_ms([&]()
+                           {
+                               for (int c = 0; c < calls; c++)
+                                   sink = sink + hasher.get_hash(id);
+                           });
+        result("string_hash", nullptr, 0, 0, string_format("\"length\": %zu, \"ns_per_hash\": %.2f", id.size(), t * 1e6 / calls));
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc > 1)
+        case_ms = std::max(10, atoi(argv[1]));
+    std::string dir = argc > 2 ? argv[2] : ".";
+    GLFWwindow *window = gl_context();
+    std::string renderer = window ? (const char *)glGetString(GL_RENDERER) : "";
+    fprintf(stderr, "%u threads, pixconv %s, framegen %s, crc32c %s, OpenGL: %s, %.0f ms per case\n", ThreadPool::shared().size() + 1, pixconv_isa(), framegen_isa(), crc32c_isa(), window ? renderer.c_str() : "none, uploads skipped", case_ms);
+    bench_display(window != nullptr);
+    bench_capture_stat();
+    bench_kernels();
+    bench_recorder(dir);
+    bench_string_hasher();
+    if (window)
+    {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
+
+    char created[32];
+    time_t now = time(NULL);
+    strftime(created, sizeof(created), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+    printf("{\n");
+    printf("  \"suite\": \"pipeline_bench\",\n");
+    printf("  \"revision\": \"%s\",\n", BENCH_REVISION);
+    printf("  \"created\": \"%s\",\n", created);
+    printf("  \"case_ms\": %.0f,\n", case_ms);
+    printf("  \"host\": {\"threads\": %u, \"pixconv_isa\": \"%s\", \"framegen_isa\": \"%s\", \"crc32c_isa\": \"%s\", \"opengl\": ", ThreadPool::shared().size() + 1, pixconv_isa(), framegen_isa(), crc32c_isa());
+    if (window)
+        printf("\"%s\"},\n", renderer.c_str());
+    else
+        printf("null},\n");
+    printf("  \"results\": [\n");
+    for (size_t i = 0; i < results.size(); i++)
+        printf("    %s%s\n", results[i].c_str(), i + 1 < results.size() ? "," : "");
+    printf("  ]\n}\n");
+    return 0;
+}
@@ -0,0 +1,227 @@
+// Micro-benchmark of the display bit-shift kernels against the in-place loop
+// Image::get_texture() used to run on the render thread, of the display
+// decimation and packed format unpacking kernels, and of the bit packing the
+// recorder uses, against its 1 GB/s (of 16 bit frame data) target.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "../pixconv.hpp"
+
+#define PACK_TARGET_GBS 1.0
+
+static double now_ms()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void legacy_loop(uint16_t *_data, size_t n, uint32_t nshift)
+{
+    for (size_t i = 0; i < n; i++)
+        _data[i] = _data[i] << nshift;
+}
+
+// naive box filter, the reference for pixconv_decimate_*
+template <typename T>
+static void decimate_ref(T *dst, const T *src, uint32_t width, uint32_t height, uint32_t channels, uint32_t factor)
+{
+    uint32_t div = factor * factor;
+    for (uint32_t oy = 0; oy < height / factor; oy++)
+        for (uint32_t ox = 0; ox < width / factor; ox++)
+            for (uint32_t c = 0; c < channels; c++)
+            {
+                uint64_t sum = 0;
+                for (uint32_t y = oy * factor; y < (oy + 1) * factor; y++)
+                    for (uint32_t x = ox * factor; x < (ox + 1) * factor; x++)
+                        sum += src[((size_t)y * width + x) * channels + c];
+                *dst++ = (sum + div / 2) / div;
+            }
+}
+
+template <typename T>
+static bool check_decimate(uint32_t maxval, void (*decimate)(T *, const T *, uint32_t, uint32_t, uint32_t, uint32_t))
+{
+    static const uint32_t sizes[][2] = {{8, 8}, {37, 29}, {64, 48}, {101, 67}}; // most leave a remainder
+    std::vector<T> src, dst, ref;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+        for (uint32_t channels = 1; channels <= 4; channels++)
+            for (uint32_t factor = 2; factor <= 8; factor *= 2)
+            {
+                uint32_t width = sizes[s][0], height = sizes[s][1];
+                size_t nout = (size_t)(width / factor) * (height / factor) * channels;
+                src.resize((size_t)width * height * channels);
+                for (size_t i = 0; i < src.size(); i++)
+                    src[i] = rand() % 4 == 0 ? maxval : rand() % (maxval + 1);
+                dst.assign(nout + 1, 0x5a); // one past the end must stay untouched
+                ref.assign(nout + 1, 0x5a);
+                decimate(dst.data(), src.data(), width, height, channels, factor);
+                decimate_ref(ref.data(), src.data(), width, height, channels, factor);
+                if (memcmp(dst.data(), ref.data(), ref.size() * sizeof(T)))
+                {
+                    fprintf(stderr, "Decimate mismatch against the box filter: %zu bit, %u x %u, %u channels, 1/%u\n", sizeof(T) * 8, width, height, channels, factor);
+                    return false;
+                }
+            }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    static const struct
+    {
+        uint32_t width;
+        uint32_t height;
+    } sizes[] = {
+        {640, 480},
+        {2048, 1536},
+        {4096, 3000},
+        {5472, 3648},
+    };
+    int niter = argc > 1 ? atoi(argv[1]) : 50;
+    if (niter < 1)
+        niter = 1;
+    printf("Kernel ISA: %s, %d iterations\n", pixconv_isa(), niter);
+    printf("%12s %10s %10s %10s %10s\n", "Size", "Legacy ms", "Scalar ms", "SIMD ms", "SIMD GB/s");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        size_t n = (size_t)sizes[s].width * sizes[s].height;
+        std::vector<uint16_t> src(n), dst(n), ref(n);
+        for (size_t i = 0; i < n; i++)
+            src[i] = rand() & 0xfff;
+        double legacy = 0, scalar = 0, simd = 0;
+        for (int i = 0; i < niter; i++)
+        {
+            ref = src;
+            double t0 = now_ms();
+            legacy_loop(ref.data(), n, 4);
+            double t1 = now_ms();
+            pixconv_shift_u16_scalar(dst.data(), src.data(), n, 4);
+            double t2 = now_ms();
+            pixconv_shift_u16(dst.data(), src.data(), n, 4);
+            double t3 = now_ms();
+            legacy += t1 - t0;
+            scalar += t2 - t1;
+            simd += t3 - t2;
+        }
+        if (memcmp(dst.data(), ref.data(), n * sizeof(uint16_t)))
+        {
+            fprintf(stderr, "Mismatch between SIMD and legacy output at %u x %u\n", sizes[s].width, sizes[s].height);
+            return 1;
+        }
+        legacy /= niter;
+        scalar /= niter;
+        simd /= niter;
+        printf("%5u x %4u %10.3f %10.3f %10.3f %10.2f\n", sizes[s].width, sizes[s].height, legacy, scalar, simd, 2.0 * n * sizeof(uint16_t) / simd * 1e-6);
+    }
+    if (!check_decimate<uint8_t>(0xff, pixconv_decimate_u8) || !check_decimate<uint16_t>(0xffff, pixconv_decimate_u16))
+        return 1;
+    printf("\nDecimation matches the box filter reference\n");
+    printf("%12s %10s %10s %10s\n", "Size", "1/2 ms", "1/4 ms", "1/8 ms");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        size_t n = (size_t)sizes[s].width * sizes[s].height;
+        std::vector<uint16_t> src(n), dst(n / 4);
+        for (size_t i = 0; i < n; i++)
+            src[i] = rand() & 0xfff;
+        double t[3] = {0, 0, 0};
+        for (int i = 0; i < niter; i++)
+        {
+            for (int f = 0; f < 3; f++)
+            {
+                double t0 = now_ms();
+                pixconv_decimate_u16(dst.data(), src.data(), sizes[s].width, sizes[s].height, 1, 2 << f);
+                t[f] += now_ms() - t0;
+            }
+        }
+        printf("%5u x %4u %10.3f %10.3f %10.3f\n", sizes[s].width, sizes[s].height, t[0] / niter, t[1] / niter, t[2] / niter);
+    }
+    printf("\n%12s %14s %14s %14s\n", "Size", "10p ms (ref)", "12p ms (ref)", "12Pkd ms (ref)");
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        size_t n = (size_t)sizes[s].width * sizes[s].height;
+        std::vector<uint16_t> src(n), dst(n), ref(n);
+        std::vector<uint8_t> packed(n * 2);
+        double t[3] = {0, 0, 0}, tref[3] = {0, 0, 0};
+        for (int f = 0; f < 3; f++)
+        {
+            uint32_t bits = f == 0 ? 10 : 12;
+            for (size_t i = 0; i < n; i++)
+                src[i] = rand() & ((1 << bits) - 1);
+            if (f == 2)
+                pixconv_pack_mono12packed(packed.data(), src.data(), n);
+            else
+                pixconv_pack_lsb(packed.data(), src.data(), n, bits);
+            for (int i = 0; i < niter; i++)
+            {
+                double t0 = now_ms();
+                if (f == 2)
+                    pixconv_unpack_mono12packed_scalar(ref.data(), packed.data(), n);
+                else
+                    pixconv_unpack_lsb_scalar(ref.data(), packed.data(), n, bits);
+                double t1 = now_ms();
+                if (f == 2)
+                    pixconv_unpack_mono12packed(dst.data(), packed.data(), n);
+                else
+                    pixconv_unpack_lsb(dst.data(), packed.data(), n, bits);
+                double t2 = now_ms();
+                tref[f] += t1 - t0;
+                t[f] += t2 - t1;
+            }
+            if (memcmp(dst.data(), src.data(), n * sizeof(uint16_t)) || memcmp(ref.data(), src.data(), n * sizeof(uint16_t)))
+            {
+                fprintf(stderr, "Unpack mismatch at %u x %u\n", sizes[s].width, sizes[s].height);
+                return 1;
+            }
+        }
+        printf("%5u x %4u", sizes[s].width, sizes[s].height);
+        for (int f = 0; f < 3; f++)
+            printf(" %6.3f (%5.2f)", t[f] / niter, tref[f] / niter);
+        printf("\n");
+    }
+    printf("\nBit packing, GB/s of 16 bit samples (scalar in parentheses), target %.1f GB/s\n", PACK_TARGET_GBS);
+    printf("%12s %5s %16s %16s\n", "Size", "Bits", "Pack", "Unpack");
+    int slow = 0;
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++)
+    {
+        size_t n = (size_t)sizes[s].width * sizes[s].height;
+        std::vector<uint16_t> src(n), dst(n);
+        std::vector<uint8_t> packed(n * 2), ref(n * 2);
+        for (uint32_t bits = 10; bits <= 14; bits += 2)
+        {
+            for (size_t i = 0; i < n; i++)
+                src[i] = rand() & ((1 << bits) - 1);
+            double t[4] = {0, 0, 0, 0}; // pack, pack scalar, unpack, unpack scalar
+            for (int i = 0; i < niter; i++)
+            {
+                double t0 = now_ms();
+                pixconv_pack_lsb(packed.data(), src.data(), n, bits);
+                double t1 = now_ms();
+                pixconv_pack_lsb_scalar(ref.data(), src.data(), n, bits);
+                double t2 = now_ms();
+                pixconv_unpack_lsb(dst.data(), packed.data(), n, bits);
+                double t3 = now_ms();
+                pixconv_unpack_lsb_scalar(dst.data(), packed.data(), n, bits);
+                double t4 = now_ms();
+                t[0] += t1 - t0;
+                t[1] += t2 - t1;
+                t[2] += t3 - t2;
+                t[3] += t4 - t3;
+            }
+            pixconv_unpack_lsb(dst.data(), packed.data(), n, bits);
+            if (memcmp(packed.data(), ref.data(), (n * bits + 7) / 8) || memcmp(dst.data(), src.data(), n * sizeof(uint16_t)))
+            {
+                fprintf(stderr, "Bit packing mismatch at %u x %u, %u bits\n", sizes[s].width, sizes[s].height, bits);
+                return 1;
+            }
+            double gbs[4];
+            for (int f = 0; f < 4; f++)
+                gbs[f] = n * sizeof(uint16_t) / (t[f] / niter) * 1e-6;
+            printf("%5u x %4u %5u %7.2f (%5.2f) %7.2f (%5.2f)%s\n", sizes[s].width, sizes[s].height, bits, gbs[0], gbs[1], gbs[2], gbs[3], gbs[0] < PACK_TARGET_GBS || gbs[2] < PACK_TARGET_GBS ? " below target" : "");
+            if (gbs[0] < PACK_TARGET_GBS || gbs[2] < PACK_TARGET_GBS)
+                slow++;
+        }
+    }
+    return slow ? 2 : 0;
+}
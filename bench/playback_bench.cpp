@@ -0,0 +1,69 @@
+// Display pipeline throughput on a real recording: every frame is played as
+// fast as possible from the mapped file through Image::update() at full
+// resolution, with statistics on, for each display stretch.
+//
+// playback_bench <file.avr> [passes]
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <thread>
+
+#include "../player.hpp"
+#include "../imagetexture.hpp"
+
+static Image img;
+static uint64_t bytes = 0;
+
+static void Callback(const FrameHandle &frame, const RecFrameHeader &hdr, void *user_data)
+{
+    img.update(frame);
+    bytes += frame.info().size;
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "Usage: %s <file%s> [passes]\n", argv[0], RECFILE_EXT);
+        return 1;
+    }
+    int passes = argc > 2 ? atoi(argv[2]) : 3;
+    if (passes < 1)
+        passes = 1;
+    Player player;
+    if (!player.open(argv[1], Callback, nullptr))
+    {
+        fprintf(stderr, "%s\n", player.error().c_str());
+        return 1;
+    }
+    const RecFileHeader &hdr = player.header();
+    printf("%s: %s, %u x %u, %llu frames, %u threads\n", argv[1], pixfmt_to_string(hdr.pixelFormat), hdr.width, hdr.height, (unsigned long long)player.frame_count(), ThreadPool::shared().size() + 1);
+    img.reserve(hdr.width, hdr.height, hdr.pixelFormat);
+    player.set_pacing(PACING_FAST);
+    player.set_loop(false);
+    static const char *stretch_names[] = {"shift", "linear", "sqrt", "log"};
+    for (int mode = STRETCH_SHIFT; mode <= STRETCH_LOG; mode++)
+    {
+        img.set_stretch((DisplayStretch)mode);
+        for (int pass = 0; pass <= passes; pass++) // the first pass pages the file in
+        {
+            uint64_t played = player.frames_played;
+            bytes = 0;
+            auto start = std::chrono::steady_clock::now();
+            player.seek(0);
+            player.play();
+            while (player.is_playing())
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+            if (pass == 0)
+                continue;
+            uint64_t n = player.frames_played - played;
+            printf("%-6s pass %d: %8.1f frames/s %8.1f MB/s\n", stretch_names[mode], pass, n / dt, bytes / dt / 1e6);
+        }
+    }
+    printf("Dropped: %llu, Corrupt: %llu, CRC errors: %llu\n", (unsigned long long)player.dropped, (unsigned long long)player.corrupt, (unsigned long long)player.crc_errors);
+    player.close();
+    img.clear();
+    player.close();
+    return 0;
+}
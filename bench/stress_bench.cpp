@@ -0,0 +1,569 @@
+// Stress harness: N virtual cameras through the whole ingest path, the display
+// path (Image::update(), with uploads into a hidden window when there is an
+// OpenGL context) and the recording path, measuring the sustained frame rate,
+// drops, callback latency percentiles, CPU per stage and memory. It can sweep
+// the number of cameras or the frame rate to find the highest load the
+// machine sustains.
+//
+// stress_bench [--cameras N] [--sweep cameras|fps] [--max-cameras N]
+//              [--warmup S] [--upload 0|1] [session settings]
+//
+// Session settings are the --key value pairs of the camera program, e.g.
+// --size 2464x2056 --format Mono12 --framerate 50 --record 1 --bitpack 1
+// --dir /data --duration 10 --virtual-pattern ramp. Recordings are deleted
+// after each step.
+//
+// A step is sustained if every camera delivers at least STRESS_MIN_RATE of
+// its frame rate, at most STRESS_MAX_LOSS of the frames are late, lost to
+// the frame pool or dropped by the recorder, and no recorder queue is more
+// than half full at the end.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dirent.h>
+#include <time.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../camsession.hpp"
+#include "../imagetexture.hpp"
+
+#define STRESS_MIN_RATE 0.99  // of the camera frame rate
+#define STRESS_MAX_LOSS 0.005 // of the frames
+#define STRESS_UPLOAD_HZ 60   // display refresh
+#define STRESS_MAX_CAMERAS 16
+#define STRESS_FPS_STEPS 5    // bisections between the last sustained and the first failed rate
+
+enum StressStage
+{
+    STAGE_CAMERA = 0, // generator threads: frame generation, ingest and the display callback
+    STAGE_DISPLAY,    // the display callback part of the above
+    STAGE_POOL,       // shared worker threads, parallel parts of all stages
+    STAGE_RECORDER,   // writer and I/O threads
+    STAGE_OTHER,      // main thread (uploads) and the rest
+    STAGE_NUM,
+};
+
+static const char *stage_names[STAGE_NUM] = {"camera", "display", "pool", "recorder", "other"};
+
+static double now_s()
+{
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int64_t thread_cpu_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// CPU seconds of every thread of the process, by the stage its name says, Linux only
+static void cpu_by_stage(double cpu[STAGE_NUM])
+{
+    memset(cpu, 0, sizeof(double) * STAGE_NUM);
+    DIR *dir = opendir("/proc/self/task");
+    if (dir == nullptr)
+        return;
+    double tick = 1.0 / sysconf(_SC_CLK_TCK);
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != nullptr)
+    {
+        if (ent->d_name[0] == '.')
+            continue;
+        char path[300], buf[512];
+        snprintf(path, sizeof(path), "/proc/self/task/%s/stat", ent->d_name);
+        FILE *fp = fopen(path, "r");
+        if (fp == nullptr)
+            continue; // the thread is gone
+        size_t n = fread(buf, 1, sizeof(buf) - 1, fp);
+        fclose(fp);
+        buf[n] = '\0';
+        char *open = strchr(buf, '('), *close = strrchr(buf, ')');
+        if (open == nullptr || close == nullptr)
+            continue;
+        std::string comm(open + 1, close);
+        unsigned long long utime = 0, stime = 0;
+        // fields after the name: state, then utime and stime are the 12th and 13th
+        if (sscanf(close + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &utime, &stime) != 2)
+            continue;
+        int stage = STAGE_OTHER;
+        if (comm == "imggen")
+            stage = STAGE_CAMERA;
+        else if (comm == "pool")
+            stage = STAGE_POOL;
+        else if (comm.compare(0, 4, "rec ") == 0)
+            stage = STAGE_RECORDER;
+        cpu[stage] += (utime + stime) * tick;
+    }
+    closedir(dir);
+}
+
+// resident and peak resident memory, MiB
+static void memory_usage(double &rss, double &peak)
+{
+    rss = peak = 0;
+    FILE *fp = fopen("/proc/self/status", "r");
+    if (fp == nullptr)
+        return;
+    char line[256];
+    while (fgets(line, sizeof(line), fp))
+    {
+        unsigned long kb;
+        if (sscanf(line, "VmRSS: %lu kB", &kb) == 1)
+            rss = kb / 1024.0;
+        else if (sscanf(line, "VmHWM: %lu kB", &kb) == 1)
+            peak = kb / 1024.0;
+    }
+    fclose(fp);
+}
+
+static GLFWwindow *gl_context()
+{
+    if (!glfwInit())
+        return nullptr;
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow *window = glfwCreateWindow(64, 64, "stress_bench", NULL, NULL);
+    if (window == nullptr)
+    {
+        glfwTerminate();
+        return nullptr;
+    }
+    glfwMakeContextCurrent(window);
+    glfwSwapInterval(0);
+    return window;
+}
+
+/**
+ * @brief A camera with a display that nobody looks at. Latencies are from the
+ * frame timestamp (CLOCK_MONOTONIC for virtual cameras) and only kept while
+ * measuring, into buffers reserved beforehand.
+ */
+class StressCamera
+{
+private:
+    static const FrameStats *FrameCallback(const FrameHandle &frame, void *user_data)
+    {
+        StressCamera *self = (StressCamera *)user_data;
+        if (!frame)
+            return nullptr; // counted by the pool, not again as a display drop
+        int64_t ingest = ImageGenerator::now_ns() - (int64_t)frame.info().timestamp;
+        int64_t cpu = thread_cpu_ns();
+        self->img.update(frame);
+        int64_t display = ImageGenerator::now_ns() - (int64_t)frame.info().timestamp;
+        if (self->measuring.load(std::memory_order_relaxed))
+        {
+            if (self->frames++ == 0)
+                self->first_ts = frame.info().timestamp;
+            self->last_ts = frame.info().timestamp;
+            self->display_cpu_ns += thread_cpu_ns() - cpu;
+            if (self->lat_ingest.size() < self->lat_ingest.capacity())
+            {
+                self->lat_ingest.push_back(ingest * 1e-6f);
+                self->lat_display.push_back(display * 1e-6f);
+            }
+        }
+        return self->img.last_stats();
+    }
+
+    static void StartCallback(uint32_t width, uint32_t height, VmbPixelFormat_t pfmt, void *user_data)
+    {
+        StressCamera *self = (StressCamera *)user_data;
+        self->img.clear();
+        self->img.reset_counters();
+        self->img.reserve(width, height, pfmt);
+    }
+
+public:
+    CameraSession cam; // its pool must outlive img
+    Image img;
+    std::atomic<bool> measuring{false};
+    uint64_t frames = 0; // camera callback, while measuring
+    uint64_t first_ts = 0, last_ts = 0;
+    int64_t display_cpu_ns = 0;
+    std::vector<float> lat_ingest; // ms
+    std::vector<float> lat_display;
+
+    StressCamera(const CameraInfo &info)
+        : cam(info, nullptr)
+    {
+        cam.set_callbacks(&FrameCallback, &StartCallback, (void *)this);
+    }
+
+    ~StressCamera()
+    {
+        cam.close_camera(); // stops the callbacks into img
+    }
+
+    double framerate()
+    {
+        double fps = 0;
+        cam.backend->get_acq_framerate(cam.handle, &fps);
+        return fps;
+    }
+
+    // over the frames received while measuring, by their timestamps so the window edges do not count
+    double received_fps()
+    {
+        return frames > 1 && last_ts > first_ts ? (frames - 1) / ((last_ts - first_ts) * 1e-9) : 0;
+    }
+};
+
+struct StepCounters
+{
+    uint64_t overruns = 0;
+    uint64_t pool_exhausted = 0;
+    uint64_t display_dropped = 0;
+    uint64_t superseded = 0;
+    uint64_t written = 0;
+    uint64_t rec_dropped = 0;
+
+    void read(StressCamera *sc)
+    {
+        VirtualCamera *vc = virtcam_find(sc->cam.info.idstr.c_str());
+        overruns = vc ? vc->overruns() : 0;
+        pool_exhausted = sc->cam.pool.exhausted + sc->cam.pool.oversize; // every frame the pool could not copy
+        display_dropped = sc->img.dropped;
+        superseded = sc->img.superseded;
+        written = sc->cam.recorder.frames_written;
+        rec_dropped = sc->cam.recorder.dropped;
+    }
+};
+
+struct StepResult
+{
+    int cameras = 0;
+    double fps = 0;      // asked for, within what the cameras can do
+    double cam_fps = 0;  // what the cameras run at, lowest of them
+    double recv_fps = 0; // per camera, lowest of them
+    uint64_t frames = 0;
+    uint64_t late = 0, pool_lost = 0, display_dropped = 0, superseded = 0, rec_dropped = 0;
+    double written_fps = 0; // all cameras
+    uint32_t queue_max = 0, queue_cap = 0;
+    float ingest[4], display[4]; // p50, p99, p99.9, max, ms
+    double cpu[STAGE_NUM];       // % of one core
+    double cpu_total = 0;
+    double rss = 0, peak = 0;
+    bool ok = false;
+    std::string why;
+};
+
+static void percentiles(std::vector<float> &v, float out[4])
+{
+    memset(out, 0, sizeof(float) * 4);
+    if (v.empty())
+        return;
+    std::sort(v.begin(), v.end());
+    static const double ps[3] = {0.5, 0.99, 0.999};
+    for (int i = 0; i < 3; i++)
+        out[i] = v[std::min(v.size() - 1, (size_t)(ps[i] * v.size()))];
+    out[3] = v.back();
+}
+
+// run cameras for the warmup then cfg.duration_s, keep uploading frames meanwhile
+static bool run_step(int ncams, double fps, const SessionConfig &base, double warmup_s, bool upload, StepResult &res)
+{
+    SessionConfig cfg = base;
+    cfg.framerate = fps;
+    res = StepResult();
+    res.cameras = ncams;
+    res.fps = fps;
+    std::vector<VmbCameraInfo_t> list;
+    virtcam_list(list);
+    std::vector<StressCamera *> cams;
+    for (int i = 0; i < ncams && i < (int)list.size(); i++)
+    {
+        StressCamera *sc = new StressCamera(CameraInfo(list[i]));
+        sc->cam.open_camera();
+        double fmin, fmax, fstep;
+        if (sc->cam.opened && sc->cam.apply(base) && sc->cam.backend->get_acq_framerate_range(sc->cam.handle, &fmin, &fmax, &fstep) == VmbErrorSuccess)
+            cfg.framerate = std::min(fps, fmax); // the size and format set the limit
+        res.fps = cfg.framerate;
+        if (!sc->cam.opened || !sc->cam.apply(cfg))
+        {
+            fprintf(stderr, "%s: %s\n", sc->cam.info.serial.c_str(), sc->cam.errmsg.c_str());
+            delete sc;
+            break;
+        }
+        size_t expect = (size_t)(fps * cfg.duration_s * 1.5) + 1000;
+        sc->lat_ingest.reserve(expect);
+        sc->lat_display.reserve(expect);
+        cams.push_back(sc);
+    }
+    bool started = (int)cams.size() == ncams;
+    for (auto sc : cams)
+    {
+        if (!started)
+            break;
+        if (cfg.record && !sc->cam.start_recording(cfg.dir, cfg.compress, cfg.bitpack))
+            started = false;
+        else if (sc->cam.start_capture() != VmbErrorSuccess)
+            started = false;
+        if (!started)
+            fprintf(stderr, "%s: %s\n", sc->cam.info.serial.c_str(), sc->cam.errmsg.c_str());
+    }
+
+    std::vector<StepCounters> before(cams.size()), after(cams.size());
+    double cpu0[STAGE_NUM], cpu1[STAGE_NUM];
+    double t_start = now_s(), t0 = 0, t1 = 0;
+    bool measuring = false;
+    while (started)
+    {
+        double t = now_s() - t_start;
+        if (!measuring && t >= warmup_s)
+        {
+            for (size_t i = 0; i < cams.size(); i++)
+            {
+                before[i].read(cams[i]);
+                cams[i]->measuring = true;
+            }
+            cpu_by_stage(cpu0);
+            t0 = now_s();
+            measuring = true;
+        }
+        if (measuring && t >= warmup_s + cfg.duration_s)
+        {
+            for (size_t i = 0; i < cams.size(); i++)
+            {
+                cams[i]->measuring = false;
+                after[i].read(cams[i]);
+                res.queue_max = std::max(res.queue_max, cams[i]->cam.recorder.queue_depth());
+                res.queue_cap = cams[i]->cam.recorder.queue_capacity();
+            }
+            cpu_by_stage(cpu1);
+            t1 = now_s();
+            break;
+        }
+        for (auto sc : cams)
+        {
+            sc->cam.poll();
+            if (upload)
+            {
+                GLuint tex;
+                uint32_t w, h;
+                sc->img.get_texture(tex, w, h);
+            }
+        }
+        if (upload)
+            glFinish();
+        std::this_thread::sleep_for(std::chrono::microseconds(1000000 / STRESS_UPLOAD_HZ));
+    }
+    memory_usage(res.rss, res.peak);
+
+    std::vector<float> ingest, display;
+    std::vector<std::string> recordings;
+    double elapsed = t1 - t0;
+    int64_t display_cpu = 0;
+    res.cam_fps = res.recv_fps = started ? 1e9 : 0;
+    for (size_t i = 0; i < cams.size(); i++)
+    {
+        StressCamera *sc = cams[i];
+        if (started)
+        {
+            res.cam_fps = std::min(res.cam_fps, sc->framerate());
+            res.recv_fps = std::min(res.recv_fps, sc->received_fps());
+        }
+        sc->cam.stop_capture();
+        if (sc->cam.recorder.recording())
+            recordings.push_back(sc->cam.recorder.get_path());
+        res.frames += sc->frames;
+        res.late += after[i].overruns - before[i].overruns;
+        res.pool_lost += after[i].pool_exhausted - before[i].pool_exhausted;
+        res.display_dropped += after[i].display_dropped - before[i].display_dropped;
+        res.superseded += after[i].superseded - before[i].superseded;
+        res.rec_dropped += after[i].rec_dropped - before[i].rec_dropped;
+        res.written_fps += (after[i].written - before[i].written) / std::max(elapsed, 1e-3);
+        ingest.insert(ingest.end(), sc->lat_ingest.begin(), sc->lat_ingest.end());
+        display.insert(display.end(), sc->lat_display.begin(), sc->lat_display.end());
+        display_cpu += sc->display_cpu_ns;
+        delete sc; // writes out the recording
+    }
+    for (auto &path : recordings)
+    {
+        unlink(path.c_str());
+        unlink((path + RECFILE_INDEX_EXT).c_str());
+    }
+    if (!started)
+    {
+        res.why = "cameras did not start";
+        return false;
+    }
+    percentiles(ingest, res.ingest);
+    percentiles(display, res.display);
+    for (int s = 0; s < STAGE_NUM; s++)
+    {
+        res.cpu[s] = (cpu1[s] - cpu0[s]) / elapsed * 100;
+        if (s != STAGE_DISPLAY)
+            res.cpu_total += res.cpu[s];
+    }
+    res.cpu[STAGE_DISPLAY] = display_cpu * 1e-9 / elapsed * 100;
+    res.cpu[STAGE_CAMERA] -= res.cpu[STAGE_DISPLAY];
+
+    uint64_t lost = res.late + res.pool_lost + res.display_dropped + (cfg.record ? res.rec_dropped : 0);
+    if (res.recv_fps < STRESS_MIN_RATE * res.cam_fps)
+        res.why = string_format("%.1f of %.1f FPS", res.recv_fps, res.cam_fps);
+    else if (lost > STRESS_MAX_LOSS * res.frames)
+        res.why = string_format("%llu frames late or lost", (unsigned long long)lost);
+    else if (cfg.record && res.queue_max > res.queue_cap / 2)
+        res.why = string_format("recorder queue at %u / %u", res.queue_max, res.queue_cap);
+    res.ok = res.why.empty();
+    return true;
+}
+
+static void print_step(const StepResult &r, bool record, bool upload)
+{
+    printf("%2d x %7.2f FPS: received %7.2f FPS/camera, late %llu, pool %llu, display %llu", r.cameras, r.cam_fps, r.recv_fps, (unsigned long long)r.late, (unsigned long long)r.pool_lost, (unsigned long long)r.display_dropped);
+    if (upload)
+        printf(", superseded %llu", (unsigned long long)r.superseded);
+    if (record)
+        printf(" | recorded %.1f FPS, dropped %llu, queue %u / %u", r.written_fps, (unsigned long long)r.rec_dropped, r.queue_max, r.queue_cap);
+    printf(" | %s\n", r.ok ? "OK" : ("FAIL: " + r.why).c_str());
+    printf("      latency ms (p50 / p99 / p99.9 / max): ingest %.2f / %.2f / %.2f / %.2f, display %.2f / %.2f / %.2f / %.2f\n", r.ingest[0], r.ingest[1], r.ingest[2], r.ingest[3], r.display[0], r.display[1], r.display[2], r.display[3]);
+    printf("      CPU %% of a core:");
+    for (int s = 0; s < STAGE_NUM; s++)
+        printf(" %s %.0f,", stage_names[s], r.cpu[s]);
+    printf(" total %.0f | RSS %.0f MiB, peak %.0f MiB\n", r.cpu_total, r.rss, r.peak);
+    fflush(stdout);
+}
+
+static void usage(const char *prog)
+{
+    printf("Usage: %s [--cameras N] [--sweep cameras|fps] [--max-cameras N] [--warmup S] [--upload 0|1] [session settings]\n", prog);
+    printf("  --cameras N       virtual cameras (default 1), the start of a frame rate sweep\n");
+    printf("  --sweep cameras   add cameras until the load is no longer sustained\n");
+    printf("  --sweep fps       double, then bisect the frame rate of --cameras cameras\n");
+    printf("  --max-cameras N   end of the camera sweep (default %d)\n", STRESS_MAX_CAMERAS);
+    printf("  --warmup S        seconds before measuring (default 1)\n");
+    printf("  --upload 0|1      upload frames at %d Hz in a hidden window (default on if OpenGL works)\n", STRESS_UPLOAD_HZ);
+    printf("Session settings as for the camera program, e.g. --size 2464x2056 --format Mono12\n");
+    printf("--framerate 30 --duration 5 --record 1 --bitpack 1 --dir D --virtual-pattern ramp\n");
+}
+
+int main(int argc, char *argv[])
+{
+    SessionConfig cfg;
+    cfg.framerate = 30;
+    cfg.duration_s = 5;
+    cfg.exposure_us = 1000; // up to 1000 FPS
+    cfg.width = 1936;
+    cfg.height = 1216;
+    int ncams = 1, max_cams = STRESS_MAX_CAMERAS, upload = -1;
+    double warmup_s = 1;
+    std::string sweep = "none";
+    for (int i = 1; i < argc; i++)
+    {
+        if (strncmp(argv[i], "--", 2) != 0)
+        {
+            usage(argv[0]);
+            return 1;
+        }
+        std::string key = argv[i] + 2;
+        const char *val = i + 1 < argc && strncmp(argv[i + 1], "--", 2) != 0 ? argv[++i] : nullptr;
+        std::string err;
+        if (key == "help")
+        {
+            usage(argv[0]);
+            return 0;
+        }
+        else if (key == "cameras" && val)
+            ncams = atoi(val);
+        else if (key == "max-cameras" && val)
+            max_cams = atoi(val);
+        else if (key == "warmup" && val)
+            warmup_s = atof(val);
+        else if (key == "upload" && val)
+            upload = atoi(val);
+        else if (key == "sweep" && val)
+            sweep = val;
+        else if (!cfg.set(key, val, err))
+        {
+            fprintf(stderr, "%s\n", err.c_str());
+            return 1;
+        }
+    }
+    if (ncams < 1 || max_cams < 1 || (sweep != "none" && sweep != "cameras" && sweep != "fps") || cfg.framerate <= 0 || cfg.duration_s <= 0)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+    cfg.virt.count = std::max(sweep == "cameras" ? max_cams : ncams, cfg.virt.count);
+    virtcam_setup(cfg.virt);
+
+    GLFWwindow *window = upload != 0 ? gl_context() : nullptr;
+    if (upload == 1 && window == nullptr)
+    {
+        fprintf(stderr, "No OpenGL context for uploads\n");
+        return 1;
+    }
+    bool uploading = window != nullptr;
+    printf("%u hardware threads | %d x %d %s | %.1f s per step after %.1f s warmup | display uploads %s | recording %s\n", std::thread::hardware_concurrency(), cfg.width, cfg.height, cfg.pixel_format.size() ? cfg.pixel_format.c_str() : "Mono12", cfg.duration_s, warmup_s, uploading ? "on" : "off", cfg.record ? cfg.dir.c_str() : "off");
+
+    StepResult res, best;
+    bool found = false;
+    if (sweep == "cameras")
+    {
+        for (int n = 1; n <= max_cams && run_step(n, cfg.framerate, cfg, warmup_s, uploading, res); n++)
+        {
+            print_step(res, cfg.record, uploading);
+            if (!res.ok)
+                break;
+            best = res;
+            found = true;
+        }
+    }
+    else if (sweep == "fps")
+    {
+        double good = 0, bad = 0, fps = cfg.framerate;
+        for (int bisect = 0; bisect < STRESS_FPS_STEPS && run_step(ncams, fps, cfg, warmup_s, uploading, res);)
+        {
+            print_step(res, cfg.record, uploading);
+            bool capped = res.fps < fps; // the cameras go no faster
+            if (res.ok)
+            {
+                best = res;
+                found = true;
+                good = res.fps;
+                if (capped)
+                {
+                    printf("The cameras top out at %.2f FPS at this size and format\n", res.fps);
+                    break;
+                }
+            }
+            else
+            {
+                bad = res.fps;
+            }
+            if (bad == 0)
+            {
+                fps *= 2;
+            }
+            else
+            {
+                fps = (good + bad) / 2;
+                bisect++;
+            }
+        }
+    }
+    else if (run_step(ncams, cfg.framerate, cfg, warmup_s, uploading, res))
+    {
+        print_step(res, cfg.record, uploading);
+        best = res;
+        found = res.ok;
+    }
+    if (window)
+    {
+        glfwDestroyWindow(window);
+        glfwTerminate();
+    }
+    if (!found)
+    {
+        printf("No sustained load\n");
+        return 2;
+    }
+    printf("Sustained: %d camera%s at %.2f FPS, %d x %d %s%s\n", best.cameras, best.cameras > 1 ? "s" : "", best.cam_fps, cfg.width, cfg.height, cfg.pixel_format.size() ? cfg.pixel_format.c_str() : "Mono12", cfg.record ? ", recording" : "");
+    return 0;
+}
@@ -0,0 +1,459 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <VmbC/VmbC.h>
+
+#include "arena.hpp"
+#include "pixfmt.hpp"
+#include "recfile.hpp"
+
+#define BURST_WRITE_CHUNK (64ULL << 20) // largest single write of consecutive records
+
+enum BurstState
+{
+    BURST_IDLE = 0,
+    BURST_ALLOCATING, // arena being mapped
+    BURST_READY,      // waiting for begin()
+    BURST_CAPTURING,  // push() takes frames
+    BURST_WRITING,    // buffer full or stopped, writing it out
+    BURST_DONE,
+    BURST_FAILED, // see error()
+};
+
+/**
+ * @brief What a burst achieved, from the stored frame headers.
+ */
+struct BurstSummary
+{
+    uint64_t frames = 0;
+    double host_avg_us = 0; // callback arrival intervals
+    double host_std_us = 0;
+    double host_min_us = 0;
+    double host_max_us = 0;
+    double cam_avg = 0; // camera timestamp intervals, in camera ticks
+    double cam_std = 0;
+    uint64_t id_gaps = 0;    // places where the frame ID did not go up by one
+    uint64_t ids_missed = 0; // frame IDs skipped in total
+    uint64_t incomplete = 0; // frames not received completely
+};
+
+/**
+ * @brief Captures exactly N frames into one pre-allocated buffer, then writes
+ * them out as a recording.
+ *
+ * The buffer is an Arena laid out exactly like the recording file: the file
+ * header block, then one fixed size slot per frame, each holding the record
+ * (frame header, data, zero padding) at a RECFILE_ALIGN boundary. push() only
+ * copies the driver buffer into the next slot, nothing is allocated or
+ * written while the burst runs, so the capture rate is bounded by memcpy
+ * alone. Once the buffer is full (or stop() is called) the writer thread
+ * writes runs of slots straight from the buffer with O_DIRECT to
+ * <prefix>_<date>_<time>_burst.avr in the chosen directory, and releases
+ * the buffer.
+ */
+class BurstCapture
+{
+private:
+    Arena mem;
+    uint8_t *arena = nullptr;
+    size_t frame_size = 0;
+    size_t slot_size = 0;
+    uint64_t count = 0;
+    RecFileHeader header;
+    std::thread writer;
+    sem_t wake;
+
+    std::atomic<int> st{BURST_IDLE};
+    std::atomic<uint32_t> pushing{0};
+    std::atomic<uint64_t> stored{0};  // slots filled, producer only
+    std::atomic<uint64_t> written{0}; // frames written out
+    std::atomic<uint64_t> written_bytes{0};
+    std::atomic<double> write_s{0};
+
+    std::mutex mtx; // guards the members below
+    std::string dir;
+    std::string prefix;
+    std::string path;
+    std::string errmsg;
+    BurstSummary sum;
+
+    RecFrameHeader *slot(uint64_t n) const
+    {
+        return (RecFrameHeader *)(arena + RECFILE_HEADER_SIZE + n * slot_size);
+    }
+
+    void set_error(const std::string &where, int err)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        errmsg = where + ": " + strerror(err);
+    }
+
+    void summarize(uint64_t n)
+    {
+        BurstSummary s;
+        s.frames = n;
+        double host = 0, host2 = 0, cam = 0, cam2 = 0;
+        s.host_min_us = n > 1 ? INFINITY : 0;
+        for (uint64_t i = 0; i < n; i++)
+        {
+            const RecFrameHeader *h = slot(i);
+            if (h->status != VmbFrameStatusComplete)
+                s.incomplete++;
+            if (i == 0)
+                continue;
+            const RecFrameHeader *p = slot(i - 1);
+            double dt = (double)(int64_t)(h->host_ns - p->host_ns) * 1e-3;
+            double dc = (double)(int64_t)(h->timestamp - p->timestamp);
+            host += dt;
+            host2 += dt * dt;
+            cam += dc;
+            cam2 += dc * dc;
+            s.host_min_us = std::min(s.host_min_us, dt);
+            s.host_max_us = std::max(s.host_max_us, dt);
+            if (h->frameID != p->frameID + 1)
+            {
+                s.id_gaps++;
+                if (h->frameID > p->frameID)
+                    s.ids_missed += h->frameID - p->frameID - 1;
+            }
+        }
+        if (n > 1)
+        {
+            s.host_avg_us = host / (n - 1);
+            s.host_std_us = sqrt(std::max(0.0, host2 / (n - 1) - s.host_avg_us * s.host_avg_us));
+            s.cam_avg = cam / (n - 1);
+            s.cam_std = sqrt(std::max(0.0, cam2 / (n - 1) - s.cam_avg * s.cam_avg));
+        }
+        std::lock_guard<std::mutex> lock(mtx);
+        sum = s;
+    }
+
+    bool write_file(uint64_t n)
+    {
+        char stamp[32];
+        time_t now = time(NULL);
+        struct tm tm;
+        strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", localtime_r(&now, &tm));
+        std::string fname;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            fname = dir + "/" + prefix + "_" + stamp + "_burst" + RECFILE_EXT;
+            path = fname;
+        }
+        bool direct;
+        int fd = recfile_create(fname.c_str(), direct);
+        if (fd < 0)
+        {
+            set_error("Open " + fname, errno);
+            return false;
+        }
+        FILE *idx = fopen((fname + RECFILE_INDEX_EXT).c_str(), "wb");
+        RecIndexHeader ih;
+        ih.created_ns = ((RecFileHeader *)arena)->created_ns;
+        if (idx == nullptr || fwrite(&ih, sizeof(ih), 1, idx) != 1)
+        {
+            set_error("Open index", errno);
+            close(fd);
+            if (idx)
+                fclose(idx);
+            return false;
+        }
+        uint64_t total = RECFILE_HEADER_SIZE;
+        for (uint64_t i = 0; i < n; i++)
+            total += slot(i)->record_size;
+        fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, total); // not all file systems can
+        int err = recfile_pwrite(fd, arena, RECFILE_HEADER_SIZE, 0, direct);
+        uint64_t offset = RECFILE_HEADER_SIZE;
+        uint64_t i = 0;
+        while (!err && i < n)
+        {
+            // full size records follow each other in the buffer just as in the file
+            uint64_t first = i;
+            uint64_t bytes = 0;
+            while (i < n)
+            {
+                RecFrameHeader *h = slot(i);
+                recfile_set_crc(*h, (const uint8_t *)h + RECFILE_FRAME_HEADER_SIZE);
+                RecIndexEntry entry = {offset + bytes, h->frameID, h->timestamp, h->host_ns};
+                if (fwrite(&entry, sizeof(entry), 1, idx) != 1)
+                {
+                    err = errno;
+                    break;
+                }
+                bytes += h->record_size;
+                i++;
+                if (h->record_size != slot_size || bytes >= BURST_WRITE_CHUNK)
+                    break;
+            }
+            if (!err)
+                err = recfile_pwrite(fd, (const uint8_t *)slot(first), bytes, offset, direct);
+            offset += bytes;
+            written = i;
+            written_bytes = offset;
+        }
+        close(fd);
+        if (fclose(idx) != 0 && !err)
+            err = errno;
+        if (err)
+        {
+            set_error("Write " + fname, err);
+            return false;
+        }
+        return true;
+    }
+
+    static void ThreadFcn(BurstCapture *self)
+    {
+        int err = self->mem.alloc(RECFILE_HEADER_SIZE + self->count * self->slot_size);
+        if (err)
+        {
+            self->set_error("Burst buffer", err);
+            self->st = BURST_FAILED;
+            return;
+        }
+        self->arena = self->mem.data();
+        memcpy(self->arena, &self->header, sizeof(self->header));
+        int allocating = BURST_ALLOCATING;
+        if (self->st.compare_exchange_strong(allocating, BURST_READY)) // else stopped already
+        {
+            while (self->st.load() != BURST_WRITING)
+                sem_wait(&self->wake);
+        }
+        while (self->pushing.load() != 0) // stop() may have raced a frame
+            std::this_thread::yield();
+        uint64_t n = self->stored.load(std::memory_order_acquire);
+        self->summarize(n);
+        bool ok = true;
+        if (n > 0)
+        {
+            auto start = std::chrono::steady_clock::now();
+            ok = self->write_file(n);
+            self->write_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        }
+        self->mem.free();
+        self->arena = nullptr;
+        self->st = ok ? BURST_DONE : BURST_FAILED;
+    }
+
+public:
+    BurstCapture()
+    {
+        sem_init(&wake, 0, 0);
+    }
+
+    ~BurstCapture()
+    {
+        stop();
+        if (writer.joinable())
+            writer.join();
+        sem_destroy(&wake);
+    }
+
+    /**
+     * @brief Allocate the buffer for count frames in the background. Frames
+     * are taken once the buffer is ready (BURST_READY) and begin() is called.
+     *
+     * @param header file header of the burst, describes the camera and the current format
+     * @param frame_size largest frame, bigger ones are skipped
+     * @param dir directory for the file, named <prefix>_<date>_<time>_burst.avr
+     * @return false if a burst is still running.
+     */
+    bool arm(const RecFileHeader &header, uint64_t count, size_t frame_size, const std::string &dir, const std::string &prefix)
+    {
+        int s = st.load();
+        if (s != BURST_IDLE && s != BURST_DONE && s != BURST_FAILED)
+            return false;
+        if (writer.joinable())
+            writer.join();
+        this->header = header;
+        this->count = std::max((uint64_t)1, count);
+        this->frame_size = frame_size;
+        slot_size = recfile_record_size(frame_size);
+        stored = 0;
+        written = 0;
+        written_bytes = 0;
+        write_s = 0;
+        oversize = 0;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            this->dir = dir;
+            this->prefix = prefix;
+            path = "";
+            errmsg = "";
+            sum = BurstSummary();
+        }
+        st = BURST_ALLOCATING;
+        writer = std::thread(ThreadFcn, this);
+        return true;
+    }
+
+    /**
+     * @brief Start taking frames once the buffer is ready.
+     */
+    bool begin()
+    {
+        int ready = BURST_READY;
+        if (!st.compare_exchange_strong(ready, BURST_CAPTURING))
+            return false;
+        ((RecFileHeader *)arena)->created_ns = recfile_now_ns();
+        return true;
+    }
+
+    /**
+     * @brief End the burst early and write out what was captured.
+     */
+    void stop()
+    {
+        int s = st.load();
+        while (s == BURST_ALLOCATING || s == BURST_READY || s == BURST_CAPTURING)
+        {
+            if (st.compare_exchange_weak(s, BURST_WRITING))
+            {
+                sem_post(&wake);
+                break;
+            }
+        }
+    }
+
+    BurstState state() const
+    {
+        return (BurstState)st.load();
+    }
+
+    bool capturing() const
+    {
+        return st.load(std::memory_order_acquire) == BURST_CAPTURING;
+    }
+
+    /**
+     * @brief Copy a frame into the next slot, camera callback only. Never blocks.
+     *
+     * @param meta host time, exposure and temperatures, as for Recorder::push().
+     * @return false if the frame was not taken.
+     */
+    bool push(const VmbFrame_t *frame, const RecFrameHeader &meta)
+    {
+        pushing++;
+        bool ok = false;
+        if (st.load(std::memory_order_acquire) == BURST_CAPTURING)
+        {
+            size_t size = pixfmt_image_size(frame->pixelFormat, frame->width, frame->height);
+            if (size == 0 || size > frame->bufferSize)
+                size = frame->bufferSize;
+            uint64_t n = stored.load(std::memory_order_relaxed);
+            if (frame->buffer == nullptr || size == 0 || size > frame_size)
+                oversize++;
+            else if (n < count)
+            {
+                RecFrameHeader *hdr = slot(n);
+                *hdr = meta;
+                hdr->index = n;
+                hdr->data_size = size;
+                hdr->raw_size = size;
+                hdr->record_size = recfile_record_size(size);
+                hdr->frameID = frame->frameID;
+                hdr->timestamp = frame->timestamp;
+                hdr->width = frame->width;
+                hdr->height = frame->height;
+                hdr->pixelFormat = frame->pixelFormat;
+                hdr->status = frame->receiveStatus;
+                memcpy((uint8_t *)hdr + RECFILE_FRAME_HEADER_SIZE, frame->buffer, size); // each slot is used once, the padding is still zero
+                stored.store(n + 1, std::memory_order_release);
+                ok = true;
+                if (n + 1 == count)
+                {
+                    int capturing = BURST_CAPTURING;
+                    if (st.compare_exchange_strong(capturing, BURST_WRITING))
+                        sem_post(&wake);
+                }
+            }
+        }
+        pushing--;
+        return ok;
+    }
+
+    uint64_t frames() const
+    {
+        return count;
+    }
+
+    uint64_t captured() const
+    {
+        return stored;
+    }
+
+    uint64_t frames_written() const
+    {
+        return written;
+    }
+
+    /**
+     * @brief Bytes the buffer takes for count frames of frame_size.
+     */
+    static uint64_t buffer_bytes(uint64_t count, size_t frame_size)
+    {
+        return RECFILE_HEADER_SIZE + count * recfile_record_size(frame_size);
+    }
+
+    size_t arena_bytes() const
+    {
+        int s = st.load();
+        return s == BURST_READY || s == BURST_CAPTURING ? mem.size() : 0;
+    }
+
+    bool huge_pages() const
+    {
+        int s = st.load();
+        return (s == BURST_READY || s == BURST_CAPTURING) && mem.huge_pages();
+    }
+
+    bool memory_locked() const
+    {
+        int s = st.load();
+        return (s == BURST_READY || s == BURST_CAPTURING) && mem.memory_locked();
+    }
+
+    /**
+     * @brief Write throughput of the last burst in MB/s, 0 while writing.
+     */
+    double throughput() const
+    {
+        double s = write_s;
+        return s > 0 ? written_bytes / s / 1e6 : 0;
+    }
+
+    BurstSummary summary()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return sum;
+    }
+
+    std::string get_path()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return path;
+    }
+
+    std::string error()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return errmsg;
+    }
+
+    std::atomic<uint64_t> oversize{0}; // larger than a slot, e.g. after a format change
+};
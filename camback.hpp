@@ -0,0 +1,338 @@
+#pragma once
+#include <stdint.h>
+
+#include <alliedcam.h>
+
+/**
+ * @brief Frame callback of a camera backend, the same as the alliedcam one:
+ * the frame goes back to the backend when it returns.
+ */
+typedef void (*CameraCaptureCallback)(const AlliedCameraHandle_t handle, const VmbHandle_t stream, VmbFrame_t *frame, void *user_data);
+
+/**
+ * @brief The camera calls CameraSession and the windows make, as a table of
+ * functions so that something other than a Vimba camera can stand behind a
+ * handle. Every function follows its allied_* namesake: handles, error codes,
+ * string lists allocated with malloc (the caller frees the array only, the
+ * strings belong to the backend).
+ */
+struct CameraBackend
+{
+    const char *name;
+    VmbError_t (*open_camera)(AlliedCameraHandle_t *handle, const char *id, uint32_t bufsize);
+    VmbError_t (*close_camera)(AlliedCameraHandle_t *handle);
+    VmbError_t (*reset_camera)(AlliedCameraHandle_t *handle); // closes the handle
+    bool (*camera_acquiring)(AlliedCameraHandle_t handle);
+    VmbError_t (*queue_capture)(AlliedCameraHandle_t handle, CameraCaptureCallback callback, void *user_data);
+    VmbError_t (*dequeue_capture)(AlliedCameraHandle_t handle);
+    VmbError_t (*start_capture)(AlliedCameraHandle_t handle);
+    VmbError_t (*stop_capture)(AlliedCameraHandle_t handle);
+    VmbError_t (*get_link_speed)(AlliedCameraHandle_t handle, VmbInt64_t *speed);
+    VmbError_t (*get_throughput_limit)(AlliedCameraHandle_t handle, VmbInt64_t *limit);
+    VmbError_t (*set_throughput_limit)(AlliedCameraHandle_t handle, VmbInt64_t limit);
+    VmbError_t (*get_throughput_limit_range)(AlliedCameraHandle_t handle, VmbInt64_t *minval, VmbInt64_t *maxval);
+    VmbError_t (*get_image_format)(AlliedCameraHandle_t handle, const char **format);
+    VmbError_t (*set_image_format)(AlliedCameraHandle_t handle, const char *format);
+    VmbError_t (*get_image_format_list)(AlliedCameraHandle_t handle, char ***formats, VmbUint32_t *count);
+    VmbError_t (*get_sensor_bit_depth)(AlliedCameraHandle_t handle, const char **depth);
+    VmbError_t (*set_sensor_bit_depth)(AlliedCameraHandle_t handle, const char *depth);
+    VmbError_t (*get_sensor_bit_depth_list)(AlliedCameraHandle_t handle, char ***depths, VmbUint32_t *count);
+    VmbError_t (*get_trigline)(AlliedCameraHandle_t handle, const char **line);
+    VmbError_t (*set_trigline)(AlliedCameraHandle_t handle, const char *line);
+    VmbError_t (*get_triglines_list)(AlliedCameraHandle_t handle, char ***lines, VmbUint32_t *count);
+    VmbError_t (*set_trigline_mode)(AlliedCameraHandle_t handle, const char *mode);
+    VmbError_t (*get_trigline_src)(AlliedCameraHandle_t handle, const char **src);
+    VmbError_t (*set_trigline_src)(AlliedCameraHandle_t handle, const char *src);
+    VmbError_t (*get_trigline_src_list)(AlliedCameraHandle_t handle, char ***srcs, VmbUint32_t *count);
+    VmbError_t (*get_indicator_luma)(AlliedCameraHandle_t handle, VmbInt64_t *luma);
+    VmbError_t (*set_indicator_luma)(AlliedCameraHandle_t handle, VmbInt64_t luma);
+    VmbError_t (*get_acq_framerate)(AlliedCameraHandle_t handle, double *framerate);
+    VmbError_t (*set_acq_framerate)(AlliedCameraHandle_t handle, double framerate);
+    VmbError_t (*get_acq_framerate_range)(AlliedCameraHandle_t handle, double *minval, double *maxval, double *step);
+    VmbError_t (*get_acq_framerate_auto)(AlliedCameraHandle_t handle, bool *on);
+    VmbError_t (*set_acq_framerate_auto)(AlliedCameraHandle_t handle, bool on);
+    VmbError_t (*get_binning_factor)(AlliedCameraHandle_t handle, VmbInt64_t *factor);
+    VmbError_t (*set_binning_factor)(AlliedCameraHandle_t handle, VmbInt64_t factor);
+    VmbError_t (*get_image_size)(AlliedCameraHandle_t handle, VmbInt64_t *width, VmbInt64_t *height);
+    VmbError_t (*set_image_size)(AlliedCameraHandle_t handle, VmbInt64_t width, VmbInt64_t height);
+    VmbError_t (*get_image_ofst)(AlliedCameraHandle_t handle, VmbInt64_t *x, VmbInt64_t *y);
+    VmbError_t (*set_image_ofst)(AlliedCameraHandle_t handle, VmbInt64_t x, VmbInt64_t y);
+    VmbError_t (*get_exposure_range_us)(AlliedCameraHandle_t handle, double *minval, double *maxval, double *step);
+    VmbError_t (*get_exposure_us)(AlliedCameraHandle_t handle, double *exposure);
+    VmbError_t (*set_exposure_us)(AlliedCameraHandle_t handle, double exposure);
+    VmbError_t (*get_temperature_src_list)(AlliedCameraHandle_t handle, char ***srcs, VmbBool_t **supported, VmbUint32_t *count);
+    VmbError_t (*set_temperature_src)(AlliedCameraHandle_t handle, const char *src);
+    VmbError_t (*get_temperature)(AlliedCameraHandle_t handle, double *temp);
+};
+
+// Vimba cameras through alliedcam
+
+static bool vimba_ready = false; // allied_init_api() succeeded
+
+static VmbError_t vimba_open_camera(AlliedCameraHandle_t *handle, const char *id, uint32_t bufsize)
+{
+    return allied_open_camera(handle, id, bufsize);
+}
+
+static VmbError_t vimba_close_camera(AlliedCameraHandle_t *handle)
+{
+    return allied_close_camera(handle);
+}
+
+static VmbError_t vimba_reset_camera(AlliedCameraHandle_t *handle)
+{
+    return allied_reset_camera(handle);
+}
+
+static bool vimba_camera_acquiring(AlliedCameraHandle_t handle)
+{
+    return allied_camera_acquiring(handle);
+}
+
+static VmbError_t vimba_queue_capture(AlliedCameraHandle_t handle, CameraCaptureCallback callback, void *user_data)
+{
+    return allied_queue_capture(handle, callback, user_data);
+}
+
+static VmbError_t vimba_dequeue_capture(AlliedCameraHandle_t handle)
+{
+    return allied_dequeue_capture(handle);
+}
+
+static VmbError_t vimba_start_capture(AlliedCameraHandle_t handle)
+{
+    return allied_start_capture(handle);
+}
+
+static VmbError_t vimba_stop_capture(AlliedCameraHandle_t handle)
+{
+    return allied_stop_capture(handle);
+}
+
+static VmbError_t vimba_get_link_speed(AlliedCameraHandle_t handle, VmbInt64_t *speed)
+{
+    return allied_get_link_speed(handle, speed);
+}
+
+static VmbError_t vimba_get_throughput_limit(AlliedCameraHandle_t handle, VmbInt64_t *limit)
+{
+    return allied_get_throughput_limit(handle, limit);
+}
+
+static VmbError_t vimba_set_throughput_limit(AlliedCameraHandle_t handle, VmbInt64_t limit)
+{
+    return allied_set_throughput_limit(handle, limit);
+}
+
+static VmbError_t vimba_get_throughput_limit_range(AlliedCameraHandle_t handle, VmbInt64_t *minval, VmbInt64_t *maxval)
+{
+    return allied_get_throughput_limit_range(handle, minval, maxval, NULL);
+}
+
+static VmbError_t vimba_get_image_format(AlliedCameraHandle_t handle, const char **format)
+{
+    return allied_get_image_format(handle, format);
+}
+
+static VmbError_t vimba_set_image_format(AlliedCameraHandle_t handle, const char *format)
+{
+    return allied_set_image_format(handle, format);
+}
+
+static VmbError_t vimba_get_image_format_list(AlliedCameraHandle_t handle, char ***formats, VmbUint32_t *count)
+{
+    return allied_get_image_format_list(handle, formats, NULL, count);
+}
+
+static VmbError_t vimba_get_sensor_bit_depth(AlliedCameraHandle_t handle, const char **depth)
+{
+    return allied_get_sensor_bit_depth(handle, depth);
+}
+
+static VmbError_t vimba_set_sensor_bit_depth(AlliedCameraHandle_t handle, const char *depth)
+{
+    return allied_set_sensor_bit_depth(handle, depth);
+}
+
+static VmbError_t vimba_get_sensor_bit_depth_list(AlliedCameraHandle_t handle, char ***depths, VmbUint32_t *count)
+{
+    return allied_get_sensor_bit_depth_list(handle, depths, NULL, count);
+}
+
+static VmbError_t vimba_get_trigline(AlliedCameraHandle_t handle, const char **line)
+{
+    return allied_get_trigline(handle, line);
+}
+
+static VmbError_t vimba_set_trigline(AlliedCameraHandle_t handle, const char *line)
+{
+    return allied_set_trigline(handle, line);
+}
+
+static VmbError_t vimba_get_triglines_list(AlliedCameraHandle_t handle, char ***lines, VmbUint32_t *count)
+{
+    return allied_get_triglines_list(handle, lines, NULL, count);
+}
+
+static VmbError_t vimba_set_trigline_mode(AlliedCameraHandle_t handle, const char *mode)
+{
+    return allied_set_trigline_mode(handle, mode);
+}
+
+static VmbError_t vimba_get_trigline_src(AlliedCameraHandle_t handle, const char **src)
+{
+    return allied_get_trigline_src(handle, src);
+}
+
+static VmbError_t vimba_set_trigline_src(AlliedCameraHandle_t handle, const char *src)
+{
+    return allied_set_trigline_src(handle, src);
+}
+
+static VmbError_t vimba_get_trigline_src_list(AlliedCameraHandle_t handle, char ***srcs, VmbUint32_t *count)
+{
+    return allied_get_trigline_src_list(handle, srcs, NULL, count);
+}
+
+static VmbError_t vimba_get_indicator_luma(AlliedCameraHandle_t handle, VmbInt64_t *luma)
+{
+    return allied_get_indicator_luma(handle, luma);
+}
+
+static VmbError_t vimba_set_indicator_luma(AlliedCameraHandle_t handle, VmbInt64_t luma)
+{
+    return allied_set_indicator_luma(handle, luma);
+}
+
+static VmbError_t vimba_get_acq_framerate(AlliedCameraHandle_t handle, double *framerate)
+{
+    return allied_get_acq_framerate(handle, framerate);
+}
+
+static VmbError_t vimba_set_acq_framerate(AlliedCameraHandle_t handle, double framerate)
+{
+    return allied_set_acq_framerate(handle, framerate);
+}
+
+static VmbError_t vimba_get_acq_framerate_range(AlliedCameraHandle_t handle, double *minval, double *maxval, double *step)
+{
+    return allied_get_acq_framerate_range(handle, minval, maxval, step);
+}
+
+static VmbError_t vimba_get_acq_framerate_auto(AlliedCameraHandle_t handle, bool *on)
+{
+    return allied_get_acq_framerate_auto(handle, on);
+}
+
+static VmbError_t vimba_set_acq_framerate_auto(AlliedCameraHandle_t handle, bool on)
+{
+    return allied_set_acq_framerate_auto(handle, on);
+}
+
+static VmbError_t vimba_get_binning_factor(AlliedCameraHandle_t handle, VmbInt64_t *factor)
+{
+    return allied_get_binning_factor(handle, factor);
+}
+
+static VmbError_t vimba_set_binning_factor(AlliedCameraHandle_t handle, VmbInt64_t factor)
+{
+    return allied_set_binning_factor(handle, factor);
+}
+
+static VmbError_t vimba_get_image_size(AlliedCameraHandle_t handle, VmbInt64_t *width, VmbInt64_t *height)
+{
+    return allied_get_image_size(handle, width, height);
+}
+
+static VmbError_t vimba_set_image_size(AlliedCameraHandle_t handle, VmbInt64_t width, VmbInt64_t height)
+{
+    return allied_set_image_size(handle, width, height);
+}
+
+static VmbError_t vimba_get_image_ofst(AlliedCameraHandle_t handle, VmbInt64_t *x, VmbInt64_t *y)
+{
+    return allied_get_image_ofst(handle, x, y);
+}
+
+static VmbError_t vimba_set_image_ofst(AlliedCameraHandle_t handle, VmbInt64_t x, VmbInt64_t y)
+{
+    return allied_set_image_ofst(handle, x, y);
+}
+
+static VmbError_t vimba_get_exposure_range_us(AlliedCameraHandle_t handle, double *minval, double *maxval, double *step)
+{
+    return allied_get_exposure_range_us(handle, minval, maxval, step);
+}
+
+static VmbError_t vimba_get_exposure_us(AlliedCameraHandle_t handle, double *exposure)
+{
+    return allied_get_exposure_us(handle, exposure);
+}
+
+static VmbError_t vimba_set_exposure_us(AlliedCameraHandle_t handle, double exposure)
+{
+    return allied_set_exposure_us(handle, exposure);
+}
+
+static VmbError_t vimba_get_temperature_src_list(AlliedCameraHandle_t handle, char ***srcs, VmbBool_t **supported, VmbUint32_t *count)
+{
+    return allied_get_temperature_src_list(handle, srcs, supported, count);
+}
+
+static VmbError_t vimba_set_temperature_src(AlliedCameraHandle_t handle, const char *src)
+{
+    return allied_set_temperature_src(handle, src);
+}
+
+static VmbError_t vimba_get_temperature(AlliedCameraHandle_t handle, double *temp)
+{
+    return allied_get_temperature(handle, temp);
+}
+
+static const CameraBackend vimba_backend = {
+    "Vimba",
+    vimba_open_camera,
+    vimba_close_camera,
+    vimba_reset_camera,
+    vimba_camera_acquiring,
+    vimba_queue_capture,
+    vimba_dequeue_capture,
+    vimba_start_capture,
+    vimba_stop_capture,
+    vimba_get_link_speed,
+    vimba_get_throughput_limit,
+    vimba_set_throughput_limit,
+    vimba_get_throughput_limit_range,
+    vimba_get_image_format,
+    vimba_set_image_format,
+    vimba_get_image_format_list,
+    vimba_get_sensor_bit_depth,
+    vimba_set_sensor_bit_depth,
+    vimba_get_sensor_bit_depth_list,
+    vimba_get_trigline,
+    vimba_set_trigline,
+    vimba_get_triglines_list,
+    vimba_set_trigline_mode,
+    vimba_get_trigline_src,
+    vimba_set_trigline_src,
+    vimba_get_trigline_src_list,
+    vimba_get_indicator_luma,
+    vimba_set_indicator_luma,
+    vimba_get_acq_framerate,
+    vimba_set_acq_framerate,
+    vimba_get_acq_framerate_range,
+    vimba_get_acq_framerate_auto,
+    vimba_set_acq_framerate_auto,
+    vimba_get_binning_factor,
+    vimba_set_binning_factor,
+    vimba_get_image_size,
+    vimba_set_image_size,
+    vimba_get_image_ofst,
+    vimba_set_image_ofst,
+    vimba_get_exposure_range_us,
+    vimba_get_exposure_us,
+    vimba_set_exposure_us,
+    vimba_get_temperature_src_list,
+    vimba_set_temperature_src,
+    vimba_get_temperature,
+};
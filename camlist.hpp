@@ -15,6 +15,7 @@
 #include "imagetexture.hpp"
 
 #include "guiwin.hpp"
+#include "playwin.hpp"
 
 #include "stringhasher.hpp"
 
@@ -44,8 +45,11 @@ public:
     std::string inp_id = "";
     std::string errstr = "";
     DeviceHandle adio_dev = nullptr;
+    const SessionConfig *cfg = nullptr; // camera settings from the command line
     StringHasher *hashgen;
     bool win_debug_adio = false;
+    std::vector<PlaybackDisplay *> playbacks;
+    char play_path[256] = "";
 
     void update_err(int devidx, const char *errmsg)
     {
@@ -79,40 +83,17 @@ public:
 
     void refresh_list()
     {
-        VmbError_t err;
-        VmbCameraInfo_t *cams = nullptr;
-        VmbUint32_t ct;
-        if (inp_id.length() > 0)
+        std::vector<VmbCameraInfo_t> cameras;
+        VmbError_t err = camsession_list(inp_id, cameras);
+        if (err != VmbErrorSuccess)
         {
-            cams = new VmbCameraInfo_t;
-            err = VmbCameraInfoQuery(inp_id.c_str(), cams, sizeof(VmbCameraInfo_t));
-            if (err != VmbErrorSuccess) // camera with ID not found
+            if (inp_id.length() > 0) // camera with ID not found
             {
-                // log something
                 printf("Could not get camera info for %s: %s\n", inp_id.c_str(), allied_strerr(err));
                 update_err(string_format("Could not get camera info for %s: %s\n", inp_id.c_str(), allied_strerr(err)));
-                return;
-            }
-            else
-            {
-                ct = 1; // we have info for only one camera
-            }
-        }
-        else
-        {
-            err = allied_list_cameras(&cams, &ct);
-            if (err != VmbErrorSuccess)
-            {
-                // log something
-                return;
             }
+            return;
         }
-        // create cameras
-        std::vector<VmbCameraInfo_t> cameras;
-        cameras.assign(cams, cams + ct);
-        // std::cout << "After assign: " << cameras.size() << std::endl;
-        free(cams); // free the memory
-        // std::cout << "After free: " << cameras.size() << std::endl;
         // create ID of cameras
         caminfos.clear();
         std::unordered_set<uint32_t> ids;
@@ -135,7 +116,7 @@ public:
             {
                 uint32_t val = cinfo->first;
                 CameraInfo cf = cinfo->second;
-                camstructs[val] = new ImageDisplay(cf, adio_dev);
+                camstructs[val] = new ImageDisplay(cf, adio_dev, cfg);
             }
             // std::cout << "Cam structs size: " << camstructs.size() << std::endl;
             return;
@@ -159,10 +140,11 @@ public:
         // std::cout << "Cam structs size: " << camstructs.size() << std::endl;
     }
 
-    CameraList(std::string id, DeviceHandle adio_dev)
+    CameraList(std::string id, DeviceHandle adio_dev, const SessionConfig *cfg = nullptr)
     {
         this->adio_dev = adio_dev;
-        this->inp_id = inp_id;
+        this->inp_id = id;
+        this->cfg = cfg;
         hashgen = new StringHasher;
         refresh_list();
     }
@@ -176,6 +158,11 @@ public:
             delete it->second; // delete memory
         }
         camstructs.clear();
+        for (auto it = playbacks.begin(); it != playbacks.end(); it++)
+        {
+            delete *it;
+        }
+        playbacks.clear();
     }
 
     void render()
@@ -226,7 +213,7 @@ public:
                 if (ImGui::TableSetColumnIndex(3))
                 {
                     bool capturing = win->running();
-                    int oldsel = win->adio_bit + 1;
+                    int oldsel = win->get_adio_bit() + 1;
                     int sel = oldsel;
                     if (ImGui::Combo("", &sel, adio_list, IM_ARRAYSIZE(adio_list)) && !capturing)
                     {
@@ -253,7 +240,7 @@ public:
                                 adio_used.insert({sel - 1, row_id});
                             }
                         }
-                        win->adio_bit = sel - 1; // update selection
+                        win->set_adio_bit(sel - 1); // update selection
                         eprintlf("ADIO Sel: %d -> %d", oldsel, sel);
                     }
                 }
@@ -304,6 +291,24 @@ public:
             }
         }
         ImGui::Separator();
+        ImGui::Text("Recording:");
+        ImGui::SameLine();
+        ImGui::InputText("##play_path", play_path, sizeof(play_path));
+        ImGui::SameLine();
+        if (ImGui::Button("Play") && play_path[0])
+        {
+            PlaybackDisplay *win = new PlaybackDisplay(play_path);
+            if (win->is_open())
+            {
+                playbacks.push_back(win);
+            }
+            else
+            {
+                update_err(win->error());
+                delete win;
+            }
+        }
+        ImGui::Separator();
         if (errstr.length())
         {
             ImGui::Text("Error: %s", errstr.c_str());
@@ -328,6 +333,20 @@ public:
             item->display();
         }
 
+        for (auto it = playbacks.begin(); it != playbacks.end();)
+        {
+            (*it)->display();
+            if (!(*it)->show) // closed
+            {
+                delete *it;
+                it = playbacks.erase(it);
+            }
+            else
+            {
+                it++;
+            }
+        }
+
         if (win_debug_adio)
         {
             // State
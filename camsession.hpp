@@ -0,0 +1,1114 @@
+#pragma once
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <assert.h>
+#include <math.h>
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <alliedcam.h>
+
+#include "string_format.hpp"
+
+#include "framepool.hpp"
+#include "framestats.hpp"
+#include "pixfmt.hpp"
+#include "burst.hpp"
+#include "capturestat.hpp"
+#include "frameacct.hpp"
+#include "flightrec.hpp"
+#include "recorder.hpp"
+#include "virtcam.hpp"
+
+#include "aDIO_library.h"
+
+#define eprintlf(fmt, ...)                                                                     \
+    {                                                                                          \
+        fprintf(stderr, "%s:%d:%s(): " fmt "\n", __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
+        fflush(stderr);                                                                        \
+    }
+
+class CameraInfo
+{
+public:
+    std::string idstr;
+    std::string name;
+    std::string model;
+    std::string serial;
+
+    CameraInfo(CameraInfo &other)
+    {
+        idstr = other.idstr;
+        name = other.name;
+        model = other.model;
+        serial = other.serial;
+    }
+
+    CameraInfo()
+    {
+        idstr = "";
+        name = "";
+        model = "";
+        serial = "";
+    }
+
+    CameraInfo(CameraInfo *other)
+    {
+        idstr = other->idstr;
+        name = other->name;
+        model = other->model;
+        serial = other->serial;
+    }
+
+    CameraInfo(VmbCameraInfo_t info)
+    {
+        idstr = info.cameraIdString;
+        name = info.cameraName;
+        model = info.modelName;
+        serial = info.serialString;
+    }
+};
+
+class CharContainer
+{
+private:
+    char *strdup(const char *str)
+    {
+        int len = strlen(str);
+        char *out = new char[len + 1];
+        strcpy(out, str);
+        return out;
+    }
+
+public:
+    char **arr = nullptr;
+    int narr = 0;
+    int selected;
+    size_t maxlen = 0;
+
+    ~CharContainer()
+    {
+        if (arr)
+        {
+            for (int i = 0; i < narr; i++)
+            {
+                delete[] arr[i];
+            }
+            delete[] arr;
+        }
+    }
+
+    CharContainer()
+    {
+        arr = nullptr;
+        narr = 0;
+        selected = -1;
+    }
+
+    CharContainer(const char **arr, int narr)
+    {
+        this->arr = new char *[narr];
+        this->narr = narr;
+        this->selected = -1;
+        for (int i = 0; i < narr; i++)
+        {
+            this->arr[i] = strdup(arr[i]);
+            if (strlen(arr[i]) > maxlen)
+            {
+                maxlen = strlen(arr[i]);
+            }
+        }
+    }
+
+    CharContainer(const char **arr, int narr, const char *key)
+    {
+        this->arr = new char *[narr];
+        this->narr = narr;
+        for (int i = 0; i < narr; i++)
+        {
+            this->arr[i] = strdup(arr[i]);
+            if (strlen(arr[i]) > maxlen)
+            {
+                maxlen = strlen(arr[i]);
+            }
+        }
+        this->selected = find_idx(key);
+    }
+
+    int find_idx(const char *str)
+    {
+        int res = -1;
+        for (int i = 0; i < narr; i++)
+        {
+            if (strcmp(arr[i], str) == 0)
+                res = i;
+        }
+        return res;
+    }
+};
+
+#define TEMPSENSOR_RESPONSE 100
+
+class TempSensors
+{
+private:
+    char **arr = nullptr;
+    VmbBool_t *supported = nullptr;
+    VmbUint32_t narr = 0;
+    uint32_t cadence_mod = 100;
+    uint32_t cadence_loop = 0;
+    const CameraBackend *backend = nullptr;
+    AlliedCameraHandle_t handle = nullptr;
+    bool running = false;
+    bool errored = true;
+    std::thread opthread;
+    std::mutex mtx;
+    std::vector<double> temps;
+
+    static void ThreadFcn(TempSensors *self)
+    {
+        while (self->running)
+        {
+            self->update();
+            std::this_thread::sleep_for(std::chrono::milliseconds(self->cadence_mod));
+            for (uint32_t i = 0; i < self->cadence_loop && self->running; i++)
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(TEMPSENSOR_RESPONSE));
+            }
+        }
+    }
+
+    void update()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (arr == nullptr || supported == nullptr || temps.size() != narr)
+            return;
+        VmbError_t err;
+        for (VmbUint32_t i = 0; i < narr; i++)
+        {
+            temps[i] = -280; // set to invalid temperature
+            if (supported[i])
+            {
+                err = backend->set_temperature_src(handle, arr[i]);
+                if (err != VmbErrorSuccess)
+                {
+                    continue;
+                }
+                err = backend->get_temperature(handle, &temps[i]);
+                if (err != VmbErrorSuccess)
+                {
+                    temps[i] = -280;
+                }
+            }
+        }
+    }
+
+public:
+    TempSensors(const CameraBackend *backend, AlliedCameraHandle_t handle, uint32_t cadence_ms = 1000) // default to 1 s cadence
+    {
+        this->backend = backend;
+        this->handle = handle;
+        this->cadence_mod = cadence_ms % TEMPSENSOR_RESPONSE;
+        this->cadence_loop = cadence_ms / TEMPSENSOR_RESPONSE;
+        VmbError_t err = backend->get_temperature_src_list(handle, &arr, &supported, &narr);
+        if (err == VmbErrorSuccess)
+        {
+            temps.resize(narr);
+            errored = false;
+            running = true;
+            opthread = std::thread(ThreadFcn, this);
+            return;
+        }
+        std::cerr << "Could not get temperature sensor list: " << allied_strerr(err) << std::endl;
+        if (arr)
+            free(arr);
+        if (supported)
+            free(supported);
+        arr = nullptr;
+        supported = nullptr;
+    }
+
+    ~TempSensors()
+    {
+        if (!errored)
+        {
+            running = false;
+            opthread.join();
+        }
+        if (arr)
+            free(arr);
+        if (supported)
+            free(supported);
+    }
+
+    const char **get_temps(std::vector<double> &temps)
+    {
+        temps = this->temps;
+        return (const char **)arr;
+    }
+};
+
+/**
+ * @brief Cameras the API can see followed by the virtual ones, or only the one
+ * with the given ID string.
+ */
+static inline VmbError_t camsession_list(const std::string &id, std::vector<VmbCameraInfo_t> &cameras)
+{
+    cameras.clear();
+    if (id.length() > 0)
+    {
+        if (virtcam_owns(id))
+        {
+            std::vector<VmbCameraInfo_t> virt;
+            virtcam_list(virt);
+            for (auto it = virt.begin(); it != virt.end(); it++)
+            {
+                if (id == it->cameraIdString)
+                    cameras.push_back(*it);
+            }
+            return VmbErrorSuccess;
+        }
+        if (!vimba_ready)
+            return VmbErrorNotFound;
+        VmbCameraInfo_t cam;
+        VmbError_t err = VmbCameraInfoQuery(id.c_str(), &cam, sizeof(VmbCameraInfo_t));
+        if (err == VmbErrorSuccess)
+            cameras.push_back(cam);
+        return err;
+    }
+    VmbError_t err = VmbErrorSuccess;
+    if (vimba_ready)
+    {
+        VmbCameraInfo_t *cams = nullptr;
+        VmbUint32_t ct = 0;
+        err = allied_list_cameras(&cams, &ct);
+        if (err == VmbErrorSuccess)
+            cameras.assign(cams, cams + ct);
+        free(cams);
+    }
+    virtcam_list(cameras);
+    return cameras.size() ? VmbErrorSuccess : err;
+}
+
+/**
+ * @brief Camera settings and what to do with the frames, given on the command
+ * line (--key value) or in a config file (key = value, one per line, # starts
+ * a comment). Settings left out keep what the camera has.
+ */
+class SessionConfig
+{
+private:
+    static std::string trim(const std::string &str)
+    {
+        size_t start = str.find_first_not_of(" \t\r\n");
+        if (start == std::string::npos)
+            return "";
+        size_t end = str.find_last_not_of(" \t\r\n");
+        return str.substr(start, end - start + 1);
+    }
+
+    static bool parse_double(const std::string &val, double &out)
+    {
+        char *end = nullptr;
+        out = strtod(val.c_str(), &end);
+        return end != val.c_str() && *end == '\0';
+    }
+
+    static bool parse_int(const std::string &val, int &out)
+    {
+        char *end = nullptr;
+        long res = strtol(val.c_str(), &end, 0);
+        out = res;
+        return end != val.c_str() && *end == '\0';
+    }
+
+    static bool parse_bool(const std::string &val, bool &out)
+    {
+        if (val == "1" || val == "true" || val == "yes" || val == "on")
+            out = true;
+        else if (val == "0" || val == "false" || val == "no" || val == "off")
+            out = false;
+        else
+            return false;
+        return true;
+    }
+
+    static bool parse_pair(const std::string &val, int &a, int &b)
+    {
+        char sep = 0;
+        return sscanf(val.c_str(), "%d%c%d", &a, &sep, &b) == 3 && (sep == 'x' || sep == 'X' || sep == ',');
+    }
+
+public:
+    // camera settings, applied after the camera is opened
+    std::string pixel_format; // e.g. Mono12
+    std::string adc;          // sensor bit depth, e.g. Bpp12
+    int binning = 0;
+    int width = 0, height = 0;
+    int offset_x = -1, offset_y = -1;
+    double exposure_us = 0;
+    double framerate = -1; // Hz, 0 for auto
+    int link_speed = 0;    // MBps
+    // what to do with the frames
+    std::string dir = "."; // recordings, flight recorder dumps and bursts go here
+    bool record = false;
+    bool compress = false;
+    bool bitpack = false;
+    double flight_gib = 0; // arm the flight recorder with this much memory
+    double flight_pre_s = 10;
+    double flight_post_s = 5;
+    int flight_trigger = -1; // aDIO port 1 input bit
+    int burst = 0;           // frames
+    std::string frame_log;   // lost, incomplete and dropped frames are appended here
+    // headless run
+    double duration_s = 0; // 0 runs until interrupted
+    double stats_s = 1;
+    // virtual cameras, set up at start
+    VirtualCameraSpec virt;
+
+    /**
+     * @brief Set one key, value is nullptr for a bare flag.
+     */
+    bool set(const std::string &key, const char *value, std::string &err)
+    {
+        std::string val = value ? trim(value) : "1";
+        bool ok = true;
+        if (key == "format")
+            pixel_format = val;
+        else if (key == "adc")
+            adc = val;
+        else if (key == "binning")
+            ok = parse_int(val, binning) && binning > 0;
+        else if (key == "size")
+            ok = parse_pair(val, width, height) && width > 0 && height > 0;
+        else if (key == "offset")
+            ok = parse_pair(val, offset_x, offset_y) && offset_x >= 0 && offset_y >= 0;
+        else if (key == "exposure")
+            ok = parse_double(val, exposure_us) && exposure_us > 0;
+        else if (key == "framerate")
+        {
+            if (val == "auto")
+                framerate = 0;
+            else
+                ok = parse_double(val, framerate) && framerate > 0;
+        }
+        else if (key == "link-speed")
+            ok = parse_int(val, link_speed) && link_speed > 0;
+        else if (key == "dir")
+            dir = val;
+        else if (key == "record")
+            ok = parse_bool(val, record);
+        else if (key == "compress")
+            ok = parse_bool(val, compress);
+        else if (key == "bitpack")
+            ok = parse_bool(val, bitpack);
+        else if (key == "flight")
+            ok = parse_double(val, flight_gib) && flight_gib > 0;
+        else if (key == "flight-pre")
+            ok = parse_double(val, flight_pre_s) && flight_pre_s >= 0;
+        else if (key == "flight-post")
+            ok = parse_double(val, flight_post_s) && flight_post_s >= 0;
+        else if (key == "flight-trigger")
+            ok = parse_int(val, flight_trigger) && flight_trigger >= 0 && flight_trigger < 8;
+        else if (key == "burst")
+            ok = parse_int(val, burst) && burst > 0;
+        else if (key == "frame-log")
+            frame_log = val;
+        else if (key == "duration")
+            ok = parse_double(val, duration_s) && duration_s >= 0;
+        else if (key == "stats")
+            ok = parse_double(val, stats_s) && stats_s > 0;
+        else if (key == "virtual")
+            ok = parse_int(val, virt.count) && virt.count >= 0;
+        else if (key == "virtual-size")
+        {
+            int w = 0, h = 0;
+            ok = parse_pair(val, w, h) && w >= VIRTCAM_WIDTH_INC && h >= VIRTCAM_HEIGHT_INC;
+            virt.sensor_width = w;
+            virt.sensor_height = h;
+        }
+        else if (key == "virtual-pattern")
+            ok = framegen_pattern_from_string(val.c_str(), virt.pattern);
+        else if (key == "virtual-seed")
+        {
+            char *end = nullptr;
+            virt.seed = strtoull(val.c_str(), &end, 0);
+            ok = end != val.c_str() && *end == '\0';
+        }
+        else if (key == "virtual-temps")
+        {
+            int n = 0;
+            ok = parse_int(val, n) && n >= 0 && n <= (int)VIRTCAM_NUM(virtcam_temps);
+            virt.ntemps = n;
+        }
+        else
+        {
+            err = "Unknown setting " + key;
+            return false;
+        }
+        if (!ok)
+            err = "Invalid value for " + key + ": " + val;
+        return ok;
+    }
+
+    bool load(const char *path, std::string &err)
+    {
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL)
+        {
+            err = std::string(path) + ": " + strerror(errno);
+            return false;
+        }
+        char line[1024];
+        int lineno = 0;
+        bool ok = true;
+        while (ok && fgets(line, sizeof(line), fp) != NULL)
+        {
+            lineno++;
+            std::string str = line;
+            str = trim(str.substr(0, str.find('#')));
+            if (str.empty())
+                continue;
+            size_t sep = str.find('=');
+            if (sep == std::string::npos)
+                sep = str.find_first_of(" \t");
+            std::string key = trim(str.substr(0, sep));
+            std::string val = sep == std::string::npos ? "" : trim(str.substr(sep + 1));
+            if (!set(key, val.size() ? val.c_str() : nullptr, err))
+            {
+                err = string_format("%s:%d: ", path, lineno) + err;
+                ok = false;
+            }
+        }
+        fclose(fp);
+        return ok;
+    }
+};
+
+/**
+ * @brief Called from the camera thread with every frame that is not part of a
+ * burst, before it goes to the recorder and the flight recorder. Returns the
+ * statistics to store with the frame, or nullptr.
+ */
+typedef const FrameStats *(*CameraFrameCallback)(const FrameHandle &frame, void *user_data);
+
+/**
+ * @brief Called by start_capture() before the frame pool is sized for
+ * width x height pfmt frames. Drop every frame still held from the pool here.
+ */
+typedef void (*CameraStartCallback)(uint32_t width, uint32_t height, VmbPixelFormat_t pfmt, void *user_data);
+
+/**
+ * @brief One camera with its capture, recording, flight recorder and burst,
+ * without any rendering. ImageDisplay puts a window around it, the headless
+ * runner drives it from the command line.
+ */
+class CameraSession
+{
+private:
+    CameraFrameCallback frame_cb = nullptr;
+    CameraStartCallback start_cb = nullptr;
+    void *cb_data = nullptr;
+    unsigned char state = 0;
+
+public:
+    CameraInfo info;
+    const CameraBackend *backend; // Vimba or virtual, from the ID
+    bool opened = false;
+    AlliedCameraHandle_t handle = nullptr;
+    std::string errmsg;
+    FramePool pool;        // must outlive whatever holds its frames
+    Recorder recorder;     // holds frames from pool
+    FlightRecorder flight; // copies, holds no frames
+    BurstCapture burst;
+    CaptureStat stat;
+    FrameAccounting acct; // lost, incomplete, dropped and superseded frames
+    CharContainer *pixfmts = nullptr;
+    CharContainer *adcrates = nullptr;
+    CharContainer *triglines = nullptr;
+    CharContainer *trigsrcs = nullptr;
+    TempSensors *tempsensors = nullptr;
+    DeviceHandle adio_hdl = nullptr;
+    int adio_bit = -1;
+    VmbInt64_t link_speed = 0;
+    std::string link_speed_str = "";
+    VmbInt64_t throughput = 0;
+    VmbInt64_t throughput_min = 0;
+    VmbInt64_t throughput_max = 0;
+    bool capturing = false;
+    int flight_trig_bit = -1; // aDIO port 1 input, rising edge dumps
+    bool flight_trig_level = false;
+    bool burst_running = false;          // begun by us
+    bool burst_started_capture = false;  // capture was off before the burst, stop it when the burst ends
+    double burst_avg = 0, burst_std = 0; // CaptureStat over the burst
+    // snapshots for the recording, written by poll(), read by the camera callback
+    std::atomic<double> exposure_us{0};
+    std::atomic<uint32_t> ntemps{0};
+    std::atomic<double> temps_now[RECFILE_MAX_TEMPS];
+
+    CameraSession(const CameraInfo &info, const DeviceHandle &adio_hdl)
+    {
+        this->info = info;
+        this->adio_hdl = adio_hdl;
+        this->backend = camback_find(info.idstr);
+        acct.set_name(info.serial);
+    }
+
+    ~CameraSession()
+    {
+        close_camera();
+    }
+
+    void set_callbacks(CameraFrameCallback on_frame, CameraStartCallback on_start, void *user_data)
+    {
+        frame_cb = on_frame;
+        start_cb = on_start;
+        cb_data = user_data;
+    }
+
+    void open_camera(uint32_t bufsize = MIB(16))
+    {
+        VmbError_t err = backend->open_camera(&handle, info.idstr.c_str(), bufsize);
+        if (err != VmbErrorSuccess)
+        {
+            errmsg = "Could not open camera: " + std::string(allied_strerr(err));
+            return;
+        }
+        char *key = nullptr;
+        char **arr = nullptr;
+        VmbUint32_t narr = 0;
+        err = backend->get_link_speed(handle, &link_speed);
+        if (err != VmbErrorSuccess)
+        {
+            update_err("Could not get link speed", err);
+        }
+        link_speed_str = string_format("Link Speed Settings (Max: %d MBps)", link_speed / 1000 / 1000);
+        err = backend->get_throughput_limit(handle, &throughput);
+        if (err != VmbErrorSuccess)
+        {
+            update_err("Could not get throughput limit", err);
+        }
+        err = backend->get_throughput_limit_range(handle, &throughput_min, &throughput_max);
+        if (err != VmbErrorSuccess)
+        {
+            update_err("Could not get throughput limit range", err);
+        }
+        err = backend->get_image_format(handle, (const char **)&key);
+        if (err == VmbErrorSuccess)
+        {
+            err = backend->get_image_format_list(handle, &arr, &narr);
+            if (err == VmbErrorSuccess)
+            {
+                pixfmts = new CharContainer((const char **)arr, narr, key);
+                free(arr);
+                narr = 0;
+            }
+            else
+            {
+                update_err("Could not get image format list", err);
+            }
+        }
+        else
+        {
+            update_err("Could not get image format", err);
+        }
+        err = backend->get_sensor_bit_depth(handle, (const char **)&key);
+        if (err == VmbErrorSuccess)
+        {
+            err = backend->get_sensor_bit_depth_list(handle, &arr, &narr);
+            if (err == VmbErrorSuccess)
+            {
+                adcrates = new CharContainer((const char **)arr, narr, (const char *)key);
+                free(arr);
+                narr = 0;
+            }
+            else
+            {
+                update_err("Could not get sensor bit depth list", err);
+            }
+        }
+        else
+        {
+            update_err("Could not get image format", err);
+        }
+        err = backend->get_trigline(handle, (const char **)&key);
+        if (err == VmbErrorSuccess)
+        {
+            err = backend->get_triglines_list(handle, &arr, &narr);
+            if (err == VmbErrorSuccess)
+            {
+                triglines = new CharContainer((const char **)arr, narr, (const char *)key);
+                free(arr);
+                narr = 0;
+            }
+            else
+            {
+                update_err("Could not get trigger lines list", err);
+            }
+        }
+        else
+        {
+            update_err("Could not get selected trigger line", err);
+        }
+        if (triglines != nullptr)
+        {
+            // set all trigger lines to output
+            for (int i = 0; i < triglines->narr; i++)
+            {
+                char *line = triglines->arr[i];
+                err = backend->set_trigline(handle, line);
+                if (err != VmbErrorSuccess)
+                {
+                    update_err(string_format("Could not select line %s", line), err);
+                }
+                else
+                {
+                    err = backend->set_trigline_mode(handle, "Output");
+                    update_err(string_format("Could not set line %s to output", line), err);
+                }
+            }
+            err = backend->set_trigline(handle, key);
+            update_err(string_format("Could not select line %s", key), err);
+            // get trigger source
+            err = backend->get_trigline_src(handle, (const char **)&key);
+            if (err == VmbErrorSuccess)
+            {
+                err = backend->get_trigline_src_list(handle, &arr, &narr);
+                if (err == VmbErrorSuccess)
+                {
+                    trigsrcs = new CharContainer((const char **)arr, narr, (const char *)key);
+                    free(arr);
+                    narr = 0;
+                }
+                else
+                {
+                    update_err("Could not get trigger sources list", err);
+                }
+            }
+        }
+        err = backend->queue_capture(handle, &Callback, (void *)this);
+        update_err("Could not queue capture", err);
+        tempsensors = new TempSensors(backend, handle);
+        opened = true;
+        // std::cout << "Opened!" << std::endl;
+    }
+
+    void close_camera()
+    {
+        cleanup();
+        if (pixfmts != nullptr)
+        {
+            delete pixfmts;
+            pixfmts = nullptr;
+        }
+        if (adcrates != nullptr)
+        {
+            delete adcrates;
+            adcrates = nullptr;
+        }
+        if (triglines != nullptr)
+        {
+            delete triglines;
+            triglines = nullptr;
+        }
+        if (trigsrcs != nullptr)
+        {
+            delete trigsrcs;
+            trigsrcs = nullptr;
+        }
+        if (tempsensors != nullptr)
+        {
+            delete tempsensors;
+            tempsensors = nullptr;
+        }
+        opened = false;
+        errmsg = "";
+    }
+
+    // dequeues the frames while the limit changes, bps in bytes per second
+    VmbError_t set_link_speed(VmbInt64_t bps)
+    {
+        VmbError_t err = backend->dequeue_capture(handle);
+        update_err("Dequeue capture", err);
+        VmbError_t ret = backend->set_throughput_limit(handle, bps);
+        update_err("Set link speed", ret);
+        if (ret == VmbErrorSuccess)
+        {
+            VmbInt64_t _throughput;
+            err = backend->get_throughput_limit(handle, &_throughput);
+            update_err("Get link speed", err);
+            if (err == VmbErrorSuccess)
+            {
+                throughput = _throughput;
+            }
+        }
+        else
+        {
+            eprintlf("Error setting link speed to %lld Bps: %s", (long long)bps, allied_strerr(ret));
+        }
+        err = backend->queue_capture(handle, &Callback, (void *)this);
+        update_err("Could not queue capture", err);
+        return ret;
+    }
+
+    /**
+     * @brief Apply the camera settings of cfg, while not capturing.
+     *
+     * @return false if any of them failed, errmsg holds the last failure.
+     */
+    bool apply(const SessionConfig &cfg)
+    {
+        if (!opened || backend->camera_acquiring(handle))
+            return false;
+        bool ok = true;
+        if (cfg.frame_log.size() && !acct.open_log(cfg.frame_log))
+        {
+            errmsg = "Could not open frame log " + cfg.frame_log + ": " + strerror(errno);
+            ok = false;
+        }
+        // binning first, it changes the size and offset limits
+        if (cfg.binning > 0)
+            ok &= applied(string_format("Set binning to %d", cfg.binning), backend->set_binning_factor(handle, cfg.binning));
+        if (cfg.width > 0 && cfg.height > 0)
+            ok &= applied(string_format("Set image size to %d x %d", cfg.width, cfg.height), backend->set_image_size(handle, cfg.width, cfg.height));
+        if (cfg.offset_x >= 0 && cfg.offset_y >= 0)
+            ok &= applied(string_format("Set image offset to %d x %d", cfg.offset_x, cfg.offset_y), backend->set_image_ofst(handle, cfg.offset_x, cfg.offset_y));
+        if (cfg.pixel_format.size())
+            ok &= applied("Set image format to " + cfg.pixel_format, backend->set_image_format(handle, cfg.pixel_format.c_str()));
+        if (cfg.adc.size())
+            ok &= applied("Set sensor bit depth to " + cfg.adc, backend->set_sensor_bit_depth(handle, cfg.adc.c_str()));
+        if (cfg.exposure_us > 0)
+            ok &= applied(string_format("Set exposure to %.1f us", cfg.exposure_us), backend->set_exposure_us(handle, cfg.exposure_us));
+        if (cfg.framerate == 0)
+            ok &= applied("Set auto frame rate", backend->set_acq_framerate_auto(handle, true));
+        else if (cfg.framerate > 0)
+        {
+            ok &= applied("Clear auto frame rate", backend->set_acq_framerate_auto(handle, false));
+            ok &= applied(string_format("Set frame rate to %.3f Hz", cfg.framerate), backend->set_acq_framerate(handle, cfg.framerate));
+        }
+        if (cfg.link_speed > 0)
+            ok &= applied(string_format("Set link speed to %d MBps", cfg.link_speed), set_link_speed((VmbInt64_t)cfg.link_speed * 1000 * 1000));
+        // keep the selections in step with the camera
+        const char *key = nullptr;
+        if (pixfmts != nullptr && backend->get_image_format(handle, &key) == VmbErrorSuccess && key != nullptr && pixfmts->find_idx(key) >= 0)
+            pixfmts->selected = pixfmts->find_idx(key);
+        if (adcrates != nullptr && backend->get_sensor_bit_depth(handle, &key) == VmbErrorSuccess && key != nullptr && adcrates->find_idx(key) >= 0)
+            adcrates->selected = adcrates->find_idx(key);
+        return ok;
+    }
+
+    bool applied(const std::string &what, VmbError_t err)
+    {
+        if (err == VmbErrorSuccess)
+            return true;
+        update_err(what, err);
+        fprintf(stderr, "%s: %s\n", info.serial.c_str(), errmsg.c_str());
+        return false;
+    }
+
+    // record into dir as <serial>_<date>_<time>.avr
+    bool start_recording(const std::string &dir, bool compress, bool bitpack)
+    {
+        recorder.set_compression(compress);
+        recorder.set_packing(bitpack ? sensor_bit_depth() : 0);
+        char stamp[32];
+        time_t now = time(NULL);
+        struct tm tm;
+        strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", localtime_r(&now, &tm));
+        std::string fname = dir + "/" + info.serial + "_" + stamp + RECFILE_EXT;
+        RecFileHeader hdr;
+        fill_rec_header(hdr);
+        if (!recorder.start(fname, hdr))
+        {
+            errmsg = "Recording: " + recorder.error();
+            return false;
+        }
+        return true;
+    }
+
+    bool arm_flight(const std::string &dir, double gib, double pre_s, double post_s)
+    {
+        RecFileHeader hdr;
+        fill_rec_header(hdr);
+        if (!flight.arm(hdr, (size_t)(gib * 1073741824.0), hdr.frame_size, pre_s, post_s, dir, info.serial))
+        {
+            errmsg = "Flight recorder: " + flight.error();
+            return false;
+        }
+        return true;
+    }
+
+    // capture starts from poll() once the buffer is allocated
+    bool start_burst(const std::string &dir, int frames)
+    {
+        RecFileHeader hdr;
+        fill_rec_header(hdr);
+        if (!burst.arm(hdr, frames, hdr.frame_size, dir, info.serial))
+        {
+            errmsg = "Burst: still running";
+            return false;
+        }
+        return true;
+    }
+
+    // temperatures for the recording, aDIO trigger and burst state, call every few ms
+    void poll()
+    {
+        if (opened)
+            capturing = backend->camera_acquiring(handle);
+        if (opened && tempsensors != nullptr)
+        {
+            std::vector<double> temps;
+            tempsensors->get_temps(temps);
+            uint32_t nt = std::min(temps.size(), (size_t)RECFILE_MAX_TEMPS);
+            for (uint32_t i = 0; i < nt; i++)
+                temps_now[i].store(temps[i], std::memory_order_relaxed);
+            ntemps.store(nt, std::memory_order_release);
+        }
+        poll_flight_trigger();
+        poll_burst();
+        acct.poll();
+    }
+
+    void update_err(const char *where, VmbError_t err)
+    {
+        if (err != VmbErrorSuccess)
+        {
+            errmsg = std::string(where) + ": " + std::string(allied_strerr(err));
+        }
+    }
+
+    void update_err(std::string where, VmbError_t err)
+    {
+        if (err != VmbErrorSuccess)
+        {
+            errmsg = where + ": " + std::string(allied_strerr(err));
+        }
+    }
+
+    void cleanup()
+    {
+        if (opened)
+        {
+            backend->stop_capture(handle);  // just stop capture...
+            recorder.stop();              // write out what was queued
+            flight.disarm();              // finish a dump in progress
+            burst.stop();                 // written out in the background
+            burst_running = false;
+            burst_started_capture = false;
+            backend->close_camera(&handle); // close the camera
+            opened = false;
+        }
+    }
+
+    bool running()
+    {
+        return capturing;
+    }
+
+    VmbError_t start_capture()
+    {
+        VmbError_t err = VmbErrorSuccess;
+        if (handle != nullptr && !capturing)
+        {
+            stat.reset();
+            acct.reset();
+            double exp;
+            if (backend->get_exposure_us(handle, &exp) == VmbErrorSuccess)
+                exposure_us = exp;
+            err = reserve_pool();
+            if (err != VmbErrorSuccess)
+                return err;
+            err = backend->start_capture(handle); // set the callback here
+            update_err("Start capture", err);
+        }
+        return err;
+    }
+
+    void fill_rec_header(RecFileHeader &hdr)
+    {
+        VmbInt64_t width = 0, height = 0;
+        const char *key = nullptr;
+        VmbPixelFormat_t pfmt = VmbPixelFormatMono8;
+        backend->get_image_size(handle, &width, &height);
+        if (backend->get_image_format(handle, &key) == VmbErrorSuccess)
+            pixfmt_from_string(key, pfmt);
+        hdr.pixelFormat = pfmt;
+        hdr.width = width;
+        hdr.height = height;
+        hdr.bit_depth = pixfmt_bit_depth(pfmt);
+        hdr.frame_size = pixfmt_image_size(pfmt, width, height);
+        snprintf(hdr.model, sizeof(hdr.model), "%s", info.model.c_str());
+        snprintf(hdr.serial, sizeof(hdr.serial), "%s", info.serial.c_str());
+        std::vector<double> temps;
+        const char **srcs = tempsensors ? tempsensors->get_temps(temps) : nullptr;
+        hdr.ntemps = srcs ? std::min(temps.size(), (size_t)RECFILE_MAX_TEMPS) : 0;
+        for (uint32_t i = 0; i < hdr.ntemps; i++)
+            snprintf(hdr.temp_names[i], RECFILE_NAME_LEN, "%s", srcs[i]);
+    }
+
+    // bits per sample the sensor delivers (SensorBitDepth "Bpp12" and the like), 0 if unknown
+    uint32_t sensor_bit_depth()
+    {
+        const char *key = nullptr;
+        if (backend->get_sensor_bit_depth(handle, &key) != VmbErrorSuccess || key == nullptr)
+            return 0;
+        return atoi(key + strcspn(key, "0123456789"));
+    }
+
+    // camera callback, st from the frame callback if there was one
+    void fill_frame_meta(RecFrameHeader &hdr, const FrameStats *st)
+    {
+        hdr.host_ns = recfile_now_ns();
+        hdr.exposure_us = exposure_us.load(std::memory_order_relaxed);
+        hdr.ntemps = ntemps.load(std::memory_order_acquire);
+        for (uint32_t i = 0; i < hdr.ntemps; i++)
+            hdr.temps[i] = temps_now[i].load(std::memory_order_relaxed);
+        if (st)
+        {
+            hdr.has_stats = 1;
+            hdr.min = st->min;
+            hdr.max = st->max;
+            hdr.mean = st->mean;
+            hdr.stddev = st->stddev;
+            hdr.saturated = st->saturated;
+        }
+    }
+
+    // start capture once the burst buffer is ready, stop it when the buffer is full
+    void poll_burst()
+    {
+        if (!opened)
+            return;
+        BurstState bs = burst.state();
+        if (bs == BURST_READY && !burst_running)
+        {
+            stat.reset();
+            burst.begin();
+            burst_running = true;
+            capturing = backend->camera_acquiring(handle);
+            burst_started_capture = !capturing;
+            if (!capturing && start_capture() != VmbErrorSuccess)
+                burst.stop();
+        }
+        else if (bs >= BURST_WRITING && burst_running)
+        {
+            stat.get_stats(burst_avg, burst_std);
+            burst_running = false;
+            capturing = backend->camera_acquiring(handle);
+            if (burst_started_capture) // a burst taken during live view leaves it running
+                stop_capture();
+            burst_started_capture = false;
+        }
+    }
+
+    // rising edge on the aDIO trigger input, polled at the UI frame rate
+    void poll_flight_trigger()
+    {
+        if (adio_hdl == nullptr || flight_trig_bit < 0)
+            return;
+        uint8_t val = 0;
+        if (ReadPort_aDIO(adio_hdl, 1, &val) != 0)
+            return;
+        bool level = (val >> flight_trig_bit) & 1;
+        if (level && !flight_trig_level)
+            flight.trigger();
+        flight_trig_level = level;
+    }
+
+    VmbError_t reserve_pool()
+    {
+        VmbInt64_t width = 0, height = 0;
+        VmbError_t err = backend->get_image_size(handle, &width, &height);
+        update_err("Get image size", err);
+        if (err != VmbErrorSuccess)
+            return err;
+        const char *key = nullptr;
+        VmbPixelFormat_t pfmt;
+        err = backend->get_image_format(handle, &key);
+        if (err != VmbErrorSuccess || !pixfmt_from_string(key, pfmt))
+            pfmt = VmbPixelFormatRgba16; // unknown format, assume the widest one
+        if (start_cb) // drop the frames held from the old pool
+            start_cb(width, height, pfmt, cb_data);
+        size_t size = pixfmt_image_size(pfmt, width, height);
+        // enough slabs to let the recorder fall behind for a while
+        uint64_t count = size ? RECORDER_POOL_BUDGET / size : FRAMEPOOL_SLABS;
+        count = std::max((uint64_t)FRAMEPOOL_SLABS, std::min((uint64_t)RECORDER_POOL_MAX_SLABS, count));
+        if (!pool.reserve(size, count))
+        {
+            errmsg = "Could not allocate frame pool: frames still in use";
+            return VmbErrorResources;
+        }
+        return VmbErrorSuccess;
+    }
+
+    VmbError_t stop_capture()
+    {
+        VmbError_t err = VmbErrorSuccess;
+        if (handle != nullptr && capturing)
+        {
+            err = backend->stop_capture(handle);
+            update_err("Stop capture", err);
+            if (adio_hdl != nullptr && adio_bit >= 0)
+            {
+                this->state = 0;
+                WriteBit_aDIO(adio_hdl, 0, adio_bit, this->state);
+            }
+        }
+        return err;
+    }
+
+    static void Callback(const AlliedCameraHandle_t handle, const VmbHandle_t stream, VmbFrame_t *frame, void *user_data)
+    {
+        assert(user_data);
+        CameraSession *self = (CameraSession *)user_data;
+        if (self->adio_hdl != nullptr && self->adio_bit >= 0)
+        {
+            self->state = ~self->state;
+            WriteBit_aDIO(self->adio_hdl, 0, self->adio_bit, self->state);
+        }
+        self->stat.update();
+        self->acct.on_frame(frame);
+        if (self->burst.capturing()) // the burst gets the whole callback, the display waits
+        {
+            RecFrameHeader hdr;
+            self->fill_frame_meta(hdr, nullptr);
+            uint64_t oversize = self->burst.oversize;
+            if (!self->burst.push(frame, hdr) && self->burst.oversize != oversize)
+                self->acct.on_dropped(frame->frameID, FRAMEDROP_BURST_OVERSIZE);
+            return;
+        }
+        uint64_t pool_oversize = self->pool.oversize.load(std::memory_order_relaxed);
+        FrameHandle fh = self->pool.copy(frame); // frame goes back to the driver when we return
+        if (!fh)
+            self->acct.on_dropped(frame->frameID, self->pool.oversize.load(std::memory_order_relaxed) != pool_oversize ? FRAMEDROP_OVERSIZE : FRAMEDROP_POOL);
+        const FrameStats *st = self->frame_cb ? self->frame_cb(fh, self->cb_data) : nullptr;
+        bool recording = self->recorder.recording();
+        bool flight = self->flight.is_armed();
+        if (recording || flight)
+        {
+            RecFrameHeader hdr;
+            self->fill_frame_meta(hdr, st);
+            uint64_t rec_dropped = self->recorder.dropped;
+            if (recording && !self->recorder.push(fh, hdr) && self->recorder.dropped != rec_dropped)
+                self->acct.on_dropped(frame->frameID, FRAMEDROP_RECORDER);
+            uint64_t flight_dropped = self->flight.dropped, flight_oversize = self->flight.oversize;
+            if (flight && !self->flight.push(fh, hdr))
+            {
+                if (self->flight.dropped != flight_dropped)
+                    self->acct.on_dropped(frame->frameID, FRAMEDROP_FLIGHT);
+                else if (self->flight.oversize != flight_oversize)
+                    self->acct.on_dropped(frame->frameID, FRAMEDROP_FLIGHT_OVERSIZE);
+            }
+        }
+    }
+};
@@ -0,0 +1,275 @@
+#pragma once
+#include <math.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+
+#define CAPSTAT_SUB_BITS 5 // 32 sub-buckets per power of two, buckets are at most 3% wide
+#define CAPSTAT_MAX_BITS 36 // intervals are clamped to 2^36 ns, about 68 s
+#define CAPSTAT_BUCKETS ((CAPSTAT_MAX_BITS - CAPSTAT_SUB_BITS + 2) << CAPSTAT_SUB_BITS)
+#define CAPSTAT_WINDOW_S 10 // longest window, one slot per second
+
+typedef enum
+{
+    CAPSTAT_TOTAL = 0, // since the last reset()
+    CAPSTAT_1S,        // the last complete second
+    CAPSTAT_10S,       // the last ten complete seconds
+} CaptureWindow;
+
+/**
+ * @brief Inter-frame intervals of one window, in us.
+ */
+typedef struct
+{
+    uint64_t count;
+    double mean;
+    double stddev;
+    double min;
+    double max; // longest gap
+    double p50;
+    double p99;
+    double p999;
+} CaptureSummary;
+
+/**
+ * @brief Frame interval statistics with a single writer, the camera callback,
+ * and any number of readers. update() takes no lock: readers copy the counters
+ * under a sequence count and retry if the writer was in between. The mean and
+ * variance are kept with Welford's update, the distribution in a log-bucketed
+ * histogram, cumulatively and per second for the windowed views.
+ */
+class CaptureStat
+{
+private:
+    struct Block
+    {
+        std::atomic<uint64_t> count;
+        std::atomic<double> mean; // us
+        std::atomic<double> m2;   // sum of squared deviations, us^2
+        std::atomic<int64_t> min; // ns
+        std::atomic<int64_t> max; // ns
+        std::atomic<int64_t> second; // steady clock second the slot holds, -1 for the cumulative block
+        std::atomic<uint64_t> buckets[CAPSTAT_BUCKETS];
+    };
+
+    // what a reader merges the blocks of a window into
+    struct Snapshot
+    {
+        uint64_t count;
+        double mean, m2;
+        int64_t min, max;
+        uint64_t buckets[CAPSTAT_BUCKETS];
+    };
+
+    Block total;
+    Block slots[CAPSTAT_WINDOW_S];
+    std::atomic<uint32_t> seq{0}; // odd while the writer is updating
+    std::atomic<bool> reset_pending{true}; // the first update() only starts the clock
+    int64_t last = 0; // writer only, previous frame
+
+    static int64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    static uint32_t bucket_of(int64_t ns)
+    {
+        uint64_t v = ns > 0 ? (uint64_t)ns : 0;
+        if (v >= (1ULL << CAPSTAT_MAX_BITS))
+            v = (1ULL << CAPSTAT_MAX_BITS) - 1;
+        if (v < (1U << CAPSTAT_SUB_BITS))
+            return (uint32_t)v;
+        int msb = 63 - __builtin_clzll(v);
+        int shift = msb - CAPSTAT_SUB_BITS;
+        return ((uint32_t)(shift + 1) << CAPSTAT_SUB_BITS) + (uint32_t)((v >> shift) & ((1U << CAPSTAT_SUB_BITS) - 1));
+    }
+
+    // middle of the bucket, ns
+    static double bucket_value(uint32_t idx)
+    {
+        if (idx < (1U << CAPSTAT_SUB_BITS))
+            return idx;
+        uint32_t shift = (idx >> CAPSTAT_SUB_BITS) - 1;
+        uint64_t low = ((1ULL << CAPSTAT_SUB_BITS) + (idx & ((1U << CAPSTAT_SUB_BITS) - 1))) << shift;
+        return low + ((1ULL << shift) - 1) * 0.5;
+    }
+
+    static void clear(Block &b, int64_t second)
+    {
+        b.count.store(0, std::memory_order_relaxed);
+        b.mean.store(0, std::memory_order_relaxed);
+        b.m2.store(0, std::memory_order_relaxed);
+        b.min.store(INT64_MAX, std::memory_order_relaxed);
+        b.max.store(0, std::memory_order_relaxed);
+        b.second.store(second, std::memory_order_relaxed);
+        for (uint32_t i = 0; i < CAPSTAT_BUCKETS; i++)
+            b.buckets[i].store(0, std::memory_order_relaxed);
+    }
+
+    // single writer: plain load and store, no read-modify-write
+    static void add(Block &b, int64_t ns, uint32_t idx)
+    {
+        double x = ns * 1e-3;
+        uint64_t n = b.count.load(std::memory_order_relaxed) + 1;
+        double mean = b.mean.load(std::memory_order_relaxed);
+        double delta = x - mean;
+        mean += delta / n;
+        b.count.store(n, std::memory_order_relaxed);
+        b.mean.store(mean, std::memory_order_relaxed);
+        b.m2.store(b.m2.load(std::memory_order_relaxed) + delta * (x - mean), std::memory_order_relaxed);
+        if (ns < b.min.load(std::memory_order_relaxed))
+            b.min.store(ns, std::memory_order_relaxed);
+        if (ns > b.max.load(std::memory_order_relaxed))
+            b.max.store(ns, std::memory_order_relaxed);
+        b.buckets[idx].store(b.buckets[idx].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    // Chan et al. pairwise combination of the moments
+    static void merge(Snapshot &s, const Block &b)
+    {
+        uint64_t n = b.count.load(std::memory_order_relaxed);
+        if (n == 0)
+            return;
+        double mean = b.mean.load(std::memory_order_relaxed);
+        double m2 = b.m2.load(std::memory_order_relaxed);
+        uint64_t total = s.count + n;
+        double delta = mean - s.mean;
+        s.m2 += m2 + delta * delta * ((double)s.count * n / total);
+        s.mean += delta * n / total;
+        s.count = total;
+        s.min = std::min(s.min, b.min.load(std::memory_order_relaxed));
+        s.max = std::max(s.max, b.max.load(std::memory_order_relaxed));
+        for (uint32_t i = 0; i < CAPSTAT_BUCKETS; i++)
+            s.buckets[i] += b.buckets[i].load(std::memory_order_relaxed);
+    }
+
+    static double percentile(const Snapshot &s, double q)
+    {
+        uint64_t rank = (uint64_t)ceil(q * s.count);
+        if (rank == 0)
+            rank = 1;
+        uint64_t seen = 0;
+        for (uint32_t i = 0; i < CAPSTAT_BUCKETS; i++)
+        {
+            seen += s.buckets[i];
+            if (seen >= rank)
+                return std::min(std::max(bucket_value(i), (double)s.min), (double)s.max) * 1e-3;
+        }
+        return s.max * 1e-3;
+    }
+
+    void snapshot(CaptureWindow window, Snapshot &s)
+    {
+        int64_t second = now_ns() / 1000000000;
+        uint32_t begin;
+        do
+        {
+            while ((begin = seq.load(std::memory_order_acquire)) & 1)
+                std::this_thread::yield();
+            s.count = 0;
+            s.mean = 0;
+            s.m2 = 0;
+            s.min = INT64_MAX;
+            s.max = 0;
+            memset(s.buckets, 0, sizeof(s.buckets));
+            if (window == CAPSTAT_TOTAL)
+                merge(s, total);
+            else
+            {
+                int64_t first = second - (window == CAPSTAT_1S ? 1 : CAPSTAT_WINDOW_S);
+                for (uint32_t i = 0; i < CAPSTAT_WINDOW_S; i++)
+                {
+                    int64_t sec = slots[i].second.load(std::memory_order_relaxed);
+                    if (sec >= first && sec < second) // the current second is still filling
+                        merge(s, slots[i]);
+                }
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+        } while (seq.load(std::memory_order_relaxed) != begin);
+    }
+
+public:
+    CaptureStat()
+    {
+        clear(total, -1);
+        for (uint32_t i = 0; i < CAPSTAT_WINDOW_S; i++)
+            clear(slots[i], -1);
+    }
+
+    /**
+     * @brief Starts over from the next frame. Safe from any thread, the writer
+     * clears the counters itself on its next update().
+     */
+    void reset()
+    {
+        reset_pending.store(true, std::memory_order_release);
+    }
+
+    /**
+     * @brief Records the interval since the previous call. Only ever called
+     * from one thread at a time.
+     */
+    void update()
+    {
+        int64_t now = now_ns();
+        bool restart = reset_pending.exchange(false, std::memory_order_acquire);
+        int64_t second = now / 1000000000;
+        Block &slot = slots[second % CAPSTAT_WINDOW_S];
+        uint32_t s = seq.load(std::memory_order_relaxed);
+        seq.store(s + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        if (restart)
+        {
+            clear(total, -1);
+            for (uint32_t i = 0; i < CAPSTAT_WINDOW_S; i++)
+                clear(slots[i], -1);
+        }
+        else
+        {
+            if (slot.second.load(std::memory_order_relaxed) != second)
+                clear(slot, second);
+            int64_t ns = now - last;
+            uint32_t idx = bucket_of(ns);
+            add(total, ns, idx);
+            add(slot, ns, idx);
+        }
+        seq.store(s + 2, std::memory_order_release);
+        last = now;
+    }
+
+    /**
+     * @brief Interval statistics of a window, all zero until it has seen a
+     * frame interval.
+     */
+    void get_summary(CaptureWindow window, CaptureSummary &sum)
+    {
+        memset(&sum, 0, sizeof(sum));
+        if (reset_pending.load(std::memory_order_acquire))
+            return;
+        Snapshot s;
+        snapshot(window, s);
+        if (s.count)
+        {
+            sum.count = s.count;
+            sum.mean = s.mean;
+            sum.stddev = s.count > 1 ? sqrt(s.m2 / (s.count - 1)) : 0;
+            sum.min = s.min * 1e-3;
+            sum.max = s.max * 1e-3;
+            sum.p50 = percentile(s, 0.5);
+            sum.p99 = percentile(s, 0.99);
+            sum.p999 = percentile(s, 0.999);
+        }
+    }
+
+    // time between frames since the last reset, us
+    void get_stats(double &avg, double &stddev)
+    {
+        CaptureSummary sum;
+        get_summary(CAPSTAT_TOTAL, sum);
+        avg = sum.mean;
+        stddev = sum.stddev;
+    }
+};
@@ -0,0 +1,182 @@
+#include "crc32c.hpp"
+
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define CRC32C_X86
+#endif
+
+#define CRC32C_POLY 0x82f63b78 // bit reflected
+#define CRC32C_LONG 8192       // bytes per stream of the three hardware streams
+#define CRC32C_SHORT 256
+
+// The crc32 instruction has a latency of three cycles but can start one per
+// cycle, so three independent streams over consecutive blocks run three times
+// as fast as one. The stream CRCs are then combined: running a CRC register
+// over n more bytes is the same as multiplying it by x^(8n) modulo the
+// polynomial and adding the CRC of those bytes from a zero register. The
+// multiplication by a fixed power is linear, so it is done with four tables
+// indexed by the bytes of the register.
+
+// a * b modulo the polynomial, bit reflected (x^0 is the top bit)
+static uint32_t multmodp(uint32_t a, uint32_t b)
+{
+    uint32_t p = 0;
+    for (uint32_t m = 1u << 31; m; m >>= 1)
+    {
+        if (a & m)
+            p ^= b;
+        b = b & 1 ? (b >> 1) ^ CRC32C_POLY : b >> 1;
+    }
+    return p;
+}
+
+// x^(8 * len) modulo the polynomial
+static uint32_t xpow8n(size_t len)
+{
+    uint32_t result = 1u << 31; // x^0
+    uint32_t sq = 1u << 23;     // x^8
+    for (; len; len >>= 1)
+    {
+        if (len & 1)
+            result = multmodp(sq, result);
+        sq = multmodp(sq, sq);
+    }
+    return result;
+}
+
+struct Crc32cTables
+{
+    uint32_t bytes[8][256]; // slice-by-8
+    uint32_t shift_long[4][256];
+    uint32_t shift_short[4][256];
+
+    Crc32cTables()
+    {
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t crc = n;
+            for (int k = 0; k < 8; k++)
+                crc = crc & 1 ? (crc >> 1) ^ CRC32C_POLY : crc >> 1;
+            bytes[0][n] = crc;
+        }
+        for (uint32_t n = 0; n < 256; n++)
+            for (int k = 1; k < 8; k++)
+                bytes[k][n] = (bytes[k - 1][n] >> 8) ^ bytes[0][bytes[k - 1][n] & 0xff];
+        uint32_t xl = xpow8n(CRC32C_LONG), xs = xpow8n(CRC32C_SHORT);
+        for (uint32_t n = 0; n < 256; n++)
+            for (int k = 0; k < 4; k++)
+            {
+                shift_long[k][n] = multmodp(xl, n << (8 * k));
+                shift_short[k][n] = multmodp(xs, n << (8 * k));
+            }
+    }
+};
+
+static const Crc32cTables &tables()
+{
+    static const Crc32cTables t; // thread safe initialization
+    return t;
+}
+
+uint32_t crc32c_scalar(uint32_t crc, const void *data, size_t len)
+{
+    const Crc32cTables &t = tables();
+    const uint8_t *p = (const uint8_t *)data;
+    crc = ~crc;
+    for (; len >= 8; len -= 8, p += 8)
+    {
+        uint64_t w;
+        memcpy(&w, p, sizeof(w)); // little endian
+        w ^= crc;
+        crc = t.bytes[7][w & 0xff] ^ t.bytes[6][(w >> 8) & 0xff] ^ t.bytes[5][(w >> 16) & 0xff] ^ t.bytes[4][(w >> 24) & 0xff] ^
+              t.bytes[3][(w >> 32) & 0xff] ^ t.bytes[2][(w >> 40) & 0xff] ^ t.bytes[1][(w >> 48) & 0xff] ^ t.bytes[0][w >> 56];
+    }
+    for (; len; len--)
+        crc = t.bytes[0][(crc ^ *p++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+#ifdef CRC32C_X86
+static inline uint32_t shift(const uint32_t table[4][256], uint32_t crc)
+{
+    return table[0][crc & 0xff] ^ table[1][(crc >> 8) & 0xff] ^ table[2][(crc >> 16) & 0xff] ^ table[3][crc >> 24];
+}
+
+__attribute__((target("sse4.2"))) static inline uint64_t load64(const uint8_t *p)
+{
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    return w;
+}
+
+// three streams of block bytes each, len >= 3 * block
+__attribute__((target("sse4.2"))) static uint32_t crc32c_streams(uint32_t crc, const uint8_t *&p, size_t &len, size_t block, const uint32_t table[4][256])
+{
+    while (len >= 3 * block)
+    {
+        uint64_t c0 = crc, c1 = 0, c2 = 0;
+        const uint8_t *end = p + block;
+        do
+        {
+            c0 = _mm_crc32_u64(c0, load64(p));
+            c1 = _mm_crc32_u64(c1, load64(p + block));
+            c2 = _mm_crc32_u64(c2, load64(p + 2 * block));
+            p += 8;
+        } while (p < end);
+        crc = shift(table, shift(table, c0) ^ c1) ^ c2;
+        p += 2 * block;
+        len -= 3 * block;
+    }
+    return crc;
+}
+
+__attribute__((target("sse4.2"))) static uint32_t crc32c_sse42(uint32_t crc, const void *data, size_t len)
+{
+    const Crc32cTables &t = tables();
+    const uint8_t *p = (const uint8_t *)data;
+    crc = ~crc;
+    for (; len && ((uintptr_t)p & 7); len--)
+        crc = _mm_crc32_u8(crc, *p++);
+    crc = crc32c_streams(crc, p, len, CRC32C_LONG, t.shift_long);
+    crc = crc32c_streams(crc, p, len, CRC32C_SHORT, t.shift_short);
+    uint64_t c = crc;
+    for (; len >= 8; len -= 8, p += 8)
+        c = _mm_crc32_u64(c, load64(p));
+    crc = c;
+    for (; len; len--)
+        crc = _mm_crc32_u8(crc, *p++);
+    return ~crc;
+}
+
+static bool have_sse42()
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse4.2");
+}
+#endif
+
+static bool use_hw()
+{
+#ifdef CRC32C_X86
+    static const bool hw = have_sse42(); // thread safe initialization
+    return hw;
+#else
+    return false;
+#endif
+}
+
+uint32_t crc32c(uint32_t crc, const void *data, size_t len)
+{
+#ifdef CRC32C_X86
+    if (use_hw())
+        return crc32c_sse42(crc, data, len);
+#endif
+    return crc32c_scalar(crc, data, len);
+}
+
+const char *crc32c_isa()
+{
+    return use_hw() ? "sse4.2" : "scalar";
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief CRC32C (Castagnoli polynomial, as in iSCSI and ext4) of len bytes,
+ * continuing from crc (0 to start).
+ *
+ * Uses the SSE4.2 crc32 instruction on three interleaved streams where the CPU
+ * has it, a slice-by-8 table otherwise; both give the same result.
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t len);
+
+/**
+ * @brief Table driven implementation of crc32c.
+ */
+uint32_t crc32c_scalar(uint32_t crc, const void *data, size_t len);
+
+/**
+ * @brief Name of the implementation crc32c uses.
+ */
+const char *crc32c_isa();
@@ -0,0 +1,343 @@
+#include "demosaic.hpp"
+
+#include <algorithm>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define DEMOSAIC_X86
+#endif
+
+// Every output pixel is built from its 3 x 3 neighbourhood:
+//   h2 = avg(left, right), v2 = avg(up, down), cross = avg(h2, v2),
+//   diag = avg(avg(up left, up right), avg(down left, down right))
+// In a row holding red (or blue) pixels, the red (blue) sites keep their own
+// value, take cross (or the smoother of h2 / v2) for green and diag for the
+// colour of the other row type. Green sites take h2 for the row's colour and
+// v2 for the other one. All averages round up like pavgb / pavgw, so the
+// scalar and the vector paths produce identical output.
+
+static bool has_avx2()
+{
+#ifdef DEMOSAIC_X86
+    static const bool avx2 = []
+    {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }();
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+// position of the red pixel in the 2 x 2 cell
+static void red_position(BayerPattern pattern, uint32_t &rx, uint32_t &ry)
+{
+    switch (pattern)
+    {
+    default:
+    case BAYER_RG:
+        rx = 0, ry = 0;
+        break;
+    case BAYER_GR:
+        rx = 1, ry = 0;
+        break;
+    case BAYER_GB:
+        rx = 0, ry = 1;
+        break;
+    case BAYER_BG:
+        rx = 1, ry = 1;
+        break;
+    }
+}
+
+template <typename T>
+static inline T avg(T a, T b)
+{
+    return (T)(((uint32_t)a + b + 1) >> 1);
+}
+
+template <typename T>
+static inline uint32_t absdiff(T a, T b)
+{
+    return a > b ? a - b : b - a;
+}
+
+// Pixels [x0, x1) of one output row. up and dn are the (mirrored) neighbouring
+// rows, nat is the x parity of the red / blue sites in this row.
+template <typename T>
+static void row_scalar(T *out, const T *up, const T *cur, const T *dn, uint32_t width, uint32_t x0, uint32_t x1, uint32_t nat, bool red_row, bool edge)
+{
+    for (uint32_t x = x0; x < x1; x++)
+    {
+        uint32_t xl = x > 0 ? x - 1 : 1;
+        uint32_t xr = x + 1 < width ? x + 1 : width - 2;
+        T h2 = avg(cur[xl], cur[xr]);
+        T v2 = avg(up[x], dn[x]);
+        T own, g, other;
+        if ((x & 1) == nat)
+        {
+            own = cur[x];
+            uint32_t gh = absdiff(cur[xl], cur[xr]);
+            uint32_t gv = absdiff(up[x], dn[x]);
+            if (edge && gh < gv)
+                g = h2;
+            else if (edge && gv < gh)
+                g = v2;
+            else
+                g = avg(h2, v2);
+            other = avg(avg(up[xl], up[xr]), avg(dn[xl], dn[xr]));
+        }
+        else
+        {
+            own = h2;
+            g = cur[x];
+            other = v2;
+        }
+        T *px = out + 3 * x;
+        px[0] = red_row ? own : other;
+        px[1] = g;
+        px[2] = red_row ? other : own;
+    }
+}
+
+#ifdef DEMOSAIC_X86
+// pshufb masks interleaving 16 byte planes (R, G, B) into 48 bytes of RGB,
+// mask[k][c] places plane c into output block k. elem is the sample size.
+struct InterleaveMasks
+{
+    uint8_t mask[3][3][16];
+
+    InterleaveMasks(uint32_t elem)
+    {
+        for (uint32_t k = 0; k < 3; k++)
+            for (uint32_t c = 0; c < 3; c++)
+                for (uint32_t b = 0; b < 16; b++)
+                {
+                    uint32_t n = (16 * k + b) / elem; // sample index in the output
+                    mask[k][c][b] = (n % 3 == c) ? (uint8_t)((n / 3) * elem + b % elem) : 0x80;
+                }
+    }
+};
+
+__attribute__((target("avx2"))) static inline void interleave3(uint8_t *out, __m128i r, __m128i g, __m128i b, const InterleaveMasks &m)
+{
+    for (int k = 0; k < 3; k++)
+    {
+        __m128i v = _mm_or_si128(_mm_or_si128(_mm_shuffle_epi8(r, _mm_loadu_si128((const __m128i *)m.mask[k][0])),
+                                              _mm_shuffle_epi8(g, _mm_loadu_si128((const __m128i *)m.mask[k][1]))),
+                                 _mm_shuffle_epi8(b, _mm_loadu_si128((const __m128i *)m.mask[k][2])));
+        _mm_storeu_si128((__m128i *)(out + 16 * k), v);
+    }
+}
+
+// 32 pixels per step, returns the first pixel not written
+__attribute__((target("avx2"))) static uint32_t row_avx2_u8(uint8_t *out, const uint8_t *up, const uint8_t *cur, const uint8_t *dn, uint32_t width, uint32_t x, uint32_t nat, bool red_row, bool edge)
+{
+    static const InterleaveMasks masks(1);
+    // lanes holding red / blue sites, x is odd here so lane i is at parity (i + 1) & 1
+    const __m256i natmask = nat ? _mm256_set1_epi16(0x00ff) : _mm256_set1_epi16((short)0xff00);
+    for (; x + 33 <= width; x += 32)
+    {
+        __m256i c = _mm256_loadu_si256((const __m256i *)(cur + x));
+        __m256i l = _mm256_loadu_si256((const __m256i *)(cur + x - 1));
+        __m256i r = _mm256_loadu_si256((const __m256i *)(cur + x + 1));
+        __m256i u = _mm256_loadu_si256((const __m256i *)(up + x));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dn + x));
+        __m256i ul = _mm256_loadu_si256((const __m256i *)(up + x - 1));
+        __m256i ur = _mm256_loadu_si256((const __m256i *)(up + x + 1));
+        __m256i dl = _mm256_loadu_si256((const __m256i *)(dn + x - 1));
+        __m256i dr = _mm256_loadu_si256((const __m256i *)(dn + x + 1));
+        __m256i h2 = _mm256_avg_epu8(l, r);
+        __m256i v2 = _mm256_avg_epu8(u, d);
+        __m256i cross = _mm256_avg_epu8(h2, v2);
+        __m256i g = cross;
+        if (edge)
+        {
+            __m256i gh = _mm256_or_si256(_mm256_subs_epu8(l, r), _mm256_subs_epu8(r, l));
+            __m256i gv = _mm256_or_si256(_mm256_subs_epu8(u, d), _mm256_subs_epu8(d, u));
+            __m256i hge = _mm256_cmpeq_epi8(_mm256_max_epu8(gh, gv), gh); // gh >= gv
+            __m256i vge = _mm256_cmpeq_epi8(_mm256_max_epu8(gh, gv), gv); // gv >= gh
+            g = _mm256_blendv_epi8(g, h2, vge);                          // gh <= gv
+            g = _mm256_blendv_epi8(g, v2, hge);                          // gv <= gh
+            g = _mm256_blendv_epi8(g, cross, _mm256_and_si256(hge, vge));
+        }
+        __m256i diag = _mm256_avg_epu8(_mm256_avg_epu8(ul, ur), _mm256_avg_epu8(dl, dr));
+        __m256i own = _mm256_blendv_epi8(h2, c, natmask);
+        __m256i green = _mm256_blendv_epi8(c, g, natmask);
+        __m256i other = _mm256_blendv_epi8(v2, diag, natmask);
+        __m256i red = red_row ? own : other;
+        __m256i blue = red_row ? other : own;
+        uint8_t *px = out + 3 * x;
+        interleave3(px, _mm256_castsi256_si128(red), _mm256_castsi256_si128(green), _mm256_castsi256_si128(blue), masks);
+        interleave3(px + 48, _mm256_extracti128_si256(red, 1), _mm256_extracti128_si256(green, 1), _mm256_extracti128_si256(blue, 1), masks);
+    }
+    return x;
+}
+
+// 16 pixels per step, returns the first pixel not written
+__attribute__((target("avx2"))) static uint32_t row_avx2_u16(uint16_t *out, const uint16_t *up, const uint16_t *cur, const uint16_t *dn, uint32_t width, uint32_t x, uint32_t nat, bool red_row, bool edge)
+{
+    static const InterleaveMasks masks(2);
+    const __m256i natmask = nat ? _mm256_set1_epi32(0x0000ffff) : _mm256_set1_epi32((int)0xffff0000);
+    for (; x + 17 <= width; x += 16)
+    {
+        __m256i c = _mm256_loadu_si256((const __m256i *)(cur + x));
+        __m256i l = _mm256_loadu_si256((const __m256i *)(cur + x - 1));
+        __m256i r = _mm256_loadu_si256((const __m256i *)(cur + x + 1));
+        __m256i u = _mm256_loadu_si256((const __m256i *)(up + x));
+        __m256i d = _mm256_loadu_si256((const __m256i *)(dn + x));
+        __m256i ul = _mm256_loadu_si256((const __m256i *)(up + x - 1));
+        __m256i ur = _mm256_loadu_si256((const __m256i *)(up + x + 1));
+        __m256i dl = _mm256_loadu_si256((const __m256i *)(dn + x - 1));
+        __m256i dr = _mm256_loadu_si256((const __m256i *)(dn + x + 1));
+        __m256i h2 = _mm256_avg_epu16(l, r);
+        __m256i v2 = _mm256_avg_epu16(u, d);
+        __m256i cross = _mm256_avg_epu16(h2, v2);
+        __m256i g = cross;
+        if (edge)
+        {
+            __m256i gh = _mm256_or_si256(_mm256_subs_epu16(l, r), _mm256_subs_epu16(r, l));
+            __m256i gv = _mm256_or_si256(_mm256_subs_epu16(u, d), _mm256_subs_epu16(d, u));
+            __m256i hge = _mm256_cmpeq_epi16(_mm256_max_epu16(gh, gv), gh);
+            __m256i vge = _mm256_cmpeq_epi16(_mm256_max_epu16(gh, gv), gv);
+            g = _mm256_blendv_epi8(g, h2, vge);
+            g = _mm256_blendv_epi8(g, v2, hge);
+            g = _mm256_blendv_epi8(g, cross, _mm256_and_si256(hge, vge));
+        }
+        __m256i diag = _mm256_avg_epu16(_mm256_avg_epu16(ul, ur), _mm256_avg_epu16(dl, dr));
+        __m256i own = _mm256_blendv_epi8(h2, c, natmask);
+        __m256i green = _mm256_blendv_epi8(c, g, natmask);
+        __m256i other = _mm256_blendv_epi8(v2, diag, natmask);
+        __m256i red = red_row ? own : other;
+        __m256i blue = red_row ? other : own;
+        uint8_t *px = (uint8_t *)(out + 3 * x);
+        interleave3(px, _mm256_castsi256_si128(red), _mm256_castsi256_si128(green), _mm256_castsi256_si128(blue), masks);
+        interleave3(px + 48, _mm256_extracti128_si256(red, 1), _mm256_extracti128_si256(green, 1), _mm256_extracti128_si256(blue, 1), masks);
+    }
+    return x;
+}
+#endif
+
+template <typename T>
+static void demosaic_rows(T *dst, const T *src, uint32_t width, uint32_t height, BayerPattern pattern, DemosaicMethod method, uint32_t y0, uint32_t y1, uint32_t (*row_simd)(T *, const T *, const T *, const T *, uint32_t, uint32_t, uint32_t, bool, bool))
+{
+    if (width < 2 || height < 2)
+        return;
+    uint32_t rx, ry;
+    red_position(pattern, rx, ry);
+    bool edge = method == DEMOSAIC_EDGE;
+    y1 = std::min(y1, height);
+    for (uint32_t y = y0; y < y1; y++)
+    {
+        // mirroring keeps the colour of the neighbouring rows
+        const T *cur = src + (size_t)y * width;
+        const T *up = src + (size_t)(y > 0 ? y - 1 : 1) * width;
+        const T *dn = src + (size_t)(y + 1 < height ? y + 1 : height - 2) * width;
+        T *out = dst + (size_t)y * width * 3;
+        bool red_row = (y & 1) == ry;
+        uint32_t nat = red_row ? rx : rx ^ 1;
+        uint32_t x = 1;
+        row_scalar(out, up, cur, dn, width, 0, 1, nat, red_row, edge);
+        if (row_simd)
+            x = row_simd(out, up, cur, dn, width, 1, nat, red_row, edge);
+        row_scalar(out, up, cur, dn, width, x, width, nat, red_row, edge);
+    }
+}
+
+void demosaic_rows_u8(uint8_t *dst, const uint8_t *src, uint32_t width, uint32_t height, BayerPattern pattern, DemosaicMethod method, uint32_t y0, uint32_t y1)
+{
+    uint32_t (*row_simd)(uint8_t *, const uint8_t *, const uint8_t *, const uint8_t *, uint32_t, uint32_t, uint32_t, bool, bool) = nullptr;
+#ifdef DEMOSAIC_X86
+    if (has_avx2())
+        row_simd = row_avx2_u8;
+#endif
+    demosaic_rows<uint8_t>(dst, src, width, height, pattern, method, y0, y1, row_simd);
+}
+
+void demosaic_rows_u16(uint16_t *dst, const uint16_t *src, uint32_t width, uint32_t height, BayerPattern pattern, DemosaicMethod method, uint32_t y0, uint32_t y1)
+{
+    uint32_t (*row_simd)(uint16_t *, const uint16_t *, const uint16_t *, const uint16_t *, uint32_t, uint32_t, uint32_t, bool, bool) = nullptr;
+#ifdef DEMOSAIC_X86
+    if (has_avx2())
+        row_simd = row_avx2_u16;
+#endif
+    demosaic_rows<uint16_t>(dst, src, width, height, pattern, method, y0, y1, row_simd);
+}
+
+void demosaic_rows_u8_scalar(uint8_t *dst, const uint8_t *src, uint32_t width, uint32_t height, BayerPattern pattern, DemosaicMethod method, uint32_t y0, uint32_t y1)
+{
+    demosaic_rows<uint8_t>(dst, src, width, height, pattern, method, y0, y1, nullptr);
+}
+
+void demosaic_rows_u16_scalar(uint16_t *dst, const uint16_t *src, uint32_t width, uint32_t height, BayerPattern pattern, DemosaicMethod method, uint32_t y0, uint32_t y1)
+{
+    demosaic_rows<uint16_t>(dst, src, width, height, pattern, method, y0, y1, nullptr);
+}
+
+// rows per band, small enough to balance the load and keep the bands in cache
+#define DEMOSAIC_BAND_ROWS 64
+
+static uint32_t band_count(ThreadPool &pool, uint32_t rows)
+{
+    uint32_t bands = (rows + DEMOSAIC_BAND_ROWS - 1) / DEMOSAIC_BAND_ROWS;
+    return std::max(1u, std::min(bands, 4 * (pool.size() + 1)));
+}
+
+void demosaic_u8(ThreadPool &pool, uint8_t *dst, const uint8_t *src, uint32_t width, uint32_t height, BayerPattern pattern, DemosaicMethod method)
+{
+    uint32_t bands = band_count(pool, height);
+    uint32_t rows = (height + bands - 1) / bands;
+    pool.parallel_for(bands, [&](uint32_t i)
+                      { demosaic_rows_u8(dst, src, width, height, pattern, method, i * rows, std::min(height, (i + 1) * rows)); });
+}
+
+void demosaic_u16(ThreadPool &pool, uint16_t *dst, const uint16_t *src, uint32_t width, uint32_t height, BayerPattern pattern, DemosaicMethod method)
+{
+    uint32_t bands = band_count(pool, height);
+    uint32_t rows = (height + bands - 1) / bands;
+    pool.parallel_for(bands, [&](uint32_t i)
+                      { demosaic_rows_u16(dst, src, width, height, pattern, method, i * rows, std::min(height, (i + 1) * rows)); });
+}
+
+template <typename T>
+static void superpixel_rows(T *dst, const T *src, uint32_t width, uint32_t rx, uint32_t ry, uint32_t oy0, uint32_t oy1)
+{
+    uint32_t owidth = width / 2;
+    for (uint32_t oy = oy0; oy < oy1; oy++)
+    {
+        const T *rrow = src + (size_t)(2 * oy + ry) * width; // row with the red pixels
+        const T *brow = src + (size_t)(2 * oy + (ry ^ 1)) * width;
+        T *out = dst + (size_t)oy * owidth * 3;
+        for (uint32_t ox = 0; ox < owidth; ox++)
+        {
+            uint32_t x = 2 * ox;
+            out[0] = rrow[x + rx];
+            out[1] = avg(rrow[x + (rx ^ 1)], brow[x + rx]);
+            out[2] = brow[x + (rx ^ 1)];
+            out += 3;
+        }
+    }
+}
+
+template <typename T>
+static void superpixel(ThreadPool &pool, T *dst, const T *src, uint32_t width, uint32_t height, BayerPattern pattern)
+{
+    uint32_t rx, ry;
+    red_position(pattern, rx, ry);
+    uint32_t oheight = height / 2;
+    uint32_t bands = band_count(pool, oheight);
+    uint32_t rows = (oheight + bands - 1) / bands;
+    pool.parallel_for(bands, [&](uint32_t i)
+                      { superpixel_rows(dst, src, width, rx, ry, i * rows, std::min(oheight, (i + 1) * rows)); });
+}
+
+void demosaic_superpixel_u8(ThreadPool &pool, uint8_t *dst, const uint8_t *src, uint32_t width, uint32_t height, BayerPattern pattern)
+{
+    superpixel<uint8_t>(pool, dst, src, width, height, pattern);
+}
+
+void demosaic_superpixel_u16(ThreadPool &pool, uint16_t *dst, const uint16_t *src, uint32_t width, uint32_t height, BayerPattern pattern)
+{
+    superpixel<uint16_t>(pool, dst, src, width, height, pattern);
+}
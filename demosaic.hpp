@@ -0,0 +1,64 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#include "threadpool.hpp"
+
+/**
+ * @brief Colour filter layout, named after the first two pixels of the first row.
+ */
+enum BayerPattern
+{
+    BAYER_RG = 0,
+    BAYER_GR,
+    BAYER_GB,
+    BAYER_BG,
+};
+
+enum DemosaicMethod
+{
+    DEMOSAIC_BILINEAR = 0,
+    DEMOSAIC_EDGE, // interpolate green along the direction with the smaller gradient
+};
+
+/**
+ * @brief Demosaic rows [y0, y1) of a width x height 8 bit Bayer image into interleaved RGB8.
+ *
+ * Neighbours outside the image are mirrored. dst points to the start of the
+ * full output image. width and height must be at least 2.
+ */
+void demosaic_rows_u8(uint8_t *dst, const uint8_t *src, uint32_t width, uint32_t height, BayerPattern pattern, DemosaicMethod method, uint32_t y0, uint32_t y1);
+
+/**
+ * @brief 16 bit version of demosaic_rows_u8, writes interleaved RGB16.
+ */
+void demosaic_rows_u16(uint16_t *dst, const uint16_t *src, uint32_t width, uint32_t height, BayerPattern pattern, DemosaicMethod method, uint32_t y0, uint32_t y1);
+
+/**
+ * @brief Scalar reference implementations of demosaic_rows_u8 / _u16, the
+ * AVX2 paths give identical output.
+ */
+void demosaic_rows_u8_scalar(uint8_t *dst, const uint8_t *src, uint32_t width, uint32_t height, BayerPattern pattern, DemosaicMethod method, uint32_t y0, uint32_t y1);
+void demosaic_rows_u16_scalar(uint16_t *dst, const uint16_t *src, uint32_t width, uint32_t height, BayerPattern pattern, DemosaicMethod method, uint32_t y0, uint32_t y1);
+
+/**
+ * @brief Demosaic a full image, split into row bands across the thread pool.
+ */
+void demosaic_u8(ThreadPool &pool, uint8_t *dst, const uint8_t *src, uint32_t width, uint32_t height, BayerPattern pattern, DemosaicMethod method);
+
+/**
+ * @brief 16 bit version of demosaic_u8.
+ */
+void demosaic_u16(ThreadPool &pool, uint16_t *dst, const uint16_t *src, uint32_t width, uint32_t height, BayerPattern pattern, DemosaicMethod method);
+
+/**
+ * @brief Turn every 2 x 2 Bayer cell into one RGB pixel ((width / 2) x (height / 2) output).
+ *
+ * Used when the display is decimated anyway; much cheaper than a full demosaic.
+ */
+void demosaic_superpixel_u8(ThreadPool &pool, uint8_t *dst, const uint8_t *src, uint32_t width, uint32_t height, BayerPattern pattern);
+
+/**
+ * @brief 16 bit version of demosaic_superpixel_u8.
+ */
+void demosaic_superpixel_u16(ThreadPool &pool, uint16_t *dst, const uint16_t *src, uint32_t width, uint32_t height, BayerPattern pattern);
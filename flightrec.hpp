@@ -0,0 +1,529 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "arena.hpp"
+#include "framepool.hpp"
+#include "recfile.hpp"
+
+#define FLIGHTREC_IDLE_CLOSE_NS 1000000000ULL // close the post-trigger window this long after it ended without frames
+#define FLIGHTREC_HEADROOM_SLOTS 4              // fewest slots a dump leaves between the trigger frame and its own start
+#define FLIGHTREC_OPEN_NS 50000000ULL           // writer start-up assumed until a dump has measured it: wake, open, header
+
+/**
+ * @brief Pre-trigger ring of the most recent frames, dumped to a recording on demand.
+ *
+ * The ring lives in one Arena of budget bytes, so that storing a frame never
+ * faults. Every slot is laid out exactly like a record of a
+ * recording (see recfile.hpp) and is RECFILE_ALIGN aligned, so a dump writes
+ * slots straight from the arena with O_DIRECT, without copying them.
+ *
+ * push() runs in the camera callback, copies the frame into the next slot and
+ * never blocks. trigger() may be called from any thread; the camera callback
+ * picks it up with the next frame and marks the frames of the last pre_s
+ * seconds and of the following post_s seconds for the dump. The writer
+ * thread writes them out while the ring keeps filling behind it; only when
+ * the ring wraps onto a slot that has not been written yet is the incoming
+ * frame dropped, capture itself is never held up.
+ */
+class FlightRecorder
+{
+private:
+    Arena mem;
+    uint8_t *arena = nullptr; // file header block, then the slots
+    size_t slot_size = 0;
+    uint64_t nslots = 0;
+
+    std::atomic<bool> running{false}; // writer thread alive
+    std::atomic<bool> armed{false};   // arena ready, push() stores frames
+    std::atomic<uint32_t> pushing{0};
+    std::thread writer;
+    sem_t wake;
+
+    // producer (camera callback) side
+    std::atomic<uint64_t> head{0}; // next sequence number to store
+    std::atomic<bool> trig_req{false};
+    std::atomic<uint64_t> trig_ns{0};
+    // dump state, set up by the producer, consumed by the writer
+    std::atomic<bool> dumping{false};
+    std::atomic<uint64_t> dump_start{0};
+    std::atomic<uint64_t> dump_next{0};           // next sequence number to write
+    std::atomic<uint64_t> dump_end{UINT64_MAX};   // first sequence number past the dump, once known
+    std::atomic<uint64_t> post_end_ns{0};
+    std::atomic<uint64_t> open_ns{0};  // writer, time open_dump() took last
+    std::atomic<uint64_t> write_ns{0}; // writer, average time to write one slot
+
+    // configuration, set while disarmed
+    size_t budget = 0;
+    size_t frame_size = 0;
+    double pre_s = 5;
+    double post_s = 5;
+
+    // writer side
+    int fd = -1;
+    bool direct = false;
+    FILE *idx = nullptr;
+    bool failed = false;
+    uint64_t written_offset = 0;
+    RecFileHeader header; // of the next dump
+
+    std::mutex mtx; // guards the strings below
+    std::string dir;
+    std::string prefix;
+    std::string path; // last dump
+    std::string errmsg;
+
+    uint8_t *slot(uint64_t seq) const
+    {
+        return arena + RECFILE_HEADER_SIZE + (seq % nslots) * slot_size;
+    }
+
+    void set_error(const std::string &where, int err)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        errmsg = where + ": " + strerror(err);
+    }
+
+    bool alloc_arena()
+    {
+        int err = mem.alloc(budget);
+        if (err)
+        {
+            set_error("Arena", err);
+            return false;
+        }
+        arena = mem.data();
+        return true;
+    }
+
+    void free_arena()
+    {
+        mem.free();
+        arena = nullptr;
+        nslots = 0;
+    }
+
+    // stop including frames at end; the producer does it by time, the writer if the camera went quiet
+    void close_window(uint64_t end)
+    {
+        uint64_t open = UINT64_MAX;
+        dump_end.compare_exchange_strong(open, end, std::memory_order_acq_rel);
+    }
+
+    /**
+     * @brief Producer only, before storing frame h: the frames of the last
+     * pre_s seconds start the dump. Frame h + k reuses the slot of frame
+     * h + k - nslots, so a dump starting at the oldest frame in a full ring
+     * would have the trigger frame and the ones after it dropped until the
+     * writer frees their slots. The dump starts at least headroom slots
+     * later instead: the frames arriving while the writer starts up and
+     * writes its first slot, measured on the last dump. The oldest
+     * pre-trigger frames are given up for the trigger frame, and only if
+     * pre_s reaches that far back.
+     */
+    void start_dump(uint64_t h)
+    {
+        uint64_t t = trig_ns.load();
+        uint64_t from = t - std::min(t, (uint64_t)(pre_s * 1e9));
+        uint64_t headroom = FLIGHTREC_HEADROOM_SLOTS;
+        if (h >= 2)
+        {
+            uint64_t first = h > nslots ? h - nslots : 0;
+            uint64_t span = ((const RecFrameHeader *)slot(h - 1))->host_ns - ((const RecFrameHeader *)slot(first))->host_ns;
+            uint64_t interval = span / (h - 1 - first); // nslots >= 2, so at least one interval
+            uint64_t ns = (open_ns ? open_ns.load() : FLIGHTREC_OPEN_NS) + write_ns;
+            if (interval)
+                headroom = std::max(headroom, (ns + interval - 1) / interval);
+        }
+        headroom = std::min(headroom, nslots);
+        uint64_t oldest = h + headroom > nslots ? h + headroom - nslots : 0; // seq h + headroom overwrites it
+        oldest = std::min(oldest, h);
+        uint64_t start = h;
+        while (start > oldest && ((const RecFrameHeader *)slot(start - 1))->host_ns >= from)
+            start--;
+        dump_start = start;
+        dump_next.store(start, std::memory_order_relaxed);
+        dump_end.store(UINT64_MAX, std::memory_order_relaxed);
+        post_end_ns = t + (uint64_t)(post_s * 1e9);
+        dumping.store(true, std::memory_order_release);
+        sem_post(&wake);
+    }
+
+    bool store(const FrameHandle &frame, const RecFrameHeader &meta)
+    {
+        const FrameInfo &info = frame.info();
+        if (info.size > frame_size)
+        {
+            oversize++;
+            return false;
+        }
+        uint64_t h = head.load(std::memory_order_relaxed);
+        if (trig_req.load(std::memory_order_acquire))
+        {
+            trig_req = false;
+            if (!dumping.load(std::memory_order_acquire)) // one dump at a time
+                start_dump(h);
+        }
+        if (dumping.load(std::memory_order_acquire))
+        {
+            uint64_t end = dump_end.load(std::memory_order_acquire);
+            if (end == UINT64_MAX && meta.host_ns > post_end_ns.load())
+            {
+                close_window(h);
+                end = dump_end.load(std::memory_order_acquire);
+            }
+            // slot h held frame h - nslots, which may still have to be written
+            if (h >= nslots && h - nslots >= dump_next.load(std::memory_order_acquire) && h - nslots < end)
+            {
+                dropped++; // in the post-trigger window or not, the frame is lost
+                return false;
+            }
+        }
+        RecFrameHeader *hdr = (RecFrameHeader *)slot(h);
+        *hdr = meta;
+        hdr->data_size = info.size;
+        hdr->raw_size = info.size;
+        hdr->record_size = recfile_record_size(info.size);
+        hdr->frameID = info.frameID;
+        hdr->timestamp = info.timestamp;
+        hdr->width = info.width;
+        hdr->height = info.height;
+        hdr->pixelFormat = info.pixelFormat;
+        hdr->status = info.status;
+        uint8_t *data = (uint8_t *)hdr + RECFILE_FRAME_HEADER_SIZE;
+        memcpy(data, frame.data(), info.size);
+        memset(data + info.size, 0, hdr->record_size - RECFILE_FRAME_HEADER_SIZE - info.size);
+        head.store(h + 1, std::memory_order_release);
+        if (dumping.load(std::memory_order_relaxed))
+            sem_post(&wake);
+        return true;
+    }
+
+    bool open_dump()
+    {
+        char stamp[32];
+        time_t now = time(NULL);
+        struct tm tm;
+        strftime(stamp, sizeof(stamp), "%Y%m%d_%H%M%S", localtime_r(&now, &tm));
+        std::string fname;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            fname = dir + "/" + prefix + "_" + stamp + "_trigger" + RECFILE_EXT;
+            path = fname;
+        }
+        failed = false;
+        uint64_t t0 = recfile_now_ns();
+        fd = recfile_create(fname.c_str(), direct);
+        if (fd < 0)
+        {
+            set_error("Open " + fname, errno);
+            failed = true;
+            return false;
+        }
+        idx = fopen((fname + RECFILE_INDEX_EXT).c_str(), "wb");
+        RecFileHeader *hdr = (RecFileHeader *)arena;
+        hdr->created_ns = recfile_now_ns();
+        RecIndexHeader ih;
+        ih.created_ns = hdr->created_ns;
+        if (idx == nullptr || fwrite(&ih, sizeof(ih), 1, idx) != 1)
+        {
+            set_error("Open index", errno);
+            failed = true;
+            return false;
+        }
+        // reserve what is already known to go into the file; not all file systems can
+        uint64_t known = (head.load() - dump_start.load()) * slot_size;
+        fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, RECFILE_HEADER_SIZE + known);
+        int err = recfile_pwrite(fd, arena, RECFILE_HEADER_SIZE, 0, direct);
+        if (err)
+        {
+            set_error("Write", err);
+            failed = true;
+            return false;
+        }
+        written_offset = RECFILE_HEADER_SIZE;
+        open_ns = recfile_now_ns() - t0;
+        return true;
+    }
+
+    void write_slot(uint64_t seq)
+    {
+        if (failed)
+            return;
+        RecFrameHeader *hdr = (RecFrameHeader *)slot(seq);
+        hdr->index = seq - dump_start.load();
+        recfile_set_crc(*hdr, (const uint8_t *)hdr + RECFILE_FRAME_HEADER_SIZE);
+        RecIndexEntry entry = {written_offset, hdr->frameID, hdr->timestamp, hdr->host_ns};
+        uint64_t t0 = recfile_now_ns();
+        int err = recfile_pwrite(fd, (const uint8_t *)hdr, hdr->record_size, written_offset, direct);
+        if (err)
+        {
+            set_error("Write", err);
+            failed = true;
+            return;
+        }
+        if (fwrite(&entry, sizeof(entry), 1, idx) != 1)
+        {
+            set_error("Index", errno);
+            failed = true;
+            return;
+        }
+        uint64_t ns = recfile_now_ns() - t0;
+        write_ns = write_ns ? (write_ns * 7 + ns) / 8 : ns;
+        written_offset += hdr->record_size;
+        frames_dumped++;
+        bytes_dumped += hdr->record_size;
+    }
+
+    void finish_dump()
+    {
+        if (fd >= 0)
+            close(fd);
+        if (idx && fclose(idx) != 0 && !failed)
+            set_error("Index", errno);
+        fd = -1;
+        idx = nullptr;
+        if (!failed)
+            dumps++;
+    }
+
+    static void ThreadFcn(FlightRecorder *self)
+    {
+        if (!self->alloc_arena())
+        {
+            self->running = false;
+            return;
+        }
+        self->nslots = (self->mem.size() - RECFILE_HEADER_SIZE) / self->slot_size;
+        if (self->nslots < 2)
+        {
+            self->set_error("Arena", ENOMEM);
+            self->free_arena();
+            self->running = false;
+            return;
+        }
+        memcpy(self->arena, &self->header, sizeof(self->header));
+        self->armed = true;
+        while (true)
+        {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_nsec += 100000000; // 100 ms
+            if (ts.tv_nsec >= 1000000000)
+            {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000;
+            }
+            sem_timedwait(&self->wake, &ts);
+            bool stop = !self->running.load();
+            if (!self->dumping.load(std::memory_order_acquire))
+            {
+                if (stop)
+                    break;
+                continue;
+            }
+            if (self->fd < 0 && !self->failed)
+                self->open_dump();
+            // the camera stopped or we are shutting down, nobody else will end the window
+            if (stop || recfile_now_ns() > self->post_end_ns.load() + FLIGHTREC_IDLE_CLOSE_NS)
+                self->close_window(self->head.load(std::memory_order_acquire));
+            uint64_t end = self->dump_end.load(std::memory_order_acquire);
+            uint64_t avail = std::min(self->head.load(std::memory_order_acquire), end);
+            uint64_t next = self->dump_next.load(std::memory_order_relaxed);
+            for (; next < avail; next++)
+            {
+                self->write_slot(next);
+                self->dump_next.store(next + 1, std::memory_order_release); // slot may be reused
+            }
+            if (end != UINT64_MAX && next >= end)
+            {
+                self->finish_dump();
+                self->failed = false;
+                self->dumping.store(false, std::memory_order_release);
+            }
+        }
+        self->free_arena();
+    }
+
+public:
+    FlightRecorder()
+    {
+        sem_init(&wake, 0, 0);
+    }
+
+    ~FlightRecorder()
+    {
+        disarm();
+        sem_destroy(&wake);
+    }
+
+    /**
+     * @brief Allocate the arena in the background and start keeping frames once
+     * it is ready (is_armed()). If the allocation fails, is_allocating() turns
+     * false without the recorder getting armed, see error().
+     *
+     * @param header file header for the dumps, describes the camera and the current format
+     * @param budget arena size in bytes
+     * @param frame_size largest frame to keep, bigger ones are skipped
+     * @param dir directory for the dumps, named <prefix>_<date>_<time>_trigger.avr
+     */
+    bool arm(const RecFileHeader &header, size_t budget, size_t frame_size, double pre_s, double post_s, const std::string &dir, const std::string &prefix)
+    {
+        if (running)
+            return false;
+        if (writer.joinable()) // the last arm() failed
+            writer.join();
+        this->budget = std::max(budget, (size_t)RECFILE_HEADER_SIZE + 2 * recfile_record_size(frame_size));
+        this->frame_size = frame_size;
+        this->slot_size = recfile_record_size(frame_size);
+        this->pre_s = pre_s;
+        this->post_s = post_s;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            this->dir = dir;
+            this->prefix = prefix;
+            errmsg = "";
+        }
+        head = 0;
+        trig_req = false;
+        dumping = false;
+        dump_end = UINT64_MAX;
+        frames_dumped = 0;
+        bytes_dumped = 0;
+        dropped = 0;
+        oversize = 0;
+        this->header = header;
+        running = true;
+        writer = std::thread(ThreadFcn, this);
+        return true;
+    }
+
+    /**
+     * @brief Stop keeping frames, finish a dump in progress and release the arena.
+     */
+    void disarm()
+    {
+        if (!writer.joinable())
+            return;
+        armed = false;
+        while (pushing.load() != 0)
+            std::this_thread::yield();
+        running = false;
+        sem_post(&wake);
+        writer.join();
+    }
+
+    bool is_armed() const
+    {
+        return armed;
+    }
+
+    bool is_allocating() const
+    {
+        return running && !armed;
+    }
+
+    /**
+     * @brief Keep a frame, camera callback only. Never blocks.
+     *
+     * @param hdr host time, exposure, temperatures and statistics of the frame,
+     * as for Recorder::push().
+     * @return false if the frame was not kept.
+     */
+    bool push(const FrameHandle &frame, const RecFrameHeader &hdr)
+    {
+        pushing++;
+        bool ok = false;
+        if (armed.load(std::memory_order_acquire) && frame)
+            ok = store(frame, hdr);
+        pushing--;
+        return ok;
+    }
+
+    /**
+     * @brief Dump the ring and the next post seconds. Ignored while a dump is running.
+     *
+     * @return false if not armed or busy.
+     */
+    bool trigger()
+    {
+        if (!armed || dumping)
+            return false;
+        trig_ns = recfile_now_ns();
+        trig_req = true;
+        return true;
+    }
+
+    bool is_dumping() const
+    {
+        return dumping;
+    }
+
+    /**
+     * @brief Frames held by the ring right now.
+     */
+    uint64_t frames_held() const
+    {
+        return std::min(head.load(), nslots);
+    }
+
+    uint64_t capacity() const
+    {
+        return armed ? nslots : 0;
+    }
+
+    size_t arena_bytes() const
+    {
+        return armed ? mem.size() : 0;
+    }
+
+    bool huge_pages() const
+    {
+        return armed && mem.huge_pages();
+    }
+
+    bool memory_locked() const
+    {
+        return armed && mem.memory_locked();
+    }
+
+    /**
+     * @brief Frames of the running dump written so far and in total, if known yet.
+     */
+    void dump_progress(uint64_t &done, uint64_t &total) const
+    {
+        uint64_t start = dump_start, end = dump_end;
+        done = dump_next - start;
+        total = end == UINT64_MAX ? 0 : end - start;
+    }
+
+    std::string get_path()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return path;
+    }
+
+    std::string error()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return errmsg;
+    }
+
+    std::atomic<uint64_t> dumps{0};
+    std::atomic<uint64_t> frames_dumped{0};
+    std::atomic<uint64_t> bytes_dumped{0};
+    std::atomic<uint64_t> dropped{0};  // not kept because the slot was still waiting for the dump
+    std::atomic<uint64_t> oversize{0}; // larger than a slot, e.g. after a format change
+};
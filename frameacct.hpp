@@ -0,0 +1,244 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <atomic>
+#include <deque>
+#include <string>
+
+#include <VmbC/VmbC.h>
+
+#include "recfile.hpp"
+#include "string_format.hpp"
+
+#define FRAMEACCT_EVENTS 1024     // events between two polls, more are only counted
+#define FRAMEACCT_LOG_LINES 256   // log lines kept for the window
+#define FRAMEACCT_SUPERSEDED_S 10 // superseded frames are logged as a sum at most this often
+
+typedef enum
+{
+    FRAMEEV_LOST = 0,   // frame ID gap, detail: frames missing
+    FRAMEEV_INCOMPLETE, // detail: VmbFrameStatus_t
+    FRAMEEV_DROPPED,    // detail: FrameDropStage
+} FrameEventKind;
+
+typedef enum
+{
+    FRAMEDROP_POOL = 0,        // no free slab to copy the frame into
+    FRAMEDROP_OVERSIZE,        // larger than a pool slab or without a buffer, e.g. after a format change
+    FRAMEDROP_RECORDER,        // recorder queue full
+    FRAMEDROP_FLIGHT,          // flight recorder slot still waiting for the dump
+    FRAMEDROP_FLIGHT_OVERSIZE, // larger than a flight recorder slot
+    FRAMEDROP_BURST_OVERSIZE,  // larger than a burst slot
+    FRAMEDROP_DISPLAY,         // truncated, nothing to show
+} FrameDropStage;
+
+struct FrameEvent
+{
+    uint64_t host_ns; // CLOCK_REALTIME
+    uint64_t frameID;
+    int64_t detail;
+    FrameEventKind kind;
+};
+
+/**
+ * @brief Where frames went missing between the camera and the screen: frame
+ * ID gaps (lost on the wire), incomplete frames, frames dropped by the
+ * pipeline and frames superseded before the display showed them. The camera
+ * callback counts them and queues an event for each; poll() turns the events
+ * into timestamped log lines, kept for the window and written to the log file.
+ */
+class FrameAccounting
+{
+private:
+    FrameEvent events[FRAMEACCT_EVENTS];
+    std::atomic<uint64_t> ev_head{0}; // camera callback
+    std::atomic<uint64_t> ev_tail{0}; // poll()
+    uint64_t last_id = 0;             // camera callback only
+    bool have_id = false;
+    std::string name;
+    FILE *logfp = nullptr;
+    FILE *echo = nullptr;
+    uint64_t superseded_logged = 0;
+    uint64_t superseded_ns = 0;
+    uint64_t unlogged_seen = 0;
+
+    void push(FrameEventKind kind, uint64_t frameID, int64_t detail)
+    {
+        uint64_t h = ev_head.load(std::memory_order_relaxed);
+        if (h - ev_tail.load(std::memory_order_acquire) >= FRAMEACCT_EVENTS)
+        {
+            unlogged++;
+            return;
+        }
+        FrameEvent &ev = events[h % FRAMEACCT_EVENTS];
+        ev.host_ns = recfile_now_ns();
+        ev.frameID = frameID;
+        ev.detail = detail;
+        ev.kind = kind;
+        ev_head.store(h + 1, std::memory_order_release);
+    }
+
+    static const char *status_str(int64_t status)
+    {
+        switch (status)
+        {
+        case VmbFrameStatusIncomplete:
+            return "incomplete";
+        case VmbFrameStatusTooSmall:
+            return "buffer too small";
+        case VmbFrameStatusInvalid:
+            return "invalid";
+        default:
+            return "not complete";
+        }
+    }
+
+    void log(uint64_t host_ns, const std::string &msg)
+    {
+        time_t t = host_ns / 1000000000;
+        struct tm tm;
+        char stamp[32];
+        strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime_r(&t, &tm));
+        std::string line = string_format("%s.%03u [%s] %s", stamp, (unsigned)(host_ns / 1000000 % 1000), name.c_str(), msg.c_str());
+        if (logfp)
+        {
+            fprintf(logfp, "%s\n", line.c_str());
+            fflush(logfp);
+        }
+        if (echo)
+            fprintf(echo, "%s\n", line.c_str());
+        lines.push_back(line);
+        if (lines.size() > FRAMEACCT_LOG_LINES)
+            lines.pop_front();
+    }
+
+public:
+    std::atomic<uint64_t> received{0};
+    std::atomic<uint64_t> lost{0};       // frames missing from frame ID gaps
+    std::atomic<uint64_t> gaps{0};       // frame ID gaps
+    std::atomic<uint64_t> incomplete{0}; // not VmbFrameStatusComplete
+    std::atomic<uint64_t> dropped{0};    // per stage that dropped a frame: pool, recorder, flight recorder, burst or display
+    std::atomic<uint64_t> superseded{0}; // replaced by a newer frame before the display showed them
+    std::atomic<uint64_t> unlogged{0};   // events the queue had no room for
+    std::deque<std::string> lines;       // poll() thread only
+
+    ~FrameAccounting()
+    {
+        if (logfp)
+            fclose(logfp);
+    }
+
+    void set_name(const std::string &name)
+    {
+        this->name = name;
+    }
+
+    /**
+     * @brief Append the log lines to path as well.
+     * @return false with errno set if the file could not be opened.
+     */
+    bool open_log(const std::string &path)
+    {
+        FILE *fp = fopen(path.c_str(), "a");
+        if (fp == nullptr)
+            return false;
+        if (logfp)
+            fclose(logfp);
+        logfp = fp;
+        return true;
+    }
+
+    // print the log lines to fp as well, e.g. stdout when headless
+    void set_echo(FILE *fp)
+    {
+        echo = fp;
+    }
+
+    void reset() // only while no frames are coming in
+    {
+        have_id = false;
+        received = 0;
+        lost = 0;
+        gaps = 0;
+        incomplete = 0;
+        dropped = 0;
+        superseded = 0;
+        unlogged = 0;
+        ev_tail.store(ev_head.load());
+        superseded_logged = 0;
+        unlogged_seen = 0;
+    }
+
+    // camera callback, every frame
+    void on_frame(const VmbFrame_t *frame)
+    {
+        received++;
+        if (frame->receiveStatus != VmbFrameStatusComplete)
+        {
+            incomplete++;
+            push(FRAMEEV_INCOMPLETE, frame->frameID, frame->receiveStatus);
+        }
+        if (!(frame->receiveFlags & VmbFrameFlagsFrameID))
+            return;
+        if (have_id && frame->frameID > last_id + 1)
+        {
+            uint64_t missing = frame->frameID - last_id - 1;
+            gaps++;
+            lost += missing;
+            push(FRAMEEV_LOST, frame->frameID, missing);
+        }
+        last_id = frame->frameID; // a frame ID going back is the camera starting over, not a gap
+        have_id = true;
+    }
+
+    // camera callback
+    void on_dropped(uint64_t frameID, FrameDropStage stage)
+    {
+        dropped++;
+        push(FRAMEEV_DROPPED, frameID, stage);
+    }
+
+    // camera callback, superseded frames are summed rather than logged one by one
+    void on_superseded(uint64_t count)
+    {
+        if (count)
+            superseded += count;
+    }
+
+    /**
+     * @brief Log the events queued since the last call. Call every few ms from
+     * one thread, the lines are only touched from there.
+     */
+    void poll()
+    {
+        static const char *stages[] = {"frame pool full", "larger than a frame pool slab", "recorder queue full", "flight recorder slot not dumped yet", "larger than a flight recorder slot", "larger than a burst slot", "truncated for display"};
+        uint64_t h = ev_head.load(std::memory_order_acquire);
+        for (uint64_t t = ev_tail.load(std::memory_order_relaxed); t != h; t++)
+        {
+            const FrameEvent &ev = events[t % FRAMEACCT_EVENTS];
+            if (ev.kind == FRAMEEV_LOST)
+                log(ev.host_ns, string_format("lost %lld frame%s before frame %llu", (long long)ev.detail, ev.detail == 1 ? "" : "s", (unsigned long long)ev.frameID));
+            else if (ev.kind == FRAMEEV_INCOMPLETE)
+                log(ev.host_ns, string_format("frame %llu %s (status %lld)", (unsigned long long)ev.frameID, status_str(ev.detail), (long long)ev.detail));
+            else
+                log(ev.host_ns, string_format("dropped frame %llu: %s", (unsigned long long)ev.frameID, stages[ev.detail]));
+            ev_tail.store(t + 1, std::memory_order_release);
+        }
+        uint64_t now = recfile_now_ns();
+        uint64_t nunlogged = unlogged;
+        if (nunlogged != unlogged_seen)
+        {
+            log(now, string_format("%llu more events not logged, the log fell behind", (unsigned long long)(nunlogged - unlogged_seen)));
+            unlogged_seen = nunlogged;
+        }
+        uint64_t nsuperseded = superseded;
+        if (nsuperseded != superseded_logged && now - superseded_ns >= FRAMEACCT_SUPERSEDED_S * 1000000000ULL)
+        {
+            log(now, string_format("%llu frames superseded in display", (unsigned long long)(nsuperseded - superseded_logged)));
+            superseded_logged = nsuperseded;
+            superseded_ns = now;
+        }
+    }
+};
@@ -0,0 +1,448 @@
+#include "framecodec.hpp"
+#include "pixfmt.hpp"
+
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+// Rice codes are written LSB first through a 64 bit accumulator, 32 bits at a
+// time. A value v with parameter k is coded as q = v >> k one bits, a zero
+// bit and the low k bits of v. Values with q >= QMAX are coded as QMAX one
+// bits followed by the value itself, which caps a code at QMAX + 16 bits.
+// Every block of samples starts with its parameter in KBITS bits.
+//
+// Residuals are taken modulo the sample size, so 16 bit samples always give
+// 16 bit residuals whatever the bit depth.
+
+#define QMAX 24
+#define KBITS 4
+#define RAW_STRIP 0x80000000u
+
+struct BitWriter
+{
+    uint8_t *start;
+    uint8_t *p;
+    uint8_t *end;
+    uint64_t acc = 0;
+    uint32_t n = 0;
+    bool full = false;
+
+    BitWriter(uint8_t *dst, size_t cap)
+        : start(dst), p(dst), end(dst + cap)
+    {
+    }
+
+    // bits <= 32, v < 2^bits
+    inline void put(uint32_t v, uint32_t bits)
+    {
+        acc |= (uint64_t)v << n;
+        n += bits;
+        if (n >= 32)
+        {
+            if (end - p >= 4)
+            {
+                uint32_t w = (uint32_t)acc;
+                memcpy(p, &w, 4);
+                p += 4;
+            }
+            else
+            {
+                full = true;
+            }
+            acc >>= 32;
+            n -= 32;
+        }
+    }
+
+    inline void put_rice(uint32_t v, uint32_t k)
+    {
+        uint32_t q = v >> k;
+        if (q < QMAX)
+        {
+            uint32_t unary = (1u << q) - 1; // q ones, then the zero
+            if (q + 1 + k <= 32)
+                put(unary | ((v & ((1u << k) - 1)) << (q + 1)), q + 1 + k);
+            else
+            {
+                put(unary, q + 1);
+                put(v & ((1u << k) - 1), k);
+            }
+        }
+        else
+        {
+            put((1u << QMAX) - 1, QMAX);
+            put(v, 16);
+        }
+    }
+
+    // 0 if the data did not fit
+    size_t finish()
+    {
+        while (n > 0 && !full)
+        {
+            if (p == end)
+                full = true;
+            else
+                *p++ = (uint8_t)acc;
+            acc >>= 8;
+            n = n > 8 ? n - 8 : 0;
+        }
+        return full ? 0 : p - start;
+    }
+};
+
+struct BitReader
+{
+    const uint8_t *p;
+    const uint8_t *end;
+    uint64_t acc = 0;
+    uint32_t n = 0;
+    uint64_t overrun = 0; // bytes read past the end, as zeros
+
+    BitReader(const uint8_t *src, size_t len)
+        : p(src), end(src + len)
+    {
+    }
+
+    inline void refill()
+    {
+        if (n < 32)
+        {
+            uint32_t w = 0;
+            if (end - p >= 4)
+            {
+                memcpy(&w, p, 4);
+                p += 4;
+            }
+            else
+            {
+                size_t left = end - p;
+                memcpy(&w, p, left);
+                p += left;
+                overrun += 4 - left;
+            }
+            acc |= (uint64_t)w << n;
+            n += 32;
+        }
+    }
+
+    // bits <= 16
+    inline uint32_t get(uint32_t bits)
+    {
+        refill();
+        uint32_t v = acc & ((1u << bits) - 1);
+        acc >>= bits;
+        n -= bits;
+        return v;
+    }
+
+    inline uint32_t get_rice(uint32_t k)
+    {
+        refill();
+        uint32_t q = __builtin_ctzll(~acc | (1ULL << QMAX));
+        if (q < QMAX)
+        {
+            acc >>= q + 1;
+            n -= q + 1;
+            return (q << k) | (k ? get(k) : 0);
+        }
+        acc >>= QMAX;
+        n -= QMAX;
+        return get(16);
+    }
+
+    // every bit consumed came from the data
+    bool ok() const
+    {
+        return overrun * 8 <= n;
+    }
+};
+
+template <typename T>
+struct Signed;
+
+template <>
+struct Signed<uint8_t>
+{
+    typedef int8_t type;
+};
+
+template <>
+struct Signed<uint16_t>
+{
+    typedef int16_t type;
+};
+
+template <typename T>
+static inline uint32_t zigzag(T x, T p)
+{
+    typedef typename Signed<T>::type S;
+    S r = (S)(T)(x - p);
+    return (T)(((uint32_t)r << 1) ^ (uint32_t)(r >> (sizeof(T) * 8 - 1)));
+}
+
+template <typename T>
+static inline T unzigzag(uint32_t z, T p)
+{
+    return (T)(p + (T)((z >> 1) ^ (0u - (z & 1))));
+}
+
+// LOCO-I median edge detector
+template <typename T>
+static inline T predict(T a, T b, T c)
+{
+    T mx = std::max(a, b);
+    T mn = std::min(a, b);
+    return c >= mx ? mn : (c <= mn ? mx : (T)(a + b - c));
+}
+
+template <typename T>
+static void residuals(const T *row, const T *up, uint32_t n, uint32_t dh, uint32_t *z)
+{
+    uint32_t x0 = std::min(dh, n);
+    if (up == nullptr) // first rows of a strip, left neighbour only
+    {
+        for (uint32_t x = 0; x < x0; x++)
+            z[x] = zigzag(row[x], (T)0);
+        for (uint32_t x = x0; x < n; x++)
+            z[x] = zigzag(row[x], row[x - dh]);
+    }
+    else
+    {
+        for (uint32_t x = 0; x < x0; x++)
+            z[x] = zigzag(row[x], up[x]);
+        for (uint32_t x = x0; x < n; x++)
+            z[x] = zigzag(row[x], predict(row[x - dh], up[x], up[x - dh]));
+    }
+}
+
+template <typename T>
+static void reconstruct(T *row, const T *up, uint32_t n, uint32_t dh, const uint32_t *z)
+{
+    uint32_t x0 = std::min(dh, n);
+    if (up == nullptr)
+    {
+        for (uint32_t x = 0; x < x0; x++)
+            row[x] = unzigzag(z[x], (T)0);
+        for (uint32_t x = x0; x < n; x++)
+            row[x] = unzigzag(z[x], row[x - dh]);
+    }
+    else
+    {
+        for (uint32_t x = 0; x < x0; x++)
+            row[x] = unzigzag(z[x], up[x]);
+        for (uint32_t x = x0; x < n; x++)
+            row[x] = unzigzag(z[x], predict(row[x - dh], up[x], up[x - dh]));
+    }
+}
+
+// 0 if the strip does not get smaller than cap
+template <typename T>
+static size_t encode_strip(const FrameCodec &fc, const T *img, uint32_t y0, uint32_t y1, uint8_t *dst, size_t cap)
+{
+    static thread_local std::vector<uint32_t> z;
+    const uint32_t n = fc.row_samples;
+    z.resize(n);
+    BitWriter bw(dst, cap);
+    for (uint32_t y = y0; y < y1 && !bw.full; y++)
+    {
+        const T *row = img + (size_t)y * n;
+        const T *up = y - y0 >= fc.dv ? row - (size_t)fc.dv * n : nullptr;
+        residuals(row, up, n, fc.dh, z.data());
+        for (uint32_t i = 0; i < n; i += FRAMECODEC_BLOCK)
+        {
+            uint32_t m = std::min((uint32_t)FRAMECODEC_BLOCK, n - i);
+            uint32_t sum = 0;
+            for (uint32_t j = 0; j < m; j++)
+                sum += z[i + j];
+            uint32_t mean = sum / m;
+            uint32_t k = mean ? 31 - __builtin_clz(mean) : 0;
+            bw.put(k, KBITS);
+            for (uint32_t j = 0; j < m; j++)
+                bw.put_rice(z[i + j], k);
+        }
+    }
+    return bw.finish();
+}
+
+template <typename T>
+static bool decode_strip(const FrameCodec &fc, const uint8_t *src, size_t len, T *img, uint32_t y0, uint32_t y1)
+{
+    static thread_local std::vector<uint32_t> z;
+    const uint32_t n = fc.row_samples;
+    z.resize(n);
+    BitReader br(src, len);
+    for (uint32_t y = y0; y < y1; y++)
+    {
+        T *row = img + (size_t)y * n;
+        const T *up = y - y0 >= fc.dv ? row - (size_t)fc.dv * n : nullptr;
+        for (uint32_t i = 0; i < n; i += FRAMECODEC_BLOCK)
+        {
+            uint32_t m = std::min((uint32_t)FRAMECODEC_BLOCK, n - i);
+            uint32_t k = std::min(br.get(KBITS), (uint32_t)sizeof(T) * 8 - 1);
+            for (uint32_t j = 0; j < m; j++)
+                z[i + j] = br.get_rice(k);
+        }
+        reconstruct(row, up, n, fc.dh, z.data());
+    }
+    return br.ok();
+}
+
+static uint32_t strip_count(const FrameCodec &fc)
+{
+    return (fc.rows + FRAMECODEC_STRIP_ROWS - 1) / FRAMECODEC_STRIP_ROWS;
+}
+
+bool framecodec_init(FrameCodec &fc, VmbPixelFormat_t pfmt, uint32_t width, uint32_t height)
+{
+    if (pixfmt_is_packed(pfmt))
+        return false;
+    uint32_t channels;
+    switch (pixfmt_bits_per_pixel(pfmt))
+    {
+    case 8:
+        fc.bytes = 1;
+        channels = 1;
+        break;
+    case 16:
+        fc.bytes = 2;
+        channels = 1;
+        break;
+    case 24:
+        fc.bytes = 1;
+        channels = 3;
+        break;
+    case 32:
+        fc.bytes = 1;
+        channels = 4;
+        break;
+    case 48:
+        fc.bytes = 2;
+        channels = 3;
+        break;
+    case 64:
+        fc.bytes = 2;
+        channels = 4;
+        break;
+    default:
+        return false;
+    }
+    fc.row_samples = width * channels;
+    fc.rows = height;
+    if (pixfmt_is_bayer(pfmt))
+    {
+        fc.dh = 2;
+        fc.dv = 2;
+    }
+    else
+    {
+        fc.dh = channels;
+        fc.dv = 1;
+    }
+    return true;
+}
+
+size_t framecodec_raw_size(const FrameCodec &fc)
+{
+    return (size_t)fc.row_samples * fc.bytes * fc.rows;
+}
+
+size_t framecodec_bound(const FrameCodec &fc)
+{
+    uint32_t nstrips = strip_count(fc);
+    return 4 + 4 * (size_t)nstrips + (size_t)nstrips * FRAMECODEC_STRIP_ROWS * fc.row_samples * fc.bytes;
+}
+
+// strip i into its own slot of cap bytes in body, its size word into sizes
+static void compress_strip(const FrameCodec &fc, const uint8_t *src, uint32_t i, uint8_t *body, size_t cap, uint8_t *sizes)
+{
+    size_t row_bytes = (size_t)fc.row_samples * fc.bytes;
+    uint32_t y0 = i * FRAMECODEC_STRIP_ROWS;
+    uint32_t y1 = std::min(fc.rows, y0 + FRAMECODEC_STRIP_ROWS);
+    size_t raw = (y1 - y0) * row_bytes;
+    uint8_t *out = body + i * cap;
+    size_t size;
+    if (fc.bytes == 1)
+        size = encode_strip(fc, src, y0, y1, out, raw);
+    else
+        size = encode_strip(fc, (const uint16_t *)src, y0, y1, out, raw);
+    uint32_t word = size;
+    if (size == 0 || size >= raw)
+    {
+        memcpy(out, src + y0 * row_bytes, raw);
+        word = raw | RAW_STRIP;
+    }
+    memcpy(sizes + 4 * (size_t)i, &word, 4);
+}
+
+static bool decompress_strip(const FrameCodec &fc, const uint8_t *src, uint32_t i, const std::vector<size_t> &offsets, uint8_t *dst)
+{
+    size_t row_bytes = (size_t)fc.row_samples * fc.bytes;
+    uint32_t y0 = i * FRAMECODEC_STRIP_ROWS;
+    uint32_t y1 = std::min(fc.rows, y0 + FRAMECODEC_STRIP_ROWS);
+    size_t raw = (y1 - y0) * row_bytes;
+    const uint8_t *in = src + offsets[i];
+    size_t size = offsets[i + 1] - offsets[i];
+    uint32_t word;
+    memcpy(&word, src + 4 + 4 * (size_t)i, 4);
+    if (word & RAW_STRIP)
+    {
+        memcpy(dst + y0 * row_bytes, in, std::min(size, raw));
+        return size == raw;
+    }
+    if (fc.bytes == 1)
+        return decode_strip(fc, in, size, dst, y0, y1);
+    return decode_strip(fc, in, size, (uint16_t *)dst, y0, y1);
+}
+
+size_t framecodec_compress(ThreadPool &pool, const FrameCodec &fc, const uint8_t *src, uint8_t *dst)
+{
+    uint32_t nstrips = strip_count(fc);
+    size_t cap = (size_t)fc.row_samples * fc.bytes * FRAMECODEC_STRIP_ROWS;
+    uint8_t *sizes = dst + 4;
+    uint8_t *body = sizes + 4 * (size_t)nstrips;
+    memcpy(dst, &nstrips, 4);
+    // every strip goes to its own slot first, then they are moved together
+    pool.parallel_for(nstrips, [&](uint32_t i)
+                      { compress_strip(fc, src, i, body, cap, sizes); });
+    uint8_t *pos = body;
+    for (uint32_t i = 0; i < nstrips; i++)
+    {
+        uint32_t word;
+        memcpy(&word, sizes + 4 * (size_t)i, 4);
+        size_t size = word & ~RAW_STRIP;
+        uint8_t *out = body + i * cap;
+        if (out != pos)
+            memmove(pos, out, size);
+        pos += size;
+    }
+    return pos - dst;
+}
+
+bool framecodec_decompress(ThreadPool &pool, const FrameCodec &fc, const uint8_t *src, size_t len, uint8_t *dst)
+{
+    uint32_t nstrips = strip_count(fc);
+    uint32_t count;
+    if (len < 4 + 4 * (size_t)nstrips)
+        return false;
+    memcpy(&count, src, 4);
+    if (count != nstrips)
+        return false;
+    std::vector<size_t> offsets(nstrips + 1);
+    offsets[0] = 4 + 4 * (size_t)nstrips;
+    for (uint32_t i = 0; i < nstrips; i++)
+    {
+        uint32_t word;
+        memcpy(&word, src + 4 + 4 * (size_t)i, 4);
+        offsets[i + 1] = offsets[i] + (word & ~RAW_STRIP);
+    }
+    if (offsets[nstrips] > len)
+        return false;
+    std::atomic<bool> ok{true};
+    pool.parallel_for(nstrips, [&](uint32_t i)
+                      {
+                          if (!decompress_strip(fc, src, i, offsets, dst))
+                              ok = false; });
+    return ok;
+}
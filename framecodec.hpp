@@ -0,0 +1,65 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#include <VmbC/VmbC.h>
+
+#include "threadpool.hpp"
+
+#define FRAMECODEC_STRIP_ROWS 32 // rows per independently coded strip
+#define FRAMECODEC_BLOCK 32      // samples sharing one Rice parameter
+
+/**
+ * @brief Layout of a frame as seen by the lossless frame codec.
+ *
+ * Samples are predicted from their left, upper and upper left neighbours of
+ * the same colour (the LOCO-I median predictor), the residuals are mapped to
+ * unsigned values and Rice coded with a parameter chosen per block of
+ * FRAMECODEC_BLOCK samples. The frame is cut into strips of
+ * FRAMECODEC_STRIP_ROWS rows that are coded independently on the thread pool;
+ * a strip that does not get smaller is stored as is.
+ *
+ * Compressed frame: uint32_t strip count, one uint32_t size per strip (bit 31
+ * set if the strip is stored raw), then the strips back to back.
+ */
+struct FrameCodec
+{
+    uint32_t bytes = 0;       // per sample, 1 or 2
+    uint32_t row_samples = 0; // samples per row
+    uint32_t rows = 0;
+    uint32_t dh = 1; // distance to the left neighbour of the same colour, in samples
+    uint32_t dv = 1; // distance to the upper neighbour of the same colour, in rows
+};
+
+/**
+ * @brief Set up the codec for a pixel format.
+ *
+ * @return false for formats the codec does not handle (bit packed ones), those are stored raw.
+ */
+bool framecodec_init(FrameCodec &fc, VmbPixelFormat_t pfmt, uint32_t width, uint32_t height);
+
+/**
+ * @brief Bytes of image data in a frame.
+ */
+size_t framecodec_raw_size(const FrameCodec &fc);
+
+/**
+ * @brief Buffer size framecodec_compress() needs.
+ */
+size_t framecodec_bound(const FrameCodec &fc);
+
+/**
+ * @brief Compress a frame, split across the thread pool.
+ *
+ * @param dst framecodec_bound() bytes
+ * @return compressed size, which may exceed the raw size for incompressible data.
+ */
+size_t framecodec_compress(ThreadPool &pool, const FrameCodec &fc, const uint8_t *src, uint8_t *dst);
+
+/**
+ * @brief Decompress a frame, split across the thread pool.
+ *
+ * @param dst framecodec_raw_size() bytes
+ * @return false if the data is damaged; dst is filled as far as possible.
+ */
+bool framecodec_decompress(ThreadPool &pool, const FrameCodec &fc, const uint8_t *src, size_t len, uint8_t *dst);
@@ -0,0 +1,533 @@
+#include "framegen.hpp"
+#include "pixfmt.hpp"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FRAMEGEN_X86
+#endif
+
+#define FRAMEGEN_PART_WORDS (1 << 16) // noise words per parallel part (256 KiB)
+#define FRAMEGEN_PART_ROWS 16         // fewest rows per parallel part of a pattern
+
+// The noise is counter based: 32 bit word j of frame f is a bijective hash of
+// j plus a key derived from the seed and f. Any word can be computed on its
+// own, so threads split the frame anywhere, SIMD lanes take consecutive
+// words, and framegen_sample() knows every value without the frame.
+
+enum FramegenIsa
+{
+    FRAMEGEN_SCALAR = 0,
+    FRAMEGEN_SSE41,
+    FRAMEGEN_AVX2,
+};
+
+static const char *isa_names[] = {"scalar", "sse4.1", "avx2"};
+
+static FramegenIsa detect_isa()
+{
+#ifdef FRAMEGEN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return FRAMEGEN_AVX2;
+    if (__builtin_cpu_supports("sse4.1"))
+        return FRAMEGEN_SSE41;
+#endif
+    return FRAMEGEN_SCALAR;
+}
+
+static FramegenIsa get_isa()
+{
+    static const FramegenIsa isa = detect_isa(); // thread safe initialization
+    return isa;
+}
+
+const char *framegen_isa()
+{
+    return isa_names[get_isa()];
+}
+
+static const char *pattern_names[] = {"noise", "ramp", "checker", "gradient", "stars", "bayer"};
+
+const char *framegen_pattern_name(FramegenPattern pattern)
+{
+    return pattern < FRAMEGEN_NUM_PATTERNS ? pattern_names[pattern] : "unknown";
+}
+
+bool framegen_pattern_from_string(const char *name, FramegenPattern &pattern)
+{
+    for (int i = 0; i < FRAMEGEN_NUM_PATTERNS; i++)
+    {
+        if (strcmp(name, pattern_names[i]) == 0)
+        {
+            pattern = (FramegenPattern)i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool framegen_spec(FramegenSpec &spec, VmbPixelFormat_t pfmt, uint32_t width, uint32_t height, FramegenPattern pattern, uint64_t seed)
+{
+    spec.width = width;
+    spec.height = height;
+    spec.pattern = pattern;
+    spec.seed = seed;
+    spec.bits = pixfmt_bit_depth(pfmt);
+    spec.bytes = spec.bits > 8 ? 2 : 1;
+    spec.bayer = pixfmt_bayer_pattern(pfmt);
+    if (pixfmt_is_packed(pfmt))
+    {
+        spec.channels = 1;
+        return true;
+    }
+    uint32_t bpp = pixfmt_bits_per_pixel(pfmt);
+    spec.channels = bpp / (8 * spec.bytes);
+    return spec.channels >= 1 && spec.channels <= 4 && bpp == spec.channels * 8 * spec.bytes;
+}
+
+size_t framegen_size(const FramegenSpec &spec)
+{
+    return (size_t)spec.width * spec.height * spec.channels * spec.bytes;
+}
+
+static inline uint32_t mix32(uint32_t x) // lowbias32, a bijection
+{
+    x ^= x >> 16;
+    x *= 0x7feb352d;
+    x ^= x >> 15;
+    x *= 0x846ca68b;
+    x ^= x >> 16;
+    return x;
+}
+
+static inline uint64_t splitmix64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+static inline uint32_t maxval(const FramegenSpec &s)
+{
+    return (1u << s.bits) - 1;
+}
+
+// word j of the noise is (mix32(key + j) & and32) + add32; every sample lane
+// stays below its maximum, so the 32 bit add never carries between lanes
+struct NoiseParams
+{
+    uint32_t key;
+    uint32_t and32;
+    uint32_t add32;
+};
+
+static NoiseParams noise_params(const FramegenSpec &s, uint64_t frame)
+{
+    NoiseParams np;
+    np.key = (uint32_t)splitmix64(s.seed ^ splitmix64(frame));
+    uint32_t mask = maxval(s), add = 0;
+    if (s.pattern == FRAMEGEN_STARS) // a dim floor the stars stand out from
+    {
+        add = 1u << (s.bits - 4);
+        mask = (1u << (s.bits - 5)) - 1;
+    }
+    if (s.bytes == 2)
+    {
+        np.and32 = mask | mask << 16;
+        np.add32 = add | add << 16;
+    }
+    else
+    {
+        np.and32 = mask * 0x01010101u;
+        np.add32 = add * 0x01010101u;
+    }
+    return np;
+}
+
+static void noise_scalar(uint8_t *dst, uint32_t j0, size_t n, const NoiseParams &np)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t w = (mix32(np.key + j0 + (uint32_t)i) & np.and32) + np.add32;
+        memcpy(dst + 4 * i, &w, sizeof(w)); // little endian
+    }
+}
+
+#ifdef FRAMEGEN_X86
+__attribute__((target("sse4.1"))) static void noise_sse41(uint8_t *dst, uint32_t j0, size_t n, const NoiseParams &np)
+{
+    const __m128i m1 = _mm_set1_epi32(0x7feb352d);
+    const __m128i m2 = _mm_set1_epi32(0x846ca68b);
+    const __m128i am = _mm_set1_epi32(np.and32);
+    const __m128i ad = _mm_set1_epi32(np.add32);
+    const __m128i step = _mm_set1_epi32(4);
+    __m128i x = _mm_add_epi32(_mm_set1_epi32(np.key + j0), _mm_setr_epi32(0, 1, 2, 3));
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128i h = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+        h = _mm_mullo_epi32(h, m1);
+        h = _mm_xor_si128(h, _mm_srli_epi32(h, 15));
+        h = _mm_mullo_epi32(h, m2);
+        h = _mm_xor_si128(h, _mm_srli_epi32(h, 16));
+        _mm_storeu_si128((__m128i *)(dst + 4 * i), _mm_add_epi32(_mm_and_si128(h, am), ad));
+        x = _mm_add_epi32(x, step);
+    }
+    noise_scalar(dst + 4 * i, j0 + (uint32_t)i, n - i, np);
+}
+
+__attribute__((target("avx2"))) static void noise_avx2(uint8_t *dst, uint32_t j0, size_t n, const NoiseParams &np)
+{
+    const __m256i m1 = _mm256_set1_epi32(0x7feb352d);
+    const __m256i m2 = _mm256_set1_epi32(0x846ca68b);
+    const __m256i am = _mm256_set1_epi32(np.and32);
+    const __m256i ad = _mm256_set1_epi32(np.add32);
+    const __m256i step = _mm256_set1_epi32(8);
+    __m256i x = _mm256_add_epi32(_mm256_set1_epi32(np.key + j0), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m256i h = _mm256_xor_si256(x, _mm256_srli_epi32(x, 16));
+        h = _mm256_mullo_epi32(h, m1);
+        h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+        h = _mm256_mullo_epi32(h, m2);
+        h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+        _mm256_storeu_si256((__m256i *)(dst + 4 * i), _mm256_add_epi32(_mm256_and_si256(h, am), ad));
+        x = _mm256_add_epi32(x, step);
+    }
+    _mm256_zeroupper(); // the tail call below skips the one gcc would add, slowing SSE code after us
+    noise_scalar(dst + 4 * i, j0 + (uint32_t)i, n - i, np);
+}
+#endif
+
+static void noise_words(uint8_t *dst, uint32_t j0, size_t n, const NoiseParams &np, bool simd)
+{
+    if (simd)
+    {
+        switch (get_isa())
+        {
+#ifdef FRAMEGEN_X86
+        case FRAMEGEN_AVX2:
+            noise_avx2(dst, j0, n, np);
+            return;
+        case FRAMEGEN_SSE41:
+            noise_sse41(dst, j0, n, np);
+            return;
+#endif
+        default:
+            break;
+        }
+    }
+    noise_scalar(dst, j0, n, np);
+}
+
+// bytes [b0, b1) of the frame
+static void noise_fill(uint8_t *dst, size_t b0, size_t b1, const NoiseParams &np, bool simd)
+{
+    size_t j0 = (b0 + 3) / 4, j1 = b1 / 4;
+    if (j0 > j1) // inside one word
+        j0 = j1 = b0 / 4;
+    uint8_t word[4];
+    if (b0 < j0 * 4) // partial word at the start
+    {
+        noise_scalar(word, j0 - 1, 1, np);
+        memcpy(dst + b0, word + (b0 & 3), std::min(j0 * 4, b1) - b0);
+    }
+    if (j1 > j0)
+        noise_words(dst + j0 * 4, j0, j1 - j0, np, simd);
+    if (b1 > std::max(j1 * 4, b0)) // partial word at the end
+    {
+        noise_scalar(word, j1, 1, np);
+        size_t from = std::max(j1 * 4, b0);
+        memcpy(dst + from, word + (from - j1 * 4), b1 - from);
+    }
+}
+
+static inline uint32_t ramp(uint64_t pos, uint64_t period, uint32_t maxv)
+{
+    return pos * (maxv + 1) / period;
+}
+
+// 0 red, 1 green, 2 blue
+static inline uint32_t bayer_colour(BayerPattern bp, uint32_t x, uint32_t y)
+{
+    uint32_t rx = bp == BAYER_GR || bp == BAYER_BG; // where red sits in the 2 x 2 cell
+    uint32_t ry = bp == BAYER_GB || bp == BAYER_BG;
+    bool col = (x & 1) == rx, row = (y & 1) == ry;
+    return col && row ? 0 : (!col && !row ? 2 : 1);
+}
+
+// everything but the noise
+static uint32_t pattern_value(const FramegenSpec &s, uint64_t frame, uint32_t x, uint32_t y, uint32_t c)
+{
+    uint32_t maxv = maxval(s);
+    switch (s.pattern)
+    {
+    case FRAMEGEN_RAMP:
+        return ramp(x, s.width, maxv);
+    case FRAMEGEN_CHECKER:
+        return ((x / FRAMEGEN_CHECKER_SIZE) ^ (y / FRAMEGEN_CHECKER_SIZE)) & 1 ? maxv : 0;
+    case FRAMEGEN_GRADIENT:
+    {
+        uint64_t period = (uint64_t)s.width + s.height;
+        return ramp((x + y + frame * FRAMEGEN_GRADIENT_STEP) % period, period, maxv);
+    }
+    case FRAMEGEN_BAYER:
+        switch (s.channels > 1 ? c : bayer_colour(s.bayer, x, y))
+        {
+        case 0:
+            return ramp(x, s.width, maxv);
+        case 1:
+            return ramp(x + y, (uint64_t)s.width + s.height, maxv);
+        case 2:
+            return ramp(y, s.height, maxv);
+        default:
+            return maxv;
+        }
+    default:
+        return 0;
+    }
+}
+
+// rows [y0, y1), dst points at row y0
+template <typename T>
+static void pattern_rows(const FramegenSpec &s, uint64_t frame, uint32_t y0, uint32_t y1, T *dst)
+{
+    uint32_t ch = s.channels;
+    size_t row = (size_t)s.width * ch;
+    uint32_t maxv = maxval(s);
+    switch (s.pattern)
+    {
+    case FRAMEGEN_RAMP:
+    case FRAMEGEN_CHECKER: // at most two different rows
+    {
+        std::vector<T> rows[2];
+        for (uint32_t y = y0; y < y1; y++)
+        {
+            uint32_t k = s.pattern == FRAMEGEN_CHECKER ? (y / FRAMEGEN_CHECKER_SIZE) & 1 : 0;
+            if (rows[k].empty())
+            {
+                rows[k].resize(row);
+                for (uint32_t x = 0; x < s.width; x++)
+                    for (uint32_t c = 0; c < ch; c++)
+                        rows[k][(size_t)x * ch + c] = pattern_value(s, frame, x, y, c);
+            }
+            memcpy(dst + (y - y0) * row, rows[k].data(), row * sizeof(T));
+        }
+        break;
+    }
+    case FRAMEGEN_GRADIENT: // row y + 1 is row y moved by one pixel
+    {
+        uint32_t n = s.width + (y1 - y0);
+        std::vector<T> lut((size_t)n * ch);
+        for (uint32_t k = 0; k < n; k++)
+            for (uint32_t c = 0; c < ch; c++)
+                lut[(size_t)k * ch + c] = pattern_value(s, frame, k, y0, c);
+        for (uint32_t y = y0; y < y1; y++)
+            memcpy(dst + (y - y0) * row, lut.data() + (size_t)(y - y0) * ch, row * sizeof(T));
+        break;
+    }
+    case FRAMEGEN_BAYER:
+    {
+        uint64_t diag = (uint64_t)s.width + s.height;
+        std::vector<T> red(s.width), green(s.width + (y1 - y0));
+        for (uint32_t x = 0; x < s.width; x++)
+            red[x] = ramp(x, s.width, maxv);
+        for (uint32_t k = 0; k < green.size(); k++)
+            green[k] = ramp((uint64_t)y0 + k, diag, maxv);
+        for (uint32_t y = y0; y < y1; y++)
+        {
+            T *out = dst + (y - y0) * row;
+            const T *g = green.data() + (y - y0);
+            T b = ramp(y, s.height, maxv);
+            if (ch == 1)
+            {
+                for (uint32_t x0 = 0; x0 < 2; x0++) // even then odd columns, one colour each
+                {
+                    uint32_t colour = bayer_colour(s.bayer, x0, y);
+                    const T *src = colour == 0 ? red.data() : g;
+                    if (colour == 2)
+                        for (uint32_t x = x0; x < s.width; x += 2)
+                            out[x] = b;
+                    else
+                        for (uint32_t x = x0; x < s.width; x += 2)
+                            out[x] = src[x];
+                }
+            }
+            else
+            {
+                for (uint32_t x = 0; x < s.width; x++)
+                {
+                    out[(size_t)x * ch] = red[x];
+                    out[(size_t)x * ch + 1] = g[x];
+                    out[(size_t)x * ch + 2] = b;
+                    for (uint32_t c = 3; c < ch; c++)
+                        out[(size_t)x * ch + c] = maxv;
+                }
+            }
+        }
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+struct Star
+{
+    float x, y;
+    float amp;
+    float inv2s2; // 1 / (2 sigma^2)
+    int32_t r;    // box half width, 3 sigma
+};
+
+// positions and sizes depend on the seed and the frame size only
+static void make_stars(const FramegenSpec &s, std::vector<Star> &stars)
+{
+    uint64_t n = std::max((uint64_t)1, (uint64_t)s.width * s.height / FRAMEGEN_STAR_AREA);
+    uint32_t key = (uint32_t)splitmix64(s.seed ^ 0x5354415253ULL);
+    uint32_t maxv = maxval(s);
+    stars.resize(n);
+    for (uint64_t i = 0; i < n; i++)
+    {
+        Star &st = stars[i];
+        st.x = (float)(mix32(key + 4 * i) / 4294967296.0 * s.width);
+        st.y = (float)(mix32(key + 4 * i + 1) / 4294967296.0 * s.height);
+        st.amp = (float)(maxv * (0.125 + 0.875 * (mix32(key + 4 * i + 2) / 4294967296.0)));
+        float sigma = (float)(1.0 + 2.0 * (mix32(key + 4 * i + 3) / 4294967296.0));
+        st.inv2s2 = 1.0f / (2.0f * sigma * sigma);
+        st.r = (int32_t)ceilf(3.0f * sigma);
+    }
+}
+
+static inline bool star_box(const Star &st, const FramegenSpec &s, int32_t &x0, int32_t &x1, int32_t &y0, int32_t &y1)
+{
+    int32_t cx = (int32_t)st.x, cy = (int32_t)st.y;
+    x0 = std::max(0, cx - st.r);
+    x1 = std::min((int32_t)s.width - 1, cx + st.r);
+    y0 = std::max(0, cy - st.r);
+    y1 = std::min((int32_t)s.height - 1, cy + st.r);
+    return x0 <= x1 && y0 <= y1;
+}
+
+static inline uint32_t star_value(const Star &st, uint32_t x, uint32_t y)
+{
+    float dx = x - st.x, dy = y - st.y;
+    return (uint32_t)(st.amp * expf(-(dx * dx + dy * dy) * st.inv2s2) + 0.5f);
+}
+
+// add the stars to rows [ry0, ry1) in star order, saturating each time
+template <typename T>
+static void star_rows(const FramegenSpec &s, const std::vector<Star> &stars, uint32_t ry0, uint32_t ry1, T *frame)
+{
+    uint32_t maxv = maxval(s), ch = s.channels;
+    for (const Star &st : stars)
+    {
+        int32_t x0, x1, y0, y1;
+        if (!star_box(st, s, x0, x1, y0, y1))
+            continue;
+        y0 = std::max(y0, (int32_t)ry0);
+        y1 = std::min(y1, (int32_t)ry1 - 1);
+        for (int32_t y = y0; y <= y1; y++)
+        {
+            T *out = frame + ((size_t)y * s.width + x0) * ch;
+            for (int32_t x = x0; x <= x1; x++)
+            {
+                uint32_t v = star_value(st, x, y);
+                for (uint32_t c = 0; c < ch; c++, out++)
+                    *out = std::min(maxv, *out + v);
+            }
+        }
+    }
+}
+
+static void fill(ThreadPool *pool, const FramegenSpec &s, uint64_t frame, void *dst, bool simd)
+{
+    uint8_t *out = (uint8_t *)dst;
+    size_t size = framegen_size(s);
+    if (size == 0)
+        return;
+    uint32_t nthreads = pool ? pool->size() + 1 : 1;
+    if (s.pattern == FRAMEGEN_NOISE || s.pattern == FRAMEGEN_STARS)
+    {
+        NoiseParams np = noise_params(s, frame);
+        size_t part = (size_t)FRAMEGEN_PART_WORDS * 4;
+        uint32_t nparts = pool ? (size + part - 1) / part : 1;
+        if (nparts <= 1)
+            noise_fill(out, 0, size, np, simd);
+        else
+            pool->parallel_for(nparts, [&](uint32_t i)
+                               { noise_fill(out, i * part, std::min(size, (i + 1) * part), np, simd); });
+        if (s.pattern == FRAMEGEN_NOISE)
+            return;
+    }
+    // patterns and stars in bands of rows
+    uint32_t nparts = std::max(1u, std::min(nthreads, s.height / FRAMEGEN_PART_ROWS));
+    uint32_t rows = (s.height + nparts - 1) / nparts;
+    size_t row_bytes = (size_t)s.width * s.channels * s.bytes;
+    std::vector<Star> stars;
+    if (s.pattern == FRAMEGEN_STARS)
+        make_stars(s, stars);
+    auto band = [&](uint32_t i)
+    {
+        uint32_t y0 = i * rows, y1 = std::min(s.height, y0 + rows);
+        if (y0 >= y1)
+            return;
+        if (s.pattern == FRAMEGEN_STARS)
+        {
+            if (s.bytes == 2)
+                star_rows(s, stars, y0, y1, (uint16_t *)out);
+            else
+                star_rows(s, stars, y0, y1, out);
+        }
+        else if (s.bytes == 2)
+            pattern_rows(s, frame, y0, y1, (uint16_t *)(out + y0 * row_bytes));
+        else
+            pattern_rows(s, frame, y0, y1, out + y0 * row_bytes);
+    };
+    if (nparts == 1 || pool == nullptr)
+    {
+        for (uint32_t i = 0; i < nparts; i++)
+            band(i);
+    }
+    else
+        pool->parallel_for(nparts, band);
+}
+
+void framegen_fill(ThreadPool &pool, const FramegenSpec &spec, uint64_t frame, void *dst)
+{
+    fill(&pool, spec, frame, dst, true);
+}
+
+void framegen_fill_scalar(const FramegenSpec &spec, uint64_t frame, void *dst)
+{
+    fill(nullptr, spec, frame, dst, false);
+}
+
+uint32_t framegen_sample(const FramegenSpec &s, uint64_t frame, uint32_t x, uint32_t y, uint32_t c)
+{
+    if (s.pattern != FRAMEGEN_NOISE && s.pattern != FRAMEGEN_STARS)
+        return pattern_value(s, frame, x, y, c);
+    size_t pos = (((size_t)y * s.width + x) * s.channels + c) * s.bytes;
+    uint8_t word[4];
+    noise_scalar(word, pos / 4, 1, noise_params(s, frame));
+    uint32_t v = s.bytes == 2 ? word[pos & 3] | word[(pos & 3) + 1] << 8 : word[pos & 3];
+    if (s.pattern == FRAMEGEN_STARS)
+    {
+        std::vector<Star> stars;
+        make_stars(s, stars);
+        for (const Star &st : stars)
+        {
+            int32_t x0, x1, y0, y1;
+            if (star_box(st, s, x0, x1, y0, y1) && (int32_t)x >= x0 && (int32_t)x <= x1 && (int32_t)y >= y0 && (int32_t)y <= y1)
+                v = std::min(maxval(s), v + star_value(st, x, y));
+        }
+    }
+    return v;
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#include <VmbC/VmbC.h>
+
+#include "demosaic.hpp"
+#include "threadpool.hpp"
+
+enum FramegenPattern
+{
+    FRAMEGEN_NOISE = 0, // uniform over the bit depth, new every frame
+    FRAMEGEN_RAMP,      // black on the left to white on the right
+    FRAMEGEN_CHECKER,   // FRAMEGEN_CHECKER_SIZE pixel squares
+    FRAMEGEN_GRADIENT,  // diagonal ramp moving FRAMEGEN_GRADIENT_STEP pixels per frame
+    FRAMEGEN_STARS,     // Gaussian stars on a dim noise floor
+    FRAMEGEN_BAYER,     // colour scene seen through the colour filter array
+    FRAMEGEN_NUM_PATTERNS,
+};
+
+#define FRAMEGEN_CHECKER_SIZE 32
+#define FRAMEGEN_GRADIENT_STEP 4
+#define FRAMEGEN_STAR_AREA 20000 // pixels per star
+
+/**
+ * @brief Layout and content of synthetic frames.
+ *
+ * Samples are 8 bit (bytes = 1) or LSB aligned 16 bit (bytes = 2) words,
+ * channels per pixel, rows packed without padding. The Bayer pattern paints
+ * a red ramp along x, a blue ramp along y and a green diagonal ramp; a mono
+ * frame gets it through the colour filter array, a colour frame gets the
+ * scene itself as R, G, B (and white in a fourth channel).
+ */
+struct FramegenSpec
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t channels = 1;
+    uint32_t bytes = 1;
+    uint32_t bits = 8;
+    BayerPattern bayer = BAYER_RG;
+    FramegenPattern pattern = FRAMEGEN_NOISE;
+    uint64_t seed = 0;
+};
+
+/**
+ * @brief Fill spec for frames in the given pixel format. Packed formats are
+ * generated as their 16 bit unpacked form.
+ *
+ * @return false for formats the generator does not know.
+ */
+bool framegen_spec(FramegenSpec &spec, VmbPixelFormat_t pfmt, uint32_t width, uint32_t height, FramegenPattern pattern, uint64_t seed);
+
+/**
+ * @brief Bytes of one generated frame.
+ */
+size_t framegen_size(const FramegenSpec &spec);
+
+/**
+ * @brief Generate frame number frame into dst, split across the thread pool.
+ *
+ * The content depends only on spec (seed included) and frame: the same on
+ * every run, every ISA and any number of threads.
+ */
+void framegen_fill(ThreadPool &pool, const FramegenSpec &spec, uint64_t frame, void *dst);
+
+/**
+ * @brief Single threaded scalar reference implementation of framegen_fill.
+ */
+void framegen_fill_scalar(const FramegenSpec &spec, uint64_t frame, void *dst);
+
+/**
+ * @brief The value framegen_fill writes for sample c of pixel (x, y) of frame,
+ * for checking frames further down the pipeline. Slow for the star field.
+ */
+uint32_t framegen_sample(const FramegenSpec &spec, uint64_t frame, uint32_t x, uint32_t y, uint32_t c);
+
+const char *framegen_pattern_name(FramegenPattern pattern);
+
+/**
+ * @brief Pattern by name ("noise", "ramp", ...).
+ */
+bool framegen_pattern_from_string(const char *name, FramegenPattern &pattern);
+
+/**
+ * @brief Name of the instruction set the noise generator uses.
+ */
+const char *framegen_isa();
@@ -0,0 +1,366 @@
+#pragma once
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+
+#include <VmbC/VmbC.h>
+
+#include "pixfmt.hpp"
+
+#define FRAMEPOOL_SLABS 8
+#define FRAMEPOOL_ALIGN 4096
+
+/**
+ * @brief Metadata of a frame held in a FramePool slab.
+ */
+struct FrameInfo
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    VmbPixelFormat_t pixelFormat = VmbPixelFormatMono8;
+    VmbUint64_t frameID = 0;
+    VmbUint64_t timestamp = 0;
+    VmbFrameStatus_t status = VmbFrameStatusComplete;
+    size_t size = 0; // bytes of image data in the slab
+};
+
+class FramePool;
+
+/**
+ * @brief Reference counted handle to a FramePool slab.
+ *
+ * The slab goes back to the pool when the last handle is reset or destroyed.
+ * Copying a handle only bumps the reference count.
+ */
+class FrameHandle
+{
+    friend class FramePool;
+
+private:
+    FramePool *pool = nullptr;
+    uint32_t idx = 0;
+
+    FrameHandle(FramePool *pool, uint32_t idx) : pool(pool), idx(idx)
+    {
+    }
+
+public:
+    FrameHandle()
+    {
+    }
+
+    inline FrameHandle(const FrameHandle &other);
+
+    FrameHandle(FrameHandle &&other) : pool(other.pool), idx(other.idx)
+    {
+        other.pool = nullptr;
+    }
+
+    inline FrameHandle &operator=(const FrameHandle &other);
+
+    FrameHandle &operator=(FrameHandle &&other)
+    {
+        if (this != &other)
+        {
+            reset();
+            pool = other.pool;
+            idx = other.idx;
+            other.pool = nullptr;
+        }
+        return *this;
+    }
+
+    ~FrameHandle()
+    {
+        reset();
+    }
+
+    inline void reset();
+
+    explicit operator bool() const
+    {
+        return pool != nullptr;
+    }
+
+    inline uint8_t *data() const;
+
+    inline FrameInfo &info() const;
+};
+
+/**
+ * @brief Fixed set of equally sized frame slabs, allocated up front.
+ *
+ * acquire() and the release of handles are lock-free and never allocate, so
+ * they are safe to use from the camera callback. Slabs can be acquired and
+ * released from any thread.
+ *
+ * A pool set up with reserve_external() has no memory of its own; wrap()
+ * hands out handles to frames that live elsewhere (e.g. a mapped recording),
+ * and in_use() tells when the last of them has been let go.
+ */
+class FramePool
+{
+    friend class FrameHandle;
+
+private:
+    static const uint32_t nil = 0xffffffff;
+
+    struct Slab
+    {
+        std::atomic<uint32_t> refs;
+        std::atomic<uint32_t> next;
+        FrameInfo info;
+        uint8_t *data;
+    };
+
+    uint8_t *arena = nullptr;
+    Slab *slabs = nullptr;
+    size_t slab_size = 0;
+    uint32_t count = 0;
+    std::atomic<uint64_t> head; // (ABA tag << 32) | index of first free slab
+    std::atomic<uint32_t> used;
+
+    void push(uint32_t idx)
+    {
+        uint64_t old = head.load(std::memory_order_relaxed);
+        uint64_t val;
+        do
+        {
+            slabs[idx].next.store((uint32_t)old, std::memory_order_relaxed);
+            val = ((old >> 32) + 1) << 32 | idx;
+        } while (!head.compare_exchange_weak(old, val, std::memory_order_release, std::memory_order_relaxed));
+    }
+
+    uint32_t pop()
+    {
+        uint64_t old = head.load(std::memory_order_acquire);
+        uint64_t val;
+        do
+        {
+            uint32_t idx = (uint32_t)old;
+            if (idx == nil)
+                return nil;
+            val = ((old >> 32) + 1) << 32 | slabs[idx].next.load(std::memory_order_relaxed);
+        } while (!head.compare_exchange_weak(old, val, std::memory_order_acquire, std::memory_order_acquire));
+        return (uint32_t)old;
+    }
+
+    void retain(uint32_t idx)
+    {
+        slabs[idx].refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void release(uint32_t idx)
+    {
+        if (slabs[idx].refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            used.fetch_sub(1, std::memory_order_relaxed);
+            push(idx);
+        }
+    }
+
+    void free_arena()
+    {
+        if (arena)
+            free(arena);
+        delete[] slabs;
+        arena = nullptr;
+        slabs = nullptr;
+        slab_size = 0;
+        count = 0;
+        head = nil;
+    }
+
+public:
+    FramePool() : head(nil), used(0)
+    {
+    }
+
+    ~FramePool()
+    {
+        free_arena();
+    }
+
+    /**
+     * @brief Allocate count slabs of slab_size bytes each. Not thread safe, and
+     * fails if any handle from a previous reservation is still alive. The
+     * counters start over unless a handle is still alive.
+     *
+     * @return true on success, or if the pool already has this geometry.
+     */
+    bool reserve(size_t slab_size, uint32_t count = FRAMEPOOL_SLABS)
+    {
+        if (used.load() != 0)
+            return false;
+        high_water = 0;
+        exhausted = 0;
+        oversize = 0;
+        slab_size = (slab_size + FRAMEPOOL_ALIGN - 1) / FRAMEPOOL_ALIGN * FRAMEPOOL_ALIGN;
+        if (slab_size == this->slab_size && count == this->count)
+            return true;
+        free_arena();
+        if (slab_size == 0 || count == 0)
+            return true;
+        void *mem = nullptr;
+        if (posix_memalign(&mem, FRAMEPOOL_ALIGN, slab_size * count) != 0)
+            return false;
+        arena = (uint8_t *)mem;
+        slabs = new Slab[count];
+        this->slab_size = slab_size;
+        this->count = count;
+        for (uint32_t i = count; i > 0; i--)
+        {
+            slabs[i - 1].refs = 0;
+            slabs[i - 1].data = arena + (i - 1) * slab_size;
+            push(i - 1);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Set up count slabs without memory, for wrap(). Same rules as reserve().
+     */
+    bool reserve_external(uint32_t count)
+    {
+        if (used.load() != 0)
+            return false;
+        high_water = 0;
+        exhausted = 0;
+        oversize = 0;
+        free_arena();
+        slabs = new Slab[count];
+        this->count = count;
+        for (uint32_t i = count; i > 0; i--)
+        {
+            slabs[i - 1].refs = 0;
+            slabs[i - 1].data = nullptr;
+            push(i - 1);
+        }
+        return true;
+    }
+
+    /**
+     * @brief Hand out a frame that lives outside the pool without copying it,
+     * external pools only. The memory must stay valid until in_use() drops to 0.
+     *
+     * @return Empty handle if all slabs are in use.
+     */
+    FrameHandle wrap(uint8_t *data, const FrameInfo &info)
+    {
+        if (slab_size != 0)
+            return FrameHandle();
+        FrameHandle fh = acquire();
+        if (!fh)
+            return fh;
+        slabs[fh.idx].data = data;
+        slabs[fh.idx].info = info;
+        return fh;
+    }
+
+    /**
+     * @brief Take a free slab, or an empty handle if the pool is exhausted.
+     */
+    FrameHandle acquire()
+    {
+        uint32_t idx = slabs ? pop() : nil;
+        if (idx == nil)
+        {
+            exhausted.fetch_add(1, std::memory_order_relaxed);
+            return FrameHandle();
+        }
+        slabs[idx].refs.store(1, std::memory_order_relaxed);
+        slabs[idx].info = FrameInfo();
+        uint32_t now = used.fetch_add(1, std::memory_order_relaxed) + 1;
+        uint32_t hw = high_water.load(std::memory_order_relaxed);
+        while (now > hw && !high_water.compare_exchange_weak(hw, now, std::memory_order_relaxed))
+            ;
+        return FrameHandle(this, idx);
+    }
+
+    /**
+     * @brief Copy a frame delivered by the driver into a free slab, so that the
+     * driver buffer can be re-queued as soon as the callback returns.
+     *
+     * @return Empty handle if the pool is exhausted or the frame does not fit.
+     */
+    FrameHandle copy(const VmbFrame_t *frame)
+    {
+        size_t size = pixfmt_image_size(frame->pixelFormat, frame->width, frame->height);
+        if (size == 0 || size > frame->bufferSize)
+            size = frame->bufferSize;
+        if (frame->buffer == nullptr || size == 0 || size > slab_size)
+        {
+            oversize.fetch_add(1, std::memory_order_relaxed);
+            return FrameHandle();
+        }
+        FrameHandle fh = acquire();
+        if (!fh)
+            return fh;
+        memcpy(fh.data(), frame->buffer, size);
+        FrameInfo &info = fh.info();
+        info.width = frame->width;
+        info.height = frame->height;
+        info.pixelFormat = frame->pixelFormat;
+        info.frameID = frame->frameID;
+        info.timestamp = frame->timestamp;
+        info.status = frame->receiveStatus;
+        info.size = size;
+        return fh;
+    }
+
+    size_t slab_bytes() const
+    {
+        return slab_size;
+    }
+
+    uint32_t capacity() const
+    {
+        return count;
+    }
+
+    uint32_t in_use() const
+    {
+        return used.load(std::memory_order_relaxed);
+    }
+
+    std::atomic<uint32_t> high_water{0}; // most slabs in use at once since reserve()
+    std::atomic<uint64_t> exhausted{0};  // acquire() calls that found no free slab since reserve()
+    std::atomic<uint64_t> oversize{0};   // frames that did not fit in a slab since reserve()
+};
+
+inline FrameHandle::FrameHandle(const FrameHandle &other) : pool(other.pool), idx(other.idx)
+{
+    if (pool)
+        pool->retain(idx);
+}
+
+inline FrameHandle &FrameHandle::operator=(const FrameHandle &other)
+{
+    if (this != &other)
+    {
+        if (other.pool)
+            other.pool->retain(other.idx);
+        reset();
+        pool = other.pool;
+        idx = other.idx;
+    }
+    return *this;
+}
+
+inline void FrameHandle::reset()
+{
+    if (pool)
+        pool->release(idx);
+    pool = nullptr;
+}
+
+inline uint8_t *FrameHandle::data() const
+{
+    return pool->slabs[idx].data;
+}
+
+inline FrameInfo &FrameHandle::info() const
+{
+    return pool->slabs[idx].info;
+}
@@ -0,0 +1,294 @@
+#include "framestats.hpp"
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define FRAMESTATS_X86
+#endif
+
+// The frame is split into one band per thread, each band fills a Partial.
+// Up to 12 bits the histogram holds every code, so min, max, mean, variance and
+// the saturated count follow exactly from it and the per-sample work is a
+// single histogram increment. Deeper samples additionally go through a
+// vectorized min / max / sum / sum of squares pass fused with the histogram.
+// Four histogram tables are used round robin so that runs of equal samples
+// do not serialize on one counter.
+
+struct Partial
+{
+    uint32_t hist[4][FRAMESTATS_BINS_MAX];
+    uint32_t min;
+    uint32_t max;
+    uint64_t sum;
+    uint64_t sumsq;
+    uint64_t saturated;
+};
+
+static bool has_avx2()
+{
+#ifdef FRAMESTATS_X86
+    static const bool avx2 = []
+    {
+        __builtin_cpu_init();
+        return __builtin_cpu_supports("avx2") != 0;
+    }();
+    return avx2;
+#else
+    return false;
+#endif
+}
+
+static void clear(Partial &p, uint32_t nbins)
+{
+    for (int t = 0; t < 4; t++)
+        memset(p.hist[t], 0, nbins * sizeof(uint32_t));
+    p.min = UINT32_MAX;
+    p.max = 0;
+    p.sum = 0;
+    p.sumsq = 0;
+    p.saturated = 0;
+}
+
+// fold the four tables into the first one
+static void fold(Partial &p, uint32_t nbins)
+{
+    for (uint32_t b = 0; b < nbins; b++)
+        p.hist[0][b] += p.hist[1][b] + p.hist[2][b] + p.hist[3][b];
+}
+
+template <typename T>
+static void hist_band(Partial &p, const T *src, size_t n, uint32_t mask)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        p.hist[0][src[i] & mask]++;
+        p.hist[1][src[i + 1] & mask]++;
+        p.hist[2][src[i + 2] & mask]++;
+        p.hist[3][src[i + 3] & mask]++;
+    }
+    for (; i < n; i++)
+        p.hist[0][src[i] & mask]++;
+}
+
+// 8 samples per load, measurably faster than byte loads
+template <>
+void hist_band<uint8_t>(Partial &p, const uint8_t *src, size_t n, uint32_t mask)
+{
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        uint64_t w;
+        memcpy(&w, src + i, sizeof(w));
+        p.hist[0][w & 0xff]++;
+        p.hist[1][(w >> 8) & 0xff]++;
+        p.hist[2][(w >> 16) & 0xff]++;
+        p.hist[3][(w >> 24) & 0xff]++;
+        p.hist[0][(w >> 32) & 0xff]++;
+        p.hist[1][(w >> 40) & 0xff]++;
+        p.hist[2][(w >> 48) & 0xff]++;
+        p.hist[3][w >> 56]++;
+    }
+    for (; i < n; i++)
+        p.hist[0][src[i] & mask]++;
+}
+
+static void moments_band_scalar(Partial &p, const uint16_t *src, size_t n, uint32_t shift, uint32_t maxcode)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t v = src[i];
+        p.min = std::min(p.min, v);
+        p.max = std::max(p.max, v);
+        p.sum += v;
+        p.sumsq += (uint64_t)v * v;
+        p.saturated += v >= maxcode;
+        p.hist[i & 3][(v >> shift) & (FRAMESTATS_BINS_MAX - 1)]++;
+    }
+}
+
+#ifdef FRAMESTATS_X86
+__attribute__((target("avx2"))) static void moments_band_avx2(Partial &p, const uint16_t *src, size_t n, uint32_t shift, uint32_t maxcode)
+{
+    const __m256i vmaxcode = _mm256_set1_epi16((short)maxcode);
+    __m256i vmin = _mm256_set1_epi16(-1);
+    __m256i vmax = _mm256_setzero_si256();
+    __m256i sq = _mm256_setzero_si256(); // 4 x 64 bit
+    uint64_t sum = 0, saturated = 0;
+    size_t i = 0;
+    while (i + 16 <= n)
+    {
+        // 32 bit lane sums, flushed before they can overflow
+        __m256i sum32 = _mm256_setzero_si256();
+        size_t end = std::min(n - (n - i) % 16, i + 16 * 8192);
+        for (; i < end; i += 16)
+        {
+            __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+            vmin = _mm256_min_epu16(vmin, v);
+            vmax = _mm256_max_epu16(vmax, v);
+            __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v));
+            __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1));
+            sum32 = _mm256_add_epi32(sum32, _mm256_add_epi32(lo, hi));
+            __m256i lo_odd = _mm256_srli_epi64(lo, 32);
+            __m256i hi_odd = _mm256_srli_epi64(hi, 32);
+            sq = _mm256_add_epi64(sq, _mm256_add_epi64(_mm256_mul_epu32(lo, lo), _mm256_mul_epu32(lo_odd, lo_odd)));
+            sq = _mm256_add_epi64(sq, _mm256_add_epi64(_mm256_mul_epu32(hi, hi), _mm256_mul_epu32(hi_odd, hi_odd)));
+            __m256i sat = _mm256_cmpeq_epi16(_mm256_max_epu16(v, vmaxcode), v);
+            saturated += __builtin_popcount(_mm256_movemask_epi8(sat)) / 2;
+            const uint16_t *s = src + i;
+            for (int k = 0; k < 16; k += 4)
+            {
+                p.hist[0][(s[k] >> shift) & (FRAMESTATS_BINS_MAX - 1)]++;
+                p.hist[1][(s[k + 1] >> shift) & (FRAMESTATS_BINS_MAX - 1)]++;
+                p.hist[2][(s[k + 2] >> shift) & (FRAMESTATS_BINS_MAX - 1)]++;
+                p.hist[3][(s[k + 3] >> shift) & (FRAMESTATS_BINS_MAX - 1)]++;
+            }
+        }
+        uint32_t lanes[8];
+        _mm256_storeu_si256((__m256i *)lanes, sum32);
+        for (int k = 0; k < 8; k++)
+            sum += lanes[k];
+    }
+    if (i > 0)
+    {
+        __m128i m = _mm_min_epu16(_mm256_castsi256_si128(vmin), _mm256_extracti128_si256(vmin, 1));
+        p.min = std::min(p.min, (uint32_t)_mm_extract_epi16(_mm_minpos_epu16(m), 0));
+        __m128i inv = _mm_xor_si128(_mm_max_epu16(_mm256_castsi256_si128(vmax), _mm256_extracti128_si256(vmax, 1)), _mm_set1_epi16(-1));
+        p.max = std::max(p.max, (uint32_t)(0xffff ^ _mm_extract_epi16(_mm_minpos_epu16(inv), 0)));
+        uint64_t sqs[4];
+        _mm256_storeu_si256((__m256i *)sqs, sq);
+        p.sum += sum;
+        p.sumsq += sqs[0] + sqs[1] + sqs[2] + sqs[3];
+        p.saturated += saturated;
+    }
+    moments_band_scalar(p, src + i, n - i, shift, maxcode);
+}
+#endif
+
+static void finish_from_hist(Partial &p, uint32_t nbins, uint32_t maxcode)
+{
+    p.min = UINT32_MAX;
+    p.max = 0;
+    for (uint32_t b = 0; b < nbins; b++)
+    {
+        uint64_t c = p.hist[0][b];
+        if (c == 0)
+            continue;
+        p.min = std::min(p.min, b);
+        p.max = b;
+        p.sum += c * b;
+        p.sumsq += c * b * b;
+        if (b >= maxcode)
+            p.saturated += c;
+    }
+}
+
+static void finish(FrameStats &st, Partial &p, size_t n)
+{
+    memcpy(st.hist, p.hist[0], st.nbins * sizeof(uint32_t));
+    st.count = n;
+    st.min = n ? p.min : 0;
+    st.max = p.max;
+    st.saturated = p.saturated;
+    st.mean = n ? (double)p.sum / n : 0;
+    double var = n ? (double)p.sumsq / n - st.mean * st.mean : 0;
+    st.stddev = var > 0 ? sqrt(var) : 0;
+}
+
+// one band per thread, partials live with the calling thread
+static std::vector<Partial> &partials(uint32_t count)
+{
+    static thread_local std::vector<Partial> parts;
+    if (parts.size() < count)
+        parts.resize(count);
+    return parts;
+}
+
+// merge bands 1.. into band 0
+static void merge(Partial *parts, uint32_t nparts, uint32_t nbins)
+{
+    for (uint32_t k = 1; k < nparts; k++)
+    {
+        for (uint32_t b = 0; b < nbins; b++)
+            parts[0].hist[0][b] += parts[k].hist[0][b];
+        parts[0].min = std::min(parts[0].min, parts[k].min);
+        parts[0].max = std::max(parts[0].max, parts[k].max);
+        parts[0].sum += parts[k].sum;
+        parts[0].sumsq += parts[k].sumsq;
+        parts[0].saturated += parts[k].saturated;
+    }
+}
+
+template <typename T>
+static void hist_stats(ThreadPool &pool, FrameStats &st, const T *src, size_t n, uint32_t bits, uint32_t nbins)
+{
+    uint32_t nparts = n < 65536 ? 1 : pool.size() + 1;
+    std::vector<Partial> &parts = partials(nparts);
+    size_t band = (n + nparts - 1) / nparts;
+    pool.parallel_for(nparts, [&](uint32_t k)
+                      {
+                          size_t start = std::min(n, k * band);
+                          size_t len = std::min(n - start, band);
+                          clear(parts[k], nbins);
+                          hist_band(parts[k], src + start, len, nbins - 1);
+                          fold(parts[k], nbins); });
+    merge(parts.data(), nparts, nbins);
+    finish_from_hist(parts[0], nbins, (1u << bits) - 1);
+    finish(st, parts[0], n);
+}
+
+void framestats_u8(ThreadPool &pool, FrameStats &st, const uint8_t *src, size_t n)
+{
+    st.bits = 8;
+    st.nbins = 256;
+    st.bin_shift = 0;
+    hist_stats(pool, st, src, n, 8, 256);
+}
+
+void framestats_u16(ThreadPool &pool, FrameStats &st, const uint16_t *src, size_t n, uint32_t bits)
+{
+    bits = std::max(9u, std::min(16u, bits));
+    st.bits = bits;
+    st.nbins = FRAMESTATS_BINS_MAX;
+    st.bin_shift = bits > 12 ? bits - 12 : 0;
+    if (bits <= 12)
+    {
+        hist_stats(pool, st, src, n, bits, FRAMESTATS_BINS_MAX);
+        return;
+    }
+    uint32_t nparts = n < 65536 ? 1 : pool.size() + 1;
+    std::vector<Partial> &parts = partials(nparts);
+    size_t band = (n + nparts - 1) / nparts;
+    uint32_t maxcode = (1u << bits) - 1;
+    void (*moments)(Partial &, const uint16_t *, size_t, uint32_t, uint32_t) = moments_band_scalar;
+#ifdef FRAMESTATS_X86
+    if (has_avx2())
+        moments = moments_band_avx2;
+#endif
+    pool.parallel_for(nparts, [&](uint32_t k)
+                      {
+                          size_t start = std::min(n, k * band);
+                          size_t len = std::min(n - start, band);
+                          clear(parts[k], FRAMESTATS_BINS_MAX);
+                          moments(parts[k], src + start, len, st.bin_shift, maxcode);
+                          fold(parts[k], FRAMESTATS_BINS_MAX); });
+    merge(parts.data(), nparts, FRAMESTATS_BINS_MAX);
+    finish(st, parts[0], n);
+}
+
+void framestats_u16_scalar(FrameStats &st, const uint16_t *src, size_t n, uint32_t bits)
+{
+    bits = std::max(9u, std::min(16u, bits));
+    st.bits = bits;
+    st.nbins = FRAMESTATS_BINS_MAX;
+    st.bin_shift = bits > 12 ? bits - 12 : 0;
+    Partial &p = partials(1)[0];
+    clear(p, FRAMESTATS_BINS_MAX);
+    moments_band_scalar(p, src, n, st.bin_shift, (1u << bits) - 1);
+    fold(p, FRAMESTATS_BINS_MAX);
+    finish(st, p, n);
+}
@@ -0,0 +1,47 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+#include "threadpool.hpp"
+
+#define FRAMESTATS_BINS_MAX 4096
+
+/**
+ * @brief Statistics over all samples of one frame.
+ *
+ * The histogram has 256 bins for 8 bit data and 4096 bins otherwise. Up to 12
+ * bits every code has its own bin, deeper samples are binned by their top 12
+ * bits (bin = sample >> bin_shift).
+ */
+struct FrameStats
+{
+    uint64_t frameID = 0;
+    uint32_t bits = 0;      // significant bits per sample
+    uint32_t nbins = 0;     // 256 or 4096
+    uint32_t bin_shift = 0; // bin = sample >> bin_shift
+    uint64_t count = 0;     // samples
+    uint32_t min = 0;
+    uint32_t max = 0;
+    double mean = 0;
+    double stddev = 0;
+    uint64_t saturated = 0; // samples at the largest code for the bit depth
+    uint32_t hist[FRAMESTATS_BINS_MAX];
+};
+
+/**
+ * @brief Compute statistics of n 8 bit samples, split across the thread pool.
+ */
+void framestats_u8(ThreadPool &pool, FrameStats &st, const uint8_t *src, size_t n);
+
+/**
+ * @brief Compute statistics of n 16 bit samples holding bits significant bits (9 - 16).
+ *
+ * Samples are expected to be LSB aligned; anything above the bit depth is
+ * ignored for the histogram of 9 - 12 bit data.
+ */
+void framestats_u16(ThreadPool &pool, FrameStats &st, const uint16_t *src, size_t n, uint32_t bits);
+
+/**
+ * @brief Single threaded scalar reference implementation of framestats_u16.
+ */
+void framestats_u16_scalar(FrameStats &st, const uint16_t *src, size_t n, uint32_t bits);
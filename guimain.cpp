@@ -14,23 +14,102 @@
 #include "backend/imgui_impl_opengl2.h"
 #include <stdio.h>
 #include <unistd.h>
+#include <getopt.h>
 
 #include "aDIO_library.h"
 
 #ifdef __APPLE__
 #define GL_SILENCE_DEPRECATION
 #endif
+#define GLFW_INCLUDE_GLEXT
 #include <GLFW/glfw3.h>
 
 #include "imagetexture.hpp"
 #include "guiwin.hpp"
 #include "camlist.hpp"
+#include "headless.hpp"
 
 static void glfw_error_callback(int error, const char* description)
 {
     fprintf(stderr, "Glfw Error %d: %s\n", error, description);
 }
 
+// long options without a short form are SessionConfig keys
+static const struct option long_opts[] = {
+    {"camera", required_argument, NULL, 'c'},
+    {"adio", required_argument, NULL, 'a'},
+    {"cti", required_argument, NULL, 'p'},
+    {"help", no_argument, NULL, 'h'},
+    {"headless", no_argument, NULL, 'H'},
+    {"config", required_argument, NULL, 'f'},
+    {"format", required_argument, NULL, 0},
+    {"adc", required_argument, NULL, 0},
+    {"binning", required_argument, NULL, 0},
+    {"size", required_argument, NULL, 0},
+    {"offset", required_argument, NULL, 0},
+    {"exposure", required_argument, NULL, 0},
+    {"framerate", required_argument, NULL, 0},
+    {"link-speed", required_argument, NULL, 0},
+    {"dir", required_argument, NULL, 0},
+    {"record", no_argument, NULL, 0},
+    {"compress", no_argument, NULL, 0},
+    {"bitpack", no_argument, NULL, 0},
+    {"flight", required_argument, NULL, 0},
+    {"flight-pre", required_argument, NULL, 0},
+    {"flight-post", required_argument, NULL, 0},
+    {"flight-trigger", required_argument, NULL, 0},
+    {"burst", required_argument, NULL, 0},
+    {"frame-log", required_argument, NULL, 0},
+    {"duration", required_argument, NULL, 0},
+    {"stats", required_argument, NULL, 0},
+    {"virtual", required_argument, NULL, 0},
+    {"virtual-size", required_argument, NULL, 0},
+    {"virtual-pattern", required_argument, NULL, 0},
+    {"virtual-seed", required_argument, NULL, 0},
+    {"virtual-temps", required_argument, NULL, 0},
+    {NULL, 0, NULL, 0},
+};
+
+static void usage(const char *name)
+{
+    printf("\nUsage: %s [options]\n\n", name);
+    printf("  -c, --camera ID         Only this camera\n");
+    printf("  -a, --adio MINOR        aDIO minor number\n");
+    printf("  -p, --cti PATH          Path to the .cti files\n");
+    printf("  -f, --config FILE       Settings below as key = value lines, the command line wins\n");
+    printf("      --headless          No window: capture, record and print statistics\n");
+    printf("  -h, --help              Show this message\n\n");
+    printf("Camera settings, applied when a camera is opened:\n");
+    printf("      --format NAME       Pixel format, e.g. Mono12\n");
+    printf("      --adc NAME          Sensor bit depth, e.g. Bpp12\n");
+    printf("      --binning N\n");
+    printf("      --size WxH\n");
+    printf("      --offset XxY\n");
+    printf("      --exposure US\n");
+    printf("      --framerate HZ|auto\n");
+    printf("      --link-speed MBPS\n\n");
+    printf("Recording (directory and defaults for the window):\n");
+    printf("      --dir DIR           Where recordings, dumps and bursts go (default .)\n");
+    printf("      --record            Record from the start (headless)\n");
+    printf("      --compress          Compress losslessly\n");
+    printf("      --bitpack           Pack samples to the sensor bit depth\n");
+    printf("      --flight GIB        Arm the flight recorder with this much memory (headless)\n");
+    printf("      --flight-pre S      Seconds kept before a trigger (default 10)\n");
+    printf("      --flight-post S     Seconds kept after a trigger (default 5)\n");
+    printf("      --flight-trigger B  aDIO port 1 input bit that triggers a dump, or SIGUSR1\n");
+    printf("      --burst N           Capture N frames into memory, write them out and exit (headless)\n");
+    printf("      --frame-log FILE    Append lost, incomplete and dropped frames with timestamps\n\n");
+    printf("Headless run:\n");
+    printf("      --duration S        Stop after S seconds (default: on Ctrl+C)\n");
+    printf("      --stats S           Print statistics every S seconds (default 1)\n\n");
+    printf("Virtual cameras (work without Vimba):\n");
+    printf("      --virtual N         Add N virtual cameras, IDs " VIRTCAM_ID_PREFIX "0 and up\n");
+    printf("      --virtual-size WxH  Sensor size (default 4096x3000)\n");
+    printf("      --virtual-pattern P noise, ramp, checker, gradient, stars or bayer\n");
+    printf("      --virtual-seed N    Seed of the generated frames\n");
+    printf("      --virtual-temps N   Temperature sensors, up to 3 (default 2)\n\n");
+}
+
 int main(int argc, char *argv[])
 {
     // arguments
@@ -38,9 +117,14 @@ int main(int argc, char *argv[])
     int adio_minor_num = 0;
     bool adio_init = true;
     std::string cti_path = "";
+    bool headless = false;
+    const char *config_path = NULL;
+    std::vector<std::pair<std::string, const char *>> settings; // applied over the config file
+    SessionConfig cfg;
+    std::string cfg_err;
     // process args
-    int c;
-    while ((c = getopt(argc, argv, "c:a:h:p:")) != -1)
+    int c, idx = 0;
+    while ((c = getopt_long(argc, argv, "c:a:hp:f:", long_opts, &idx)) != -1)
     {
         switch (c)
         {
@@ -62,14 +146,43 @@ int main(int argc, char *argv[])
                 cti_path = optarg;
                 break;
             }
+            case 'H':
+            {
+                headless = true;
+                break;
+            }
+            case 'f':
+            {
+                config_path = optarg;
+                break;
+            }
+            case 0:
+            {
+                settings.push_back(std::make_pair(std::string(long_opts[idx].name), optarg));
+                break;
+            }
             case 'h':
             default:
             {
-                printf("\nUsage: %s [-c camera_id] [-a adio_minor_num] [-p /path/to/cti/files] [-h Show this message]\n\n", argv[0]);
-                exit(EXIT_SUCCESS);
+                usage(argv[0]);
+                exit(c == 'h' ? EXIT_SUCCESS : EXIT_FAILURE);
             }
         }
     }
+    if (config_path != NULL && !cfg.load(config_path, cfg_err))
+    {
+        fprintf(stderr, "%s\n", cfg_err.c_str());
+        exit(EXIT_FAILURE);
+    }
+    for (auto it = settings.begin(); it != settings.end(); it++)
+    {
+        if (!cfg.set(it->first, it->second, cfg_err))
+        {
+            fprintf(stderr, "%s\n", cfg_err.c_str());
+            exit(EXIT_FAILURE);
+        }
+    }
+    virtcam_setup(cfg.virt);
     // setup ADIO API
     DeviceHandle adio_dev = nullptr;
     if (OpenDIO_aDIO(&adio_dev, adio_minor_num) != 0)
@@ -107,8 +220,21 @@ done_allied:
     if (allied_init_api(cti_path_cstr) != VmbErrorSuccess)
     {
         printf("Could not initialize the Allied Camera API. Check if .cti files are in path.\n");
-        exit(EXIT_FAILURE);
-    } 
+        if (cfg.virt.count == 0)
+            exit(EXIT_FAILURE);
+        printf("Continuing with the virtual cameras only.\n");
+    }
+    else
+    {
+        vimba_ready = true;
+    }
+    if (headless) // no GL context at all
+    {
+        int ret = run_headless(camera_id, adio_dev, cfg);
+        if (adio_dev != nullptr)
+            CloseDIO_aDIO(adio_dev);
+        return ret;
+    }
     // Setup window
     glfwSetErrorCallback(glfw_error_callback);
     if (!glfwInit())
@@ -154,7 +280,7 @@ done_allied:
     ImVec4 clear_color = ImVec4(0.45f, 0.55f, 0.60f, 1.00f);
 
     CameraList *camlist;
-    camlist = new CameraList(camera_id, adio_dev);
+    camlist = new CameraList(camera_id, adio_dev, &cfg);
 
     // Main loop
     while (!glfwWindowShouldClose(window))
@@ -3,512 +3,119 @@
 #include "imgui/imgui.h"
 #include <stdio.h>
 #include <math.h>
+#include <algorithm>
 #include <chrono>
-#include <mutex>
-#include <thread>
 #include <vector>
 
 #include <alliedcam.h>
 
 #include "string_format.hpp"
 
+#include "camsession.hpp"
 #include "imagetexture.hpp"
+#include "imageview.hpp"
 
 #include "imgui_separator.hpp"
 
-#define eprintlf(fmt, ...)                                                                     \
-    {                                                                                          \
-        fprintf(stderr, "%s:%d:%s(): " fmt "\n", __FILE__, __LINE__, __func__, ##__VA_ARGS__); \
-        fflush(stderr);                                                                        \
-    }
-
 static ImVec4 header_col = ImVec4(168.0 / 255, 21.0 / 255, 5.0 / 255, 1);
 
-class CaptureStat
+class ImageDisplay
 {
 private:
-    std::chrono::steady_clock::time_point last;
-    bool firstrun = true;
-    double avg = 0, avg2 = 0;
-    uint64_t count = 0;
-    std::mutex mtx;
-
-    void update_avg(double period)
-    {
-        uint64_t ncount = count++;
-        avg = (avg * ncount + period) / (count);
-        avg2 = (avg2 * ncount + period * period) / (count);
-    }
-
-public:
-    void reset()
-    {
-        std::lock_guard<std::mutex> lock(mtx);
-        firstrun = true;
-        avg = 0;
-        avg2 = 0;
-        count = 0;
-    }
-
-    void update()
-    {
-        std::lock_guard<std::mutex> lock(mtx);
-        if (firstrun)
-        {
-            last = std::chrono::steady_clock::now();
-            firstrun = false;
-        }
-        else
-        {
-            auto now = std::chrono::steady_clock::now();
-            auto diff = now - last;
-            auto diff_us = std::chrono::duration_cast<std::chrono::microseconds>(diff);
-            double period = diff_us.count();
-            update_avg(period);
-            last = now;
-        }
-    }
-
-    void get_stats(double &avg, double &stddev)
-    {
-        avg = this->avg;
-        stddev = sqrt(avg2 - avg * avg);
-    }
-};
-
-class CameraInfo
-{
-public:
-    std::string idstr;
-    std::string name;
-    std::string model;
-    std::string serial;
-
-    CameraInfo(CameraInfo &other)
-    {
-        idstr = other.idstr;
-        name = other.name;
-        model = other.model;
-        serial = other.serial;
-    }
-
-    CameraInfo()
-    {
-        idstr = "";
-        name = "";
-        model = "";
-        serial = "";
-    }
-
-    CameraInfo(CameraInfo *other)
-    {
-        idstr = other->idstr;
-        name = other->name;
-        model = other->model;
-        serial = other->serial;
-    }
+    std::string title;
+    CameraSession cam; // its pool must outlive img
+    Image img;
+    ImageView view;
+    char rec_dir[256] = ".";
+    bool rec_bitpack = false; // to the sensor bit depth
+    float flight_gb = 2.0f;
+    float flight_pre_s = 10.0f;
+    float flight_post_s = 5.0f;
+    int burst_frames = 1000;
+    const SessionConfig *cfg = nullptr;
 
-    CameraInfo(VmbCameraInfo_t info)
+    static const FrameStats *FrameCallback(const FrameHandle &frame, void *user_data)
     {
-        idstr = info.cameraIdString;
-        name = info.cameraName;
-        model = info.modelName;
-        serial = info.serialString;
+        ImageDisplay *self = (ImageDisplay *)user_data;
+        uint64_t superseded = self->img.superseded, dropped = self->img.dropped;
+        self->img.update(frame);
+        if (frame && self->img.dropped != dropped) // an empty frame was counted by the session already
+            self->cam.acct.on_dropped(frame.info().frameID, FRAMEDROP_DISPLAY);
+        self->cam.acct.on_superseded(self->img.superseded - superseded);
+        return self->img.last_stats();
     }
-};
 
-class CharContainer
-{
-private:
-    char *strdup(const char *str)
+    static void StartCallback(uint32_t width, uint32_t height, VmbPixelFormat_t pfmt, void *user_data)
     {
-        int len = strlen(str);
-        char *out = new char[len + 1];
-        strcpy(out, str);
-        return out;
+        ImageDisplay *self = (ImageDisplay *)user_data;
+        self->img.clear();
+        self->img.reset_counters();
+        self->view.reset();
+        self->img.reserve(width, height, pfmt);
     }
 
 public:
-    char **arr = nullptr;
-    int narr = 0;
-    int selected;
-    size_t maxlen = 0;
-
-    ~CharContainer()
-    {
-        if (arr)
-        {
-            for (int i = 0; i < narr; i++)
-            {
-                delete[] arr[i];
-            }
-            delete[] arr;
-        }
-    }
-
-    CharContainer()
-    {
-        arr = nullptr;
-        narr = 0;
-        selected = -1;
-    }
-
-    CharContainer(const char **arr, int narr)
-    {
-        this->arr = new char *[narr];
-        this->narr = narr;
-        this->selected = -1;
-        for (int i = 0; i < narr; i++)
-        {
-            this->arr[i] = strdup(arr[i]);
-            if (strlen(arr[i]) > maxlen)
-            {
-                maxlen = strlen(arr[i]);
-            }
-        }
-    }
-
-    CharContainer(const char **arr, int narr, const char *key)
-    {
-        this->arr = new char *[narr];
-        this->narr = narr;
-        for (int i = 0; i < narr; i++)
-        {
-            this->arr[i] = strdup(arr[i]);
-            if (strlen(arr[i]) > maxlen)
-            {
-                maxlen = strlen(arr[i]);
-            }
-        }
-        this->selected = find_idx(key);
-    }
-
-    int find_idx(const char *str)
-    {
-        int res = -1;
-        for (int i = 0; i < narr; i++)
-        {
-            if (strcmp(arr[i], str) == 0)
-                res = i;
-        }
-        return res;
-    }
-};
-
-#define TEMPSENSOR_RESPONSE 100
-
-class TempSensors
-{
-private:
-    char **arr = nullptr;
-    VmbBool_t *supported = nullptr;
-    VmbUint32_t narr = 0;
-    uint32_t cadence_mod = 100;
-    uint32_t cadence_loop = 0;
-    AlliedCameraHandle_t handle = nullptr;
-    bool running = false;
-    bool errored = true;
-    std::thread opthread;
-    std::mutex mtx;
-    std::vector<double> temps;
-
-    static void ThreadFcn(TempSensors *self)
-    {
-        while (self->running)
-        {
-            self->update();
-            std::this_thread::sleep_for(std::chrono::milliseconds(self->cadence_mod));
-            for (uint32_t i = 0; i < self->cadence_loop && self->running; i++)
-            {
-                std::this_thread::sleep_for(std::chrono::milliseconds(TEMPSENSOR_RESPONSE));
-            }
-        }
-    }
+    bool show;
 
-    void update()
+    ImageDisplay(const CameraInfo &info, const DeviceHandle &adio_hdl, const SessionConfig *cfg = nullptr)
+        : cam(info, adio_hdl)
     {
-        std::lock_guard<std::mutex> lock(mtx);
-        if (arr == nullptr || supported == nullptr || temps.size() != narr)
-            return;
-        VmbError_t err;
-        for (VmbUint32_t i = 0; i < narr; i++)
+        show = false;
+        title = info.name + " [" + info.serial + "]";
+        cam.set_callbacks(&FrameCallback, &StartCallback, (void *)this);
+        this->cfg = cfg;
+        if (cfg != nullptr)
         {
-            temps[i] = -280; // set to invalid temperature
-            if (supported[i])
-            {
-                err = allied_set_temperature_src(handle, arr[i]);
-                if (err != VmbErrorSuccess)
-                {
-                    continue;
-                }
-                err = allied_get_temperature(handle, &temps[i]);
-                if (err != VmbErrorSuccess)
-                {
-                    temps[i] = -280;
-                }
-            }
+            snprintf(rec_dir, sizeof(rec_dir), "%s", cfg->dir.c_str());
+            rec_bitpack = cfg->bitpack;
+            cam.recorder.set_compression(cfg->compress);
+            if (cfg->flight_gib > 0)
+                flight_gb = cfg->flight_gib;
+            flight_pre_s = cfg->flight_pre_s;
+            flight_post_s = cfg->flight_post_s;
+            cam.flight_trig_bit = cfg->flight_trigger;
+            cam.flight_trig_level = true; // wait for the line to go low first
+            if (cfg->burst > 0)
+                burst_frames = cfg->burst;
         }
     }
 
-public:
-    TempSensors(AlliedCameraHandle_t handle, uint32_t cadence_ms = 1000) // default to 1 s cadence
+    ~ImageDisplay()
     {
-        this->handle = handle;
-        this->cadence_mod = cadence_ms % TEMPSENSOR_RESPONSE;
-        this->cadence_loop = cadence_ms / TEMPSENSOR_RESPONSE;
-        VmbError_t err = allied_get_temperature_src_list(handle, &arr, &supported, &narr);
-        if (err == VmbErrorSuccess)
-        {
-            temps.resize(narr);
-            errored = false;
-            running = true;
-            opthread = std::thread(ThreadFcn, this);
-            return;
-        }
-        std::cerr << "Could not get temperature sensor list: " << allied_strerr(err) << std::endl;
-        if (arr)
-            free(arr);
-        if (supported)
-            free(supported);
-        arr = nullptr;
-        supported = nullptr;
+        cam.close_camera(); // stops the callbacks into img
     }
 
-    ~TempSensors()
+    void open_camera()
     {
-        if (!errored)
-        {
-            running = false;
-            opthread.join();
-        }
-        if (arr)
-            free(arr);
-        if (supported)
-            free(supported);
+        cam.open_camera();
+        if (cam.opened && cfg != nullptr)
+            cam.apply(*cfg);
     }
 
-    const char **get_temps(std::vector<double> &temps)
+    bool running()
     {
-        temps = this->temps;
-        return (const char **)arr;
+        return cam.running();
     }
-};
-
-class ImageDisplay
-{
-private:
-    CameraInfo info;
-    std::string title;
-    bool opened;
-    AlliedCameraHandle_t handle = nullptr;
-    std::string errmsg;
-    Image img;
-    CaptureStat stat;
-    CharContainer *pixfmts = nullptr;
-    CharContainer *adcrates = nullptr;
-    CharContainer *triglines = nullptr;
-    CharContainer *trigsrcs = nullptr;
-    TempSensors *tempsensors = nullptr;
-    DeviceHandle adio_hdl = nullptr;
-    VmbInt64_t link_speed = 0;
-    std::string link_speed_str = "";
-    VmbInt64_t throughput = 0;
-    VmbInt64_t throughput_min = 0;
-    VmbInt64_t throughput_max = 0;
-    unsigned char state = 0;
-    bool capturing;
 
-    ImVec2 render_size(uint32_t swid, uint32_t shgt)
+    VmbError_t start_capture()
     {
-        ImVec2 avail_size = ImGui::GetContentRegionAvail();
-        float wid = avail_size[0]; // get window width
-        float hgt = avail_size[1]; // get window height
-        ImVec2 out = ImVec2(
-            wid,
-            round((float)shgt / (float)swid * wid) // calculate height
-        );
-        if (out[1] > hgt)
-        {
-            out[1] = hgt;
-            out[0] = round((float)swid / (float)shgt * hgt); // calculate width
-        }
-        return out;
+        return cam.start_capture();
     }
 
-public:
-    bool show;
-    int adio_bit = -1;
-
-    ImageDisplay(const CameraInfo &info, const DeviceHandle &adio_hdl)
+    VmbError_t stop_capture()
     {
-        show = false;
-        this->info = info;
-        this->adio_hdl = adio_hdl;
-        title = info.name + " [" + info.serial + "]";
-        opened = false;
-        capturing = false;
-        // open_camera();
+        return cam.stop_capture();
     }
 
-    void open_camera(uint32_t bufsize = MIB(16))
+    int get_adio_bit()
     {
-        VmbError_t err = allied_open_camera(&handle, info.idstr.c_str(), bufsize);
-        if (err != VmbErrorSuccess)
-        {
-            errmsg = "Could not open camera: " + std::string(allied_strerr(err));
-            return;
-        }
-        char *key = nullptr;
-        char **arr = nullptr;
-        VmbUint32_t narr = 0;
-        err = allied_get_link_speed(handle, &link_speed);
-        if (err != VmbErrorSuccess)
-        {
-            update_err("Could not get link speed", err);
-        }
-        link_speed_str = string_format("Link Speed Settings (Max: %d MBps)", link_speed / 1000 / 1000);
-        err = allied_get_throughput_limit(handle, &throughput);
-        if (err != VmbErrorSuccess)
-        {
-            update_err("Could not get throughput limit", err);
-        }
-        err = allied_get_throughput_limit_range(handle, &throughput_min, &throughput_max, NULL);
-        if (err != VmbErrorSuccess)
-        {
-            update_err("Could not get throughput limit range", err);
-        }
-        err = allied_get_image_format(handle, (const char **)&key);
-        if (err == VmbErrorSuccess)
-        {
-            err = allied_get_image_format_list(handle, &arr, NULL, &narr);
-            if (err == VmbErrorSuccess)
-            {
-                pixfmts = new CharContainer((const char **)arr, narr, key);
-                free(arr);
-                narr = 0;
-            }
-            else
-            {
-                update_err("Could not get image format list", err);
-            }
-        }
-        else
-        {
-            update_err("Could not get image format", err);
-        }
-        err = allied_get_sensor_bit_depth(handle, (const char **)&key);
-        if (err == VmbErrorSuccess)
-        {
-            err = allied_get_sensor_bit_depth_list(handle, &arr, NULL, &narr);
-            if (err == VmbErrorSuccess)
-            {
-                adcrates = new CharContainer((const char **)arr, narr, (const char *)key);
-                free(arr);
-                narr = 0;
-            }
-            else
-            {
-                update_err("Could not get sensor bit depth list", err);
-            }
-        }
-        else
-        {
-            update_err("Could not get image format", err);
-        }
-        err = allied_get_trigline(handle, (const char **)&key);
-        if (err == VmbErrorSuccess)
-        {
-            err = allied_get_triglines_list(handle, &arr, NULL, &narr);
-            if (err == VmbErrorSuccess)
-            {
-                triglines = new CharContainer((const char **)arr, narr, (const char *)key);
-                free(arr);
-                narr = 0;
-            }
-            else
-            {
-                update_err("Could not get trigger lines list", err);
-            }
-        }
-        else
-        {
-            update_err("Could not get selected trigger line", err);
-        }
-        if (triglines != nullptr)
-        {
-            // set all trigger lines to output
-            for (int i = 0; i < triglines->narr; i++)
-            {
-                char *line = triglines->arr[i];
-                err = allied_set_trigline(handle, line);
-                if (err != VmbErrorSuccess)
-                {
-                    update_err(string_format("Could not select line %s", line), err);
-                }
-                else
-                {
-                    err = allied_set_trigline_mode(handle, "Output");
-                    update_err(string_format("Could not set line %s to output", line), err);
-                }
-            }
-            err = allied_set_trigline(handle, key);
-            update_err(string_format("Could not select line %s", key), err);
-            // get trigger source
-            err = allied_get_trigline_src(handle, (const char **)&key);
-            if (err == VmbErrorSuccess)
-            {
-                err = allied_get_trigline_src_list(handle, &arr, NULL, &narr);
-                if (err == VmbErrorSuccess)
-                {
-                    trigsrcs = new CharContainer((const char **)arr, narr, (const char *)key);
-                    free(arr);
-                    narr = 0;
-                }
-                else
-                {
-                    update_err("Could not get trigger sources list", err);
-                }
-            }
-        }
-        err = allied_queue_capture(handle, &Callback, (void *)this);
-        update_err("Could not queue capture", err);
-        tempsensors = new TempSensors(handle);
-        opened = true;
-        // std::cout << "Opened!" << std::endl;
+        return cam.adio_bit;
     }
 
-    void close_camera()
+    void set_adio_bit(int bit)
     {
-        cleanup();
-        if (pixfmts != nullptr)
-        {
-            delete pixfmts;
-            pixfmts = nullptr;
-        }
-        if (adcrates != nullptr)
-        {
-            delete adcrates;
-            adcrates = nullptr;
-        }
-        if (triglines != nullptr)
-        {
-            delete triglines;
-            triglines = nullptr;
-        }
-        if (trigsrcs != nullptr)
-        {
-            delete trigsrcs;
-            trigsrcs = nullptr;
-        }
-        if (tempsensors != nullptr)
-        {
-            delete tempsensors;
-            tempsensors = nullptr;
-        }
-        opened = false;
-        errmsg = "";
+        cam.adio_bit = bit;
     }
-
     void display()
     {
         static bool bin_changed = true;
@@ -528,8 +135,8 @@ public:
         static bool frate_auto = true;
         static bool frate_changed = true;
         static bool trigline_changed = true;
-        static int speed = throughput / 1000 / 1000;
-        static std::string window_id = string_format("%016x", (uint64_t)handle);
+        static int speed = cam.throughput / 1000 / 1000;
+        static std::string window_id = string_format("%016x", (uint64_t)cam.handle);
         static std::string pixfmt_id = string_format("##pixfmt_%s", window_id.c_str());
         static std::string adcbpp_id = string_format("##adcbpp_%s", window_id.c_str());
         static std::string bin_id = string_format("##bin_%s", window_id.c_str());
@@ -549,35 +156,36 @@ public:
         static std::string speed_id = string_format("##speed_%s", window_id.c_str());
         static std::string update_speed_id = string_format("Update##speed_%s", window_id.c_str());
 
+        cam.poll(); // also while the window is hidden
 
         ImGui::SetNextWindowSizeConstraints(ImVec2(512, 640), ImVec2(INFINITY, INFINITY));
         const float TEXT_BASE_WIDTH = ImGui::CalcTextSize("A").x;
         if (show && ImGui::Begin(title.c_str(), &show))
         {
             ImGui::PushID(window_id.c_str());
-            if (!opened)
+            if (!cam.opened)
             {
                 if (ImGui::Button("Open Camera"))
                 {
                     open_camera();
                 }
-                ImGui::Text("Last error: %s", errmsg.c_str());
+                ImGui::Text("Last error: %s", cam.errmsg.c_str());
             }
             else
             {
                 VmbError_t err;
-                capturing = allied_camera_acquiring(handle);
+                cam.capturing = cam.backend->camera_acquiring(cam.handle);
                 if (ImGui::Button("Close Camera"))
                 {
-                    close_camera();
+                    cam.close_camera();
                     goto outside;
                 }
                 ImGui::SameLine();
                 if (ImGui::Button("Reset Camera"))
                 {
-                    opened = false;
-                    allied_reset_camera(&handle);
-                    close_camera();
+                    cam.opened = false;
+                    cam.backend->reset_camera(&cam.handle);
+                    cam.close_camera();
                     goto outside;
                 }
                 ImGui::SameLine();
@@ -586,8 +194,8 @@ public:
                     {
                         luma_changed = false;
                         VmbInt64_t luma;
-                        err = allied_get_indicator_luma(handle, &luma);
-                        update_err("Getting indicator status", err);
+                        err = cam.backend->get_indicator_luma(cam.handle, &luma);
+                        cam.update_err("Getting indicator status", err);
                         if (err == VmbErrorSuccess)
                         {
                             led_on = luma > 0;
@@ -597,19 +205,19 @@ public:
                     {
                         if (led_on)
                         {
-                            err = allied_set_indicator_luma(handle, 10);
+                            err = cam.backend->set_indicator_luma(cam.handle, 10);
                         }
                         else
                         {
-                            err = allied_set_indicator_luma(handle, 0);
+                            err = cam.backend->set_indicator_luma(cam.handle, 0);
                         }
-                        update_err("Setting indicator status", err);
+                        cam.update_err("Setting indicator status", err);
                         luma_changed = true;
                     }
                 }
                 {
                     std::vector<double> temps;
-                    const char **srcs = tempsensors->get_temps(temps);
+                    const char **srcs = cam.tempsensors->get_temps(temps);
                     ImGui::Text("Temperatures:");
                     for (size_t i = 0; i < temps.size(); i++)
                     {
@@ -628,37 +236,37 @@ public:
                     if (frate_changed)
                     {
                         double dummy;
-                        err = allied_get_acq_framerate(handle, &frate);
-                        update_err("Get framerate", err);
-                        err = allied_get_acq_framerate_range(handle, &frate_min, &frate_max, &dummy);
-                        update_err("Get framerate range", err);
+                        err = cam.backend->get_acq_framerate(cam.handle, &frate);
+                        cam.update_err("Get framerate", err);
+                        err = cam.backend->get_acq_framerate_range(cam.handle, &frate_min, &frate_max, &dummy);
+                        cam.update_err("Get framerate range", err);
                         frate_changed = false;
                     }
                     // Select pixel format and ADC bpp
-                    if (pixfmts != nullptr && adcrates != nullptr)
+                    if (cam.pixfmts != nullptr && cam.adcrates != nullptr)
                     {
                         ImGui::Text("Pixel Format:");
                         ImGui::SameLine();
-                        ImGui::PushItemWidth(TEXT_BASE_WIDTH * (pixfmts->maxlen + 6));
-                        int sel = pixfmts->selected;
-                        if (ImGui::Combo(pixfmt_id.c_str(), &sel, pixfmts->arr, pixfmts->narr))
+                        ImGui::PushItemWidth(TEXT_BASE_WIDTH * (cam.pixfmts->maxlen + 6));
+                        int sel = cam.pixfmts->selected;
+                        if (ImGui::Combo(pixfmt_id.c_str(), &sel, cam.pixfmts->arr, cam.pixfmts->narr))
                         {
-                            if (!capturing)
+                            if (!cam.capturing)
                             {
                                 // pixfmts->selected = sel;
-                                err = allied_set_image_format(handle, pixfmts->arr[sel]);
-                                update_err("Set image format", err);
+                                err = cam.backend->set_image_format(cam.handle, cam.pixfmts->arr[sel]);
+                                cam.update_err("Set image format", err);
                                 char *key = nullptr;
-                                err = allied_get_image_format(handle, (const char **)&key);
-                                if (err == VmbErrorSuccess && key != nullptr && (sel = pixfmts->find_idx(key)) != -1)
+                                err = cam.backend->get_image_format(cam.handle, (const char **)&key);
+                                if (err == VmbErrorSuccess && key != nullptr && (sel = cam.pixfmts->find_idx(key)) != -1)
                                 {
                                     // all good
-                                    pixfmts->selected = sel;
+                                    cam.pixfmts->selected = sel;
                                     frate_changed = true;
                                 }
                                 else
                                 {
-                                    update_err("Could not get image format", err);
+                                    cam.update_err("Could not get image format", err);
                                 }
                             } // don't change if capturing
                         }
@@ -666,25 +274,25 @@ public:
                         ImGui::SameLine();
                         ImGui::Text("ADC BPP:");
                         ImGui::SameLine();
-                        ImGui::PushItemWidth(TEXT_BASE_WIDTH * (adcrates->maxlen + 6));
-                        sel = adcrates->selected;
-                        if (ImGui::Combo(adcbpp_id.c_str(), &sel, adcrates->arr, adcrates->narr))
+                        ImGui::PushItemWidth(TEXT_BASE_WIDTH * (cam.adcrates->maxlen + 6));
+                        sel = cam.adcrates->selected;
+                        if (ImGui::Combo(adcbpp_id.c_str(), &sel, cam.adcrates->arr, cam.adcrates->narr))
                         {
-                            if (!capturing)
+                            if (!cam.capturing)
                             {
-                                err = allied_set_sensor_bit_depth(handle, adcrates->arr[sel]);
-                                update_err("Set sensor bit depth", err);
+                                err = cam.backend->set_sensor_bit_depth(cam.handle, cam.adcrates->arr[sel]);
+                                cam.update_err("Set sensor bit depth", err);
                                 char *key = nullptr;
-                                err = allied_get_sensor_bit_depth(handle, (const char **)&key);
-                                if (err == VmbErrorSuccess && key != nullptr && (sel = adcrates->find_idx(key)) != -1)
+                                err = cam.backend->get_sensor_bit_depth(cam.handle, (const char **)&key);
+                                if (err == VmbErrorSuccess && key != nullptr && (sel = cam.adcrates->find_idx(key)) != -1)
                                 {
                                     // all good
-                                    adcrates->selected = sel;
+                                    cam.adcrates->selected = sel;
                                     frate_changed = true;
                                 }
                                 else
                                 {
-                                    update_err("Could not get sensor bit depth", err);
+                                    cam.update_err("Could not get sensor bit depth", err);
                                 }
                             }
                         }
@@ -695,30 +303,30 @@ public:
                         if (bin_changed)
                         {
                             VmbInt64_t bin;
-                            err = allied_get_binning_factor(handle, &bin);
-                            update_err("Binning changed", err);
+                            err = cam.backend->get_binning_factor(cam.handle, &bin);
+                            cam.update_err("Binning changed", err);
                             sbin = bin;
                             bin_changed = false;
                         }
                         ImGui::Text("Image Bin:");
                         ImGui::SameLine();
                         ImGui::PushItemWidth(TEXT_BASE_WIDTH * 5);
-                        if (ImGui::InputInt(bin_id.c_str(), &sbin, 0, 0, capturing ? ImGuiInputTextFlags_ReadOnly : 0))
+                        if (ImGui::InputInt(bin_id.c_str(), &sbin, 0, 0, cam.capturing ? ImGuiInputTextFlags_ReadOnly : 0))
                         {
                             if (sbin < 1)
                                 sbin = 1;
                         }
                         ImGui::PopItemWidth();
                         ImGui::SameLine();
-                        if (ImGui::SmallButton(update_bin_id.c_str()) && !capturing)
+                        if (ImGui::SmallButton(update_bin_id.c_str()) && !cam.capturing)
                         {
                             bin_changed = true;
                             size_changed = true;
                             ofst_changed = true;
-                            err = allied_set_binning_factor(handle, sbin);
+                            err = cam.backend->set_binning_factor(cam.handle, sbin);
                             if (err != VmbErrorSuccess)
                             {
-                                errmsg = string_format("Could not set binning to %d: ", sbin) + std::string(allied_strerr(err));
+                                cam.errmsg = string_format("Could not set binning to %d: ", sbin) + std::string(allied_strerr(err));
                             }
                         }
                     }
@@ -727,8 +335,8 @@ public:
                         if (size_changed)
                         {
                             VmbInt64_t width, height;
-                            err = allied_get_image_size(handle, &width, &height);
-                            update_err("Size changed", err);
+                            err = cam.backend->get_image_size(cam.handle, &width, &height);
+                            cam.update_err("Size changed", err);
                             frate_changed = true;
                             swid = width;
                             shgt = height;
@@ -737,22 +345,22 @@ public:
                         ImGui::Text("Image Size:");
                         ImGui::SameLine();
                         ImGui::PushItemWidth(TEXT_BASE_WIDTH * 5);
-                        ImGui::InputInt(width_id.c_str(), &swid, 0, 0, capturing ? ImGuiInputTextFlags_ReadOnly : 0);
+                        ImGui::InputInt(width_id.c_str(), &swid, 0, 0, cam.capturing ? ImGuiInputTextFlags_ReadOnly : 0);
                         ImGui::PopItemWidth();
                         ImGui::SameLine();
                         ImGui::Text(" x ");
                         ImGui::SameLine();
                         ImGui::PushItemWidth(TEXT_BASE_WIDTH * 5);
-                        ImGui::InputInt(height_id.c_str(), &shgt, 0, 0, capturing ? ImGuiInputTextFlags_ReadOnly : 0);
+                        ImGui::InputInt(height_id.c_str(), &shgt, 0, 0, cam.capturing ? ImGuiInputTextFlags_ReadOnly : 0);
                         ImGui::PopItemWidth();
                         ImGui::SameLine();
-                        if (ImGui::SmallButton((update_size_id.c_str() + info.idstr).c_str()) && !capturing)
+                        if (ImGui::SmallButton((update_size_id.c_str() + cam.info.idstr).c_str()) && !cam.capturing)
                         {
                             size_changed = true;
-                            err = allied_set_image_size(handle, swid, shgt);
+                            err = cam.backend->set_image_size(cam.handle, swid, shgt);
                             if (err != VmbErrorSuccess)
                             {
-                                errmsg = string_format("Could not set image size to %u x %u: ", swid, shgt) + std::string(allied_strerr(err));
+                                cam.errmsg = string_format("Could not set image size to %u x %u: ", swid, shgt) + std::string(allied_strerr(err));
                             }
                         }
                     }
@@ -761,7 +369,7 @@ public:
                         if (ofst_changed)
                         {
                             VmbInt64_t width, height;
-                            err = allied_get_image_ofst(handle, &width, &height);
+                            err = cam.backend->get_image_ofst(cam.handle, &width, &height);
                             ofx = width;
                             ofy = height;
                             ofst_changed = false;
@@ -769,22 +377,22 @@ public:
                         ImGui::Text("Image Offset:");
                         ImGui::SameLine();
                         ImGui::PushItemWidth(TEXT_BASE_WIDTH * 5);
-                        ImGui::InputInt((ofstx_id.c_str() + info.idstr).c_str(), &ofx, 0, 0, 0);
+                        ImGui::InputInt((ofstx_id.c_str() + cam.info.idstr).c_str(), &ofx, 0, 0, 0);
                         ImGui::PopItemWidth();
                         ImGui::SameLine();
                         ImGui::Text(" x ");
                         ImGui::SameLine();
                         ImGui::PushItemWidth(TEXT_BASE_WIDTH * 5);
-                        ImGui::InputInt((ofsty_id.c_str() + info.idstr).c_str(), &ofy, 0, 0, 0);
+                        ImGui::InputInt((ofsty_id.c_str() + cam.info.idstr).c_str(), &ofy, 0, 0, 0);
                         ImGui::PopItemWidth();
                         ImGui::SameLine();
                         if (ImGui::SmallButton(update_ofst_id.c_str()))
                         {
                             ofst_changed = true;
-                            err = allied_set_image_ofst(handle, ofx, ofy);
+                            err = cam.backend->set_image_ofst(cam.handle, ofx, ofy);
                             if (err != VmbErrorSuccess)
                             {
-                                errmsg = "Could not set image offset: " + std::string(allied_strerr(err));
+                                cam.errmsg = "Could not set image offset: " + std::string(allied_strerr(err));
                             }
                         }
                     }
@@ -799,10 +407,12 @@ public:
                     {
                         if (exp_changed)
                         {
-                            err = allied_get_exposure_range_us(handle, &expmin, &expmax, &expstep);
-                            update_err("Get exposure range", err);
-                            err = allied_get_exposure_us(handle, &currexp);
-                            update_err("Get exposure", err);
+                            err = cam.backend->get_exposure_range_us(cam.handle, &expmin, &expmax, &expstep);
+                            cam.update_err("Get exposure range", err);
+                            err = cam.backend->get_exposure_us(cam.handle, &currexp);
+                            cam.update_err("Get exposure", err);
+                            if (err == VmbErrorSuccess)
+                                cam.exposure_us = currexp;
                             frate_changed = true;
                             exp_changed = false;
                         }
@@ -822,10 +432,10 @@ public:
                                 currexp = expmin;
                             if (currexp > expmax)
                                 currexp = expmax;
-                            err = allied_set_exposure_us(handle, currexp);
-                            update_err("Update exposure", err);
+                            err = cam.backend->set_exposure_us(cam.handle, currexp);
+                            cam.update_err("Update exposure", err);
                             exp_changed = true;
-                            stat.reset();
+                            cam.stat.reset();
                         }
                     }
                     // set framerate
@@ -833,18 +443,18 @@ public:
                         bool old_frate_auto = frate_auto;
                         if (ImGui::Checkbox("Auto Frame Rate", &frate_auto))
                         {
-                            err = allied_set_acq_framerate_auto(handle, frate_auto);
+                            err = cam.backend->set_acq_framerate_auto(cam.handle, frate_auto);
                             if (err != VmbErrorSuccess)
                             {
                                 frate_auto = old_frate_auto;
                             }
-                            update_err("Auto frame rate set", err);
-                            err = allied_get_acq_framerate_auto(handle, &frate_auto);
+                            cam.update_err("Auto frame rate set", err);
+                            err = cam.backend->get_acq_framerate_auto(cam.handle, &frate_auto);
                             if (err != VmbErrorSuccess)
                             {
                                 frate_auto = old_frate_auto;
                             }
-                            update_err("Auto frame rate get", err);
+                            cam.update_err("Auto frame rate get", err);
                             frate_changed = true;
                         }
                         ImGui::PushItemWidth(TEXT_BASE_WIDTH * 25);
@@ -863,74 +473,74 @@ public:
                                 frate = frate_min;
                             if (frate > frate_max)
                                 frate = frate_max;
-                            err = allied_set_acq_framerate(handle, frate);
-                            update_err("Set frame rate", err);
+                            err = cam.backend->set_acq_framerate(cam.handle, frate);
+                            cam.update_err("Set frame rate", err);
                             frate_changed = true;
-                            stat.reset();
+                            cam.stat.reset();
                         }
                     }
                     // select trigger line and source
-                    if (triglines != nullptr && trigsrcs != nullptr)
+                    if (cam.triglines != nullptr && cam.trigsrcs != nullptr)
                     {
                         ImGui::PushStyleColor(ImGuiCol_Text, header_col);
                         ImGui::TextSeparator((char *)"Camera GPIO");
                         ImGui::PopStyleColor();
                         if (trigline_changed) // trig line changed, update source selection
                         {
-                            int sel = trigsrcs->selected;
+                            int sel = cam.trigsrcs->selected;
                             const char *key;
-                            err = allied_get_trigline_src(handle, &key);
-                            update_err("Could not get trigline source", err);
-                            sel = trigsrcs->find_idx(key);
+                            err = cam.backend->get_trigline_src(cam.handle, &key);
+                            cam.update_err("Could not get trigline source", err);
+                            sel = cam.trigsrcs->find_idx(key);
                             if (sel >= 0)
-                                trigsrcs->selected = sel;
+                                cam.trigsrcs->selected = sel;
                             trigline_changed = false;
                         }
                         ImGui::Text("Trigger Line:");
                         ImGui::SameLine();
-                        ImGui::PushItemWidth(TEXT_BASE_WIDTH * (triglines->maxlen + 6));
-                        int sel = triglines->selected;
-                        if (ImGui::Combo(trigline_id.c_str(), &sel, triglines->arr, triglines->narr) && !capturing)
+                        ImGui::PushItemWidth(TEXT_BASE_WIDTH * (cam.triglines->maxlen + 6));
+                        int sel = cam.triglines->selected;
+                        if (ImGui::Combo(trigline_id.c_str(), &sel, cam.triglines->arr, cam.triglines->narr) && !cam.capturing)
                         {
-                            err = allied_set_trigline(handle, triglines->arr[sel]);
-                            update_err("Select trigger line", err);
+                            err = cam.backend->set_trigline(cam.handle, cam.triglines->arr[sel]);
+                            cam.update_err("Select trigger line", err);
                             if (err != VmbErrorSuccess)
                             {
                                 goto trigline_clear;
                             }
                             const char *key = nullptr;
-                            err = allied_get_trigline(handle, &key);
-                            if (err == VmbErrorSuccess && key != nullptr && (sel = triglines->find_idx(key)) != -1)
+                            err = cam.backend->get_trigline(cam.handle, &key);
+                            if (err == VmbErrorSuccess && key != nullptr && (sel = cam.triglines->find_idx(key)) != -1)
                             {
                                 // all good
-                                triglines->selected = sel;
+                                cam.triglines->selected = sel;
                                 trigline_changed = true;
                                 goto trigline_clear;
                             }
                             else
                             {
-                                update_err("Could not get trigger line", err);
+                                cam.update_err("Could not get trigger line", err);
                             }
                         }
                         ImGui::SameLine();
                         ImGui::Text("     Source:");
                         ImGui::SameLine();
-                        sel = trigsrcs->selected;
-                        ImGui::PushItemWidth(TEXT_BASE_WIDTH * (trigsrcs->maxlen + 6));
-                        if (ImGui::Combo(trigsrc_id.c_str(), &sel, trigsrcs->arr, trigsrcs->narr) && !capturing)
+                        sel = cam.trigsrcs->selected;
+                        ImGui::PushItemWidth(TEXT_BASE_WIDTH * (cam.trigsrcs->maxlen + 6));
+                        if (ImGui::Combo(trigsrc_id.c_str(), &sel, cam.trigsrcs->arr, cam.trigsrcs->narr) && !cam.capturing)
                         {
-                            err = allied_set_trigline_src(handle, trigsrcs->arr[sel]);
-                            update_err("Select trigger src", err);
+                            err = cam.backend->set_trigline_src(cam.handle, cam.trigsrcs->arr[sel]);
+                            cam.update_err("Select trigger src", err);
                             const char *key = nullptr;
-                            err = allied_get_trigline_src(handle, &key);
-                            if (err == VmbErrorSuccess && key != nullptr && (sel = trigsrcs->find_idx(key)) != -1)
+                            err = cam.backend->get_trigline_src(cam.handle, &key);
+                            if (err == VmbErrorSuccess && key != nullptr && (sel = cam.trigsrcs->find_idx(key)) != -1)
                             {
                                 // all good
-                                trigsrcs->selected = sel;
+                                cam.trigsrcs->selected = sel;
                             }
                             else
                             {
-                                update_err("Could not get trigline src", err);
+                                cam.update_err("Could not get trigline src", err);
                             }
                         }
                         ImGui::PopItemWidth();
@@ -939,14 +549,14 @@ public:
                     }
                 }
                 // Start/stop capture
-                if (!capturing)
+                if (!cam.capturing)
                 {
                     if (pressed_stop)
                         pressed_stop = false;
                     if (ImGui::Button("Start Capture") && !pressed_start)
                     {
                         pressed_start = true;
-                        err = start_capture();
+                        err = cam.start_capture();
                         if (err != VmbErrorSuccess)
                             pressed_start = false;
                     }
@@ -958,59 +568,225 @@ public:
                     if (ImGui::Button("Stop Capture") && !pressed_stop)
                     {
                         pressed_stop = true;
-                        err = stop_capture();
+                        err = cam.stop_capture();
                         if (err != VmbErrorSuccess)
                             pressed_stop = false;
                     }
                 }
                 ImGui::PushStyleColor(ImGuiCol_Text, header_col);
-                ImGui::TextSeparator((char *)link_speed_str.c_str());
+                ImGui::TextSeparator((char *)cam.link_speed_str.c_str());
                 ImGui::PopStyleColor();
                 // set link speed
                 {
                     if (speed == 0) // init
-                        speed = throughput / 1000 / 1000;
+                        speed = cam.throughput / 1000 / 1000;
                     bool update = false;
-                    ImGui::Text("Link Speed (Current: %3lld MBps):", throughput / 1000 / 1000);
+                    ImGui::Text("Link Speed (Current: %3lld MBps):", cam.throughput / 1000 / 1000);
                     ImGui::SameLine();
                     ImGui::PushItemWidth(TEXT_BASE_WIDTH * 5);
-                    if (ImGui::InputInt(speed_id.c_str(), &speed, 0, 0, capturing ? ImGuiInputTextFlags_ReadOnly : 0))
+                    if (ImGui::InputInt(speed_id.c_str(), &speed, 0, 0, cam.capturing ? ImGuiInputTextFlags_ReadOnly : 0))
                     {
-                        if (speed < throughput_min / 1000 / 1000)
-                            speed = throughput_min / 1000 / 1000;
-                        if (speed > throughput_max / 1000 / 1000)
-                            speed = throughput_max / 1000 / 1000;
+                        if (speed < cam.throughput_min / 1000 / 1000)
+                            speed = cam.throughput_min / 1000 / 1000;
+                        if (speed > cam.throughput_max / 1000 / 1000)
+                            speed = cam.throughput_max / 1000 / 1000;
                     }
                     ImGui::PopItemWidth();
                     ImGui::SameLine();
-                    if (ImGui::SmallButton(update_speed_id.c_str()) && !capturing)
+                    if (ImGui::SmallButton(update_speed_id.c_str()) && !cam.capturing)
                     {
                         update = true;
                     }
                     if (update)
                     {
-                        err = allied_dequeue_capture(handle);
-                        update_err("Dequeue capture", err);
-                        err = allied_set_throughput_limit(handle, speed * 1000 * 1000);
-                        update_err("Set link speed", err);
-                        if (err == VmbErrorSuccess)
+                        if (cam.set_link_speed((VmbInt64_t)speed * 1000 * 1000) == VmbErrorSuccess)
+                            frate_changed = true;
+                        speed = cam.throughput / 1000 / 1000;
+                    }
+                }
+                ImGui::PushStyleColor(ImGuiCol_Text, header_col);
+                ImGui::TextSeparator((char *)"Recording");
+                ImGui::PopStyleColor();
+                {
+                    if (!cam.recorder.recording())
+                    {
+                        ImGui::Text("Directory:");
+                        ImGui::SameLine();
+                        ImGui::PushItemWidth(TEXT_BASE_WIDTH * 32);
+                        ImGui::InputText("##rec_dir", rec_dir, sizeof(rec_dir));
+                        ImGui::PopItemWidth();
+                        ImGui::SameLine();
+                        bool compress = cam.recorder.get_compression();
+                        if (ImGui::Checkbox("Compress", &compress))
+                            cam.recorder.set_compression(compress);
+                        ImGui::SameLine();
+                        ImGui::Checkbox("Bit pack", &rec_bitpack);
+                        ImGui::SameLine();
+                        if (ImGui::Button("Record"))
                         {
-                            VmbInt64_t _throughput;
-                            err = allied_get_throughput_limit(handle, &_throughput);
-                            update_err("Get link speed", err);
-                            if (err == VmbErrorSuccess)
+                            cam.start_recording(rec_dir, cam.recorder.get_compression(), rec_bitpack);
+                        }
+                    }
+                    else
+                    {
+                        ImGui::Text("Recording to %s (%s)", cam.recorder.get_path().c_str(), cam.recorder.direct_io() ? "O_DIRECT" : "buffered");
+                        ImGui::SameLine();
+                        if (ImGui::Button("Stop Recording"))
+                        {
+                            cam.recorder.stop();
+                        }
+                    }
+                    ImGui::Text("Queue: %u / %u | %.1f MB/s | Written: %llu frames (%.1f MiB) | Dropped: %llu", cam.recorder.queue_depth(), cam.recorder.queue_capacity(), cam.recorder.throughput(), (unsigned long long)cam.recorder.frames_written, cam.recorder.bytes_written / 1048576.0, (unsigned long long)cam.recorder.dropped);
+                    if (cam.recorder.get_compression() && cam.recorder.frames_written > 0)
+                    {
+                        ImGui::Text("Compression: %.2f : 1 | %.1f MB/s | Compressed: %llu frames | Stored raw to catch up: %llu", cam.recorder.compression_ratio(), cam.recorder.compression_speed(), (unsigned long long)cam.recorder.frames_compressed, (unsigned long long)cam.recorder.raw_fallbacks);
+                    }
+                    if (cam.recorder.get_packing() && cam.recorder.frames_written > 0)
+                    {
+                        ImGui::Text("Bit packing to %u bits: %.2f : 1 | %.1f MB/s | Packed: %llu frames | Samples too wide, stored raw: %llu", cam.recorder.get_packing(), cam.recorder.compression_ratio(), cam.recorder.packing_speed(), (unsigned long long)cam.recorder.frames_packed, (unsigned long long)cam.recorder.pack_overflows);
+                    }
+                    std::string rec_err = cam.recorder.error();
+                    if (rec_err.size())
+                    {
+                        ImGui::SameLine();
+                        ImGui::Text("| Error: %s", rec_err.c_str());
+                    }
+                }
+                ImGui::PushStyleColor(ImGuiCol_Text, header_col);
+                ImGui::TextSeparator((char *)"Flight Recorder");
+                ImGui::PopStyleColor();
+                {
+                    if (!cam.flight.is_armed() && !cam.flight.is_allocating())
+                    {
+                        ImGui::PushItemWidth(TEXT_BASE_WIDTH * 10);
+                        ImGui::InputFloat("Memory (GiB)", &flight_gb, 0.5f, 1.0f, "%.1f");
+                        ImGui::SameLine();
+                        ImGui::InputFloat("Pre (s)", &flight_pre_s, 1.0f, 10.0f, "%.1f");
+                        ImGui::SameLine();
+                        ImGui::InputFloat("Post (s)", &flight_post_s, 1.0f, 10.0f, "%.1f");
+                        ImGui::PopItemWidth();
+                        flight_gb = std::max(0.1f, flight_gb);
+                        flight_pre_s = std::max(0.0f, flight_pre_s);
+                        flight_post_s = std::max(0.0f, flight_post_s);
+                        ImGui::SameLine();
+                        if (ImGui::Button("Arm"))
+                        {
+                            cam.arm_flight(rec_dir, flight_gb, flight_pre_s, flight_post_s);
+                        }
+                    }
+                    else if (cam.flight.is_allocating())
+                    {
+                        ImGui::Text("Allocating %.1f GiB...", flight_gb);
+                    }
+                    else
+                    {
+                        if (!cam.flight.is_dumping())
+                        {
+                            if (ImGui::Button("Trigger"))
                             {
-                                throughput = _throughput;
+                                cam.flight.trigger();
                             }
-                            frate_changed = true;
+                            ImGui::SameLine();
+                        }
+                        if (ImGui::Button("Disarm"))
+                        {
+                            cam.flight.disarm();
+                        }
+                    }
+                    if (cam.adio_hdl != nullptr)
+                    {
+                        static const char *trig_bits[] = {"None", "0", "1", "2", "3", "4", "5", "6", "7"};
+                        int sel = cam.flight_trig_bit + 1;
+                        ImGui::SameLine();
+                        ImGui::PushItemWidth(TEXT_BASE_WIDTH * 8);
+                        if (ImGui::Combo("aDIO trigger input", &sel, trig_bits, IM_ARRAYSIZE(trig_bits)))
+                        {
+                            cam.flight_trig_bit = sel - 1;
+                            cam.flight_trig_level = true; // wait for the line to go low first
                         }
+                        ImGui::PopItemWidth();
+                    }
+                    if (cam.flight.is_armed())
+                    {
+                        double avg, std;
+                        cam.stat.get_stats(avg, std);
+                        uint64_t held = cam.flight.frames_held();
+                        ImGui::Text("Arena: %.2f GiB (%s, %s) | Holding %llu / %llu frames (%.1f s)", cam.flight.arena_bytes() / 1073741824.0, cam.flight.huge_pages() ? "huge pages" : "normal pages", cam.flight.memory_locked() ? "locked" : "not locked", (unsigned long long)held, (unsigned long long)cam.flight.capacity(), cam.capturing && avg > 0 ? held * avg * 1e-6 : 0.0);
+                    }
+                    if (cam.flight.is_dumping())
+                    {
+                        uint64_t done, total;
+                        cam.flight.dump_progress(done, total);
+                        if (total)
+                            ImGui::Text("Dumping to %s: %llu / %llu frames", cam.flight.get_path().c_str(), (unsigned long long)done, (unsigned long long)total);
                         else
+                            ImGui::Text("Dumping to %s: %llu frames, collecting post trigger frames", cam.flight.get_path().c_str(), (unsigned long long)done);
+                    }
+                    else if (cam.flight.dumps > 0)
+                    {
+                        ImGui::Text("Last dump: %s", cam.flight.get_path().c_str());
+                    }
+                    ImGui::Text("Dumps: %llu | Dumped: %llu frames (%.1f MiB) | Dropped: %llu | Oversize: %llu", (unsigned long long)cam.flight.dumps, (unsigned long long)cam.flight.frames_dumped, cam.flight.bytes_dumped / 1048576.0, (unsigned long long)cam.flight.dropped, (unsigned long long)cam.flight.oversize);
+                    std::string flight_err = cam.flight.error();
+                    if (flight_err.size())
+                    {
+                        ImGui::SameLine();
+                        ImGui::Text("| Error: %s", flight_err.c_str());
+                    }
+                }
+                ImGui::PushStyleColor(ImGuiCol_Text, header_col);
+                ImGui::TextSeparator((char *)"Burst");
+                ImGui::PopStyleColor();
+                {
+                    BurstState bs = cam.burst.state();
+                    if (bs == BURST_IDLE || bs == BURST_DONE || bs == BURST_FAILED)
+                    {
+                        ImGui::PushItemWidth(TEXT_BASE_WIDTH * 12);
+                        ImGui::InputInt("Frames##burst", &burst_frames, 100, 1000);
+                        ImGui::PopItemWidth();
+                        burst_frames = std::max(1, burst_frames);
+                        if (cam.pool.slab_bytes())
+                        {
+                            ImGui::SameLine();
+                            ImGui::Text("(%.2f GiB)", BurstCapture::buffer_bytes(burst_frames, cam.pool.slab_bytes()) / 1073741824.0);
+                        }
+                        ImGui::SameLine();
+                        if (ImGui::Button("Start Burst"))
+                        {
+                            cam.start_burst(rec_dir, burst_frames);
+                        }
+                    }
+                    else if (bs == BURST_ALLOCATING)
+                    {
+                        ImGui::Text("Allocating...");
+                    }
+                    else if (bs == BURST_READY || bs == BURST_CAPTURING)
+                    {
+                        ImGui::Text("Capturing %llu / %llu frames (%.2f GiB, %s, %s)", (unsigned long long)cam.burst.captured(), (unsigned long long)cam.burst.frames(), cam.burst.arena_bytes() / 1073741824.0, cam.burst.huge_pages() ? "huge pages" : "normal pages", cam.burst.memory_locked() ? "locked" : "not locked");
+                        ImGui::SameLine();
+                        if (ImGui::Button("Stop Burst"))
                         {
-                            eprintlf("Error setting link speed to %d Bps: %s", speed * 1000 * 1000, allied_strerr(err));
+                            cam.burst.stop();
                         }
-                        err = allied_queue_capture(handle, &Callback, (void *)this);
-                        update_err("Could not queue capture", err);
-                        speed = throughput / 1000 / 1000;
+                    }
+                    else if (bs == BURST_WRITING)
+                    {
+                        ImGui::Text("Writing %s: %llu / %llu frames", cam.burst.get_path().c_str(), (unsigned long long)cam.burst.frames_written(), (unsigned long long)cam.burst.captured());
+                    }
+                    BurstSummary bsum = cam.burst.summary();
+                    if (bsum.frames > 0 && bs >= BURST_WRITING)
+                    {
+                        ImGui::Text("Captured %llu frames | Frame Time: %.3f +/- %.3f ms (CaptureStat), %.3f - %.3f ms | %.1f FPS", (unsigned long long)bsum.frames, cam.burst_avg * 1e-3, cam.burst_std * 1e-3, bsum.host_min_us * 1e-3, bsum.host_max_us * 1e-3, bsum.host_avg_us > 0 ? 1e6 / bsum.host_avg_us : 0.0);
+                        ImGui::Text("Camera timestamp interval: %.0f +/- %.0f ticks | Frame ID gaps: %llu (%llu IDs missed) | Incomplete: %llu", bsum.cam_avg, bsum.cam_std, (unsigned long long)bsum.id_gaps, (unsigned long long)bsum.ids_missed, (unsigned long long)bsum.incomplete);
+                    }
+                    if (bs == BURST_DONE && bsum.frames > 0)
+                    {
+                        ImGui::Text("Written to %s | %.1f MB/s", cam.burst.get_path().c_str(), cam.burst.throughput());
+                    }
+                    std::string burst_err = cam.burst.error();
+                    if (burst_err.size())
+                    {
+                        ImGui::Text("Error: %s", burst_err.c_str());
                     }
                 }
                 ImGui::PushStyleColor(ImGuiCol_Text, header_col);
@@ -1018,32 +794,62 @@ public:
                 ImGui::PopStyleColor();
                 // Capture stats display
                 double avg, std;
-                stat.get_stats(avg, std);
+                cam.stat.get_stats(avg, std);
                 ImGui::Text(
                     "Frame Time: %.3f +/- %.6f ms", avg * 1e-3, std * 1e-3);
                 ImGui::Text("Frame Rate: %.3f FPS | Expected max: %.3f FPS", 1e6 / avg, frate);
+                if (ImGui::BeginTable("interval_table", 6, ImGuiTableFlags_RowBg | ImGuiTableFlags_BordersOuter | ImGuiTableFlags_BordersV))
+                {
+                    static const char *windows[] = {"Last 1 s", "Last 10 s", "Total"};
+                    static const CaptureWindow window_ids[] = {CAPSTAT_1S, CAPSTAT_10S, CAPSTAT_TOTAL};
+                    ImGui::TableSetupColumn("Interval");
+                    ImGui::TableSetupColumn("Frames");
+                    ImGui::TableSetupColumn("p50 (ms)");
+                    ImGui::TableSetupColumn("p99 (ms)");
+                    ImGui::TableSetupColumn("p99.9 (ms)");
+                    ImGui::TableSetupColumn("Max gap (ms)");
+                    ImGui::TableHeadersRow();
+                    for (int w = 0; w < 3; w++)
+                    {
+                        CaptureSummary sum;
+                        cam.stat.get_summary(window_ids[w], sum);
+                        ImGui::TableNextRow();
+                        ImGui::TableSetColumnIndex(0);
+                        ImGui::TextUnformatted(windows[w]);
+                        ImGui::TableSetColumnIndex(1);
+                        ImGui::Text("%llu", (unsigned long long)sum.count);
+                        ImGui::TableSetColumnIndex(2);
+                        ImGui::Text("%.3f", sum.p50 * 1e-3);
+                        ImGui::TableSetColumnIndex(3);
+                        ImGui::Text("%.3f", sum.p99 * 1e-3);
+                        ImGui::TableSetColumnIndex(4);
+                        ImGui::Text("%.3f", sum.p999 * 1e-3);
+                        ImGui::TableSetColumnIndex(5);
+                        ImGui::Text("%.3f", sum.max * 1e-3);
+                    }
+                    ImGui::EndTable();
+                }
+                ImGui::Text("Received: %llu | Lost: %llu (%llu gaps) | Incomplete: %llu | Dropped: %llu | Superseded: %llu", (unsigned long long)cam.acct.received, (unsigned long long)cam.acct.lost, (unsigned long long)cam.acct.gaps, (unsigned long long)cam.acct.incomplete, (unsigned long long)cam.acct.dropped, (unsigned long long)cam.acct.superseded);
+                if (cam.acct.lines.size() && ImGui::TreeNode("Frame Log"))
+                {
+                    ImGui::BeginChild("frame_log", ImVec2(0, ImGui::GetTextLineHeightWithSpacing() * 8), true, ImGuiWindowFlags_HorizontalScrollbar);
+                    for (auto &line : cam.acct.lines)
+                        ImGui::TextUnformatted(line.c_str());
+                    if (ImGui::GetScrollY() >= ImGui::GetScrollMaxY())
+                        ImGui::SetScrollHereY(1.0f); // follow new lines unless scrolled up
+                    ImGui::EndChild();
+                    ImGui::TreePop();
+                }
                 ImGui::Separator();
                 // Error message display
-                ImGui::Text("Last error: %s", errmsg.c_str());
+                ImGui::Text("Last error: %s", cam.errmsg.c_str());
                 if (ImGui::Button("Clear"))
                 {
-                    errmsg = "";
+                    cam.errmsg = "";
                 }
                 ImGui::TextSeparator((char *)"Image Display");
                 // Image Display
-                {
-                    GLuint texture = 0;
-                    uint32_t width = 0, height = 0;
-                    if (show)
-                    {
-                        img.get_texture(texture, width, height);
-                    }
-                    ImGui::Text("ViewFinder | %u x %u | Collision: %u, Stall: %u", width, height, img.collision, img.stall);
-                    if (show)
-                    {
-                        ImGui::Image((void *)(intptr_t)texture, render_size(width, height));
-                    }
-                }
+                view.render(img, cam.pool, show);
             outside:
                 assert(true);
             }
@@ -1051,83 +857,4 @@ public:
             ImGui::End();
         }
     }
-
-    void update_err(const char *where, VmbError_t err)
-    {
-        if (err != VmbErrorSuccess)
-        {
-            errmsg = std::string(where) + ": " + std::string(allied_strerr(err));
-        }
-    }
-
-    void update_err(std::string where, VmbError_t err)
-    {
-        if (err != VmbErrorSuccess)
-        {
-            errmsg = where + ": " + std::string(allied_strerr(err));
-        }
-    }
-
-    void cleanup()
-    {
-        if (opened)
-        {
-            allied_stop_capture(handle);  // just stop capture...
-            allied_close_camera(&handle); // close the camera
-            opened = false;
-        }
-    }
-
-    bool running()
-    {
-        return capturing;
-    }
-
-    VmbError_t start_capture()
-    {
-        VmbError_t err = VmbErrorSuccess;
-        if (handle != nullptr && !capturing)
-        {
-            stat.reset();
-            img.collision = 0;
-            img.stall = 0;
-            err = allied_start_capture(handle); // set the callback here
-            update_err("Start capture", err);
-        }
-        return err;
-    }
-
-    VmbError_t stop_capture()
-    {
-        VmbError_t err = VmbErrorSuccess;
-        if (handle != nullptr && capturing)
-        {
-            err = allied_stop_capture(handle);
-            update_err("Stop capture", err);
-            if (adio_hdl != nullptr && adio_bit >= 0)
-            {
-                this->state = 0;
-                WriteBit_aDIO(adio_hdl, 0, adio_bit, this->state);
-            }
-        }
-        return err;
-    }
-
-    ~ImageDisplay()
-    {
-        close_camera();
-    }
-
-    static void Callback(const AlliedCameraHandle_t handle, const VmbHandle_t stream, VmbFrame_t *frame, void *user_data)
-    {
-        assert(user_data);
-        ImageDisplay *self = (ImageDisplay *)user_data;
-        if (self->adio_hdl != nullptr && self->adio_bit >= 0)
-        {
-            self->state = ~self->state;
-            WriteBit_aDIO(self->adio_hdl, 0, self->adio_bit, self->state);
-        }
-        self->stat.update();
-        self->img.update(frame);
-    }
 };
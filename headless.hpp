@@ -0,0 +1,245 @@
+#pragma once
+#include <stdio.h>
+#include <signal.h>
+#include <chrono>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "camsession.hpp"
+#include "framestats.hpp"
+#include "threadpool.hpp"
+#include "tripbuf.hpp"
+
+#define HEADLESS_POLL_MS 10 // temperature snapshot, aDIO trigger and burst state
+
+static volatile sig_atomic_t headless_quit = 0;
+static volatile sig_atomic_t headless_trigger = 0;
+
+static void headless_signal(int sig)
+{
+    if (sig == SIGUSR1)
+        headless_trigger = 1;
+    else
+        headless_quit = 1;
+}
+
+/**
+ * @brief A camera without a window: frame statistics stand in for the display
+ * and are printed with the capture counters.
+ */
+class HeadlessCamera
+{
+private:
+    std::vector<uint16_t> unpacked;
+    TripleBuffer<FrameStats> stats; // camera callback -> main thread
+    bool have_stats = false;
+
+    static const FrameStats *FrameCallback(const FrameHandle &frame, void *user_data)
+    {
+        if (!frame)
+            return nullptr; // the pool had no slab for it
+        HeadlessCamera *self = (HeadlessCamera *)user_data;
+        const FrameInfo &info = frame.info();
+        size_t size = pixfmt_image_size(info.pixelFormat, info.width, info.height);
+        if (size == 0 || size > info.size)
+            return nullptr; // truncated frame
+        uint32_t bits = pixfmt_bit_depth(info.pixelFormat);
+        FrameStats &st = self->stats.write_slot();
+        if (pixfmt_is_packed(info.pixelFormat))
+        {
+            size_t npix = (size_t)info.width * info.height;
+            if (self->unpacked.size() < npix)
+                self->unpacked.resize(npix); // only if the start callback did not see this size
+            pixfmt_unpack(info.pixelFormat, self->unpacked.data(), frame.data(), npix);
+            framestats_u16(ThreadPool::shared(), st, self->unpacked.data(), npix, bits);
+        }
+        else if (bits > 8)
+            framestats_u16(ThreadPool::shared(), st, (const uint16_t *)frame.data(), size / sizeof(uint16_t), bits);
+        else
+            framestats_u8(ThreadPool::shared(), st, frame.data(), size);
+        st.frameID = info.frameID;
+        self->stats.publish();
+        return &st; // not written again before the next publish
+    }
+
+    static void StartCallback(uint32_t width, uint32_t height, VmbPixelFormat_t pfmt, void *user_data)
+    {
+        HeadlessCamera *self = (HeadlessCamera *)user_data;
+        if (pixfmt_is_packed(pfmt))
+            self->unpacked.resize((size_t)width * height);
+    }
+
+public:
+    CameraSession cam;
+
+    HeadlessCamera(const CameraInfo &info, const DeviceHandle &adio_hdl)
+        : cam(info, adio_hdl)
+    {
+        cam.set_callbacks(&FrameCallback, &StartCallback, (void *)this);
+        cam.acct.set_echo(stdout); // lost, incomplete and dropped frames as they come
+    }
+
+    ~HeadlessCamera()
+    {
+        cam.close_camera(); // stops the callbacks before the buffers go
+    }
+
+    bool bursting()
+    {
+        BurstState bs = cam.burst.state();
+        return bs != BURST_IDLE && bs != BURST_DONE && bs != BURST_FAILED;
+    }
+
+    void print(double t)
+    {
+        static const char *burst_states[] = {"idle", "allocating", "waiting", "capturing", "writing", "done", "failed"};
+        double avg, std;
+        cam.stat.get_stats(avg, std);
+        CaptureSummary sum;
+        cam.stat.get_summary(CAPSTAT_10S, sum);
+        std::string line = string_format("[%s] %9.1f s | %s | %8.3f FPS | Frame Time: %.3f +/- %.3f ms | Last 10 s p50: %.3f p99: %.3f p99.9: %.3f Max gap: %.3f ms", cam.info.serial.c_str(), t, cam.capturing ? "capturing" : "stopped", avg > 0 ? 1e6 / avg : 0.0, avg * 1e-3, std * 1e-3, sum.p50 * 1e-3, sum.p99 * 1e-3, sum.p999 * 1e-3, sum.max * 1e-3);
+        line += string_format(" | Lost: %llu (%llu gaps) Incomplete: %llu Dropped: %llu", (unsigned long long)cam.acct.lost, (unsigned long long)cam.acct.gaps, (unsigned long long)cam.acct.incomplete, (unsigned long long)cam.acct.dropped);
+        if (stats.consume())
+            have_stats = true;
+        if (have_stats)
+        {
+            const FrameStats &st = stats.read_slot();
+            line += string_format(" | Min: %u Max: %u Mean: %.1f Std: %.1f Saturated: %llu", st.min, st.max, st.mean, st.stddev, (unsigned long long)st.saturated);
+        }
+        uint32_t nt = cam.ntemps.load(std::memory_order_acquire);
+        for (uint32_t i = 0; i < nt; i++)
+            line += string_format("%s%.1f C", i ? " " : " | Temperatures: ", cam.temps_now[i].load(std::memory_order_relaxed));
+        if (cam.recorder.recording() || cam.recorder.frames_written > 0)
+        {
+            line += string_format(" | Recorded: %llu frames (%.1f MiB), %.1f MB/s, queue %u / %u, dropped %llu", (unsigned long long)cam.recorder.frames_written, cam.recorder.bytes_written / 1048576.0, cam.recorder.throughput(), cam.recorder.queue_depth(), cam.recorder.queue_capacity(), (unsigned long long)cam.recorder.dropped);
+            if ((cam.recorder.get_compression() || cam.recorder.get_packing()) && cam.recorder.frames_written > 0)
+                line += string_format(", %.2f : 1", cam.recorder.compression_ratio());
+        }
+        if (cam.flight.is_armed())
+            line += string_format(" | Flight: holding %llu / %llu frames, %llu dumps (%llu frames)%s", (unsigned long long)cam.flight.frames_held(), (unsigned long long)cam.flight.capacity(), (unsigned long long)cam.flight.dumps, (unsigned long long)cam.flight.frames_dumped, cam.flight.is_dumping() ? ", dumping" : "");
+        else if (cam.flight.is_allocating())
+            line += " | Flight: allocating";
+        BurstState bs = cam.burst.state();
+        if (bs != BURST_IDLE)
+            line += string_format(" | Burst: %s, %llu / %llu frames captured, %llu written", burst_states[bs], (unsigned long long)cam.burst.captured(), (unsigned long long)cam.burst.frames(), (unsigned long long)cam.burst.frames_written());
+        std::string errs[] = {cam.recorder.error(), cam.flight.error(), cam.burst.error(), cam.errmsg};
+        for (size_t i = 0; i < sizeof(errs) / sizeof(errs[0]); i++)
+        {
+            if (errs[i].size())
+                line += " | Error: " + errs[i];
+        }
+        cam.errmsg = ""; // reported once
+        printf("%s\n", line.c_str());
+        fflush(stdout);
+    }
+};
+
+/**
+ * @brief Capture from the cameras (all of them, or the one with camera_id) as
+ * cfg says, printing statistics every cfg.stats_s seconds, until interrupted,
+ * cfg.duration_s has passed or the bursts are written out.
+ *
+ * SIGUSR1 triggers the flight recorders.
+ */
+static int run_headless(const std::string &camera_id, DeviceHandle adio_dev, const SessionConfig &cfg)
+{
+    std::vector<VmbCameraInfo_t> list;
+    VmbError_t err = camsession_list(camera_id, list);
+    if (err != VmbErrorSuccess || list.empty())
+    {
+        fprintf(stderr, "No cameras found%s%s: %s\n", camera_id.size() ? " with ID " : "", camera_id.c_str(), allied_strerr(err));
+        return 1;
+    }
+    std::vector<HeadlessCamera *> cams;
+    std::set<std::string> ids;
+    for (auto it = list.begin(); it != list.end(); it++)
+    {
+        CameraInfo info(*it);
+        if (!ids.insert(info.idstr).second) // listed twice
+            continue;
+        HeadlessCamera *hc = new HeadlessCamera(info, adio_dev);
+        hc->cam.open_camera();
+        if (!hc->cam.opened)
+        {
+            fprintf(stderr, "%s [%s]: %s\n", info.name.c_str(), info.serial.c_str(), hc->cam.errmsg.c_str());
+            delete hc;
+            continue;
+        }
+        hc->cam.apply(cfg); // failures go to stderr, the camera keeps its setting
+        hc->cam.flight_trig_bit = cfg.flight_trigger;
+        hc->cam.flight_trig_level = true; // wait for the line to go low first
+        printf("Opened %s [%s]\n", info.name.c_str(), info.serial.c_str());
+        cams.push_back(hc);
+    }
+    if (cams.empty())
+        return 1;
+
+    signal(SIGINT, headless_signal);
+    signal(SIGTERM, headless_signal);
+    signal(SIGUSR1, headless_signal);
+
+    for (auto hc : cams)
+    {
+        CameraSession &cam = hc->cam;
+        if (cfg.burst > 0) // poll() starts capture once the buffer is allocated
+        {
+            if (!cam.start_burst(cfg.dir, cfg.burst))
+                fprintf(stderr, "%s: %s\n", cam.info.serial.c_str(), cam.errmsg.c_str());
+            continue;
+        }
+        if (cfg.flight_gib > 0 && !cam.arm_flight(cfg.dir, cfg.flight_gib, cfg.flight_pre_s, cfg.flight_post_s))
+            fprintf(stderr, "%s: %s\n", cam.info.serial.c_str(), cam.errmsg.c_str());
+        if (cfg.record)
+        {
+            if (cam.start_recording(cfg.dir, cfg.compress, cfg.bitpack))
+                printf("%s: recording to %s\n", cam.info.serial.c_str(), cam.recorder.get_path().c_str());
+            else
+                fprintf(stderr, "%s: %s\n", cam.info.serial.c_str(), cam.errmsg.c_str());
+        }
+        if (cam.start_capture() != VmbErrorSuccess)
+            fprintf(stderr, "%s: %s\n", cam.info.serial.c_str(), cam.errmsg.c_str());
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    double next_stats = cfg.stats_s;
+    while (!headless_quit)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(HEADLESS_POLL_MS));
+        bool bursting = false;
+        for (auto hc : cams)
+        {
+            hc->cam.poll();
+            if (headless_trigger && hc->cam.flight.is_armed())
+                hc->cam.flight.trigger();
+            bursting |= hc->bursting();
+        }
+        headless_trigger = 0;
+        double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (t >= next_stats)
+        {
+            for (auto hc : cams)
+                hc->print(t);
+            next_stats += cfg.stats_s * (1 + floor((t - next_stats) / cfg.stats_s)); // skip missed intervals
+        }
+        if (cfg.duration_s > 0 && t >= cfg.duration_s)
+            break;
+        if (cfg.burst > 0 && !bursting)
+            break;
+    }
+
+    double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    for (auto hc : cams)
+    {
+        hc->cam.poll();
+        hc->cam.stop_capture();
+        hc->print(t);
+        if (hc->cam.recorder.recording())
+            printf("%s: finishing %s\n", hc->cam.info.serial.c_str(), hc->cam.recorder.get_path().c_str());
+        if (hc->cam.burst.state() == BURST_DONE)
+            printf("%s: burst written to %s\n", hc->cam.info.serial.c_str(), hc->cam.burst.get_path().c_str());
+        delete hc; // writes out the recording and a flight recorder dump in progress
+    }
+    return 0;
+}
@@ -3,13 +3,27 @@
 #ifdef __APPLE__
 #define GL_SILENCE_DEPRECATION
 #endif
+#define GLFW_INCLUDE_GLEXT
 #include <GLFW/glfw3.h>
 
 #include <VmbC/VmbC.h>
 
-#include <mutex>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <vector>
 
 #include <math.h>
+#include <string.h>
+
+#include "tripbuf.hpp"
+#include "framepool.hpp"
+#include "pixconv.hpp"
+#include "pixfmt.hpp"
+#include "demosaic.hpp"
+#include "threadpool.hpp"
+#include "framestats.hpp"
+#include "pboring.hpp"
 
 /*
 #define eprintf(fmt, ...)                                                                 \
@@ -20,31 +34,79 @@
 */
 #define eprintf(fmt, ...)
 
+struct ImageFrame
+{
+    FrameHandle frame;
+    std::vector<uint8_t> display; // frame converted for display, the pool slab is never modified
+    bool converted = false;       // upload display instead of the frame data
+    uint32_t width = 0;           // texture size, smaller than the frame when decimated
+    uint32_t height = 0;
+    size_t length = 0; // bytes to upload
+    GLenum fmt = GL_LUMINANCE;
+    GLenum type = GL_UNSIGNED_BYTE;
+};
+
+#define IMAGE_MAX_DECIMATION 8
+
+enum DisplayStretch
+{
+    STRETCH_SHIFT = 0, // fixed shift of the sample bit depth to 16 bits
+    STRETCH_LINEAR,    // percentile window stretched to the full range
+    STRETCH_SQRT,
+    STRETCH_LOG,
+};
+
+#define IMAGE_STRETCH_HYSTERESIS 0.02 // rebuild the LUT once an end of the window moves by this fraction of it
+#define IMAGE_STRETCH_LOG_GAIN 1000.0 // log curve: log(1 + gain * t) / log(1 + gain)
+
 class Image
 {
 private:
     uint32_t width;
     uint32_t height;
-    uint32_t nshift;
-    uint8_t *data;
     VmbPixelFormat_t pixelFormat;
     GLuint texture = 0;
+    uint32_t tex_width = 0;
+    uint32_t tex_height = 0;
     GLenum fmt;
     GLenum type;
-    bool reset = false;
-    bool newdata = false;
-    std::mutex mtx;
+    TripleBuffer<ImageFrame> frames;    // camera callback -> ImGui thread
+    std::atomic<uint32_t> decimation{1}; // set by the ImGui thread from the on-screen size
+    std::atomic<int> demosaic{DEMOSAIC_BILINEAR};
+    TripleBuffer<FrameStats> stats;         // camera callback -> ImGui thread
+    std::atomic<bool> stats_on{true};
+    const FrameStats *last = nullptr; // published by the latest update(), camera callback only
+    std::atomic<int> stretch{STRETCH_SHIFT};
+    std::atomic<float> stretch_plow{0.5f}; // percentiles
+    std::atomic<float> stretch_phigh{99.5f};
+    std::vector<uint16_t> lut; // camera callback only, as is the rest of the LUT state
+    uint8_t lut8[256];
+    int lut_mode = -1;
+    uint32_t lut_bits = 0;
+    uint32_t lut_low = 0;
+    uint32_t lut_high = 0;
+    std::atomic<bool> lut_dirty{false}; // percentiles changed, rebuild the LUT with the next frame
+    std::atomic<uint32_t> window_low{0};     // current LUT window, for display
+    std::atomic<uint32_t> window_high{0};
+    std::vector<uint8_t> scratch;        // camera callback only
+    std::vector<uint8_t> color;          // demosaiced frame, camera callback only
+    std::vector<uint16_t> unpacked;      // camera callback only
+    PboRing pbo;
+    bool use_pbo = true;
+    bool pbo_active = false;
+    double upload_last = 0; // ms
+    double upload_avg = 0;  // ms, exponential moving average
 
 public:
     Image()
     {
         width = 0;
         height = 0;
-        nshift = 0;
         texture = 0;
         fmt = GL_LUMINANCE;
         type = GL_UNSIGNED_BYTE;
         pixelFormat = VmbPixelFormatMono8;
+        lut.resize(PIXCONV_LUT_SIZE + 1);
     }
 
     ~Image()
@@ -55,25 +117,30 @@ public:
 
     void get_texture(GLuint &tex, uint32_t &w, uint32_t &h) // draw in the ImGui thread
     {
-        std::lock_guard<std::mutex> lock(mtx);
-        if (!newdata)
+        if (!frames.consume() || !frames.read_slot().frame)
         {
             tex = texture;
             w = width;
             h = height;
             return;
         }
-        newdata = false;
-        // scale data
-        if (type == GL_UNSIGNED_SHORT) // 16 bits data
-        {
-            uint16_t *_data = (uint16_t *)data;
-            for (size_t i = 0; i < width * height; i++)
-                _data[i] = _data[i] << nshift;
-        }
+        ImageFrame &slot = frames.read_slot();
+        const FrameInfo &info = slot.frame.info();
+        bool reset = texture == 0 || tex_width != slot.width || tex_height != slot.height || fmt != slot.fmt || type != slot.type;
+        width = info.width;
+        height = info.height;
+        tex_width = slot.width;
+        tex_height = slot.height;
+        pixelFormat = info.pixelFormat;
+        fmt = slot.fmt;
+        type = slot.type;
+        uint8_t *data = slot.converted ? slot.display.data() : slot.frame.data();
+        auto start = std::chrono::steady_clock::now();
+        GLint alignment;
+        glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment); // restored below, ImGui uploads its own textures too
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);          // decimated rows are not padded
         if (reset)
         {
-            pixfmt_to_glfmt(pixelFormat, nshift, fmt, type);
             eprintf("Image: %u x %u | %u | %u | %u\n", width, height, pixelFormat, fmt, type);
             if (texture)
             {
@@ -89,65 +156,426 @@ public:
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE); // This is required on WebGL for non power-of-two textures
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
-            glTexImage2D(GL_TEXTURE_2D, 0, fmt, width, height, 0, fmt, type, data);
-            eprintf("Set texture: %d | %u x %u\n", itexture, width, height);
+            glTexImage2D(GL_TEXTURE_2D, 0, fmt, tex_width, tex_height, 0, fmt, type, data);
+            eprintf("Set texture: %d | %u x %u\n", itexture, tex_width, tex_height);
             glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
             eprintf("Created texture: %d | %u x %u\n", itexture, width, height);
             texture = itexture;
-            reset = false;
+            pbo_active = use_pbo && pbo.reserve(slot.length);
+            if (!pbo_active)
+                pbo.release();
         }
         else
         {
             glBindTexture(GL_TEXTURE_2D, texture);
             eprintf("Rebound texture: %d\n", texture);
-            glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, fmt, type, data);
+            if (!pbo_active || !pbo.upload(data, slot.length, tex_width, tex_height, fmt, type))
+            {
+                glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, tex_width, tex_height, fmt, type, data);
+            }
             eprintf("Updated texture: %d | %u x %u\n", texture, width, height);
         }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+        upload_last = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        upload_avg = upload_avg == 0 ? upload_last : 0.95 * upload_avg + 0.05 * upload_last;
         tex = texture;
         w = width;
         h = height;
     }
 
-    void update(VmbFrame_t *frame)
+    void update(const FrameHandle &frame) // called from the camera callback, never blocks
     {
-        if (data == frame->buffer)
+        last = nullptr;
+        if (!frame)
+        {
+            dropped++;
+            return;
+        }
+        const FrameInfo &info = frame.info();
+        uint32_t nshift;
+        GLenum ofmt, otype;
+        pixfmt_to_glfmt(info.pixelFormat, nshift, ofmt, otype);
+        uint32_t channels = gl_channels(ofmt);
+        uint32_t bpc = otype == GL_UNSIGNED_SHORT ? 2 : 1;
+        bool bayer = pixfmt_is_bayer(info.pixelFormat);
+        uint32_t in_channels = bayer ? 1 : channels; // a Bayer frame becomes RGB on the way
+        const uint8_t *src = frame.data();
+        size_t srclen = info.size;
+        if (pixfmt_is_packed(info.pixelFormat))
+        {
+            size_t npix = (size_t)info.width * info.height;
+            if (pixfmt_image_size(info.pixelFormat, info.width, info.height) > info.size)
+            {
+                dropped++; // truncated frame
+                return;
+            }
+            if (unpacked.size() < npix)
+                unpacked.resize(npix); // only if reserve() was not called
+            pixfmt_unpack(info.pixelFormat, unpacked.data(), src, npix);
+            src = (const uint8_t *)unpacked.data();
+            srclen = npix * sizeof(uint16_t);
+        }
+        if ((size_t)info.width * info.height * in_channels * bpc > srclen || (bayer && (info.width < 2 || info.height < 2)))
         {
-            // reading from this frame, lock!
-            std::lock_guard<std::mutex> lock(mtx);
-            stall++;
-            // now do stuff and get out
-            unsafe_update(frame);
+            dropped++; // truncated frame, nothing sensible to show
             return;
         }
-        // not reading from this frame, check if it is rendering
-        else if (!mtx.try_lock())
+        int mode = stretch.load(std::memory_order_relaxed);
+        if (stats_on.load(std::memory_order_relaxed) || mode != STRETCH_SHIFT) // on the samples as they came from the camera
+        {
+            FrameStats &st = stats.write_slot();
+            size_t nsamples = (size_t)info.width * info.height * in_channels;
+            if (bpc == 2)
+                framestats_u16(ThreadPool::shared(), st, (const uint16_t *)src, nsamples, 16 - nshift);
+            else
+                framestats_u8(ThreadPool::shared(), st, src, nsamples);
+            st.frameID = info.frameID;
+            if (mode != STRETCH_SHIFT)
+                update_lut(st, mode);
+            stats.publish();
+            last = &st; // not written again before the next publish
+        }
+        bool remap = mode != STRETCH_SHIFT || (bpc == 2 && nshift); // the last stage maps every sample into the display buffer
+        uint32_t f = decimation.load(std::memory_order_relaxed);
+        if (info.width < f || info.height < f)
+            f = 1;
+        bool superpixel = bayer && f >= 2; // one RGB pixel per Bayer cell already halves the size
+        uint32_t fd = superpixel ? f / 2 : f;
+        uint32_t w = info.width; // size of src
+        uint32_t h = info.height;
+        ImageFrame &slot = frames.write_slot();
+        slot.frame = frame; // releases whatever frame the slot held before
+        slot.fmt = ofmt;
+        slot.type = otype;
+        slot.width = info.width / f;
+        slot.height = info.height / f;
+        slot.length = (size_t)slot.width * slot.height * channels * bpc;
+        slot.converted = false;
+        if (slot.display.size() < slot.length)
+            slot.display.resize(slot.length); // only if reserve() was not called
+        // unpack, demosaic, decimate and scale here so that the ImGui thread only uploads
+        if (bayer)
+        {
+            uint8_t *dst = slot.display.data();
+            if (fd > 1 || remap) // more stages follow
+            {
+                size_t len = (superpixel ? (size_t)(w / 2) * (h / 2) : (size_t)w * h) * channels * bpc;
+                if (color.size() < len)
+                    color.resize(len);
+                dst = color.data();
+            }
+            BayerPattern pattern = pixfmt_bayer_pattern(info.pixelFormat);
+            DemosaicMethod method = (DemosaicMethod)demosaic.load(std::memory_order_relaxed);
+            ThreadPool &pool = ThreadPool::shared();
+            if (superpixel && bpc == 2)
+                demosaic_superpixel_u16(pool, (uint16_t *)dst, (const uint16_t *)src, w, h, pattern);
+            else if (superpixel)
+                demosaic_superpixel_u8(pool, dst, src, w, h, pattern);
+            else if (bpc == 2)
+                demosaic_u16(pool, (uint16_t *)dst, (const uint16_t *)src, w, h, pattern, method);
+            else
+                demosaic_u8(pool, dst, src, w, h, pattern, method);
+            if (superpixel)
+            {
+                w /= 2;
+                h /= 2;
+            }
+            src = dst;
+            slot.converted = true;
+        }
+        if (fd > 1)
+        {
+            uint8_t *dst = slot.display.data();
+            if (remap) // map afterwards, into the display buffer
+            {
+                if (scratch.size() < slot.length)
+                    scratch.resize(slot.length);
+                dst = scratch.data();
+            }
+            if (bpc == 2)
+                pixconv_decimate_u16((uint16_t *)dst, (const uint16_t *)src, w, h, channels, fd);
+            else
+                pixconv_decimate_u8(dst, src, w, h, channels, fd);
+            src = dst;
+            slot.converted = true;
+        }
+        else if (src != frame.data() && src != slot.display.data() && !remap) // unpacked, nothing else to do
+        {
+            memcpy(slot.display.data(), src, slot.length);
+            slot.converted = true;
+        }
+        if (mode != STRETCH_SHIFT)
+        {
+            size_t n = slot.length / bpc;
+            if (bpc == 2)
+                pixconv_lut_u16((uint16_t *)slot.display.data(), (const uint16_t *)src, n, lut.data());
+            else
+                pixconv_lut_u8(slot.display.data(), src, n, lut8);
+            slot.converted = true;
+        }
+        else if (bpc == 2 && nshift) // 16 bits data
+        {
+            pixconv_shift_u16((uint16_t *)slot.display.data(), (const uint16_t *)src, slot.length / sizeof(uint16_t), nshift);
+            slot.converted = true;
+        }
+        if (frames.publish())
         {
-            collision++;
-            return; // rendering, so don't update
+            superseded++; // the ImGui thread never saw the previous frame
         }
-        // not rendering, so update
         eprintf("Updating image\n");
-        unsafe_update(frame);
-        mtx.unlock();
+    }
+
+    void reserve(uint32_t width, uint32_t height, VmbPixelFormat_t pfmt) // pre-allocate the conversion buffers, only while no frames are coming in
+    {
+        uint32_t nshift;
+        GLenum ofmt, otype;
+        pixfmt_to_glfmt(pfmt, nshift, ofmt, otype);
+        size_t size = (size_t)width * height * gl_channels(ofmt) * (otype == GL_UNSIGNED_SHORT ? 2 : 1);
+        for (int i = 0; i < 3; i++)
+            frames.slot(i).display.resize(size);
+        scratch.resize(size / 4); // decimated by at least 2 x 2
+        color.resize(pixfmt_is_bayer(pfmt) ? size : 0);
+        unpacked.resize(pixfmt_is_packed(pfmt) ? (size_t)width * height : 0);
+    }
+
+    /**
+     * @brief Pick the decimation factor for the next frames from the size the image is drawn at.
+     *
+     * The frame is shrunk by the largest power of two (up to IMAGE_MAX_DECIMATION) that
+     * still leaves at least one texel per screen pixel. ImGui thread only.
+     *
+     * @param full_res Upload at full resolution, e.g. when shown 1:1.
+     */
+    void set_view_size(float view_width, float view_height, bool full_res = false)
+    {
+        uint32_t f = 1;
+        if (!full_res && view_width > 0 && view_height > 0)
+        {
+            while (f < IMAGE_MAX_DECIMATION && width / (f * 2) >= view_width && height / (f * 2) >= view_height)
+                f *= 2;
+        }
+        decimation.store(f, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Demosaic method for Bayer frames shown at full resolution.
+     *
+     * Decimated frames always use one RGB pixel per 2 x 2 Bayer cell.
+     */
+    void set_demosaic(DemosaicMethod method)
+    {
+        demosaic.store(method, std::memory_order_relaxed);
+    }
+
+    DemosaicMethod get_demosaic()
+    {
+        return (DemosaicMethod)demosaic.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Copy the statistics of the latest frame, if there is a newer one than last time.
+     *
+     * ImGui thread only.
+     */
+    bool get_stats(FrameStats &st)
+    {
+        if (!stats.consume())
+            return false;
+        st = stats.read_slot();
+        return true;
+    }
+
+    /**
+     * @brief Statistics of the frame passed to the latest update(), nullptr if they were not computed.
+     *
+     * Camera callback only, valid until the next update().
+     */
+    const FrameStats *last_stats() const
+    {
+        return last;
+    }
+
+    void set_stats(bool enable)
+    {
+        stats_on.store(enable, std::memory_order_relaxed);
+    }
+
+    bool stats_enabled()
+    {
+        return stats_on.load(std::memory_order_relaxed);
+    }
+
+    void set_stretch(DisplayStretch mode)
+    {
+        stretch.store(mode, std::memory_order_relaxed);
+    }
+
+    DisplayStretch get_stretch()
+    {
+        return (DisplayStretch)stretch.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Percentiles of the histogram mapped to black and white in the stretch modes.
+     */
+    void set_stretch_percentiles(float low, float high)
+    {
+        low = std::max(0.0f, std::min(low, 100.0f));
+        high = std::max(low, std::min(high, 100.0f));
+        stretch_plow.store(low, std::memory_order_relaxed);
+        stretch_phigh.store(high, std::memory_order_relaxed);
+        lut_dirty = true;
+    }
+
+    void get_stretch_percentiles(float &low, float &high)
+    {
+        low = stretch_plow.load(std::memory_order_relaxed);
+        high = stretch_phigh.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Sample values the current LUT maps to black and white.
+     */
+    void get_stretch_window(uint32_t &low, uint32_t &high)
+    {
+        low = window_low.load(std::memory_order_relaxed);
+        high = window_high.load(std::memory_order_relaxed);
+    }
+
+    void get_texture_size(uint32_t &w, uint32_t &h) // ImGui thread only
+    {
+        w = tex_width;
+        h = tex_height;
+    }
+
+    void clear() // release all held frames, only while no frames are coming in
+    {
+        for (int i = 0; i < 3; i++)
+            frames.slot(i).frame.reset();
+    }
+
+    void reset_counters()
+    {
+        superseded = 0;
+        dropped = 0;
+        upload_avg = 0;
+    }
+
+    void set_pbo(bool enable) // takes effect with the next texture (re)creation, ImGui thread only
+    {
+        use_pbo = enable;
+        if (!enable)
+        {
+            pbo.release();
+            pbo_active = false;
+        }
+        else if (texture && !pbo_active)
+        {
+            glDeleteTextures(1, &texture); // force a reset on the next frame
+            texture = 0;
+        }
+    }
+
+    bool pbo_enabled()
+    {
+        return use_pbo;
+    }
+
+    void get_upload_stats(double &last_ms, double &avg_ms, bool &async) // ImGui thread only
+    {
+        last_ms = upload_last;
+        avg_ms = upload_avg;
+        async = pbo_active;
     }
 
 private:
-    void unsafe_update(VmbFrame_t *frame)
+    /**
+     * @brief Move the stretch window to the configured percentiles of st, rebuild the LUT if it moved enough.
+     */
+    void update_lut(const FrameStats &st, int mode)
     {
-        if (width != frame->width || height != frame->height || pixelFormat != frame->pixelFormat)
+        if (st.count == 0)
+            return;
+        uint64_t nlow = st.count * (double)stretch_plow.load(std::memory_order_relaxed) / 100;
+        uint64_t nhigh = st.count * (double)stretch_phigh.load(std::memory_order_relaxed) / 100;
+        uint32_t blow = 0, bhigh = st.nbins - 1;
+        uint64_t cum = 0;
+        bool found_low = false;
+        for (uint32_t b = 0; b < st.nbins; b++)
         {
-            reset = true;
+            cum += st.hist[b];
+            if (!found_low && cum > nlow)
+            {
+                blow = b;
+                found_low = true;
+            }
+            if (cum >= nhigh)
+            {
+                bhigh = b;
+                break;
+            }
+        }
+        uint32_t low = blow << st.bin_shift;
+        uint32_t high = ((bhigh + 1) << st.bin_shift) - 1;
+        if (high <= low)
+            high = low + 1;
+        double slack = IMAGE_STRETCH_HYSTERESIS * (lut_high - lut_low);
+        bool moved = fabs((double)low - lut_low) > slack || fabs((double)high - lut_high) > slack;
+        if (!moved && !lut_dirty && mode == lut_mode && st.bits == lut_bits)
+            return;
+        lut_dirty = false;
+        lut_mode = mode;
+        lut_bits = st.bits;
+        lut_low = low;
+        lut_high = high;
+        window_low.store(low, std::memory_order_relaxed);
+        window_high.store(high, std::memory_order_relaxed);
+        lut_builds++;
+        if (st.bits <= 8)
+            build_lut(lut8, 256, low, high, 255, mode);
+        else
+            build_lut(lut.data(), PIXCONV_LUT_SIZE, low, high, 0xffff, mode);
+    }
+
+    template <typename T>
+    static void build_lut(T *table, uint32_t size, uint32_t low, uint32_t high, uint32_t outmax, int mode)
+    {
+        double span = high - low;
+        double lognorm = 1.0 / log1p(IMAGE_STRETCH_LOG_GAIN);
+        for (uint32_t v = 0; v < size; v++)
+        {
+            if (v <= low)
+            {
+                table[v] = 0;
+                continue;
+            }
+            if (v >= high)
+            {
+                table[v] = outmax;
+                continue;
+            }
+            double t = (v - low) / span;
+            if (mode == STRETCH_SQRT)
+                t = sqrt(t);
+            else if (mode == STRETCH_LOG)
+                t = log1p(IMAGE_STRETCH_LOG_GAIN * t) * lognorm;
+            table[v] = (T)(t * outmax + 0.5);
         }
-        width = frame->width;
-        height = frame->height;
-        pixelFormat = frame->pixelFormat;
-        data = (uint8_t *)frame->buffer;
-        newdata = true;
     }
 
-    static void update(Image *self, VmbFrame_t *frame)
+    static uint32_t gl_channels(GLenum fmt)
     {
-        self->update(frame);
+        switch (fmt)
+        {
+        case GL_RGB:
+        case GL_BGR:
+            return 3;
+        case GL_RGBA:
+        case GL_BGRA:
+            return 4;
+        default:
+            return 1;
+        }
     }
 
     static void pixfmt_to_glfmt(VmbPixelFormat_t pfmt, uint32_t &nshift, GLenum &fmt, GLenum &type)
@@ -178,6 +606,17 @@ private:
             fmt = GL_LUMINANCE;
             type = GL_UNSIGNED_SHORT;
             break;
+        case VmbPixelFormatMono10p: // unpacked to 16 bits on ingest
+            fmt = GL_LUMINANCE;
+            type = GL_UNSIGNED_SHORT;
+            nshift = 6;
+            break;
+        case VmbPixelFormatMono12p:
+        case VmbPixelFormatMono12Packed:
+            fmt = GL_LUMINANCE;
+            type = GL_UNSIGNED_SHORT;
+            nshift = 4;
+            break;
         case VmbPixelFormatBgr8:
             fmt = GL_BGR;
             type = GL_UNSIGNED_BYTE;
@@ -210,6 +649,36 @@ private:
             fmt = GL_BGRA;
             type = GL_UNSIGNED_SHORT;
             break;
+        case VmbPixelFormatBayerGR8:
+        case VmbPixelFormatBayerRG8:
+        case VmbPixelFormatBayerGB8:
+        case VmbPixelFormatBayerBG8: // demosaiced to RGB on ingest
+            fmt = GL_RGB;
+            type = GL_UNSIGNED_BYTE;
+            break;
+        case VmbPixelFormatBayerGR10:
+        case VmbPixelFormatBayerRG10:
+        case VmbPixelFormatBayerGB10:
+        case VmbPixelFormatBayerBG10:
+            fmt = GL_RGB;
+            type = GL_UNSIGNED_SHORT;
+            nshift = 6;
+            break;
+        case VmbPixelFormatBayerGR12:
+        case VmbPixelFormatBayerRG12:
+        case VmbPixelFormatBayerGB12:
+        case VmbPixelFormatBayerBG12:
+            fmt = GL_RGB;
+            type = GL_UNSIGNED_SHORT;
+            nshift = 4;
+            break;
+        case VmbPixelFormatBayerGR16:
+        case VmbPixelFormatBayerRG16:
+        case VmbPixelFormatBayerGB16:
+        case VmbPixelFormatBayerBG16:
+            fmt = GL_RGB;
+            type = GL_UNSIGNED_SHORT;
+            break;
         default:
             fmt = GL_LUMINANCE;
             type = GL_UNSIGNED_BYTE;
@@ -218,6 +687,7 @@ private:
         }
     }
 public:
-    uint32_t collision = 0;
-    uint32_t stall = 0;
+    std::atomic<uint64_t> superseded{0}; // published but replaced by a newer frame before display
+    std::atomic<uint64_t> dropped{0};    // could not be handed to the display at all
+    std::atomic<uint64_t> lut_builds{0}; // display stretch LUT rebuilds
 };
@@ -0,0 +1,161 @@
+#pragma once
+#include <stdint.h>
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+#include <vector>
+
+#include "imgui/imgui.h"
+
+#include "imagetexture.hpp"
+#include "framepool.hpp"
+#include "framestats.hpp"
+
+/**
+ * @brief Viewfinder of a camera or playback window.
+ *
+ * Shows the texture of an Image together with the upload and frame pool
+ * counters, the statistics and the display controls. ImGui thread only.
+ */
+class ImageView
+{
+private:
+    bool full_res = false; // show the viewfinder 1:1 instead of fitting it to the window
+    FrameStats frame_stats;
+    bool have_stats = false;
+    std::vector<float> hist_plot;
+
+    static ImVec2 render_size(uint32_t swid, uint32_t shgt)
+    {
+        ImVec2 avail_size = ImGui::GetContentRegionAvail();
+        float wid = avail_size[0]; // get window width
+        float hgt = avail_size[1]; // get window height
+        ImVec2 out = ImVec2(
+            wid,
+            round((float)shgt / (float)swid * wid) // calculate height
+        );
+        if (out[1] > hgt)
+        {
+            out[1] = hgt;
+            out[0] = round((float)swid / (float)shgt * hgt); // calculate width
+        }
+        return out;
+    }
+
+public:
+    /**
+     * @brief Forget the statistics of the previous capture.
+     */
+    void reset()
+    {
+        have_stats = false;
+    }
+
+    /**
+     * @brief Draw the viewfinder section into the current window.
+     *
+     * @param show false if the window is collapsed, the texture is then left alone
+     */
+    void render(Image &img, const FramePool &pool, bool show)
+    {
+        const float TEXT_BASE_WIDTH = ImGui::CalcTextSize("A").x;
+        GLuint texture = 0;
+        uint32_t width = 0, height = 0;
+        if (show)
+        {
+            img.get_texture(texture, width, height);
+        }
+        uint32_t tex_width = 0, tex_height = 0;
+        img.get_texture_size(tex_width, tex_height);
+        ImGui::Text("ViewFinder | %u x %u (Texture: %u x %u) | Superseded: %llu, Dropped: %llu", width, height, tex_width, tex_height, (unsigned long long)img.superseded, (unsigned long long)img.dropped);
+        {
+            double upload_last, upload_avg;
+            bool async;
+            img.get_upload_stats(upload_last, upload_avg, async);
+            ImGui::Text("Texture Upload (%s): %.3f ms | Average: %.3f ms", async ? "PBO" : "Direct", upload_last, upload_avg);
+            ImGui::SameLine();
+            bool use_pbo = img.pbo_enabled();
+            if (ImGui::Checkbox("PBO", &use_pbo))
+            {
+                img.set_pbo(use_pbo);
+            }
+        }
+        ImGui::Text("Frame Pool | %u / %u slabs (%.1f MiB) | High water: %u, Exhausted: %llu", pool.in_use(), pool.capacity(), pool.slab_bytes() / 1048576.0, (unsigned)pool.high_water, (unsigned long long)pool.exhausted);
+        {
+            bool enabled = img.stats_enabled();
+            if (ImGui::Checkbox("Statistics", &enabled))
+            {
+                img.set_stats(enabled);
+            }
+            if (enabled && img.get_stats(frame_stats))
+            {
+                // plot the codes the bit depth can reach, in at most 256 bars
+                uint32_t used = std::min(frame_stats.nbins, (1u << frame_stats.bits) >> frame_stats.bin_shift);
+                uint32_t group = used > 256 ? used / 256 : 1;
+                hist_plot.assign(used / group, 0);
+                for (uint32_t b = 0; b < hist_plot.size() * group; b++)
+                    hist_plot[b / group] += frame_stats.hist[b];
+                have_stats = true;
+            }
+            if (enabled && have_stats)
+            {
+                ImGui::SameLine();
+                ImGui::Text("Frame %llu | Min: %u, Max: %u, Mean: %.1f, Std Dev: %.1f | Saturated: %llu (%.3f%%)", (unsigned long long)frame_stats.frameID, frame_stats.min, frame_stats.max, frame_stats.mean, frame_stats.stddev, (unsigned long long)frame_stats.saturated, frame_stats.count ? 100.0 * frame_stats.saturated / frame_stats.count : 0.0);
+                ImGui::PlotHistogram("##histogram", hist_plot.data(), (int)hist_plot.size(), 0, NULL, 0.0f, FLT_MAX, ImVec2(0, 60));
+            }
+        }
+        {
+            static const char *stretch_names[] = {"Shift", "Linear", "Sqrt", "Log"};
+            int sel = img.get_stretch();
+            ImGui::Text("Display:");
+            ImGui::SameLine();
+            ImGui::PushItemWidth(TEXT_BASE_WIDTH * 10);
+            if (ImGui::Combo("##stretch", &sel, stretch_names, IM_ARRAYSIZE(stretch_names)))
+            {
+                img.set_stretch((DisplayStretch)sel);
+            }
+            ImGui::PopItemWidth();
+            if (sel != STRETCH_SHIFT)
+            {
+                float plow, phigh;
+                img.get_stretch_percentiles(plow, phigh);
+                ImGui::SameLine();
+                ImGui::PushItemWidth(TEXT_BASE_WIDTH * 24);
+                if (ImGui::DragFloatRange2("Percentiles", &plow, &phigh, 0.05f, 0.0f, 100.0f, "%.2f%%", "%.2f%%", ImGuiSliderFlags_AlwaysClamp))
+                {
+                    img.set_stretch_percentiles(plow, phigh);
+                }
+                ImGui::PopItemWidth();
+                uint32_t wlow, whigh;
+                img.get_stretch_window(wlow, whigh);
+                ImGui::SameLine();
+                ImGui::Text("Window: %u - %u | LUT builds: %llu", wlow, whigh, (unsigned long long)img.lut_builds);
+            }
+        }
+        ImGui::Checkbox("1:1", &full_res);
+        {
+            static const char *demosaic_names[] = {"Bilinear", "Edge Aware"};
+            int sel = img.get_demosaic();
+            ImGui::SameLine();
+            ImGui::PushItemWidth(TEXT_BASE_WIDTH * 16);
+            if (ImGui::Combo("Demosaic", &sel, demosaic_names, 2))
+            {
+                img.set_demosaic((DemosaicMethod)sel);
+            }
+            ImGui::PopItemWidth();
+        }
+        if (show && full_res)
+        {
+            img.set_view_size(width, height, true);
+            ImGui::BeginChild("##viewfinder", ImGui::GetContentRegionAvail(), false, ImGuiWindowFlags_HorizontalScrollbar);
+            ImGui::Image((void *)(intptr_t)texture, ImVec2(width, height));
+            ImGui::EndChild();
+        }
+        else if (show)
+        {
+            ImVec2 size = render_size(width, height);
+            img.set_view_size(size[0], size[1]); // only upload what is visible
+            ImGui::Image((void *)(intptr_t)texture, size);
+        }
+    }
+};
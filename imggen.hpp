@@ -1,13 +1,27 @@
 #pragma once
 #include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
+#include <math.h>
+#include <time.h>
 #include <VmbC/VmbC.h>
+#include <algorithm>
+#include <atomic>
 #include <thread>
+#include <vector>
 
 #include <chrono>
 
-#include "imagetexture.hpp"
+#include "framegen.hpp"
+#include "pixfmt.hpp"
+
+#define IMGGEN_SPIN_US 200       // busy wait before each deadline, covers the wakeup latency
+#define IMGGEN_MAX_SLEEP_MS 100  // longest sleep without checking for join()
+
+/**
+ * @brief Receives every generated frame on the generator thread, like a camera
+ * frame callback: the buffer is reused once it returns.
+ */
+typedef void (*ImageGeneratorCallback)(VmbFrame_t *frame, void *user_data);
 
 class ImageGenerator
 {
@@ -15,63 +29,73 @@ private:
     uint32_t width;
     uint32_t height;
     VmbPixelFormat_t pixelFormat;
-    ssize_t elem_size;
-    ssize_t rmax;
-    uint8_t *data;
-    Image *img;
-    uint32_t sleep_us = 100;
+    FramegenSpec spec;
+    uint64_t frame_id = 0;
+    size_t frame_size;                // bytes per frame in pixelFormat
+    std::vector<uint16_t> unpacked;   // samples of packed formats before packing
+    std::vector<uint8_t> buffer;      // frame handed to the callback
+    VmbFrame_t frame;
+    ImageGeneratorCallback callback;
+    void *user_data;
+    std::atomic<int64_t> period_ns{0}; // 0: as fast as frames can be made
+    std::atomic<uint32_t> spin_us{IMGGEN_SPIN_US};
     std::thread thread;
-    bool running = false;
-    std::chrono::steady_clock::time_point last;
-    bool firstrun = true;
+    std::atomic<bool> running{false};
+    int64_t last = 0;
     double avg, avg2;
     uint64_t count;
+    double jit_avg, jit_avg2, jit_max;
+    uint64_t jit_count;
 
 public:
-    ImageGenerator(uint32_t width, uint32_t height, VmbPixelFormat_t pixelFormat, Image *img)
+    std::atomic<uint64_t> overruns{0}; // frames a period or more late, the schedule restarts from there
+
+    /**
+     * @brief Generates pattern frames in pixelFormat for callback, the same
+     * sequence for the same seed. Formats the generator does not know get
+     * RGBA8 sized frames.
+     */
+    ImageGenerator(uint32_t width, uint32_t height, VmbPixelFormat_t pixelFormat, ImageGeneratorCallback callback, void *user_data, FramegenPattern pattern = FRAMEGEN_NOISE, uint64_t seed = 0)
     {
         this->width = width;
         this->height = height;
         this->pixelFormat = pixelFormat;
-        switch (pixelFormat)
+        if (!framegen_spec(spec, pixelFormat, width, height, pattern, seed))
+            framegen_spec(spec, VmbPixelFormatRgba8, width, height, pattern, seed);
+        frame_size = framegen_size(spec);
+        if (pixfmt_is_packed(pixelFormat))
         {
-        case VmbPixelFormatMono8:
-            elem_size = 1;
-            rmax = 0xff;
-            break;
-        case VmbPixelFormatMono10:
-            elem_size = 2;
-            rmax = 0x3ff;
-            break;
-        case VmbPixelFormatMono12:
-            elem_size = 2;
-            rmax = 0xfff;
-            break;
-        case VmbPixelFormatMono14:
-            elem_size = 2;
-            rmax = 0x3fff;
-            break;
-        case VmbPixelFormatMono16:
-            elem_size = 2;
-            rmax = 0xffff;
-            break;
-        case VmbPixelFormatRgb8:
-            elem_size = 3;
-            rmax = 0xff;
-            break;
-        default:
-            elem_size = 4;
-            rmax = 0xff;
-            break;
+            frame_size = pixfmt_image_size(pixelFormat, width, height);
+            unpacked.resize(width * height);
         }
-        data = new uint8_t[width * height * elem_size];
-        this->img = img;
+        buffer.resize(frame_size);
+        memset(&frame, 0, sizeof(frame));
+        frame.buffer = buffer.data();
+        frame.bufferSize = frame_size;
+        frame.imageData = buffer.data();
+        frame.width = width;
+        frame.height = height;
+        frame.pixelFormat = pixelFormat;
+        this->callback = callback;
+        this->user_data = user_data;
+    }
+
+    /**
+     * @brief Deliver a frame every 1 / fps seconds on an absolute schedule, so
+     * the rate does not drift with the time a frame takes. 0 runs flat out.
+     */
+    void set_framerate(double fps)
+    {
+        period_ns = fps > 0 ? (int64_t)(1e9 / fps + 0.5) : 0;
     }
 
-    void set_sleep(uint32_t sleep_us)
+    /**
+     * @brief Busy wait the last spin_us of every period instead of sleeping,
+     * for microsecond delivery jitter at the cost of a core. 0 only sleeps.
+     */
+    void set_spin(uint32_t spin_us)
     {
-        this->sleep_us = sleep_us;
-        printf("Sleep: %u us\n", sleep_us);
+        this->spin_us = spin_us;
     }
 
     ~ImageGenerator()
@@ -81,16 +105,20 @@ public:
             running = false;
             thread.join();
         }
-        delete[] data;
     }
 
     void start()
     {
         running = true;
-        firstrun = true;
+        last = 0;
         avg = 0;
         avg2 = 0;
         count = 0;
+        jit_avg = 0;
+        jit_avg2 = 0;
+        jit_max = 0;
+        jit_count = 0;
+        overruns = 0;
         thread = std::thread(ImageGenerator::generate_fn, this);
     }
 
@@ -105,77 +133,101 @@ public:
         return running;
     }
 
+    // time between deliveries, us
     void get_stats(double &avg, double &stddev)
     {
         avg = this->avg;
         stddev = sqrt(avg2 - avg * avg);
     }
 
+    // how late frames were delivered against their deadlines, us
+    void get_jitter(double &avg, double &stddev, double &max)
+    {
+        avg = this->jit_avg;
+        stddev = sqrt(std::max(0.0, jit_avg2 - avg * avg));
+        max = this->jit_max;
+    }
+
+    static int64_t now_ns()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
 private:
     void generate()
     {
-        if (firstrun)
-        {
-            last = std::chrono::steady_clock::now();
-            firstrun = false;
-        }
-        else
+        uint8_t *data = unpacked.size() ? (uint8_t *)unpacked.data() : buffer.data();
+        framegen_fill(ThreadPool::shared(), spec, frame_id, data);
+        if (unpacked.size())
         {
-            auto now = std::chrono::steady_clock::now();
-            auto diff = now - last;
-            auto diff_us = std::chrono::duration_cast<std::chrono::microseconds>(diff);
-            double period = diff_us.count();
-            update_avg(period);
-            last = now;
+            pixfmt_pack(pixelFormat, buffer.data(), unpacked.data(), unpacked.size());
         }
-        if (elem_size % 2 == 0)
-        {
-            uint16_t *ptr = (uint16_t *)data;
-            for (uint32_t i = 0; i < width * height * (elem_size / 2); i++) // 2 or 4
-            {
-                *ptr++ = (uint16_t)(rand() % rmax);
-            }
-        }
-        else
-        {
-            uint8_t *ptr = data;
-            for (uint32_t i = 0; i < width * height * elem_size; i++) // 1 or 3
-            {
-                *ptr++ = (uint8_t)(rand() % rmax);
-            }
-        }
-        VmbFrame_t frame = get_frame();
-        img->update(&frame);
+        frame.frameID = frame_id++;
+        frame.receiveStatus = VmbFrameStatusComplete;
+        frame.receiveFlags = VmbFrameFlagsDimension | VmbFrameFlagsFrameID | VmbFrameFlagsTimestamp | VmbFrameFlagsImageData;
     }
 
-    static void generate_fn(ImageGenerator *self)
+    // false if join() came first
+    bool wait_until(int64_t deadline)
     {
-        while (self->running)
+        int64_t wake = deadline - (int64_t)spin_us * 1000;
+        int64_t now;
+        while (running && (now = now_ns()) < wake)
         {
-            self->generate();
-            std::this_thread::sleep_for(std::chrono::microseconds(self->sleep_us));
+            int64_t until = std::min(wake, now + (int64_t)IMGGEN_MAX_SLEEP_MS * 1000000);
+#ifdef __linux__
+            struct timespec ts;
+            ts.tv_sec = until / 1000000000;
+            ts.tv_nsec = until % 1000000000;
+            clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL); // steady_clock is CLOCK_MONOTONIC, EINTR goes round again
+#else
+            std::this_thread::sleep_until(std::chrono::steady_clock::time_point(std::chrono::nanoseconds(until)));
+#endif
         }
+        while (running && now_ns() < deadline)
+            ; // the tail the scheduler would overshoot
+        return running;
     }
 
-    uint8_t *clone()
+    void deliver(int64_t now, int64_t timestamp)
     {
-        uint8_t *clone = new uint8_t[width * height * elem_size];
-        memcpy(clone, data, width * height * elem_size);
-        return clone;
+        if (last != 0)
+            update_avg((now - last) * 1e-3);
+        last = now;
+        frame.timestamp = timestamp; // CLOCK_MONOTONIC, so latency is now_ns() - timestamp anywhere downstream
+        callback(&frame, user_data);
     }
 
-    VmbFrame_t get_frame()
+    static void generate_fn(ImageGenerator *self)
     {
-        VmbFrame_t frame;
-
-        frame.buffer = data;
-        frame.bufferSize = width * height * elem_size;
-        frame.width = width;
-        frame.height = height;
-        frame.pixelFormat = pixelFormat;
-        frame.receiveStatus = VmbFrameStatusComplete;
-
-        return frame;
+        thread_set_name("imggen");
+        int64_t deadline = 0;
+        while (self->running)
+        {
+            self->generate(); // ahead of the deadline, as a camera reads out before delivering
+            if (deadline == 0)
+                deadline = now_ns(); // the schedule starts with the first frame
+            int64_t period = self->period_ns;
+            if (period > 0 && !self->wait_until(deadline))
+                break;
+            int64_t now = now_ns();
+            if (period > 0)
+            {
+                self->update_jitter((now - deadline) * 1e-3);
+                self->deliver(now, deadline); // camera clock: exactly on schedule
+                if (now - deadline >= period) // do not burst to catch up
+                {
+                    self->overruns++;
+                    deadline = now;
+                }
+                deadline += period;
+            }
+            else
+            {
+                self->deliver(now, now);
+                deadline = now;
+            }
+        }
     }
 
     void update_avg(double period)
@@ -184,4 +236,12 @@ private:
         avg = (avg * ncount + period) / (count);
         avg2 = (avg2 * ncount + period * period) / (count);
     }
+
+    void update_jitter(double late)
+    {
+        uint64_t ncount = jit_count++;
+        jit_avg = (jit_avg * ncount + late) / (jit_count);
+        jit_avg2 = (jit_avg2 * ncount + late * late) / (jit_count);
+        jit_max = std::max(jit_max, late);
+    }
 };
@@ -0,0 +1,165 @@
+#pragma once
+
+#ifdef __APPLE__
+#define GL_SILENCE_DEPRECATION
+#endif
+#define GLFW_INCLUDE_GLEXT
+#include <GLFW/glfw3.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define PBO_RING_SIZE 3
+
+/**
+ * @brief Ring of pixel buffer objects used to stream frames into a texture.
+ *
+ * The frame is written into a mapped PBO and glTexSubImage2D() sources it from
+ * there, so the call returns immediately and the driver copies the data while
+ * the rest of the UI frame is rendered. Each PBO is only rewritten after the
+ * other ones were used, so mapping it does not wait for an upload in flight.
+ *
+ * Needs OpenGL 2.1 or GL_ARB_pixel_buffer_object, resolved at run time through
+ * GLFW. Must only be used from the thread owning the GL context.
+ */
+class PboRing
+{
+private:
+    struct Funcs
+    {
+        PFNGLGENBUFFERSPROC GenBuffers = nullptr;
+        PFNGLDELETEBUFFERSPROC DeleteBuffers = nullptr;
+        PFNGLBINDBUFFERPROC BindBuffer = nullptr;
+        PFNGLBUFFERDATAPROC BufferData = nullptr;
+        PFNGLMAPBUFFERPROC MapBuffer = nullptr;
+        PFNGLMAPBUFFERRANGEPROC MapBufferRange = nullptr; // optional, GL 3.0
+        PFNGLUNMAPBUFFERPROC UnmapBuffer = nullptr;
+        bool loaded = false;
+        bool available = false;
+    };
+
+    GLuint pbos[PBO_RING_SIZE] = {0};
+    size_t size = 0;
+    int idx = 0;
+
+    static Funcs &gl()
+    {
+        static Funcs funcs;
+        return funcs;
+    }
+
+    static bool load()
+    {
+        Funcs &f = gl();
+        if (f.loaded)
+            return f.available;
+        f.loaded = true;
+        int major = 0, minor = 0;
+        const char *version = (const char *)glGetString(GL_VERSION);
+        if (version == nullptr || sscanf(version, "%d.%d", &major, &minor) != 2)
+            return false;
+        if (major * 10 + minor < 21 && !glfwExtensionSupported("GL_ARB_pixel_buffer_object"))
+            return false;
+        f.GenBuffers = (PFNGLGENBUFFERSPROC)glfwGetProcAddress("glGenBuffers");
+        f.DeleteBuffers = (PFNGLDELETEBUFFERSPROC)glfwGetProcAddress("glDeleteBuffers");
+        f.BindBuffer = (PFNGLBINDBUFFERPROC)glfwGetProcAddress("glBindBuffer");
+        f.BufferData = (PFNGLBUFFERDATAPROC)glfwGetProcAddress("glBufferData");
+        f.MapBuffer = (PFNGLMAPBUFFERPROC)glfwGetProcAddress("glMapBuffer");
+        f.UnmapBuffer = (PFNGLUNMAPBUFFERPROC)glfwGetProcAddress("glUnmapBuffer");
+        if (major >= 3 || glfwExtensionSupported("GL_ARB_map_buffer_range"))
+            f.MapBufferRange = (PFNGLMAPBUFFERRANGEPROC)glfwGetProcAddress("glMapBufferRange");
+        f.available = f.GenBuffers && f.DeleteBuffers && f.BindBuffer && f.BufferData && f.MapBuffer && f.UnmapBuffer;
+        if (!f.available)
+            fprintf(stderr, "Pixel buffer objects unavailable, using synchronous texture uploads\n");
+        return f.available;
+    }
+
+public:
+    ~PboRing()
+    {
+        release();
+    }
+
+    /**
+     * @brief Whether the current GL context supports PBOs. Needs a current context.
+     */
+    static bool supported()
+    {
+        return load();
+    }
+
+    /**
+     * @brief (Re)allocate the ring for frames of the given size.
+     *
+     * @return false if PBOs are not available, in which case upload from client memory.
+     */
+    bool reserve(size_t size)
+    {
+        if (!load())
+            return false;
+        if (pbos[0] && this->size == size)
+            return true;
+        release();
+        Funcs &f = gl();
+        f.GenBuffers(PBO_RING_SIZE, pbos);
+        for (int i = 0; i < PBO_RING_SIZE; i++)
+        {
+            f.BindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[i]);
+            f.BufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+        }
+        f.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        this->size = size;
+        idx = 0;
+        return true;
+    }
+
+    void release()
+    {
+        if (pbos[0])
+        {
+            gl().DeleteBuffers(PBO_RING_SIZE, pbos);
+            memset(pbos, 0, sizeof(pbos));
+        }
+        size = 0;
+    }
+
+    bool ready() const
+    {
+        return pbos[0] != 0;
+    }
+
+    /**
+     * @brief Copy data into the next PBO and update the bound texture from it.
+     *
+     * @return false if the buffer could not be mapped, the texture is not updated then.
+     */
+    bool upload(const void *data, size_t len, GLsizei width, GLsizei height, GLenum fmt, GLenum type)
+    {
+        if (!pbos[0] || len > size)
+            return false;
+        Funcs &f = gl();
+        idx = (idx + 1) % PBO_RING_SIZE;
+        f.BindBuffer(GL_PIXEL_UNPACK_BUFFER, pbos[idx]);
+        void *ptr;
+        if (f.MapBufferRange)
+        {
+            ptr = f.MapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        }
+        else
+        {
+            f.BufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW); // orphan the old storage
+            ptr = f.MapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+        }
+        if (ptr == nullptr)
+        {
+            f.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+            return false;
+        }
+        memcpy(ptr, data, len);
+        f.UnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, width, height, fmt, type, 0); // offset into the PBO
+        f.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        return true;
+    }
+};
@@ -0,0 +1,670 @@
+#include "pixconv.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PIXCONV_X86
+#endif
+
+enum PixconvIsa
+{
+    ISA_SCALAR = 0,
+    ISA_SSE2,
+    ISA_SSSE3,
+    ISA_AVX2,
+};
+
+static const char *isa_names[] = {"scalar", "sse2", "ssse3", "avx2"};
+
+static PixconvIsa detect_isa()
+{
+#ifdef PIXCONV_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2"))
+        return ISA_AVX2;
+    if (__builtin_cpu_supports("ssse3"))
+        return ISA_SSSE3;
+    if (__builtin_cpu_supports("sse2"))
+        return ISA_SSE2;
+#endif
+    return ISA_SCALAR;
+}
+
+static PixconvIsa get_isa()
+{
+    static const PixconvIsa isa = detect_isa(); // thread safe initialization
+    return isa;
+}
+
+const char *pixconv_isa()
+{
+    return isa_names[get_isa()];
+}
+
+void pixconv_shift_u16_scalar(uint16_t *dst, const uint16_t *src, size_t n, uint32_t shift)
+{
+    for (size_t i = 0; i < n; i++)
+        dst[i] = src[i] << shift;
+}
+
+#ifdef PIXCONV_X86
+__attribute__((target("sse2"))) static void shift_u16_sse2(uint16_t *dst, const uint16_t *src, size_t n, uint32_t shift)
+{
+    __m128i cnt = _mm_cvtsi32_si128(shift);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i + 8));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_sll_epi16(a, cnt));
+        _mm_storeu_si128((__m128i *)(dst + i + 8), _mm_sll_epi16(b, cnt));
+    }
+    pixconv_shift_u16_scalar(dst + i, src + i, n - i, shift);
+}
+
+__attribute__((target("avx2"))) static void shift_u16_avx2(uint16_t *dst, const uint16_t *src, size_t n, uint32_t shift)
+{
+    __m128i cnt = _mm_cvtsi32_si128(shift);
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(src + i + 16));
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_sll_epi16(a, cnt));
+        _mm256_storeu_si256((__m256i *)(dst + i + 16), _mm256_sll_epi16(b, cnt));
+    }
+    pixconv_shift_u16_scalar(dst + i, src + i, n - i, shift);
+}
+#endif
+
+// Decimation runs in two passes per output row: the factor input rows are
+// summed into a wide accumulator row (the bulk of the work, vectorized), then
+// groups of factor accumulators are summed horizontally and divided.
+
+static void accumulate_u8_scalar(uint16_t *acc, const uint8_t *src, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        acc[i] += src[i];
+}
+
+static void accumulate_u16_scalar(uint32_t *acc, const uint16_t *src, size_t n)
+{
+    for (size_t i = 0; i < n; i++)
+        acc[i] += src[i];
+}
+
+#ifdef PIXCONV_X86
+__attribute__((target("sse2"))) static void accumulate_u8_sse2(uint16_t *acc, const uint8_t *src, size_t n)
+{
+    __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i a0 = _mm_loadu_si128((const __m128i *)(acc + i));
+        __m128i a1 = _mm_loadu_si128((const __m128i *)(acc + i + 8));
+        _mm_storeu_si128((__m128i *)(acc + i), _mm_add_epi16(a0, _mm_unpacklo_epi8(v, zero)));
+        _mm_storeu_si128((__m128i *)(acc + i + 8), _mm_add_epi16(a1, _mm_unpackhi_epi8(v, zero)));
+    }
+    accumulate_u8_scalar(acc + i, src + i, n - i);
+}
+
+__attribute__((target("sse2"))) static void accumulate_u16_sse2(uint32_t *acc, const uint16_t *src, size_t n)
+{
+    __m128i zero = _mm_setzero_si128();
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        __m128i a0 = _mm_loadu_si128((const __m128i *)(acc + i));
+        __m128i a1 = _mm_loadu_si128((const __m128i *)(acc + i + 4));
+        _mm_storeu_si128((__m128i *)(acc + i), _mm_add_epi32(a0, _mm_unpacklo_epi16(v, zero)));
+        _mm_storeu_si128((__m128i *)(acc + i + 4), _mm_add_epi32(a1, _mm_unpackhi_epi16(v, zero)));
+    }
+    accumulate_u16_scalar(acc + i, src + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void accumulate_u8_avx2(uint16_t *acc, const uint8_t *src, size_t n)
+{
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i a0 = _mm256_loadu_si256((const __m256i *)(acc + i));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *)(acc + i + 16));
+        a0 = _mm256_add_epi16(a0, _mm256_cvtepu8_epi16(_mm256_castsi256_si128(v)));
+        a1 = _mm256_add_epi16(a1, _mm256_cvtepu8_epi16(_mm256_extracti128_si256(v, 1)));
+        _mm256_storeu_si256((__m256i *)(acc + i), a0);
+        _mm256_storeu_si256((__m256i *)(acc + i + 16), a1);
+    }
+    accumulate_u8_scalar(acc + i, src + i, n - i);
+}
+
+__attribute__((target("avx2"))) static void accumulate_u16_avx2(uint32_t *acc, const uint16_t *src, size_t n)
+{
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i a0 = _mm256_loadu_si256((const __m256i *)(acc + i));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *)(acc + i + 8));
+        a0 = _mm256_add_epi32(a0, _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v)));
+        a1 = _mm256_add_epi32(a1, _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1)));
+        _mm256_storeu_si256((__m256i *)(acc + i), a0);
+        _mm256_storeu_si256((__m256i *)(acc + i + 8), a1);
+    }
+    accumulate_u16_scalar(acc + i, src + i, n - i);
+}
+#endif
+
+static void accumulate_u8(uint16_t *acc, const uint8_t *src, size_t n)
+{
+    switch (get_isa())
+    {
+#ifdef PIXCONV_X86
+    case ISA_AVX2:
+        accumulate_u8_avx2(acc, src, n);
+        break;
+    case ISA_SSSE3:
+    case ISA_SSE2:
+        accumulate_u8_sse2(acc, src, n);
+        break;
+#endif
+    default:
+        accumulate_u8_scalar(acc, src, n);
+        break;
+    }
+}
+
+static void accumulate_u16(uint32_t *acc, const uint16_t *src, size_t n)
+{
+    switch (get_isa())
+    {
+#ifdef PIXCONV_X86
+    case ISA_AVX2:
+        accumulate_u16_avx2(acc, src, n);
+        break;
+    case ISA_SSSE3:
+    case ISA_SSE2:
+        accumulate_u16_sse2(acc, src, n);
+        break;
+#endif
+    default:
+        accumulate_u16_scalar(acc, src, n);
+        break;
+    }
+}
+
+template <typename T, typename A, uint32_t F>
+static void reduce_row(T *out, const A *a, uint32_t owidth, uint32_t channels)
+{
+    const uint32_t div = F * F;
+    if (channels == 1) // mono, lets the compiler unroll and vectorize
+    {
+        for (uint32_t ox = 0; ox < owidth; ox++)
+        {
+            uint32_t sum = 0;
+            for (uint32_t k = 0; k < F; k++)
+                sum += a[ox * F + k];
+            out[ox] = (sum + div / 2) / div;
+        }
+        return;
+    }
+    for (uint32_t ox = 0; ox < owidth; ox++)
+    {
+        for (uint32_t c = 0; c < channels; c++)
+        {
+            uint32_t sum = 0;
+            for (uint32_t k = 0; k < F; k++)
+                sum += a[k * channels + c];
+            out[c] = (sum + div / 2) / div;
+        }
+        a += F * channels;
+        out += channels;
+    }
+}
+
+template <typename T, typename A>
+static void reduce_row(T *out, const A *a, uint32_t owidth, uint32_t channels, uint32_t factor)
+{
+    switch (factor)
+    {
+    case 2:
+        reduce_row<T, A, 2>(out, a, owidth, channels);
+        return;
+    case 4:
+        reduce_row<T, A, 4>(out, a, owidth, channels);
+        return;
+    case 8:
+        reduce_row<T, A, 8>(out, a, owidth, channels);
+        return;
+    default:
+        break;
+    }
+    uint32_t div = factor * factor;
+    for (uint32_t ox = 0; ox < owidth; ox++)
+    {
+        for (uint32_t c = 0; c < channels; c++)
+        {
+            uint32_t sum = 0;
+            for (uint32_t k = 0; k < factor; k++)
+                sum += a[k * channels + c];
+            out[c] = (sum + div / 2) / div;
+        }
+        a += factor * channels;
+        out += channels;
+    }
+}
+
+template <typename T, typename A>
+static void decimate(T *dst, const T *src, uint32_t width, uint32_t height, uint32_t channels, uint32_t factor, void (*accumulate)(A *, const T *, size_t))
+{
+    if (factor < 1 || factor > 16 || channels < 1)
+        return;
+    uint32_t owidth = width / factor;
+    uint32_t oheight = height / factor;
+    size_t rowlen = (size_t)width * channels;
+    size_t usedlen = (size_t)owidth * factor * channels;
+    static thread_local std::vector<A> acc; // grows once per thread
+    if (acc.size() < usedlen)
+        acc.resize(usedlen);
+    for (uint32_t oy = 0; oy < oheight; oy++)
+    {
+        const T *row = src + (size_t)oy * factor * rowlen;
+        std::fill(acc.begin(), acc.begin() + usedlen, 0);
+        for (uint32_t k = 0; k < factor; k++)
+            accumulate(acc.data(), row + k * rowlen, usedlen);
+        reduce_row(dst + (size_t)oy * owidth * channels, acc.data(), owidth, channels, factor);
+    }
+}
+
+void pixconv_decimate_u8(uint8_t *dst, const uint8_t *src, uint32_t width, uint32_t height, uint32_t channels, uint32_t factor)
+{
+    decimate<uint8_t, uint16_t>(dst, src, width, height, channels, factor, accumulate_u8);
+}
+
+void pixconv_decimate_u16(uint16_t *dst, const uint16_t *src, uint32_t width, uint32_t height, uint32_t channels, uint32_t factor)
+{
+    decimate<uint16_t, uint32_t>(dst, src, width, height, channels, factor, accumulate_u16);
+}
+
+void pixconv_shift_u16(uint16_t *dst, const uint16_t *src, size_t n, uint32_t shift)
+{
+    switch (get_isa())
+    {
+#ifdef PIXCONV_X86
+    case ISA_AVX2:
+        shift_u16_avx2(dst, src, n, shift);
+        break;
+    case ISA_SSSE3:
+    case ISA_SSE2:
+        shift_u16_sse2(dst, src, n, shift);
+        break;
+#endif
+    default:
+        pixconv_shift_u16_scalar(dst, src, n, shift);
+        break;
+    }
+}
+
+// Packed formats. PFNC "p" formats (Mono10p, Mono12p, ...) are a little endian
+// bit stream, pixel i occupies bits [i * bits, (i + 1) * bits). Mono12Packed is
+// the older GigE Vision layout: two pixels in three bytes, with the high eight
+// bits of each pixel in bytes 0 and 2 and both low nibbles in byte 1.
+
+void pixconv_unpack_lsb_scalar(uint16_t *dst, const uint8_t *src, size_t n, uint32_t bits)
+{
+    uint32_t mask = (1u << bits) - 1;
+    uint64_t acc = 0;
+    uint32_t nacc = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        while (nacc < bits)
+        {
+            acc |= (uint64_t)(*src++) << nacc;
+            nacc += 8;
+        }
+        dst[i] = acc & mask;
+        acc >>= bits;
+        nacc -= bits;
+    }
+}
+
+bool pixconv_pack_lsb_scalar(uint8_t *dst, const uint16_t *src, size_t n, uint32_t bits)
+{
+    uint32_t mask = (1u << bits) - 1;
+    uint32_t over = 0;
+    uint64_t acc = 0;
+    uint32_t nacc = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        over |= src[i];
+        acc |= (uint64_t)(src[i] & mask) << nacc;
+        nacc += bits;
+        while (nacc >= 8)
+        {
+            *dst++ = acc & 0xff;
+            acc >>= 8;
+            nacc -= 8;
+        }
+    }
+    if (nacc)
+        *dst = acc & 0xff;
+    return (over & ~mask) == 0;
+}
+
+void pixconv_unpack_mono12packed_scalar(uint16_t *dst, const uint8_t *src, size_t n)
+{
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2, src += 3)
+    {
+        dst[i] = (src[0] << 4) | (src[1] & 0xf);
+        dst[i + 1] = (src[2] << 4) | (src[1] >> 4);
+    }
+    if (i < n)
+        dst[i] = (src[0] << 4) | (src[1] & 0xf);
+}
+
+void pixconv_pack_mono12packed(uint8_t *dst, const uint16_t *src, size_t n)
+{
+    size_t i = 0;
+    for (; i + 2 <= n; i += 2, dst += 3)
+    {
+        dst[0] = (src[i] >> 4) & 0xff;
+        dst[1] = (src[i] & 0xf) | ((src[i + 1] & 0xf) << 4);
+        dst[2] = (src[i + 1] >> 4) & 0xff;
+    }
+    if (i < n)
+    {
+        dst[0] = (src[i] >> 4) & 0xff;
+        dst[1] = src[i] & 0xf;
+    }
+}
+
+// The SIMD unpackers gather the two bytes holding each pixel into a 16 bit
+// lane with a byte shuffle, then shift every lane left (by multiplying with a
+// per-lane power of two) so the pixel's top bit lands in bit 15, and shift all
+// lanes right by 16 - bits. Each 128 bit lane produces 8 pixels.
+#ifdef PIXCONV_X86
+// Mono10p: 8 pixels in 10 bytes, pixel j of a 4 pixel group starts at bit 2 * j of byte j
+static const int8_t shuf_10p[16] = {0, 1, 1, 2, 2, 3, 3, 4, 5, 6, 6, 7, 7, 8, 8, 9};
+static const int16_t mul_10p[8] = {64, 16, 4, 1, 64, 16, 4, 1};
+// Mono12p: 8 pixels in 12 bytes, odd pixels start at bit 4
+static const int8_t shuf_12p[16] = {0, 1, 1, 2, 3, 4, 4, 5, 6, 7, 7, 8, 9, 10, 10, 11};
+static const int16_t mul_12p[8] = {16, 1, 16, 1, 16, 1, 16, 1};
+// Mono12Packed: even pixels are (b0 << 4) | (b1 & 0xf), odd pixels (b2 << 4) | (b1 >> 4)
+static const int8_t shuf_12packed[16] = {1, 0, 1, 2, 4, 3, 4, 5, 7, 6, 7, 8, 10, 9, 10, 11};
+// Mono14p needs up to 20 bits per pixel, so the AVX2 unpacker gathers 32 bit
+// lanes (pixels 0-3 from the low 128 bit lane, 4-7 from the high one) and
+// shifts each by its own amount
+static const int8_t shuf_14p[32] = {0, 1, 2, 3, 1, 2, 3, 4, 3, 4, 5, 6, 5, 6, 7, 8,
+                                    7, 8, 9, 10, 8, 9, 10, 11, 10, 11, 12, 13, 12, 13, 14, 15};
+static const int32_t shift_14p[8] = {0, 6, 4, 2, 0, 6, 4, 2};
+
+// The packers go the other way: a multiply-add merges pixel pairs into 32 bit
+// lanes (p0 | p1 << bits), a 64 bit shift merges those into 4 * bits wide
+// groups, and a byte shuffle drops the unused top bytes of each group. Each
+// 128 bit lane consumes 8 pixels and produces bits bytes.
+static const int8_t shuf_pack[3][16] = {
+    {0, 1, 2, 3, 4, 8, 9, 10, 11, 12, -1, -1, -1, -1, -1, -1}, // 10 bit
+    {0, 1, 2, 3, 4, 5, 8, 9, 10, 11, 12, 13, -1, -1, -1, -1},  // 12 bit
+    {0, 1, 2, 3, 4, 5, 6, 8, 9, 10, 11, 12, 13, 14, -1, -1},   // 14 bit
+};
+
+__attribute__((target("ssse3"))) static void unpack_lsb_ssse3(uint16_t *dst, const uint8_t *src, size_t n, uint32_t bits)
+{
+    __m128i shuf = _mm_loadu_si128((const __m128i *)(bits == 10 ? shuf_10p : shuf_12p));
+    __m128i mul = _mm_loadu_si128((const __m128i *)(bits == 10 ? mul_10p : mul_12p));
+    size_t total = (n * bits + 7) / 8;
+    size_t step = bits; // bytes per 8 pixels
+    size_t i = 0, off = 0;
+    for (; off + 16 <= total; i += 8, off += step)
+    {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + off)), shuf);
+        v = _mm_srli_epi16(_mm_mullo_epi16(v, mul), 16 - bits);
+        _mm_storeu_si128((__m128i *)(dst + i), v);
+    }
+    pixconv_unpack_lsb_scalar(dst + i, src + off, n - i, bits);
+}
+
+__attribute__((target("avx2"))) static void unpack_lsb_avx2(uint16_t *dst, const uint8_t *src, size_t n, uint32_t bits)
+{
+    __m256i shuf = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(bits == 10 ? shuf_10p : shuf_12p)));
+    __m256i mul = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(bits == 10 ? mul_10p : mul_12p)));
+    size_t total = (n * bits + 7) / 8;
+    size_t step = bits;
+    size_t i = 0, off = 0;
+    for (; off + step + 16 <= total; i += 16, off += 2 * step)
+    {
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(src + off))), _mm_loadu_si128((const __m128i *)(src + off + step)), 1);
+        v = _mm256_shuffle_epi8(v, shuf);
+        v = _mm256_srli_epi16(_mm256_mullo_epi16(v, mul), 16 - bits);
+        _mm256_storeu_si256((__m256i *)(dst + i), v);
+    }
+    pixconv_unpack_lsb_scalar(dst + i, src + off, n - i, bits);
+}
+
+__attribute__((target("avx2"))) static void unpack_14p_avx2(uint16_t *dst, const uint8_t *src, size_t n)
+{
+    __m256i shuf = _mm256_loadu_si256((const __m256i *)shuf_14p);
+    __m256i shift = _mm256_loadu_si256((const __m256i *)shift_14p);
+    __m256i mask = _mm256_set1_epi32(0x3fff);
+    size_t total = (n * 14 + 7) / 8;
+    size_t i = 0, off = 0;
+    for (; off + 14 + 16 <= total; i += 16, off += 28)
+    {
+        __m256i a = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(src + off)));
+        __m256i b = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)(src + off + 14)));
+        a = _mm256_and_si256(_mm256_srlv_epi32(_mm256_shuffle_epi8(a, shuf), shift), mask);
+        b = _mm256_and_si256(_mm256_srlv_epi32(_mm256_shuffle_epi8(b, shuf), shift), mask);
+        // packus works per 128 bit lane: a0-3 b0-3 a4-7 b4-7
+        __m256i v = _mm256_permute4x64_epi64(_mm256_packus_epi32(a, b), 0xd8);
+        _mm256_storeu_si256((__m256i *)(dst + i), v);
+    }
+    pixconv_unpack_lsb_scalar(dst + i, src + off, n - i, 14);
+}
+
+__attribute__((target("ssse3"))) static bool pack_lsb_ssse3(uint8_t *dst, const uint16_t *src, size_t n, uint32_t bits)
+{
+    __m128i shuf = _mm_loadu_si128((const __m128i *)shuf_pack[(bits - 10) / 2]);
+    __m128i mul = _mm_set1_epi32(1 | (1 << (bits + 16)));
+    __m128i mask = _mm_set1_epi64x((1LL << (2 * bits)) - 1);
+    __m128i high = _mm_set1_epi16((int16_t)(0xffff << bits));
+    __m128i over = _mm_setzero_si128();
+    size_t total = (n * bits + 7) / 8;
+    size_t i = 0, off = 0;
+    for (; i + 8 <= n && off + 16 <= total; i += 8, off += bits)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+        over = _mm_or_si128(over, _mm_and_si128(v, high));
+        v = _mm_madd_epi16(_mm_andnot_si128(high, v), mul);
+        v = _mm_or_si128(_mm_and_si128(v, mask), _mm_andnot_si128(mask, _mm_srli_epi64(v, 32 - 2 * bits)));
+        _mm_storeu_si128((__m128i *)(dst + off), _mm_shuffle_epi8(v, shuf));
+    }
+    bool ok = _mm_movemask_epi8(_mm_cmpeq_epi8(over, _mm_setzero_si128())) == 0xffff;
+    return pixconv_pack_lsb_scalar(dst + off, src + i, n - i, bits) && ok;
+}
+
+__attribute__((target("avx2"))) static bool pack_lsb_avx2(uint8_t *dst, const uint16_t *src, size_t n, uint32_t bits)
+{
+    __m256i shuf = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)shuf_pack[(bits - 10) / 2]));
+    __m256i mul = _mm256_set1_epi32(1 | (1 << (bits + 16)));
+    __m256i mask = _mm256_set1_epi64x((1LL << (2 * bits)) - 1);
+    __m256i high = _mm256_set1_epi16((int16_t)(0xffff << bits));
+    __m256i over = _mm256_setzero_si256();
+    size_t total = (n * bits + 7) / 8;
+    size_t i = 0, off = 0;
+    for (; i + 16 <= n && off + bits + 16 <= total; i += 16, off += 2 * bits)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        over = _mm256_or_si256(over, _mm256_and_si256(v, high));
+        v = _mm256_madd_epi16(_mm256_andnot_si256(high, v), mul);
+        v = _mm256_or_si256(_mm256_and_si256(v, mask), _mm256_andnot_si256(mask, _mm256_srli_epi64(v, 32 - 2 * bits)));
+        v = _mm256_shuffle_epi8(v, shuf);
+        // the second store overwrites the 16 - bits unused bytes of the first
+        _mm_storeu_si128((__m128i *)(dst + off), _mm256_castsi256_si128(v));
+        _mm_storeu_si128((__m128i *)(dst + off + bits), _mm256_extracti128_si256(v, 1));
+    }
+    bool ok = _mm256_testz_si256(over, over);
+    return pixconv_pack_lsb_scalar(dst + off, src + i, n - i, bits) && ok;
+}
+
+__attribute__((target("ssse3"))) static void unpack_mono12packed_ssse3(uint16_t *dst, const uint8_t *src, size_t n)
+{
+    __m128i shuf = _mm_loadu_si128((const __m128i *)shuf_12packed);
+    __m128i odd = _mm_set1_epi32(0xffff0000);
+    __m128i lo = _mm_set1_epi16(0x000f);
+    __m128i hi = _mm_set1_epi16(0x0ff0);
+    size_t total = (n * 12 + 7) / 8;
+    size_t i = 0, off = 0;
+    for (; off + 16 <= total; i += 8, off += 12)
+    {
+        __m128i v = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *)(src + off)), shuf);
+        __m128i s = _mm_srli_epi16(v, 4);
+        __m128i e = _mm_or_si128(_mm_and_si128(s, hi), _mm_and_si128(v, lo)); // even pixels
+        v = _mm_or_si128(_mm_and_si128(odd, s), _mm_andnot_si128(odd, e));
+        _mm_storeu_si128((__m128i *)(dst + i), v);
+    }
+    pixconv_unpack_mono12packed_scalar(dst + i, src + off, n - i);
+}
+
+__attribute__((target("avx2"))) static void unpack_mono12packed_avx2(uint16_t *dst, const uint8_t *src, size_t n)
+{
+    __m256i shuf = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)shuf_12packed));
+    __m256i odd = _mm256_set1_epi32(0xffff0000);
+    __m256i lo = _mm256_set1_epi16(0x000f);
+    __m256i hi = _mm256_set1_epi16(0x0ff0);
+    size_t total = (n * 12 + 7) / 8;
+    size_t i = 0, off = 0;
+    for (; off + 12 + 16 <= total; i += 16, off += 24)
+    {
+        __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(_mm_loadu_si128((const __m128i *)(src + off))), _mm_loadu_si128((const __m128i *)(src + off + 12)), 1);
+        v = _mm256_shuffle_epi8(v, shuf);
+        __m256i s = _mm256_srli_epi16(v, 4);
+        __m256i e = _mm256_or_si256(_mm256_and_si256(s, hi), _mm256_and_si256(v, lo));
+        v = _mm256_blendv_epi8(e, s, odd);
+        _mm256_storeu_si256((__m256i *)(dst + i), v);
+    }
+    pixconv_unpack_mono12packed_scalar(dst + i, src + off, n - i);
+}
+#endif
+
+void pixconv_unpack_lsb(uint16_t *dst, const uint8_t *src, size_t n, uint32_t bits)
+{
+#ifdef PIXCONV_X86
+    if (bits == 14 && get_isa() == ISA_AVX2)
+    {
+        unpack_14p_avx2(dst, src, n);
+        return;
+    }
+    if (bits == 10 || bits == 12)
+    {
+        switch (get_isa())
+        {
+        case ISA_AVX2:
+            unpack_lsb_avx2(dst, src, n, bits);
+            return;
+        case ISA_SSSE3:
+            unpack_lsb_ssse3(dst, src, n, bits);
+            return;
+        default:
+            break;
+        }
+    }
+#endif
+    pixconv_unpack_lsb_scalar(dst, src, n, bits);
+}
+
+bool pixconv_pack_lsb(uint8_t *dst, const uint16_t *src, size_t n, uint32_t bits)
+{
+#ifdef PIXCONV_X86
+    if (bits == 10 || bits == 12 || bits == 14)
+    {
+        switch (get_isa())
+        {
+        case ISA_AVX2:
+            return pack_lsb_avx2(dst, src, n, bits);
+        case ISA_SSSE3:
+            return pack_lsb_ssse3(dst, src, n, bits);
+        default:
+            break;
+        }
+    }
+#endif
+    return pixconv_pack_lsb_scalar(dst, src, n, bits);
+}
+
+void pixconv_unpack_mono12packed(uint16_t *dst, const uint8_t *src, size_t n)
+{
+    switch (get_isa())
+    {
+#ifdef PIXCONV_X86
+    case ISA_AVX2:
+        unpack_mono12packed_avx2(dst, src, n);
+        break;
+    case ISA_SSSE3:
+        unpack_mono12packed_ssse3(dst, src, n);
+        break;
+#endif
+    default:
+        pixconv_unpack_mono12packed_scalar(dst, src, n);
+        break;
+    }
+}
+
+// Look up tables. AVX2 gathers 32 bits per 16 bit entry (hence the padding
+// entry) and keeps the low half; on the machines tested that beats the
+// unrolled scalar loop by about a third.
+
+template <typename T>
+static void lut_scalar(T *dst, const T *src, size_t n, const T *lut)
+{
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        dst[i] = lut[src[i]];
+        dst[i + 1] = lut[src[i + 1]];
+        dst[i + 2] = lut[src[i + 2]];
+        dst[i + 3] = lut[src[i + 3]];
+    }
+    for (; i < n; i++)
+        dst[i] = lut[src[i]];
+}
+
+#ifdef PIXCONV_X86
+__attribute__((target("avx2"))) static void lut_u16_avx2(uint16_t *dst, const uint16_t *src, size_t n, const uint16_t *lut)
+{
+    const __m256i mask = _mm256_set1_epi32(0xffff);
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+        __m256i lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(v));
+        __m256i hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(v, 1));
+        lo = _mm256_and_si256(_mm256_i32gather_epi32((const int *)lut, lo, 2), mask);
+        hi = _mm256_and_si256(_mm256_i32gather_epi32((const int *)lut, hi, 2), mask);
+        // packus works per 128 bit lane, restore the sample order
+        _mm256_storeu_si256((__m256i *)(dst + i), _mm256_permute4x64_epi64(_mm256_packus_epi32(lo, hi), 0xd8));
+    }
+    lut_scalar(dst + i, src + i, n - i, lut);
+}
+#endif
+
+void pixconv_lut_u16(uint16_t *dst, const uint16_t *src, size_t n, const uint16_t *lut)
+{
+#ifdef PIXCONV_X86
+    if (get_isa() == ISA_AVX2)
+    {
+        lut_u16_avx2(dst, src, n, lut);
+        return;
+    }
+#endif
+    lut_scalar(dst, src, n, lut);
+}
+
+void pixconv_lut_u8(uint8_t *dst, const uint8_t *src, size_t n, const uint8_t *lut)
+{
+    lut_scalar(dst, src, n, lut);
+}
@@ -0,0 +1,94 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+
+/**
+ * @brief Pixel conversion kernels for the display path.
+ *
+ * Every kernel writes to a separate destination buffer and leaves the source
+ * untouched. The fastest implementation supported by the CPU (AVX2, SSE2 or
+ * scalar) is picked at run time on first use.
+ */
+
+/**
+ * @brief dst[i] = src[i] << shift, used to bring 10/12/14 bit samples to the full 16 bit range.
+ */
+void pixconv_shift_u16(uint16_t *dst, const uint16_t *src, size_t n, uint32_t shift);
+
+/**
+ * @brief Scalar reference implementation of pixconv_shift_u16.
+ */
+void pixconv_shift_u16_scalar(uint16_t *dst, const uint16_t *src, size_t n, uint32_t shift);
+
+/**
+ * @brief Shrink an 8 bit image by an integer factor, averaging factor x factor blocks (box filter).
+ *
+ * The output is (width / factor) x (height / factor) pixels of the given
+ * number of interleaved channels; edge pixels that do not fill a block are
+ * dropped. factor must be between 1 and 16.
+ */
+void pixconv_decimate_u8(uint8_t *dst, const uint8_t *src, uint32_t width, uint32_t height, uint32_t channels, uint32_t factor);
+
+/**
+ * @brief 16 bit version of pixconv_decimate_u8.
+ */
+void pixconv_decimate_u16(uint16_t *dst, const uint16_t *src, uint32_t width, uint32_t height, uint32_t channels, uint32_t factor);
+
+/**
+ * @brief Unpack a little endian bit stream of bits wide samples (GenICam Mono10p, Mono12p, ...) to 16 bit.
+ *
+ * Reads (n * bits + 7) / 8 bytes. bits must be between 1 and 16.
+ */
+void pixconv_unpack_lsb(uint16_t *dst, const uint8_t *src, size_t n, uint32_t bits);
+
+/**
+ * @brief Scalar reference implementation of pixconv_unpack_lsb.
+ */
+void pixconv_unpack_lsb_scalar(uint16_t *dst, const uint8_t *src, size_t n, uint32_t bits);
+
+/**
+ * @brief Inverse of pixconv_unpack_lsb, writes (n * bits + 7) / 8 bytes.
+ *
+ * @return false if any sample had bits set above bits, those are dropped.
+ */
+bool pixconv_pack_lsb(uint8_t *dst, const uint16_t *src, size_t n, uint32_t bits);
+
+/**
+ * @brief Scalar reference implementation of pixconv_pack_lsb.
+ */
+bool pixconv_pack_lsb_scalar(uint8_t *dst, const uint16_t *src, size_t n, uint32_t bits);
+
+/**
+ * @brief Unpack GigE Vision Mono12Packed (two pixels in three bytes) to 16 bit.
+ */
+void pixconv_unpack_mono12packed(uint16_t *dst, const uint8_t *src, size_t n);
+
+/**
+ * @brief Scalar reference implementation of pixconv_unpack_mono12packed.
+ */
+void pixconv_unpack_mono12packed_scalar(uint16_t *dst, const uint8_t *src, size_t n);
+
+/**
+ * @brief Inverse of pixconv_unpack_mono12packed.
+ */
+void pixconv_pack_mono12packed(uint8_t *dst, const uint16_t *src, size_t n);
+
+#define PIXCONV_LUT_SIZE 65536
+
+/**
+ * @brief dst[i] = lut[src[i]] for 16 bit samples.
+ *
+ * lut must hold PIXCONV_LUT_SIZE + 1 entries, the last one is padding read
+ * (and ignored) by the gather based AVX2 path.
+ */
+void pixconv_lut_u16(uint16_t *dst, const uint16_t *src, size_t n, const uint16_t *lut);
+
+/**
+ * @brief dst[i] = lut[src[i]] for 8 bit samples, lut holds 256 entries.
+ */
+void pixconv_lut_u8(uint8_t *dst, const uint8_t *src, size_t n, const uint8_t *lut);
+
+/**
+ * @brief Name of the instruction set the dispatched kernels use.
+ */
+const char *pixconv_isa();
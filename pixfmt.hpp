@@ -0,0 +1,271 @@
+#pragma once
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <VmbC/VmbC.h>
+
+#include "pixconv.hpp"
+#include "demosaic.hpp"
+
+/**
+ * @brief Bits occupied by one pixel, as encoded in the GenICam PFNC pixel format code.
+ */
+static inline uint32_t pixfmt_bits_per_pixel(VmbPixelFormat_t pfmt)
+{
+    return (pfmt >> 16) & 0xff;
+}
+
+/**
+ * @brief Bytes occupied by a width x height image in the given pixel format.
+ */
+static inline size_t pixfmt_image_size(VmbPixelFormat_t pfmt, uint32_t width, uint32_t height)
+{
+    return ((size_t)width * height * pixfmt_bits_per_pixel(pfmt) + 7) / 8;
+}
+
+static const struct
+{
+    const char *name;
+    VmbPixelFormat_t pfmt;
+} pixfmt_names[] = {
+    {"Mono8", VmbPixelFormatMono8},
+    {"Mono10", VmbPixelFormatMono10},
+    {"Mono12", VmbPixelFormatMono12},
+    {"Mono14", VmbPixelFormatMono14},
+    {"Mono16", VmbPixelFormatMono16},
+    {"Mono10p", VmbPixelFormatMono10p},
+    {"Mono12p", VmbPixelFormatMono12p},
+    {"Mono12Packed", VmbPixelFormatMono12Packed},
+    {"RGB8", VmbPixelFormatRgb8},
+    {"BGR8", VmbPixelFormatBgr8},
+    {"RGBa8", VmbPixelFormatRgba8},
+    {"BGRa8", VmbPixelFormatBgra8},
+    {"RGB16", VmbPixelFormatRgb16},
+    {"BGR16", VmbPixelFormatBgr16},
+    {"RGBa16", VmbPixelFormatRgba16},
+    {"BGRa16", VmbPixelFormatBgra16},
+    {"BayerGR8", VmbPixelFormatBayerGR8},
+    {"BayerRG8", VmbPixelFormatBayerRG8},
+    {"BayerGB8", VmbPixelFormatBayerGB8},
+    {"BayerBG8", VmbPixelFormatBayerBG8},
+    {"BayerGR10", VmbPixelFormatBayerGR10},
+    {"BayerRG10", VmbPixelFormatBayerRG10},
+    {"BayerGB10", VmbPixelFormatBayerGB10},
+    {"BayerBG10", VmbPixelFormatBayerBG10},
+    {"BayerGR12", VmbPixelFormatBayerGR12},
+    {"BayerRG12", VmbPixelFormatBayerRG12},
+    {"BayerGB12", VmbPixelFormatBayerGB12},
+    {"BayerBG12", VmbPixelFormatBayerBG12},
+    {"BayerGR16", VmbPixelFormatBayerGR16},
+    {"BayerRG16", VmbPixelFormatBayerRG16},
+    {"BayerGB16", VmbPixelFormatBayerGB16},
+    {"BayerBG16", VmbPixelFormatBayerBG16},
+};
+
+/**
+ * @brief Convert a GenICam pixel format name (as reported by allied_get_image_format) to a pixel format code.
+ *
+ * @return true if the name is known.
+ */
+static inline bool pixfmt_from_string(const char *name, VmbPixelFormat_t &pfmt)
+{
+    if (name == nullptr)
+        return false;
+    for (size_t i = 0; i < sizeof(pixfmt_names) / sizeof(pixfmt_names[0]); i++)
+    {
+        if (strcmp(pixfmt_names[i].name, name) == 0)
+        {
+            pfmt = pixfmt_names[i].pfmt;
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * @brief Convert a pixel format code to its GenICam name.
+ */
+static inline const char *pixfmt_to_string(VmbPixelFormat_t pfmt)
+{
+    for (size_t i = 0; i < sizeof(pixfmt_names) / sizeof(pixfmt_names[0]); i++)
+    {
+        if (pixfmt_names[i].pfmt == pfmt)
+            return pixfmt_names[i].name;
+    }
+    return "Unknown";
+}
+
+/**
+ * @brief Significant bits per sample.
+ */
+static inline uint32_t pixfmt_bit_depth(VmbPixelFormat_t pfmt)
+{
+    switch (pfmt)
+    {
+    case VmbPixelFormatMono10:
+    case VmbPixelFormatMono10p:
+    case VmbPixelFormatBayerGR10:
+    case VmbPixelFormatBayerRG10:
+    case VmbPixelFormatBayerGB10:
+    case VmbPixelFormatBayerBG10:
+        return 10;
+    case VmbPixelFormatMono12:
+    case VmbPixelFormatMono12p:
+    case VmbPixelFormatMono12Packed:
+    case VmbPixelFormatBayerGR12:
+    case VmbPixelFormatBayerRG12:
+    case VmbPixelFormatBayerGB12:
+    case VmbPixelFormatBayerBG12:
+        return 12;
+    case VmbPixelFormatMono14:
+        return 14;
+    case VmbPixelFormatMono16:
+    case VmbPixelFormatRgb16:
+    case VmbPixelFormatBgr16:
+    case VmbPixelFormatRgba16:
+    case VmbPixelFormatBgra16:
+    case VmbPixelFormatBayerGR16:
+    case VmbPixelFormatBayerRG16:
+    case VmbPixelFormatBayerGB16:
+    case VmbPixelFormatBayerBG16:
+        return 16;
+    default:
+        return 8;
+    }
+}
+
+/**
+ * @brief Whether samples of this format are packed tighter than byte aligned 16 bit words.
+ */
+static inline bool pixfmt_is_packed(VmbPixelFormat_t pfmt)
+{
+    switch (pfmt)
+    {
+    case VmbPixelFormatMono10p:
+    case VmbPixelFormatMono12p:
+    case VmbPixelFormatMono12Packed:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief The 16 bit format a packed format unpacks to, or the format itself if it is not packed.
+ */
+static inline VmbPixelFormat_t pixfmt_unpacked(VmbPixelFormat_t pfmt)
+{
+    switch (pfmt)
+    {
+    case VmbPixelFormatMono10p:
+        return VmbPixelFormatMono10;
+    case VmbPixelFormatMono12p:
+    case VmbPixelFormatMono12Packed:
+        return VmbPixelFormatMono12;
+    default:
+        return pfmt;
+    }
+}
+
+/**
+ * @brief Unpack npix pixels of a packed format to 16 bit samples.
+ *
+ * @return false if the format is not a packed format.
+ */
+static inline bool pixfmt_unpack(VmbPixelFormat_t pfmt, uint16_t *dst, const uint8_t *src, size_t npix)
+{
+    switch (pfmt)
+    {
+    case VmbPixelFormatMono10p:
+        pixconv_unpack_lsb(dst, src, npix, 10);
+        return true;
+    case VmbPixelFormatMono12p:
+        pixconv_unpack_lsb(dst, src, npix, 12);
+        return true;
+    case VmbPixelFormatMono12Packed:
+        pixconv_unpack_mono12packed(dst, src, npix);
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Pack npix 16 bit samples into a packed format, the inverse of pixfmt_unpack.
+ *
+ * @return false if the format is not a packed format.
+ */
+static inline bool pixfmt_pack(VmbPixelFormat_t pfmt, uint8_t *dst, const uint16_t *src, size_t npix)
+{
+    switch (pfmt)
+    {
+    case VmbPixelFormatMono10p:
+        pixconv_pack_lsb(dst, src, npix, 10);
+        return true;
+    case VmbPixelFormatMono12p:
+        pixconv_pack_lsb(dst, src, npix, 12);
+        return true;
+    case VmbPixelFormatMono12Packed:
+        pixconv_pack_mono12packed(dst, src, npix);
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Whether this is a raw colour filter array (Bayer) format.
+ */
+static inline bool pixfmt_is_bayer(VmbPixelFormat_t pfmt)
+{
+    switch (pfmt)
+    {
+    case VmbPixelFormatBayerGR8:
+    case VmbPixelFormatBayerGR10:
+    case VmbPixelFormatBayerGR12:
+    case VmbPixelFormatBayerGR16:
+    case VmbPixelFormatBayerRG8:
+    case VmbPixelFormatBayerRG10:
+    case VmbPixelFormatBayerRG12:
+    case VmbPixelFormatBayerRG16:
+    case VmbPixelFormatBayerGB8:
+    case VmbPixelFormatBayerGB10:
+    case VmbPixelFormatBayerGB12:
+    case VmbPixelFormatBayerGB16:
+    case VmbPixelFormatBayerBG8:
+    case VmbPixelFormatBayerBG10:
+    case VmbPixelFormatBayerBG12:
+    case VmbPixelFormatBayerBG16:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * @brief Colour filter layout of a Bayer format.
+ */
+static inline BayerPattern pixfmt_bayer_pattern(VmbPixelFormat_t pfmt)
+{
+    switch (pfmt)
+    {
+    case VmbPixelFormatBayerGR8:
+    case VmbPixelFormatBayerGR10:
+    case VmbPixelFormatBayerGR12:
+    case VmbPixelFormatBayerGR16:
+        return BAYER_GR;
+    case VmbPixelFormatBayerGB8:
+    case VmbPixelFormatBayerGB10:
+    case VmbPixelFormatBayerGB12:
+    case VmbPixelFormatBayerGB16:
+        return BAYER_GB;
+    case VmbPixelFormatBayerBG8:
+    case VmbPixelFormatBayerBG10:
+    case VmbPixelFormatBayerBG12:
+    case VmbPixelFormatBayerBG16:
+        return BAYER_BG;
+    default:
+        return BAYER_RG;
+    }
+}
@@ -0,0 +1,458 @@
+#pragma once
+#include <stdint.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "framepool.hpp"
+#include "recfile.hpp"
+
+#define PLAYER_HANDLES 8 // frames the receiver may hold at once
+
+enum PlaybackPacing
+{
+    PACING_ORIGINAL = 0, // host arrival times of the recording, scaled by the speed
+    PACING_FAST,         // as fast as the receiver takes them
+};
+
+/**
+ * @brief Receives played frames on the playback thread. The handle points
+ * into the mapped recording and must not be written to.
+ */
+typedef void (*PlayerCallback)(const FrameHandle &frame, const RecFrameHeader &hdr, void *user_data);
+
+/**
+ * @brief Plays a recording back from a read only mapping.
+ *
+ * Frames are handed to the callback as FrameHandles from an external pool
+ * (see FramePool::wrap()) that point straight into the mapping, so nothing is
+ * copied on the way to the receiver; the kernel pages the file in, helped by
+ * a read ahead hint for the next record. Compressed records are decoded into
+ * a small pool of their own instead. The receiver has to let go of all
+ * handles before close().
+ */
+class Player
+{
+private:
+    RecFileReader reader;
+    FramePool pool;
+    FramePool decoded; // compressed recordings
+    uint8_t *map = nullptr;
+    size_t map_size = 0;
+    PlayerCallback cb = nullptr;
+    void *user_data = nullptr;
+    std::thread thread;
+
+    std::mutex mtx; // guards the commands below
+    std::condition_variable cv;
+    bool quit = false;
+    bool playing = false;
+    bool show = false;    // deliver the target frame once, also while paused
+    int64_t target = -1; // frame to continue from
+    bool rebase = false;  // restart pacing from the next frame
+
+    std::atomic<int> pacing{PACING_ORIGINAL};
+    std::atomic<float> speed{1.0f};
+    std::atomic<bool> loop{true};
+    std::atomic<uint64_t> current{0};   // last frame handed out
+    std::atomic<double> rate{0};        // frames per second
+    std::string errmsg;
+
+    uint64_t frame_time(uint64_t n) const
+    {
+        const RecIndexEntry &e = reader.entry(n);
+        return e.host_ns ? e.host_ns : e.timestamp; // camera ticks are ns on most models
+    }
+
+    bool deliver(uint64_t n)
+    {
+        uint64_t off = reader.entry(n).offset;
+        const RecFrameHeader *hdr = (const RecFrameHeader *)(map + off);
+        if (off + RECFILE_FRAME_HEADER_SIZE > map_size || hdr->magic != RECFILE_FRAME_MAGIC || off + RECFILE_FRAME_HEADER_SIZE + hdr->data_size > map_size)
+        {
+            corrupt++;
+            return false;
+        }
+        if (!recfile_check_crc(*hdr, map + off + RECFILE_FRAME_HEADER_SIZE))
+            crc_errors++; // shown anyway, damage is better seen than skipped
+        if (n + 1 < reader.frame_count()) // read ahead
+        {
+            uint64_t next = reader.entry(n + 1).offset;
+            if (next < map_size) // records are page aligned
+                madvise(map + next, std::min((uint64_t)map_size - next, recfile_record_size(hdr->data_size)), MADV_WILLNEED);
+        }
+        FrameInfo info;
+        info.width = hdr->width;
+        info.height = hdr->height;
+        info.pixelFormat = hdr->pixelFormat;
+        info.frameID = hdr->frameID;
+        info.timestamp = hdr->timestamp;
+        info.status = (VmbFrameStatus_t)hdr->status;
+        info.size = recfile_frame_size(*hdr);
+        FrameHandle fh;
+        if (hdr->codec == RECFILE_CODEC_RAW)
+            fh = pool.wrap(map + off + RECFILE_FRAME_HEADER_SIZE, info);
+        else if (info.size > decoded.slab_bytes())
+        {
+            corrupt++;
+            return false;
+        }
+        else
+            fh = decoded.acquire();
+        if (!fh)
+        {
+            dropped++; // receiver holds on to too many frames
+            return false;
+        }
+        if (hdr->codec != RECFILE_CODEC_RAW)
+        {
+            if (!recfile_decode(*hdr, map + off + RECFILE_FRAME_HEADER_SIZE, fh.data()))
+            {
+                corrupt++;
+                return false;
+            }
+            fh.info() = info;
+        }
+        current = n;
+        cb(fh, *hdr, user_data);
+        frames_played++;
+        return true;
+    }
+
+    static void ThreadFcn(Player *self)
+    {
+        uint64_t n = 0;
+        uint64_t count = self->reader.frame_count();
+        bool have_base = false;
+        std::chrono::steady_clock::time_point t0;
+        uint64_t ns0 = 0;
+        auto last = std::chrono::steady_clock::now();
+        uint64_t last_played = 0;
+        std::unique_lock<std::mutex> lock(self->mtx);
+        while (true)
+        {
+            self->cv.wait(lock, [self]
+                          { return self->quit || self->playing || self->show; });
+            if (self->quit)
+                break;
+            if (self->target >= 0)
+            {
+                n = self->target;
+                self->target = -1;
+                have_base = false;
+            }
+            if (self->rebase)
+            {
+                have_base = false;
+                self->rebase = false;
+            }
+            bool once = self->show;
+            self->show = false;
+            if (n >= count)
+            {
+                if (count == 0 || (!once && !self->loop.load()))
+                {
+                    self->playing = false; // stop at the end
+                    continue;
+                }
+                n = once ? count - 1 : 0;
+                have_base = false;
+            }
+            if (!once && have_base && self->pacing.load() == PACING_ORIGINAL)
+            {
+                double dt = (double)(int64_t)(self->frame_time(n) - ns0) / self->speed.load();
+                auto deadline = t0 + std::chrono::nanoseconds((int64_t)std::max(0.0, dt));
+                // woken early by any command, which is then handled first
+                if (self->cv.wait_until(lock, deadline, [self]
+                                        { return self->quit || !self->playing || self->show || self->target >= 0 || self->rebase; }))
+                    continue;
+                if (std::chrono::steady_clock::now() - deadline > std::chrono::milliseconds(1))
+                    self->late++;
+            }
+            if (!have_base)
+            {
+                t0 = std::chrono::steady_clock::now();
+                ns0 = self->frame_time(n);
+                have_base = true;
+            }
+            lock.unlock();
+            self->deliver(n);
+            n++;
+            auto now = std::chrono::steady_clock::now();
+            double el = std::chrono::duration<double>(now - last).count();
+            if (el >= 0.5)
+            {
+                uint64_t played = self->frames_played;
+                self->rate = (played - last_played) / el;
+                last_played = played;
+                last = now;
+            }
+            lock.lock();
+        }
+    }
+
+public:
+    ~Player()
+    {
+        close();
+    }
+
+    /**
+     * @brief Map a recording and start the (paused) playback thread.
+     *
+     * @return false if the file could not be opened or mapped, see error().
+     */
+    bool open(const std::string &path, PlayerCallback cb, void *user_data)
+    {
+        if (!close())
+            return false;
+        if (!reader.open(path))
+        {
+            errmsg = reader.error();
+            return false;
+        }
+        struct stat sb;
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0 || fstat(fd, &sb) < 0)
+        {
+            errmsg = "Open " + path + ": " + strerror(errno);
+            if (fd >= 0)
+                ::close(fd);
+            reader.close();
+            return false;
+        }
+        void *mem = mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+        ::close(fd); // the mapping keeps the file
+        if (mem == MAP_FAILED)
+        {
+            errmsg = "Map " + path + ": " + strerror(errno);
+            reader.close();
+            return false;
+        }
+        map = (uint8_t *)mem;
+        map_size = sb.st_size;
+        madvise(map, map_size, MADV_SEQUENTIAL);
+        pool.reserve_external(PLAYER_HANDLES);
+        if (reader.header().codec != RECFILE_CODEC_RAW)
+            decoded.reserve(reader.header().frame_size, PLAYER_HANDLES);
+        this->cb = cb;
+        this->user_data = user_data;
+        quit = false;
+        playing = false;
+        show = false;
+        target = -1;
+        rebase = false;
+        current = 0;
+        rate = 0;
+        frames_played = 0;
+        late = 0;
+        dropped = 0;
+        corrupt = 0;
+        crc_errors = 0;
+        errmsg = "";
+        thread = std::thread(ThreadFcn, this);
+        return true;
+    }
+
+    /**
+     * @brief Stop the playback thread and unmap the recording.
+     *
+     * @return false if the receiver still holds frames, nothing is closed then.
+     */
+    bool close()
+    {
+        if (thread.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                quit = true;
+            }
+            cv.notify_all();
+            thread.join();
+        }
+        if (map == nullptr)
+            return true;
+        if (pool.in_use() != 0 || decoded.in_use() != 0)
+        {
+            errmsg = "Frames still in use";
+            return false;
+        }
+        munmap(map, map_size);
+        map = nullptr;
+        map_size = 0;
+        reader.close();
+        return true;
+    }
+
+    bool is_open() const
+    {
+        return map != nullptr;
+    }
+
+    const RecFileHeader &header() const
+    {
+        return reader.header();
+    }
+
+    uint64_t frame_count() const
+    {
+        return map ? reader.frame_count() : 0;
+    }
+
+    /**
+     * @brief The handles given out, for display.
+     */
+    const FramePool &frame_pool() const
+    {
+        return reader.header().codec != RECFILE_CODEC_RAW ? decoded : pool;
+    }
+
+    bool index_recovered() const
+    {
+        return reader.index_recovered();
+    }
+
+    void play()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            playing = true;
+            rebase = true;
+        }
+        cv.notify_all();
+    }
+
+    void pause()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            playing = false;
+        }
+        cv.notify_all();
+        rate = 0;
+    }
+
+    bool is_playing()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return playing;
+    }
+
+    /**
+     * @brief Show frame n and continue from there.
+     */
+    void seek(uint64_t n)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            target = n;
+            show = true;
+        }
+        cv.notify_all();
+    }
+
+    /**
+     * @brief Seek to the first frame at or after a camera timestamp.
+     */
+    void seek_timestamp(uint64_t ts)
+    {
+        if (frame_count() == 0)
+            return;
+        uint64_t n = reader.find_timestamp(ts);
+        seek(std::min(n, frame_count() - 1));
+    }
+
+    /**
+     * @brief Pause and show the frame delta frames away from the current one.
+     */
+    void step(int64_t delta)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            int64_t n = (target >= 0 ? target : (int64_t)current.load()) + delta; // steps add up before they are shown
+            n = std::max((int64_t)0, std::min((int64_t)frame_count() - 1, n));
+            playing = false;
+            target = n;
+            show = true;
+        }
+        cv.notify_all();
+    }
+
+    void set_pacing(PlaybackPacing mode)
+    {
+        pacing = mode;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            rebase = true;
+        }
+        cv.notify_all();
+    }
+
+    PlaybackPacing get_pacing() const
+    {
+        return (PlaybackPacing)pacing.load();
+    }
+
+    void set_speed(float factor)
+    {
+        speed = std::max(0.01f, factor);
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            rebase = true;
+        }
+        cv.notify_all();
+    }
+
+    float get_speed() const
+    {
+        return speed;
+    }
+
+    void set_loop(bool enable)
+    {
+        loop = enable;
+    }
+
+    bool get_loop() const
+    {
+        return loop;
+    }
+
+    /**
+     * @brief Number of the frame handed out last.
+     */
+    uint64_t position() const
+    {
+        return current;
+    }
+
+    /**
+     * @brief Playback rate over the last half second.
+     */
+    double fps() const
+    {
+        return rate;
+    }
+
+    const std::string &error() const
+    {
+        return errmsg;
+    }
+
+    std::atomic<uint64_t> frames_played{0};
+    std::atomic<uint64_t> late{0};    // paced frames that went out more than 1 ms after their time
+    std::atomic<uint64_t> dropped{0}; // no free handle, the receiver held on to too many frames
+    std::atomic<uint64_t> corrupt{0}; // records that did not check out
+    std::atomic<uint64_t> crc_errors{0}; // records whose data does not match their checksum
+};
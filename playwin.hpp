@@ -0,0 +1,189 @@
+#pragma once
+#include <stdio.h>
+#include <time.h>
+#include <string>
+
+#include "imgui/imgui.h"
+
+#include "guiwin.hpp"
+#include "imagetexture.hpp"
+#include "imageview.hpp"
+#include "player.hpp"
+#include "tripbuf.hpp"
+
+/**
+ * @brief Window that plays a recording back through the same display path as a camera.
+ */
+class PlaybackDisplay
+{
+private:
+    std::string path;
+    std::string title;
+    std::string errmsg;
+    Player player; // must outlive img, its frames point into the mapping
+    Image img;
+    ImageView view;
+    TripleBuffer<RecFrameHeader> meta; // playback thread -> ImGui thread
+    RecFrameHeader shown;
+    bool have_shown = false;
+    CaptureStat stat;
+
+    static void Callback(const FrameHandle &frame, const RecFrameHeader &hdr, void *user_data)
+    {
+        PlaybackDisplay *self = (PlaybackDisplay *)user_data;
+        self->stat.update();
+        self->img.update(frame);
+        self->meta.write_slot() = hdr;
+        self->meta.publish();
+    }
+
+public:
+    bool show = true;
+
+    PlaybackDisplay(const std::string &path)
+    {
+        this->path = path;
+        title = "Playback: " + path + string_format("##playback_%p", (void *)this);
+        if (!player.open(path, Callback, this))
+        {
+            errmsg = player.error();
+            return;
+        }
+        const RecFileHeader &hdr = player.header();
+        img.reserve(hdr.width, hdr.height, hdr.pixelFormat);
+        if (player.index_recovered())
+            errmsg = "Index incomplete, recovered from the data";
+        player.seek(0);
+    }
+
+    ~PlaybackDisplay()
+    {
+        if (!player.close()) // stops the playback thread either way
+        {
+            img.clear(); // hand the frames back before the mapping goes
+            player.close();
+        }
+    }
+
+    bool is_open() const
+    {
+        return player.is_open();
+    }
+
+    const std::string &error() const
+    {
+        return errmsg;
+    }
+
+    void display()
+    {
+        const float TEXT_BASE_WIDTH = ImGui::CalcTextSize("A").x;
+        ImGui::SetNextWindowSizeConstraints(ImVec2(512, 640), ImVec2(INFINITY, INFINITY));
+        if (!show)
+            return;
+        if (!ImGui::Begin(title.c_str(), &show))
+        {
+            ImGui::End();
+            return;
+        }
+        ImGui::PushID(this);
+        if (player.is_open())
+        {
+            const RecFileHeader &hdr = player.header();
+            uint64_t count = player.frame_count();
+            ImGui::Text("Camera: %s [%s] | %s, %u x %u, %u bits | %llu frames", hdr.model, hdr.serial, pixfmt_to_string(hdr.pixelFormat), hdr.width, hdr.height, hdr.bit_depth, (unsigned long long)count);
+            ImGui::PushStyleColor(ImGuiCol_Text, header_col);
+            ImGui::TextSeparator((char *)"Playback");
+            ImGui::PopStyleColor();
+            {
+                bool playing = player.is_playing();
+                if (ImGui::Button(playing ? "Pause" : "Play"))
+                {
+                    if (playing)
+                        player.pause();
+                    else
+                    {
+                        stat.reset();
+                        player.play();
+                    }
+                }
+                ImGui::SameLine();
+                ImGui::PushButtonRepeat(true);
+                if (ImGui::Button("<"))
+                    player.step(-1);
+                ImGui::SameLine();
+                if (ImGui::Button(">"))
+                    player.step(1);
+                ImGui::PopButtonRepeat();
+                ImGui::SameLine();
+                bool loop = player.get_loop();
+                if (ImGui::Checkbox("Loop", &loop))
+                    player.set_loop(loop);
+                ImGui::SameLine();
+                static const char *pacing_names[] = {"Original timing", "As fast as possible"};
+                int pacing = player.get_pacing();
+                ImGui::PushItemWidth(TEXT_BASE_WIDTH * 22);
+                if (ImGui::Combo("##pacing", &pacing, pacing_names, IM_ARRAYSIZE(pacing_names)))
+                    player.set_pacing((PlaybackPacing)pacing);
+                ImGui::PopItemWidth();
+                if (pacing == PACING_ORIGINAL)
+                {
+                    ImGui::SameLine();
+                    float speed = player.get_speed();
+                    ImGui::PushItemWidth(TEXT_BASE_WIDTH * 10);
+                    if (ImGui::DragFloat("Speed", &speed, 0.01f, 0.01f, 100.0f, "%.2fx", ImGuiSliderFlags_AlwaysClamp))
+                        player.set_speed(speed);
+                    ImGui::PopItemWidth();
+                }
+            }
+            if (count > 0)
+            {
+                uint64_t pos = player.position();
+                uint64_t first = 0, last = count - 1;
+                ImGui::PushItemWidth(-1);
+                if (ImGui::SliderScalar("##position", ImGuiDataType_U64, &pos, &first, &last, "Frame %llu"))
+                    player.seek(pos);
+                ImGui::PopItemWidth();
+            }
+            if (meta.consume())
+            {
+                shown = meta.read_slot();
+                have_shown = true;
+            }
+            if (have_shown)
+            {
+                char stamp[32];
+                time_t t = shown.host_ns / 1000000000ULL;
+                struct tm tm;
+                strftime(stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S", localtime_r(&t, &tm));
+                ImGui::Text("Frame %llu | ID: %llu | Timestamp: %llu | %s.%03u | Exposure: %.1f us", (unsigned long long)shown.index, (unsigned long long)shown.frameID, (unsigned long long)shown.timestamp, stamp, (unsigned)(shown.host_ns / 1000000 % 1000), shown.exposure_us);
+                if (shown.ntemps)
+                {
+                    ImGui::Text("Temperatures:");
+                    for (uint32_t i = 0; i < shown.ntemps && i < RECFILE_MAX_TEMPS; i++)
+                    {
+                        ImGui::SameLine();
+                        ImGui::Text("%.*s: %5.2f C", RECFILE_NAME_LEN, hdr.temp_names[i], shown.temps[i]);
+                    }
+                }
+            }
+            double avg, std;
+            stat.get_stats(avg, std);
+            ImGui::Text("Playback: %.1f FPS | Frame Time: %.3f +/- %.3f ms | Played: %llu, Late: %llu, Dropped: %llu, Corrupt: %llu, CRC errors: %llu", player.fps(), avg * 1e-3, std * 1e-3, (unsigned long long)player.frames_played, (unsigned long long)player.late, (unsigned long long)player.dropped, (unsigned long long)player.corrupt, (unsigned long long)player.crc_errors);
+        }
+        if (errmsg.size())
+        {
+            ImGui::Text("Last error: %s", errmsg.c_str());
+            ImGui::SameLine();
+            if (ImGui::Button("Clear"))
+                errmsg = "";
+        }
+        if (player.is_open())
+        {
+            ImGui::TextSeparator((char *)"Image Display");
+            view.render(img, player.frame_pool(), true);
+        }
+        ImGui::PopID();
+        ImGui::End();
+    }
+};
@@ -0,0 +1,566 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <string>
+#include <vector>
+
+#include "crc32c.hpp"
+#include "framecodec.hpp"
+#include "pixconv.hpp"
+
+// Recording container
+//
+// <name>.avr:
+//   RecFileHeader, RECFILE_HEADER_SIZE bytes
+//   record 0: RecFrameHeader, frame data, zero padding to RECFILE_ALIGN
+//   record 1: ...
+// <name>.avr.idx:
+//   RecIndexHeader, then one RecIndexEntry per record
+//
+// A record holds either the raw frame or, if RecFrameHeader::codec says so,
+// the frame compressed with framecodec.hpp, or its 16 bit samples bit packed
+// to sample_bits each (a little endian bit stream, as in Mono12p); raw_size
+// is the size of the frame once decoded. If has_crc is set, crc is the
+// CRC32C of the stored data, so damaged and truncated records can be told
+// apart from good ones without decoding them.
+//
+// Records start on RECFILE_ALIGN boundaries so that they can be written with
+// O_DIRECT and read back without touching neighbouring frames. Every record
+// header holds its own size, so the index can always be rebuilt by hopping
+// from header to header. All fields are in host (little endian) byte order.
+
+#define RECFILE_MAGIC "AVMREC01"
+#define RECFILE_INDEX_MAGIC "AVMIDX01"
+#define RECFILE_FRAME_MAGIC 0x4d415246 // "FRAM"
+#define RECFILE_VERSION 1
+#define RECFILE_HEADER_SIZE 4096
+#define RECFILE_FRAME_HEADER_SIZE 256
+#define RECFILE_ALIGN 4096
+#define RECFILE_MAX_TEMPS 8
+#define RECFILE_NAME_LEN 32
+#define RECFILE_CODEC_RAW 0
+#define RECFILE_CODEC_RICE 1 // framecodec.hpp
+#define RECFILE_CODEC_PACKED 2 // pixconv_pack_lsb() to RecFrameHeader::sample_bits
+#define RECFILE_PACK_PART (1 << 20) // samples per thread pool part when bit packing, multiple of 8
+#define RECFILE_EXT ".avr"
+#define RECFILE_INDEX_EXT ".idx"
+
+static inline uint64_t recfile_now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline uint64_t recfile_record_size(uint64_t data_size)
+{
+    return (RECFILE_FRAME_HEADER_SIZE + data_size + RECFILE_ALIGN - 1) / RECFILE_ALIGN * RECFILE_ALIGN;
+}
+
+/**
+ * @brief Create (truncate) a file for writing, with O_DIRECT where the file system allows it.
+ *
+ * @return the descriptor, or -1 with errno set.
+ */
+static inline int recfile_create(const char *path, bool &direct)
+{
+    direct = true;
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (fd < 0 && errno == EINVAL) // e.g. tmpfs
+    {
+        direct = false;
+        fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    }
+    return fd;
+}
+
+/**
+ * @brief Write all of buf at offset. If the file was opened with O_DIRECT but
+ * the file system refuses it, the file is switched to buffered writes.
+ *
+ * @return 0, or the errno value of the failed write.
+ */
+static inline int recfile_pwrite(int fd, const uint8_t *buf, size_t len, uint64_t offset, bool &direct)
+{
+    while (len > 0)
+    {
+        ssize_t ret = pwrite(fd, buf, len, offset);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret < 0 && errno == EINVAL && direct)
+        {
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_DIRECT);
+            direct = false;
+            continue;
+        }
+        if (ret <= 0)
+            return ret < 0 ? errno : EIO;
+        buf += ret;
+        len -= ret;
+        offset += ret;
+    }
+    return 0;
+}
+
+/**
+ * @brief File header, describes the camera and the format at the start of the recording.
+ *
+ * Every record carries its own format as well, so a recording survives a format change.
+ */
+struct RecFileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t frame_header_size;
+    uint32_t record_align;
+    uint32_t pixelFormat;
+    uint32_t width;
+    uint32_t height;
+    uint32_t bit_depth; // significant bits per sample
+    uint64_t frame_size; // bytes of image data per frame
+    uint64_t created_ns; // CLOCK_REALTIME
+    char model[64];
+    char serial[64];
+    uint32_t ntemps;
+    uint32_t codec; // RECFILE_CODEC_* the records may use, each record says which one it does
+    char temp_names[RECFILE_MAX_TEMPS][RECFILE_NAME_LEN]; // order of RecFrameHeader::temps
+    uint8_t reserved[3648];
+
+    RecFileHeader()
+    {
+        memset(this, 0, sizeof(*this));
+        memcpy(magic, RECFILE_MAGIC, sizeof(magic));
+        version = RECFILE_VERSION;
+        header_size = RECFILE_HEADER_SIZE;
+        frame_header_size = RECFILE_FRAME_HEADER_SIZE;
+        record_align = RECFILE_ALIGN;
+        created_ns = recfile_now_ns();
+    }
+
+    bool valid() const
+    {
+        return memcmp(magic, RECFILE_MAGIC, sizeof(magic)) == 0 && version == RECFILE_VERSION && header_size == RECFILE_HEADER_SIZE && frame_header_size == RECFILE_FRAME_HEADER_SIZE && record_align == RECFILE_ALIGN;
+    }
+};
+
+/**
+ * @brief Header in front of every frame.
+ */
+struct RecFrameHeader
+{
+    uint32_t magic;
+    uint32_t header_size;
+    uint64_t index;       // record number, from 0
+    uint64_t record_size; // header, data and padding, the next record follows
+    uint64_t data_size;   // bytes stored
+    uint64_t frameID;   // VmbFrame_t::frameID
+    uint64_t timestamp; // VmbFrame_t::timestamp, camera ticks
+    uint64_t host_ns;   // CLOCK_REALTIME when the frame arrived
+    uint32_t width;
+    uint32_t height;
+    uint32_t pixelFormat;
+    int32_t status; // VmbFrameStatus_t
+    double exposure_us;
+    uint32_t ntemps;
+    uint32_t has_stats; // the fields below are valid
+    double temps[RECFILE_MAX_TEMPS]; // degrees C, names in the file header
+    uint32_t min;
+    uint32_t max;
+    double mean;
+    double stddev;
+    uint64_t saturated;
+    uint32_t codec; // RECFILE_CODEC_*
+    uint32_t sample_bits; // bits per stored sample of RECFILE_CODEC_PACKED records
+    uint64_t raw_size; // frame data once decoded, data_size for raw records
+    uint32_t has_crc;
+    uint32_t crc; // CRC32C of the data_size bytes stored
+    uint8_t reserved[48];
+
+    RecFrameHeader()
+    {
+        memset(this, 0, sizeof(*this));
+        magic = RECFILE_FRAME_MAGIC;
+        header_size = RECFILE_FRAME_HEADER_SIZE;
+    }
+};
+
+struct RecIndexHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t entry_size;
+    uint64_t created_ns; // matches RecFileHeader::created_ns of the recording
+    uint64_t reserved;
+
+    RecIndexHeader()
+    {
+        memset(this, 0, sizeof(*this));
+        memcpy(magic, RECFILE_INDEX_MAGIC, sizeof(magic));
+        version = RECFILE_VERSION;
+        entry_size = 32;
+    }
+};
+
+struct RecIndexEntry
+{
+    uint64_t offset; // of the record header
+    uint64_t frameID;
+    uint64_t timestamp;
+    uint64_t host_ns;
+};
+
+static_assert(sizeof(RecFileHeader) == RECFILE_HEADER_SIZE, "RecFileHeader size");
+static_assert(sizeof(RecFrameHeader) == RECFILE_FRAME_HEADER_SIZE, "RecFrameHeader size");
+static_assert(sizeof(RecIndexHeader) == 32, "RecIndexHeader size");
+static_assert(sizeof(RecIndexEntry) == 32, "RecIndexEntry size");
+
+/**
+ * @brief Bytes of frame data once decoded.
+ */
+static inline uint64_t recfile_frame_size(const RecFrameHeader &fh)
+{
+    return fh.codec == RECFILE_CODEC_RAW ? fh.data_size : fh.raw_size;
+}
+
+/**
+ * @brief Checksum the data_size bytes stored for a record.
+ */
+static inline void recfile_set_crc(RecFrameHeader &fh, const uint8_t *data)
+{
+    fh.crc = crc32c(0, data, fh.data_size);
+    fh.has_crc = 1;
+}
+
+/**
+ * @brief Whether the stored data of a record matches its checksum, true for records without one.
+ */
+static inline bool recfile_check_crc(const RecFrameHeader &fh, const uint8_t *data)
+{
+    return !fh.has_crc || crc32c(0, data, fh.data_size) == fh.crc;
+}
+
+/**
+ * @brief Bytes n samples take bit packed to bits each.
+ */
+static inline uint64_t recfile_packed_size(uint64_t n, uint32_t bits)
+{
+    return (n * bits + 7) / 8;
+}
+
+/**
+ * @brief Bit pack n 16 bit samples to bits each, split across the thread pool.
+ *
+ * @return false if a sample has bits set above bits, dst is then incomplete.
+ */
+static inline bool recfile_pack(ThreadPool &pool, uint8_t *dst, const uint16_t *src, size_t n, uint32_t bits)
+{
+    std::atomic<bool> ok{true};
+    pool.parallel_for((n + RECFILE_PACK_PART - 1) / RECFILE_PACK_PART, [&](uint32_t i)
+                      {
+                          size_t start = (size_t)i * RECFILE_PACK_PART;
+                          if (!pixconv_pack_lsb(dst + start / 8 * bits, src + start, std::min(n - start, (size_t)RECFILE_PACK_PART), bits))
+                              ok = false; });
+    return ok;
+}
+
+/**
+ * @brief Inverse of recfile_pack.
+ */
+static inline void recfile_unpack(ThreadPool &pool, uint16_t *dst, const uint8_t *src, size_t n, uint32_t bits)
+{
+    pool.parallel_for((n + RECFILE_PACK_PART - 1) / RECFILE_PACK_PART, [&](uint32_t i)
+                      {
+                          size_t start = (size_t)i * RECFILE_PACK_PART;
+                          pixconv_unpack_lsb(dst + start, src + start / 8 * bits, std::min(n - start, (size_t)RECFILE_PACK_PART), bits); });
+}
+
+/**
+ * @brief Decode the stored data of a compressed or bit packed record into dst, which holds raw_size bytes.
+ */
+static inline bool recfile_decode(const RecFrameHeader &fh, const uint8_t *data, uint8_t *dst)
+{
+    if (fh.codec == RECFILE_CODEC_PACKED)
+    {
+        if (fh.sample_bits < 1 || fh.sample_bits > 16 || fh.raw_size % 2 || recfile_packed_size(fh.raw_size / 2, fh.sample_bits) != fh.data_size)
+            return false;
+        recfile_unpack(ThreadPool::shared(), (uint16_t *)dst, data, fh.raw_size / 2, fh.sample_bits);
+        return true;
+    }
+    FrameCodec fc;
+    if (fh.codec != RECFILE_CODEC_RICE || !framecodec_init(fc, fh.pixelFormat, fh.width, fh.height) || framecodec_raw_size(fc) != fh.raw_size)
+        return false;
+    return framecodec_decompress(ThreadPool::shared(), fc, data, fh.data_size, dst);
+}
+
+/**
+ * @brief Random access to a recording.
+ *
+ * The index is loaded into memory on open (32 bytes per frame), so seeking to
+ * a frame number is a lookup and seeking to a timestamp a binary search (a
+ * linear scan if the camera timestamps go back somewhere). A missing, foreign
+ * or short index (e.g. after a crash) is completed in memory by walking the
+ * record headers from the last good entry; rebuild_index() writes the result
+ * back to the sidecar file.
+ */
+class RecFileReader
+{
+private:
+    int fd = -1;
+    uint64_t fsize = 0;
+    RecFileHeader hdr;
+    std::vector<RecIndexEntry> index;
+    std::string path;
+    std::string errmsg;
+    bool recovered = false;
+    bool monotonic = true; // camera timestamps never go back, e.g. after a camera reset
+    std::vector<uint8_t> packed; // compressed or bit packed frame
+
+    bool set_error(const std::string &what, int err = 0)
+    {
+        errmsg = err ? what + ": " + strerror(err) : what;
+        return false;
+    }
+
+    bool read_at(void *buf, size_t len, uint64_t pos)
+    {
+        uint8_t *p = (uint8_t *)buf;
+        while (len > 0)
+        {
+            ssize_t ret = pread(fd, p, len, pos);
+            if (ret < 0 && errno == EINTR)
+                continue;
+            if (ret == 0)
+                errno = EIO; // short read, the file ends early
+            if (ret <= 0)
+                return false;
+            p += ret;
+            len -= ret;
+            pos += ret;
+        }
+        return true;
+    }
+
+    // a complete record with the expected number at pos
+    bool check_record(uint64_t pos, uint64_t n, RecFrameHeader &fh)
+    {
+        if (pos + RECFILE_FRAME_HEADER_SIZE > fsize || !read_at(&fh, sizeof(fh), pos))
+            return false;
+        return fh.magic == RECFILE_FRAME_MAGIC && fh.header_size == RECFILE_FRAME_HEADER_SIZE && fh.index == n && fh.record_size == recfile_record_size(fh.data_size) && pos + RECFILE_FRAME_HEADER_SIZE + fh.data_size <= fsize;
+    }
+
+    void load_index()
+    {
+        index.clear();
+        FILE *fp = fopen((path + RECFILE_INDEX_EXT).c_str(), "rb");
+        if (fp == nullptr)
+            return;
+        RecIndexHeader ih;
+        if (fread(&ih, sizeof(ih), 1, fp) == 1 && memcmp(ih.magic, RECFILE_INDEX_MAGIC, sizeof(ih.magic)) == 0 && ih.entry_size == sizeof(RecIndexEntry) && ih.created_ns == hdr.created_ns)
+        {
+            RecIndexEntry e;
+            while (fread(&e, sizeof(e), 1, fp) == 1) // a torn last entry is ignored
+                index.push_back(e);
+        }
+        fclose(fp);
+    }
+
+    // drop entries that do not point at their record, then walk the headers past the last one
+    void recover()
+    {
+        RecFrameHeader fh;
+        size_t good = index.size();
+        while (good > 0 && !check_record(index[good - 1].offset, good - 1, fh))
+            good--;
+        // spot check the start as well, a foreign index would have failed above already
+        if (good > 0 && !check_record(index[0].offset, 0, fh))
+            good = 0;
+        recovered = good != index.size();
+        index.resize(good);
+        uint64_t pos = RECFILE_HEADER_SIZE;
+        if (good > 0)
+        {
+            check_record(index[good - 1].offset, good - 1, fh);
+            pos = index[good - 1].offset + fh.record_size;
+        }
+        while (check_record(pos, index.size(), fh))
+        {
+            RecIndexEntry e = {pos, fh.frameID, fh.timestamp, fh.host_ns};
+            index.push_back(e);
+            pos += fh.record_size;
+            recovered = true;
+        }
+    }
+
+public:
+    ~RecFileReader()
+    {
+        close();
+    }
+
+    /**
+     * @brief Open a recording and its index.
+     *
+     * @return false if the file is not a recording, see error().
+     */
+    bool open(const std::string &path)
+    {
+        close();
+        this->path = path;
+        fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return set_error("Open " + path, errno);
+        struct stat sb;
+        if (fstat(fd, &sb) < 0)
+            return set_error("Stat " + path, errno);
+        fsize = sb.st_size;
+        if (!read_at(&hdr, sizeof(hdr), 0) || !hdr.valid())
+        {
+            close();
+            return set_error(path + " is not a recording");
+        }
+        load_index();
+        recover();
+        for (size_t i = 1; i < index.size() && monotonic; i++)
+            monotonic = index[i].timestamp >= index[i - 1].timestamp;
+        return true;
+    }
+
+    void close()
+    {
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+        index.clear();
+        recovered = false;
+        monotonic = true;
+    }
+
+    bool is_open() const
+    {
+        return fd >= 0;
+    }
+
+    const RecFileHeader &header() const
+    {
+        return hdr;
+    }
+
+    uint64_t frame_count() const
+    {
+        return index.size();
+    }
+
+    /**
+     * @brief The sidecar index was missing or incomplete and had to be completed from the data.
+     */
+    bool index_recovered() const
+    {
+        return recovered;
+    }
+
+    const RecIndexEntry &entry(uint64_t n) const
+    {
+        return index[n];
+    }
+
+    /**
+     * @brief Read the header of frame n.
+     */
+    bool read_header(uint64_t n, RecFrameHeader &fh)
+    {
+        if (n >= index.size())
+            return set_error("Frame out of range");
+        if (!read_at(&fh, sizeof(fh), index[n].offset))
+            return set_error("Read", errno);
+        return true;
+    }
+
+    /**
+     * @brief Read the header and data of frame n, decoded if it is stored
+     * compressed or bit packed. buf must hold len >= raw_size bytes (see recfile_frame_size()).
+     */
+    bool read_frame(uint64_t n, RecFrameHeader &fh, uint8_t *buf, size_t len)
+    {
+        if (!read_header(n, fh))
+            return false;
+        if (recfile_frame_size(fh) > len)
+            return set_error("Buffer too small");
+        uint8_t *dst = buf;
+        if (fh.codec != RECFILE_CODEC_RAW)
+        {
+            packed.resize(fh.data_size);
+            dst = packed.data();
+        }
+        if (!read_at(dst, fh.data_size, index[n].offset + RECFILE_FRAME_HEADER_SIZE))
+            return set_error("Read", errno);
+        if (fh.codec != RECFILE_CODEC_RAW && !recfile_decode(fh, packed.data(), buf))
+            return set_error("Frame data damaged");
+        return true;
+    }
+
+    /**
+     * @brief First frame with a camera timestamp at or after ts.
+     *
+     * O(log n) binary search over the in memory index, which needs the
+     * timestamps in order; a seek is rare next to the frames read, so a lookup
+     * table for O(1) is not worth its memory. If the camera timestamps went
+     * back somewhere in the recording this falls back to a linear scan for the
+     * first frame at or after ts in recording order.
+     *
+     * @return frame_count() if there is none.
+     */
+    uint64_t find_timestamp(uint64_t ts) const
+    {
+        if (!monotonic)
+        {
+            for (size_t i = 0; i < index.size(); i++)
+                if (index[i].timestamp >= ts)
+                    return i;
+            return index.size();
+        }
+        auto it = std::lower_bound(index.begin(), index.end(), ts, [](const RecIndexEntry &e, uint64_t t)
+                                   { return e.timestamp < t; });
+        return it - index.begin();
+    }
+
+    /**
+     * @brief Rewrite the sidecar index from the in memory one.
+     */
+    bool rebuild_index()
+    {
+        if (fd < 0)
+            return set_error("Not open");
+        std::string ipath = path + RECFILE_INDEX_EXT;
+        std::string tmp = ipath + ".tmp";
+        FILE *fp = fopen(tmp.c_str(), "wb");
+        if (fp == nullptr)
+            return set_error("Open " + tmp, errno);
+        RecIndexHeader ih;
+        ih.created_ns = hdr.created_ns;
+        bool ok = fwrite(&ih, sizeof(ih), 1, fp) == 1 && (index.empty() || fwrite(index.data(), sizeof(RecIndexEntry), index.size(), fp) == index.size());
+        ok = fclose(fp) == 0 && ok;
+        if (!ok || rename(tmp.c_str(), ipath.c_str()) < 0)
+        {
+            int err = errno;
+            unlink(tmp.c_str());
+            return set_error("Write " + ipath, err);
+        }
+        recovered = false;
+        return true;
+    }
+
+    const std::string &error() const
+    {
+        return errmsg;
+    }
+};
@@ -0,0 +1,98 @@
+// Print the header and frame index of a recording, and rebuild its index after a crash.
+//
+// recinfo [-f] [-r] <file.avr>
+//   -f  list every frame
+//   -r  write the recovered index back to <file.avr>.idx
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "recfile.hpp"
+#include "pixfmt.hpp"
+
+static void print_time(uint64_t ns)
+{
+    char buf[32];
+    time_t t = ns / 1000000000ULL;
+    struct tm tm;
+    strftime(buf, sizeof(buf), "%Y-%m-%d %H:%M:%S", localtime_r(&t, &tm));
+    printf("%s.%06llu", buf, (unsigned long long)(ns % 1000000000ULL / 1000));
+}
+
+int main(int argc, char *argv[])
+{
+    bool list = false, rebuild = false;
+    const char *path = nullptr;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-f") == 0)
+            list = true;
+        else if (strcmp(argv[i], "-r") == 0)
+            rebuild = true;
+        else
+            path = argv[i];
+    }
+    if (path == nullptr)
+    {
+        fprintf(stderr, "Usage: %s [-f] [-r] <file%s>\n", argv[0], RECFILE_EXT);
+        return 1;
+    }
+    RecFileReader rec;
+    if (!rec.open(path))
+    {
+        fprintf(stderr, "%s\n", rec.error().c_str());
+        return 1;
+    }
+    const RecFileHeader &hdr = rec.header();
+    printf("Camera: %s [%s]\n", hdr.model, hdr.serial);
+    printf("Created: ");
+    print_time(hdr.created_ns);
+    printf("\n");
+    printf("Format: %s, %u x %u, %u bits, %llu bytes per frame\n", pixfmt_to_string(hdr.pixelFormat), hdr.width, hdr.height, hdr.bit_depth, (unsigned long long)hdr.frame_size);
+    printf("Compression: %s\n", hdr.codec == RECFILE_CODEC_RICE ? "lossless (predictor + Rice)" : hdr.codec == RECFILE_CODEC_PACKED ? "bit packed to the sensor bit depth" : "none");
+    printf("Temperature sensors:");
+    for (uint32_t i = 0; i < hdr.ntemps && i < RECFILE_MAX_TEMPS; i++)
+        printf(" %.*s", RECFILE_NAME_LEN, hdr.temp_names[i]);
+    printf("\n");
+    printf("Frames: %llu%s\n", (unsigned long long)rec.frame_count(), rec.index_recovered() ? " (index incomplete, recovered from the data)" : "");
+    if (rec.frame_count() > 0)
+    {
+        const RecIndexEntry &first = rec.entry(0);
+        const RecIndexEntry &last = rec.entry(rec.frame_count() - 1);
+        printf("Frame IDs: %llu - %llu\n", (unsigned long long)first.frameID, (unsigned long long)last.frameID);
+        printf("Host time: ");
+        print_time(first.host_ns);
+        printf(" - ");
+        print_time(last.host_ns);
+        printf("\n");
+    }
+    if (list)
+    {
+        printf("%10s %12s %20s %10s %10s %10s %8s %8s %10s %10s\n", "Frame", "Frame ID", "Timestamp", "Offset", "Stored", "Exp (us)", "Min", "Max", "Mean", "Std");
+        for (uint64_t n = 0; n < rec.frame_count(); n++)
+        {
+            RecFrameHeader fh;
+            if (!rec.read_header(n, fh))
+            {
+                fprintf(stderr, "Frame %llu: %s\n", (unsigned long long)n, rec.error().c_str());
+                return 1;
+            }
+            printf("%10llu %12llu %20llu %10llu %10llu %10.1f", (unsigned long long)n, (unsigned long long)fh.frameID, (unsigned long long)fh.timestamp, (unsigned long long)rec.entry(n).offset, (unsigned long long)fh.data_size, fh.exposure_us);
+            if (fh.has_stats)
+                printf(" %8u %8u %10.2f %10.2f", fh.min, fh.max, fh.mean, fh.stddev);
+            for (uint32_t i = 0; i < fh.ntemps && i < RECFILE_MAX_TEMPS; i++)
+                printf(" %.2f", fh.temps[i]);
+            printf("\n");
+        }
+    }
+    if (rebuild)
+    {
+        if (!rec.rebuild_index())
+        {
+            fprintf(stderr, "%s\n", rec.error().c_str());
+            return 1;
+        }
+        printf("Index written to %s%s\n", path, RECFILE_INDEX_EXT);
+    }
+    return 0;
+}
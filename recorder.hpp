@@ -0,0 +1,692 @@
+#pragma once
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "framecodec.hpp"
+#include "framepool.hpp"
+#include "pixfmt.hpp"
+#include "recfile.hpp"
+#include "threadpool.hpp"
+
+#define RECORDER_QUEUE_DEPTH 256       // frames, power of two
+#define RECORDER_CHUNK (8 << 20)       // bytes per write, multiple of RECORDER_ALIGN
+#define RECORDER_ALIGN 4096            // O_DIRECT buffer, offset and length alignment
+#define RECORDER_PREALLOC (1ULL << 30) // file space reserved ahead of the writer
+#define RECORDER_POOL_BUDGET (512ULL << 20) // frame pool memory that lets the writer fall behind
+#define RECORDER_POOL_MAX_SLABS 256
+#define RECORDER_COMPRESS_BACKLOG 4 // queued frames beyond which frames are stored raw until the writer catches up
+
+static_assert(RECFILE_ALIGN % RECORDER_ALIGN == 0 && RECFILE_HEADER_SIZE % RECORDER_ALIGN == 0, "records must keep O_DIRECT alignment");
+
+/**
+ * @brief Streams frames to a recording (see recfile.hpp) from a dedicated writer thread.
+ *
+ * The camera callback hands frames over with push(), which only moves the
+ * handle into a bounded single producer / single consumer ring and never
+ * blocks; if the ring is full the frame is dropped and counted. The writer
+ * thread checksums each frame (CRC32C) and copies it into one of two aligned
+ * RECORDER_CHUNK staging buffers; a full buffer goes to an I/O thread that
+ * writes it out while the writer fills the other one, so checksums,
+ * compression and copies overlap with the disk. Writes use O_DIRECT where the
+ * file system allows it so that the page cache does not fill up with frames
+ * that are never read back. File space is reserved RECORDER_PREALLOC ahead
+ * with fallocate(). Every record is padded to RECFILE_ALIGN, so the staging
+ * buffers stay aligned. The index entry of a record goes to the sidecar file
+ * once its data has been written.
+ *
+ * The frame handles keep their pool slabs alive until they are written, so
+ * the frame pool must be sized for the queue (see RECORDER_POOL_BUDGET).
+ *
+ * With compression on, the writer compresses each frame (framecodec.hpp,
+ * split across the shared thread pool) before staging it, and stores it raw
+ * if that does not make it smaller. Whenever more than
+ * RECORDER_COMPRESS_BACKLOG frames are queued the writer stores frames raw
+ * until it has caught up, so a slow machine costs disk space, not frames.
+ *
+ * With bit packing on, frames of 16 bit samples are packed to the sensor bit
+ * depth (10, 12 or 14 bits) instead, which runs at several GB/s. Frames the
+ * compressor skips are bit packed if packing is on as well. A frame with a
+ * sample that does not fit the bit depth is stored raw.
+ */
+class Recorder
+{
+private:
+    FrameHandle ring[RECORDER_QUEUE_DEPTH];
+    RecFrameHeader meta[RECORDER_QUEUE_DEPTH];
+    std::atomic<uint32_t> head{0}; // next slot to fill, producer
+    std::atomic<uint32_t> tail{0}; // next slot to write, consumer
+    std::atomic<bool> accepting{false};
+    std::atomic<uint32_t> pushing{0}; // producers inside push()
+    std::atomic<bool> running{false};
+    std::thread writer;
+    sem_t wake;
+
+    int fd = -1;
+    bool direct = false;
+    uint8_t *staging = nullptr; // being filled by the writer
+    uint8_t *spare = nullptr;   // being written by the I/O thread
+    size_t staged = 0;
+    uint64_t offset = 0;    // file offset of the staging buffer
+    uint64_t allocated = 0; // file space reserved so far
+    bool failed = false;
+    FILE *idx = nullptr;
+    std::vector<std::pair<RecIndexEntry, uint64_t>> pending; // index entries and the end of their record, until it is written
+    uint64_t records = 0;
+    std::atomic<bool> compress{false};
+    bool compressing = false; // for this recording
+    std::atomic<uint32_t> pack_bits{0};
+    uint32_t packing = 0;      // for this recording
+    uint8_t *packed = nullptr; // compressed or bit packed frame
+    size_t packed_size = 0;
+
+    std::thread io;
+    std::mutex io_mtx; // guards the io_ fields
+    std::condition_variable io_cv;
+    size_t io_len = 0; // bytes of spare to write, 0 when idle
+    uint64_t io_offset = 0;
+    int io_err = 0;
+    bool io_quit = false;
+
+    std::mutex mtx; // guards path and errmsg
+    std::string path;
+    std::string errmsg;
+    std::atomic<double> rate{0}; // bytes per second
+
+    bool pop(FrameHandle &frame, RecFrameHeader &hdr)
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire))
+            return false;
+        frame = std::move(ring[t % RECORDER_QUEUE_DEPTH]);
+        hdr = meta[t % RECORDER_QUEUE_DEPTH];
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    void set_error(const char *where, int err)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        errmsg = std::string(where) + ": " + strerror(err);
+    }
+
+    bool write_all(const uint8_t *buf, size_t len)
+    {
+        int err = recfile_pwrite(fd, buf, len, offset, direct);
+        if (err)
+        {
+            set_error("Write", err);
+            return false;
+        }
+        offset += len;
+        return true;
+    }
+
+    // wait until the I/O thread is idle, false if its last write failed
+    bool wait_io()
+    {
+        std::unique_lock<std::mutex> lock(io_mtx);
+        io_cv.wait(lock, [this]
+                   { return io_len == 0; });
+        if (io_err)
+        {
+            set_error("Write", io_err);
+            io_err = 0;
+            return false;
+        }
+        return true;
+    }
+
+    // index entries of the records that end by written
+    void write_index(uint64_t written)
+    {
+        size_t n = 0;
+        while (n < pending.size() && pending[n].second <= written)
+        {
+            if (!failed && fwrite(&pending[n].first, sizeof(RecIndexEntry), 1, idx) != 1)
+            {
+                set_error("Index", errno);
+                failed = true;
+            }
+            n++;
+        }
+        pending.erase(pending.begin(), pending.begin() + n);
+        if (n && !failed)
+            fflush(idx); // keep the index close behind the data, readers check it anyway
+    }
+
+    // hand the full staging buffer to the I/O thread and carry on in the other one
+    void flush_chunk()
+    {
+        if (!failed && offset + staged > allocated)
+        {
+            // not all file systems support this, writing still works then
+            if (fallocate(fd, FALLOC_FL_KEEP_SIZE, allocated, RECORDER_PREALLOC) == 0)
+                allocated += RECORDER_PREALLOC;
+            else
+                allocated = UINT64_MAX;
+        }
+        if (!wait_io())
+            failed = true;
+        write_index(offset);
+        if (!failed)
+        {
+            std::lock_guard<std::mutex> lock(io_mtx);
+            std::swap(staging, spare);
+            io_len = staged;
+            io_offset = offset;
+            offset += staged;
+            io_cv.notify_all();
+        }
+        staged = 0;
+    }
+
+    void append(const uint8_t *data, size_t len)
+    {
+        while (len > 0)
+        {
+            size_t n = std::min(len, (size_t)RECORDER_CHUNK - staged);
+            memcpy(staging + staged, data, n);
+            staged += n;
+            data += n;
+            len -= n;
+            if (staged == RECORDER_CHUNK)
+                flush_chunk();
+        }
+    }
+
+    void append_zeros(size_t len)
+    {
+        while (len > 0)
+        {
+            size_t n = std::min(len, (size_t)RECORDER_CHUNK - staged);
+            memset(staging + staged, 0, n);
+            staged += n;
+            len -= n;
+            if (staged == RECORDER_CHUNK)
+                flush_chunk();
+        }
+    }
+
+    bool reserve_packed(size_t size)
+    {
+        if (size > packed_size)
+        {
+            free(packed);
+            packed_size = 0;
+            if (posix_memalign((void **)&packed, RECORDER_ALIGN, size) != 0)
+            {
+                packed = nullptr;
+                return false;
+            }
+            packed_size = size;
+        }
+        return true;
+    }
+
+    // compressed data in packed, or 0 to store the frame raw
+    size_t pack(const FrameHandle &frame)
+    {
+        const FrameInfo &info = frame.info();
+        if (queue_depth() > RECORDER_COMPRESS_BACKLOG)
+        {
+            raw_fallbacks++;
+            return 0;
+        }
+        FrameCodec fc;
+        if (!framecodec_init(fc, info.pixelFormat, info.width, info.height) || framecodec_raw_size(fc) != info.size)
+            return 0;
+        if (!reserve_packed(framecodec_bound(fc)))
+            return 0;
+        auto start = std::chrono::steady_clock::now();
+        size_t size = framecodec_compress(ThreadPool::shared(), fc, frame.data(), packed);
+        compress_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        compress_in += info.size;
+        return size < info.size ? size : 0;
+    }
+
+    // bit packed data in packed, or 0 to store the frame raw
+    size_t bitpack(const FrameHandle &frame, uint32_t &bits)
+    {
+        const FrameInfo &info = frame.info();
+        FrameCodec fc;
+        if (!framecodec_init(fc, info.pixelFormat, info.width, info.height) || fc.bytes != 2 || framecodec_raw_size(fc) != info.size)
+            return 0;
+        bits = std::min(packing, pixfmt_bit_depth(info.pixelFormat));
+        size_t n = info.size / 2;
+        size_t size = recfile_packed_size(n, bits);
+        if (bits >= 16 || !reserve_packed(size))
+            return 0;
+        auto start = std::chrono::steady_clock::now();
+        bool ok = recfile_pack(ThreadPool::shared(), packed, (const uint16_t *)frame.data(), n, bits);
+        pack_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        pack_in += info.size;
+        if (!ok)
+        {
+            pack_overflows++;
+            return 0;
+        }
+        return size;
+    }
+
+    void write_frame(const FrameHandle &frame, RecFrameHeader &hdr)
+    {
+        const FrameInfo &info = frame.info();
+        const uint8_t *data = frame.data();
+        uint32_t bits = 0;
+        size_t size = compressing ? pack(frame) : 0;
+        if (size)
+        {
+            data = packed;
+            hdr.codec = RECFILE_CODEC_RICE;
+            frames_compressed++;
+        }
+        else if (packing && (size = bitpack(frame, bits)) != 0)
+        {
+            data = packed;
+            hdr.codec = RECFILE_CODEC_PACKED;
+            hdr.sample_bits = bits;
+            frames_packed++;
+        }
+        else
+        {
+            size = info.size;
+            hdr.codec = RECFILE_CODEC_RAW;
+        }
+        hdr.index = records;
+        hdr.data_size = size;
+        recfile_set_crc(hdr, data);
+        hdr.raw_size = info.size;
+        hdr.record_size = recfile_record_size(size);
+        hdr.frameID = info.frameID;
+        hdr.timestamp = info.timestamp;
+        hdr.width = info.width;
+        hdr.height = info.height;
+        hdr.pixelFormat = info.pixelFormat;
+        hdr.status = info.status;
+        RecIndexEntry entry = {offset + staged, hdr.frameID, hdr.timestamp, hdr.host_ns};
+        append((const uint8_t *)&hdr, sizeof(hdr));
+        append(data, size);
+        append_zeros(hdr.record_size - sizeof(hdr) - size);
+        if (failed)
+            return;
+        pending.push_back(std::make_pair(entry, entry.offset + hdr.record_size));
+        records++;
+        frames_written++;
+        bytes_written += hdr.record_size;
+        raw_bytes += info.size;
+        data_bytes += size;
+    }
+
+    // records end on RECFILE_ALIGN, so there is normally no tail to pad and cut off
+    void finish()
+    {
+        uint64_t end = offset + staged;
+        if (!wait_io())
+            failed = true;
+        if (staged && !failed)
+        {
+            size_t padded = (staged + RECORDER_ALIGN - 1) / RECORDER_ALIGN * RECORDER_ALIGN;
+            memset(staging + staged, 0, padded - staged);
+            if (!write_all(staging, padded))
+                failed = true;
+        }
+        staged = 0;
+        write_index(end);
+        pending.clear();
+        if (ftruncate(fd, end) < 0 && !failed)
+            set_error("Truncate", errno);
+        close(fd);
+        fd = -1;
+        if (fclose(idx) != 0 && !failed)
+            set_error("Index", errno);
+        idx = nullptr;
+    }
+
+    static void IoFcn(Recorder *self)
+    {
+        thread_set_name("rec io");
+        std::unique_lock<std::mutex> lock(self->io_mtx);
+        while (true)
+        {
+            self->io_cv.wait(lock, [self]
+                             { return self->io_len || self->io_quit; });
+            if (self->io_len == 0)
+                break;
+            size_t len = self->io_len;
+            uint64_t off = self->io_offset;
+            lock.unlock();
+            int err = recfile_pwrite(self->fd, self->spare, len, off, self->direct);
+            lock.lock();
+            self->io_err = err;
+            self->io_len = 0;
+            self->io_cv.notify_all();
+        }
+    }
+
+    static void ThreadFcn(Recorder *self)
+    {
+        thread_set_name("rec writer");
+        auto last = std::chrono::steady_clock::now();
+        uint64_t last_bytes = 0;
+        FrameHandle frame;
+        RecFrameHeader hdr;
+        while (true)
+        {
+            if (self->pop(frame, hdr))
+            {
+                self->write_frame(frame, hdr);
+                frame.reset(); // back to the pool
+            }
+            else if (!self->running.load())
+            {
+                // producers are gone, write what is left
+                while (self->pop(frame, hdr))
+                {
+                    self->write_frame(frame, hdr);
+                    frame.reset();
+                }
+                break;
+            }
+            else
+            {
+                struct timespec ts;
+                clock_gettime(CLOCK_REALTIME, &ts);
+                ts.tv_nsec += 100000000; // 100 ms
+                if (ts.tv_nsec >= 1000000000)
+                {
+                    ts.tv_sec++;
+                    ts.tv_nsec -= 1000000000;
+                }
+                sem_timedwait(&self->wake, &ts);
+            }
+            auto now = std::chrono::steady_clock::now();
+            double dt = std::chrono::duration<double>(now - last).count();
+            if (dt >= 0.5)
+            {
+                uint64_t bytes = self->bytes_written;
+                self->rate = (bytes - last_bytes) / dt;
+                last_bytes = bytes;
+                last = now;
+            }
+        }
+        self->finish();
+        self->rate = 0;
+    }
+
+public:
+    Recorder()
+    {
+        sem_init(&wake, 0, 0);
+    }
+
+    ~Recorder()
+    {
+        stop();
+        sem_destroy(&wake);
+    }
+
+    /**
+     * @brief Create the recording and its index and start the writer thread.
+     *
+     * @param header written as is, describes the camera and the current format
+     * @return false if the files could not be created, see error().
+     */
+    bool start(const std::string &path, const RecFileHeader &header)
+    {
+        if (running)
+            return false;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            this->path = path;
+            errmsg = "";
+        }
+        fd = recfile_create(path.c_str(), direct);
+        if (fd < 0)
+        {
+            set_error("Open", errno);
+            return false;
+        }
+        idx = fopen((path + RECFILE_INDEX_EXT).c_str(), "wb");
+        RecIndexHeader ih;
+        ih.created_ns = header.created_ns;
+        if (idx == nullptr || fwrite(&ih, sizeof(ih), 1, idx) != 1)
+        {
+            set_error("Open index", errno);
+            if (idx)
+                fclose(idx);
+            idx = nullptr;
+            close(fd);
+            fd = -1;
+            return false;
+        }
+        if ((staging == nullptr && posix_memalign((void **)&staging, RECORDER_ALIGN, RECORDER_CHUNK) != 0) ||
+            (spare == nullptr && posix_memalign((void **)&spare, RECORDER_ALIGN, RECORDER_CHUNK) != 0))
+        {
+            free(staging);
+            staging = nullptr;
+            spare = nullptr;
+            set_error("Staging buffer", ENOMEM);
+            fclose(idx);
+            idx = nullptr;
+            close(fd);
+            fd = -1;
+            return false;
+        }
+        compressing = compress;
+        packing = pack_bits;
+        memcpy(staging, &header, sizeof(header));
+        ((RecFileHeader *)staging)->codec = compressing ? RECFILE_CODEC_RICE : packing ? RECFILE_CODEC_PACKED : RECFILE_CODEC_RAW;
+        staged = sizeof(header);
+        offset = 0;
+        allocated = 0;
+        failed = false;
+        records = 0;
+        frames_written = 0;
+        bytes_written = 0;
+        dropped = 0;
+        raw_bytes = 0;
+        data_bytes = 0;
+        frames_compressed = 0;
+        raw_fallbacks = 0;
+        compress_in = 0;
+        compress_ns = 0;
+        frames_packed = 0;
+        pack_overflows = 0;
+        pack_in = 0;
+        pack_ns = 0;
+        pending.clear();
+        head = 0;
+        tail = 0;
+        io_len = 0;
+        io_err = 0;
+        io_quit = false;
+        io = std::thread(IoFcn, this);
+        running = true;
+        writer = std::thread(ThreadFcn, this);
+        accepting = true;
+        return true;
+    }
+
+    /**
+     * @brief Stop accepting frames, write out the queue and close the file.
+     */
+    void stop()
+    {
+        if (!running)
+            return;
+        accepting = false;
+        while (pushing.load() != 0) // a push() that saw accepting may still be running
+            std::this_thread::yield();
+        running = false;
+        sem_post(&wake);
+        writer.join();
+        {
+            std::lock_guard<std::mutex> lock(io_mtx);
+            io_quit = true;
+            io_cv.notify_all();
+        }
+        io.join();
+        free(staging);
+        staging = nullptr;
+        free(spare);
+        spare = nullptr;
+        free(packed);
+        packed = nullptr;
+        packed_size = 0;
+    }
+
+    /**
+     * @brief Queue a frame for writing, camera callback only. Never blocks.
+     *
+     * @param hdr host time, exposure, temperatures and statistics of the frame;
+     * the format, frameID and timestamp are filled in from the frame.
+     * @return false if not recording or the frame was dropped because the queue is full.
+     */
+    bool push(const FrameHandle &frame, const RecFrameHeader &hdr)
+    {
+        pushing++;
+        bool ok = false;
+        if (accepting.load() && frame)
+        {
+            uint32_t h = head.load(std::memory_order_relaxed);
+            if (h - tail.load(std::memory_order_acquire) < RECORDER_QUEUE_DEPTH)
+            {
+                ring[h % RECORDER_QUEUE_DEPTH] = frame;
+                meta[h % RECORDER_QUEUE_DEPTH] = hdr;
+                head.store(h + 1, std::memory_order_release);
+                sem_post(&wake);
+                ok = true;
+            }
+            else
+            {
+                dropped++;
+            }
+        }
+        pushing--;
+        return ok;
+    }
+
+    bool recording() const
+    {
+        return running;
+    }
+
+    bool direct_io() const
+    {
+        return direct;
+    }
+
+    uint32_t queue_depth() const
+    {
+        return head.load() - tail.load();
+    }
+
+    uint32_t queue_capacity() const
+    {
+        return RECORDER_QUEUE_DEPTH;
+    }
+
+    /**
+     * @brief Write throughput over the last half second, in MB/s.
+     */
+    double throughput() const
+    {
+        return rate.load() / 1e6;
+    }
+
+    /**
+     * @brief Compress the frames of recordings started from now on.
+     */
+    void set_compression(bool enable)
+    {
+        compress = enable;
+    }
+
+    bool get_compression() const
+    {
+        return compress;
+    }
+
+    /**
+     * @brief Bit pack 16 bit samples of recordings started from now on to bits
+     * each, normally the sensor bit depth. 0 stores them as they are.
+     */
+    void set_packing(uint32_t bits)
+    {
+        pack_bits = bits < 16 ? bits : 0;
+    }
+
+    uint32_t get_packing() const
+    {
+        return pack_bits;
+    }
+
+    /**
+     * @brief Frame bytes per byte stored over the recording so far, 1 without compression or packing.
+     */
+    double compression_ratio() const
+    {
+        uint64_t stored = data_bytes;
+        return stored ? (double)raw_bytes / stored : 1.0;
+    }
+
+    /**
+     * @brief Frame bytes the compressor takes per second, in MB/s.
+     */
+    double compression_speed() const
+    {
+        uint64_t ns = compress_ns;
+        return ns ? compress_in * 1e3 / ns : 0;
+    }
+
+    /**
+     * @brief Frame bytes the bit packer takes per second, in MB/s.
+     */
+    double packing_speed() const
+    {
+        uint64_t ns = pack_ns;
+        return ns ? pack_in * 1e3 / ns : 0;
+    }
+
+    std::string get_path()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return path;
+    }
+
+    std::string error()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return errmsg;
+    }
+
+    std::atomic<uint64_t> frames_written{0};
+    std::atomic<uint64_t> bytes_written{0}; // including headers and padding
+    std::atomic<uint64_t> dropped{0}; // queue full
+    std::atomic<uint64_t> raw_bytes{0};  // frame data written, before compression
+    std::atomic<uint64_t> data_bytes{0}; // frame data written, after compression
+    std::atomic<uint64_t> frames_compressed{0};
+    std::atomic<uint64_t> raw_fallbacks{0}; // stored raw because the writer fell behind
+    std::atomic<uint64_t> compress_in{0};   // frame bytes that went through the compressor
+    std::atomic<uint64_t> compress_ns{0};
+    std::atomic<uint64_t> frames_packed{0};
+    std::atomic<uint64_t> pack_overflows{0}; // stored raw because a sample did not fit the bit depth
+    std::atomic<uint64_t> pack_in{0};        // frame bytes that went through the bit packer
+    std::atomic<uint64_t> pack_ns{0};
+};
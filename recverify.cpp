@@ -0,0 +1,205 @@
+// Check every frame of a recording against its CRC32C, with several threads
+// reading in parallel (O_DIRECT where the file system allows it) so that the
+// scan runs at disk speed.
+//
+// recverify [-j threads] <file.avr> ...
+//   -j  reader threads, default one per CPU
+//
+// Exits with 1 if a recording is damaged or truncated.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "recfile.hpp"
+
+#define RECVERIFY_BATCH 8 // consecutive frames a thread takes at a time
+#define RECVERIFY_MAX_REPORT 20
+
+struct Verify
+{
+    const RecFileReader *rec;
+    int fd;
+    uint64_t fsize;
+    std::atomic<uint64_t> next{0};
+    std::atomic<uint64_t> checked{0};   // frames with a checksum that matched
+    std::atomic<uint64_t> unchecked{0}; // frames recorded without a checksum
+    std::atomic<uint64_t> bytes{0};
+    std::mutex mtx; // guards bad
+    std::vector<std::pair<uint64_t, std::string>> bad;
+
+    void report(uint64_t n, const std::string &what)
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        bad.push_back(std::make_pair(n, what));
+    }
+};
+
+static bool read_at(int fd, uint8_t *buf, size_t len, uint64_t pos)
+{
+    while (len > 0)
+    {
+        ssize_t ret = pread(fd, buf, len, pos);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret <= 0)
+            return false;
+        buf += ret;
+        len -= ret;
+        pos += ret;
+    }
+    return true;
+}
+
+static void check_frame(Verify &v, uint64_t n, uint8_t *&buf, size_t &buf_size)
+{
+    uint64_t off = v.rec->entry(n).offset;
+    // records start and end on RECFILE_ALIGN, so all reads keep O_DIRECT alignment
+    if (!read_at(v.fd, buf, RECFILE_ALIGN, off))
+    {
+        v.report(n, "truncated header");
+        return;
+    }
+    const RecFrameHeader *fh = (const RecFrameHeader *)buf;
+    if (fh->magic != RECFILE_FRAME_MAGIC || fh->header_size != RECFILE_FRAME_HEADER_SIZE || fh->index != n || fh->record_size != recfile_record_size(fh->data_size) || fh->frameID != v.rec->entry(n).frameID)
+    {
+        v.report(n, "damaged header");
+        return;
+    }
+    uint64_t size = fh->record_size;
+    if (size > buf_size)
+    {
+        uint8_t *nbuf = nullptr;
+        if (posix_memalign((void **)&nbuf, RECFILE_ALIGN, size) != 0)
+        {
+            v.report(n, "out of memory");
+            return;
+        }
+        memcpy(nbuf, buf, RECFILE_ALIGN);
+        free(buf);
+        buf = nbuf;
+        buf_size = size;
+        fh = (const RecFrameHeader *)buf;
+    }
+    if (off + size > v.fsize || !read_at(v.fd, buf + RECFILE_ALIGN, size - RECFILE_ALIGN, off + RECFILE_ALIGN))
+    {
+        v.report(n, "truncated data");
+        return;
+    }
+    v.bytes += size;
+    if (!fh->has_crc)
+        v.unchecked++;
+    else if (!recfile_check_crc(*fh, buf + RECFILE_FRAME_HEADER_SIZE))
+        v.report(n, "checksum mismatch");
+    else
+        v.checked++;
+}
+
+static void worker(Verify *v)
+{
+    size_t buf_size = RECFILE_ALIGN;
+    uint8_t *buf = nullptr;
+    if (posix_memalign((void **)&buf, RECFILE_ALIGN, buf_size) != 0)
+        return;
+    uint64_t count = v->rec->frame_count();
+    while (true)
+    {
+        uint64_t first = v->next.fetch_add(RECVERIFY_BATCH);
+        if (first >= count)
+            break;
+        for (uint64_t n = first; n < std::min(count, first + RECVERIFY_BATCH); n++)
+            check_frame(*v, n, buf, buf_size);
+    }
+    free(buf);
+}
+
+static bool verify(const char *path, uint32_t nthreads)
+{
+    RecFileReader rec;
+    if (!rec.open(path))
+    {
+        fprintf(stderr, "%s\n", rec.error().c_str());
+        return false;
+    }
+    int fd = open(path, O_RDONLY | O_DIRECT);
+    bool direct = fd >= 0;
+    if (fd < 0)
+        fd = open(path, O_RDONLY);
+    struct stat sb;
+    if (fd < 0 || fstat(fd, &sb) < 0)
+    {
+        fprintf(stderr, "%s: %s\n", path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return false;
+    }
+    if (!direct)
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    Verify v;
+    v.rec = &rec;
+    v.fd = fd;
+    v.fsize = sb.st_size;
+    auto start = std::chrono::steady_clock::now();
+    std::vector<std::thread> threads;
+    for (uint32_t i = 0; i < nthreads; i++)
+        threads.push_back(std::thread(worker, &v));
+    for (auto &t : threads)
+        t.join();
+    double dt = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    close(fd);
+
+    uint64_t count = rec.frame_count();
+    uint64_t end = RECFILE_HEADER_SIZE;
+    if (count > 0)
+    {
+        RecFrameHeader fh;
+        if (rec.read_header(count - 1, fh))
+            end = rec.entry(count - 1).offset + fh.record_size;
+    }
+    std::sort(v.bad.begin(), v.bad.end());
+    printf("%s: %llu frames, %llu checked, %llu without checksum, %zu bad, %.1f MB/s (%u threads%s)\n", path, (unsigned long long)count, (unsigned long long)v.checked, (unsigned long long)v.unchecked, v.bad.size(), v.bytes / dt / 1e6, nthreads, direct ? ", O_DIRECT" : "");
+    for (size_t i = 0; i < v.bad.size() && i < RECVERIFY_MAX_REPORT; i++)
+        printf("  frame %llu (ID %llu): %s\n", (unsigned long long)v.bad[i].first, (unsigned long long)rec.entry(v.bad[i].first).frameID, v.bad[i].second.c_str());
+    if (v.bad.size() > RECVERIFY_MAX_REPORT)
+        printf("  ... and %zu more\n", v.bad.size() - RECVERIFY_MAX_REPORT);
+    bool truncated = v.fsize > end;
+    if (truncated)
+        printf("  %llu bytes after the last complete frame, the recording was cut off\n", (unsigned long long)(v.fsize - end));
+    if (rec.index_recovered())
+        printf("  index incomplete, recovered from the data\n");
+    return v.bad.empty() && !truncated;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t nthreads = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<const char *> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            nthreads = std::max(1, atoi(argv[++i]));
+        else
+            paths.push_back(argv[i]);
+    }
+    if (paths.empty())
+    {
+        fprintf(stderr, "Usage: %s [-j threads] <file%s> ...\n", argv[0], RECFILE_EXT);
+        return 1;
+    }
+    printf("CRC32C: %s\n", crc32c_isa());
+    bool ok = true;
+    for (const char *path : paths)
+        ok &= verify(path, nthreads);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,167 @@
+#pragma once
+#include <stdint.h>
+#include <pthread.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define THREADPOOL_AUTO UINT32_MAX // one worker per core but the caller's
+
+/**
+ * @brief Name the calling thread for top, perf and /proc (15 characters at most on Linux).
+ */
+static inline void thread_set_name(const char *name)
+{
+#if defined(__linux__)
+    pthread_setname_np(pthread_self(), name);
+#elif defined(__APPLE__)
+    pthread_setname_np(name);
+#endif
+}
+
+/**
+ * @brief Fixed set of worker threads running fork-join jobs.
+ *
+ * parallel_for() splits a job into parts, queues them and runs parts on the
+ * calling thread as well until the job is done, so several cameras can share
+ * one pool without waiting on each other's jobs to start.
+ */
+class ThreadPool
+{
+private:
+    struct Job
+    {
+        std::function<void(uint32_t)> fn;
+        std::atomic<uint32_t> next; // next part to run
+        std::atomic<uint32_t> done; // parts finished
+        uint32_t nparts;
+        uint32_t users; // workers holding a pointer to the job, guarded by mtx
+    };
+
+    std::vector<std::thread> workers;
+    std::deque<Job *> queue; // jobs with parts left to hand out
+    std::mutex mtx;
+    std::condition_variable cv;
+    std::condition_variable cv_done;
+    bool running = true;
+
+    // run parts of a job until none are left
+    static void work(Job *job)
+    {
+        uint32_t part;
+        while ((part = job->next.fetch_add(1)) < job->nparts)
+        {
+            job->fn(part);
+            job->done.fetch_add(1);
+        }
+    }
+
+    static void ThreadFcn(ThreadPool *self)
+    {
+        thread_set_name("pool");
+        while (true)
+        {
+            Job *job;
+            {
+                std::unique_lock<std::mutex> lock(self->mtx);
+                self->cv.wait(lock, [self]
+                              { return !self->running || !self->queue.empty(); });
+                if (!self->running)
+                    return;
+                job = self->queue.front();
+                if (job->next.load() + 1 >= job->nparts) // we take the last part(s)
+                    self->queue.pop_front();
+                job->users++;
+            }
+            work(job);
+            {
+                std::lock_guard<std::mutex> lock(self->mtx);
+                job->users--;
+                self->cv_done.notify_all();
+            }
+        }
+    }
+
+public:
+    /**
+     * @brief Start nthreads workers. With 0 every job runs on the calling thread.
+     */
+    ThreadPool(uint32_t nthreads = THREADPOOL_AUTO)
+    {
+        if (nthreads == THREADPOOL_AUTO)
+        {
+            nthreads = std::thread::hardware_concurrency();
+            nthreads = nthreads > 1 ? nthreads - 1 : 1; // leave one core for the caller
+        }
+        for (uint32_t i = 0; i < nthreads; i++)
+            workers.push_back(std::thread(ThreadFcn, this));
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            running = false;
+        }
+        cv.notify_all();
+        for (auto &t : workers)
+            t.join();
+    }
+
+    /**
+     * @brief Pool shared by all cameras, sized to the machine.
+     */
+    static ThreadPool &shared()
+    {
+        static ThreadPool pool;
+        return pool;
+    }
+
+    uint32_t size() const
+    {
+        return workers.size();
+    }
+
+    /**
+     * @brief Run fn(0) ... fn(nparts - 1) on the pool and the calling thread, return when all are done.
+     */
+    void parallel_for(uint32_t nparts, const std::function<void(uint32_t)> &fn)
+    {
+        if (nparts == 0)
+            return;
+        if (nparts == 1 || workers.empty())
+        {
+            for (uint32_t i = 0; i < nparts; i++)
+                fn(i);
+            return;
+        }
+        Job job;
+        job.fn = fn;
+        job.next = 0;
+        job.done = 0;
+        job.nparts = nparts;
+        job.users = 0;
+        {
+            std::lock_guard<std::mutex> lock(mtx);
+            queue.push_back(&job);
+        }
+        cv.notify_all();
+        work(&job);
+        std::unique_lock<std::mutex> lock(mtx);
+        // make sure no worker can pick the job up once we return
+        for (auto it = queue.begin(); it != queue.end(); it++)
+        {
+            if (*it == &job)
+            {
+                queue.erase(it);
+                break;
+            }
+        }
+        cv_done.wait(lock, [&job]
+                     { return job.done.load() == job.nparts && job.users == 0; });
+    }
+};
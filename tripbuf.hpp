@@ -0,0 +1,81 @@
+#pragma once
+#include <stdint.h>
+#include <atomic>
+
+/**
+ * @brief Lock-free single producer, single consumer triple buffer.
+ *
+ * The producer always owns one slot to write into and the consumer always
+ * owns one slot to read from. The third slot is exchanged atomically between
+ * them, so neither side ever blocks. The consumer always sees the newest
+ * complete slot; slots published while the consumer was busy are superseded.
+ *
+ * @tparam T Slot type.
+ */
+template <typename T>
+class TripleBuffer
+{
+private:
+    static const uint8_t idx_mask = 0x3;
+    static const uint8_t dirty = 0x4;
+
+    T slots[3];
+    std::atomic<uint8_t> middle; // index of the shared slot, with the dirty bit set if it holds unread data
+    uint8_t back;                // owned by the producer
+    uint8_t front;               // owned by the consumer
+
+public:
+    TripleBuffer() : middle(1), back(0), front(2)
+    {
+    }
+
+    /**
+     * @brief Slot owned by the producer. Only call from the producer thread.
+     */
+    T &write_slot()
+    {
+        return slots[back];
+    }
+
+    /**
+     * @brief Publish the producer slot.
+     *
+     * @return true if the previously published slot was never consumed (superseded).
+     */
+    bool publish()
+    {
+        uint8_t prev = middle.exchange(back | dirty, std::memory_order_acq_rel);
+        back = prev & idx_mask;
+        return (prev & dirty) != 0;
+    }
+
+    /**
+     * @brief Grab the newest published slot, if any. Only call from the consumer thread.
+     *
+     * @return true if read_slot() now holds new data.
+     */
+    bool consume()
+    {
+        if (!(middle.load(std::memory_order_acquire) & dirty))
+            return false;
+        uint8_t prev = middle.exchange(front, std::memory_order_acq_rel);
+        front = prev & idx_mask;
+        return true;
+    }
+
+    /**
+     * @brief Slot owned by the consumer. Only call from the consumer thread.
+     */
+    T &read_slot()
+    {
+        return slots[front];
+    }
+
+    /**
+     * @brief Access all slots, e.g. to pre-allocate them. Not thread safe.
+     */
+    T &slot(int idx)
+    {
+        return slots[idx % 3];
+    }
+};
@@ -0,0 +1,739 @@
+#pragma once
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "string_format.hpp"
+
+#include "camback.hpp"
+#include "framegen.hpp"
+#include "imggen.hpp"
+#include "pixfmt.hpp"
+
+#define VIRTCAM_ID_PREFIX "VIRTUAL-"
+#define VIRTCAM_PIXEL_RATE 400e6           // sensor readout, pixels per second
+#define VIRTCAM_LINK_SPEED 450000000LL     // bytes per second, as USB3 Vision
+#define VIRTCAM_MIN_THROUGHPUT 10000000LL  // lowest link limit, bytes per second
+#define VIRTCAM_MIN_EXPOSURE_US 10.0
+#define VIRTCAM_MAX_EXPOSURE_US 10000000.0
+#define VIRTCAM_MIN_FRAMERATE 0.1
+#define VIRTCAM_WIDTH_INC 8
+#define VIRTCAM_HEIGHT_INC 2
+#define VIRTCAM_MAX_BINNING 8
+#define VIRTCAM_WARMUP_S 300.0 // temperature time constant after opening
+
+/**
+ * @brief What the virtual cameras look like, from the session configuration.
+ */
+struct VirtualCameraSpec
+{
+    int count = 0;
+    uint32_t sensor_width = 4096;
+    uint32_t sensor_height = 3000;
+    FramegenPattern pattern = FRAMEGEN_NOISE;
+    uint64_t seed = 0;
+    uint32_t ntemps = 2; // temperature sensors
+};
+
+static const char *virtcam_formats[] = {"Mono8", "Mono10", "Mono10p", "Mono12", "Mono12p", "Mono14", "Mono16", "BayerRG8", "BayerRG12", "RGB8"};
+static const char *virtcam_depths[] = {"Bpp8", "Bpp10", "Bpp12"};
+static const char *virtcam_lines[] = {"Line0", "Line1", "Line2", "Line3"};
+static const char *virtcam_line_srcs[] = {"Off", "ExposureActive", "FrameTriggerReady", "AcquisitionActive"};
+static const struct
+{
+    const char *name;
+    double base; // C when opened
+    double rise; // C once warm
+} virtcam_temps[] = {
+    {"Sensor", 30.0, 18.0},
+    {"Mainboard", 35.0, 12.0},
+    {"Housing", 25.0, 6.0},
+};
+
+#define VIRTCAM_NUM(arr) (sizeof(arr) / sizeof(arr[0]))
+#define VIRTCAM_DEFAULT_FORMAT 3 // Mono12
+#define VIRTCAM_DEFAULT_DEPTH 2  // Bpp12
+
+/**
+ * @brief A camera made of an ImageGenerator. Size, offset, binning, pixel
+ * format, exposure, frame rate, link limit and temperatures behave as on an
+ * Alvium: the frame rate is capped by the sensor readout, the exposure and
+ * the link, and frames arrive on their own thread through the queued
+ * callback, with frame IDs and timestamps.
+ */
+class VirtualCamera
+{
+public:
+    std::string id;
+    std::string name;
+    std::string model;
+    std::string serial;
+    VirtualCameraSpec spec;
+    bool opened = false;
+    // settings, the geometry and format only with the camera stopped
+    int format = VIRTCAM_DEFAULT_FORMAT;
+    int depth = VIRTCAM_DEFAULT_DEPTH;
+    int line = 0;
+    int line_src[VIRTCAM_NUM(virtcam_lines)] = {0};
+    int temp_src = 0;
+    VmbInt64_t width = 0, height = 0;
+    VmbInt64_t ofx = 0, ofy = 0;
+    VmbInt64_t binning = 1;
+    VmbInt64_t luma = 10;
+    VmbInt64_t throughput = VIRTCAM_LINK_SPEED;
+    double exposure_us = 10000;
+    double framerate = 10;
+    bool framerate_auto = false;
+    std::chrono::steady_clock::time_point opened_at;
+    CameraCaptureCallback callback = nullptr;
+    void *user_data = nullptr;
+    ImageGenerator *gen = nullptr;
+    std::mutex mtx; // gen, against frame rate changes while capturing
+
+    VirtualCamera(int idx, const VirtualCameraSpec &spec)
+    {
+        this->spec = spec;
+        id = string_format(VIRTCAM_ID_PREFIX "%d", idx);
+        name = "Virtual Camera";
+        model = string_format("Virtual %ux%u", spec.sensor_width, spec.sensor_height);
+        serial = string_format("VIRT%04d", idx);
+        reset();
+    }
+
+    ~VirtualCamera()
+    {
+        stop();
+    }
+
+    void reset()
+    {
+        format = VIRTCAM_DEFAULT_FORMAT;
+        depth = VIRTCAM_DEFAULT_DEPTH;
+        line = 0;
+        memset(line_src, 0, sizeof(line_src));
+        temp_src = 0;
+        binning = 1;
+        width = spec.sensor_width / VIRTCAM_WIDTH_INC * VIRTCAM_WIDTH_INC;
+        height = spec.sensor_height / VIRTCAM_HEIGHT_INC * VIRTCAM_HEIGHT_INC;
+        ofx = ofy = 0;
+        luma = 10;
+        throughput = VIRTCAM_LINK_SPEED;
+        exposure_us = 10000;
+        framerate = 10;
+        framerate_auto = false;
+    }
+
+    VmbPixelFormat_t pixel_format()
+    {
+        VmbPixelFormat_t pfmt = VmbPixelFormatMono8;
+        pixfmt_from_string(virtcam_formats[format], pfmt);
+        return pfmt;
+    }
+
+    VmbInt64_t max_width()
+    {
+        return spec.sensor_width / binning / VIRTCAM_WIDTH_INC * VIRTCAM_WIDTH_INC;
+    }
+
+    VmbInt64_t max_height()
+    {
+        return spec.sensor_height / binning / VIRTCAM_HEIGHT_INC * VIRTCAM_HEIGHT_INC;
+    }
+
+    // readout of the rows in use, exposure (overlapped with readout) and link
+    double max_framerate()
+    {
+        double readout = VIRTCAM_PIXEL_RATE / ((double)spec.sensor_width * height * binning);
+        double link = (double)throughput / pixfmt_image_size(pixel_format(), width, height);
+        return std::max(VIRTCAM_MIN_FRAMERATE, std::min(std::min(readout, link), 1e6 / exposure_us));
+    }
+
+    double current_framerate()
+    {
+        double fmax = max_framerate();
+        return framerate_auto ? fmax : std::min(framerate, fmax);
+    }
+
+    bool acquiring()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return gen != nullptr;
+    }
+
+    // frames delivered a period or more late since the capture started
+    uint64_t overruns()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        return gen ? gen->overruns.load() : 0;
+    }
+
+    // after anything the frame rate depends on changes
+    void update_rate()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (gen != nullptr)
+            gen->set_framerate(current_framerate());
+    }
+
+    double temperature(int src)
+    {
+        double t = std::chrono::duration<double>(std::chrono::steady_clock::now() - opened_at).count();
+        return virtcam_temps[src].base + virtcam_temps[src].rise * (1 - exp(-t / VIRTCAM_WARMUP_S));
+    }
+
+    VmbError_t start()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (gen != nullptr)
+            return VmbErrorSuccess;
+        if (callback == nullptr)
+            return VmbErrorInvalidCall; // no frames queued
+        gen = new ImageGenerator(width, height, pixel_format(), &Deliver, (void *)this, spec.pattern, spec.seed);
+        gen->set_framerate(current_framerate());
+        gen->start();
+        return VmbErrorSuccess;
+    }
+
+    void stop()
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+        if (gen == nullptr)
+            return;
+        gen->join();
+        delete gen;
+        gen = nullptr;
+    }
+
+    static void Deliver(VmbFrame_t *frame, void *user_data)
+    {
+        VirtualCamera *self = (VirtualCamera *)user_data;
+        frame->offsetX = self->ofx;
+        frame->offsetY = self->ofy;
+        self->callback((AlliedCameraHandle_t)self, nullptr, frame, self->user_data);
+    }
+};
+
+static std::vector<VirtualCamera *> virtcams; // made once by virtcam_setup()
+
+/**
+ * @brief Create spec.count virtual cameras, listed after the Vimba ones.
+ */
+static inline void virtcam_setup(const VirtualCameraSpec &spec)
+{
+    for (int i = (int)virtcams.size(); i < spec.count; i++)
+        virtcams.push_back(new VirtualCamera(i, spec));
+}
+
+static inline VirtualCamera *virtcam_find(const char *id)
+{
+    for (auto cam : virtcams)
+    {
+        if (cam->id == id)
+            return cam;
+    }
+    return nullptr;
+}
+
+static inline bool virtcam_owns(const std::string &id)
+{
+    return virtcam_find(id.c_str()) != nullptr;
+}
+
+/**
+ * @brief Append the virtual cameras. The strings live as long as the cameras.
+ */
+static inline void virtcam_list(std::vector<VmbCameraInfo_t> &cameras)
+{
+    for (auto cam : virtcams)
+    {
+        VmbCameraInfo_t info;
+        memset(&info, 0, sizeof(info));
+        info.cameraIdString = cam->id.c_str();
+        info.cameraIdExtended = cam->id.c_str();
+        info.cameraName = cam->name.c_str();
+        info.modelName = cam->model.c_str();
+        info.serialString = cam->serial.c_str();
+        cameras.push_back(info);
+    }
+}
+
+// string lists as alliedcam returns them: the array is the caller's
+static VmbError_t virtcam_strlist(const char **names, uint32_t n, char ***arr, VmbUint32_t *count)
+{
+    *arr = (char **)malloc(n * sizeof(char *));
+    if (*arr == NULL)
+        return VmbErrorResources;
+    for (uint32_t i = 0; i < n; i++)
+        (*arr)[i] = (char *)names[i];
+    *count = n;
+    return VmbErrorSuccess;
+}
+
+static int virtcam_index(const char **names, uint32_t n, const char *name)
+{
+    for (uint32_t i = 0; name != NULL && i < n; i++)
+    {
+        if (strcmp(names[i], name) == 0)
+            return i;
+    }
+    return -1;
+}
+
+#define VIRTCAM_HANDLE(handle)                       \
+    VirtualCamera *cam = (VirtualCamera *)(handle); \
+    if (cam == nullptr || !cam->opened)              \
+        return VmbErrorBadHandle;
+
+static VmbError_t virtcam_open_camera(AlliedCameraHandle_t *handle, const char *id, uint32_t bufsize)
+{
+    VirtualCamera *cam = virtcam_find(id);
+    if (cam == nullptr)
+        return VmbErrorNotFound;
+    if (cam->opened)
+        return VmbErrorInvalidAccess;
+    cam->opened = true;
+    cam->opened_at = std::chrono::steady_clock::now();
+    *handle = (AlliedCameraHandle_t)cam;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_close_camera(AlliedCameraHandle_t *handle)
+{
+    VIRTCAM_HANDLE(*handle);
+    cam->stop();
+    cam->callback = nullptr;
+    cam->opened = false;
+    *handle = nullptr;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_reset_camera(AlliedCameraHandle_t *handle)
+{
+    VIRTCAM_HANDLE(*handle);
+    cam->stop();
+    cam->reset();
+    return virtcam_close_camera(handle);
+}
+
+static bool virtcam_camera_acquiring(AlliedCameraHandle_t handle)
+{
+    VirtualCamera *cam = (VirtualCamera *)handle;
+    return cam != nullptr && cam->acquiring();
+}
+
+static VmbError_t virtcam_queue_capture(AlliedCameraHandle_t handle, CameraCaptureCallback callback, void *user_data)
+{
+    VIRTCAM_HANDLE(handle);
+    if (cam->acquiring())
+        return VmbErrorInvalidCall;
+    cam->callback = callback;
+    cam->user_data = user_data;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_dequeue_capture(AlliedCameraHandle_t handle)
+{
+    VIRTCAM_HANDLE(handle);
+    cam->stop();
+    cam->callback = nullptr;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_start_capture(AlliedCameraHandle_t handle)
+{
+    VIRTCAM_HANDLE(handle);
+    return cam->start();
+}
+
+static VmbError_t virtcam_stop_capture(AlliedCameraHandle_t handle)
+{
+    VIRTCAM_HANDLE(handle);
+    cam->stop();
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_get_link_speed(AlliedCameraHandle_t handle, VmbInt64_t *speed)
+{
+    VIRTCAM_HANDLE(handle);
+    *speed = VIRTCAM_LINK_SPEED;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_get_throughput_limit(AlliedCameraHandle_t handle, VmbInt64_t *limit)
+{
+    VIRTCAM_HANDLE(handle);
+    *limit = cam->throughput;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_set_throughput_limit(AlliedCameraHandle_t handle, VmbInt64_t limit)
+{
+    VIRTCAM_HANDLE(handle);
+    if (limit < VIRTCAM_MIN_THROUGHPUT || limit > VIRTCAM_LINK_SPEED)
+        return VmbErrorInvalidValue;
+    cam->throughput = limit;
+    cam->update_rate();
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_get_throughput_limit_range(AlliedCameraHandle_t handle, VmbInt64_t *minval, VmbInt64_t *maxval)
+{
+    VIRTCAM_HANDLE(handle);
+    *minval = VIRTCAM_MIN_THROUGHPUT;
+    *maxval = VIRTCAM_LINK_SPEED;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_get_image_format(AlliedCameraHandle_t handle, const char **format)
+{
+    VIRTCAM_HANDLE(handle);
+    *format = virtcam_formats[cam->format];
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_set_image_format(AlliedCameraHandle_t handle, const char *format)
+{
+    VIRTCAM_HANDLE(handle);
+    int idx = virtcam_index(virtcam_formats, VIRTCAM_NUM(virtcam_formats), format);
+    if (idx < 0)
+        return VmbErrorInvalidValue;
+    if (cam->acquiring())
+        return VmbErrorInvalidAccess;
+    cam->format = idx;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_get_image_format_list(AlliedCameraHandle_t handle, char ***formats, VmbUint32_t *count)
+{
+    VIRTCAM_HANDLE(handle);
+    return virtcam_strlist(virtcam_formats, VIRTCAM_NUM(virtcam_formats), formats, count);
+}
+
+static VmbError_t virtcam_get_sensor_bit_depth(AlliedCameraHandle_t handle, const char **depth)
+{
+    VIRTCAM_HANDLE(handle);
+    *depth = virtcam_depths[cam->depth];
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_set_sensor_bit_depth(AlliedCameraHandle_t handle, const char *depth)
+{
+    VIRTCAM_HANDLE(handle);
+    int idx = virtcam_index(virtcam_depths, VIRTCAM_NUM(virtcam_depths), depth);
+    if (idx < 0)
+        return VmbErrorInvalidValue;
+    if (cam->acquiring())
+        return VmbErrorInvalidAccess;
+    cam->depth = idx;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_get_sensor_bit_depth_list(AlliedCameraHandle_t handle, char ***depths, VmbUint32_t *count)
+{
+    VIRTCAM_HANDLE(handle);
+    return virtcam_strlist(virtcam_depths, VIRTCAM_NUM(virtcam_depths), depths, count);
+}
+
+static VmbError_t virtcam_get_trigline(AlliedCameraHandle_t handle, const char **line)
+{
+    VIRTCAM_HANDLE(handle);
+    *line = virtcam_lines[cam->line];
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_set_trigline(AlliedCameraHandle_t handle, const char *line)
+{
+    VIRTCAM_HANDLE(handle);
+    int idx = virtcam_index(virtcam_lines, VIRTCAM_NUM(virtcam_lines), line);
+    if (idx < 0)
+        return VmbErrorInvalidValue;
+    cam->line = idx;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_get_triglines_list(AlliedCameraHandle_t handle, char ***lines, VmbUint32_t *count)
+{
+    VIRTCAM_HANDLE(handle);
+    return virtcam_strlist(virtcam_lines, VIRTCAM_NUM(virtcam_lines), lines, count);
+}
+
+static VmbError_t virtcam_set_trigline_mode(AlliedCameraHandle_t handle, const char *mode)
+{
+    VIRTCAM_HANDLE(handle);
+    return strcmp(mode, "Output") == 0 || strcmp(mode, "Input") == 0 ? VmbErrorSuccess : VmbErrorInvalidValue;
+}
+
+static VmbError_t virtcam_get_trigline_src(AlliedCameraHandle_t handle, const char **src)
+{
+    VIRTCAM_HANDLE(handle);
+    *src = virtcam_line_srcs[cam->line_src[cam->line]];
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_set_trigline_src(AlliedCameraHandle_t handle, const char *src)
+{
+    VIRTCAM_HANDLE(handle);
+    int idx = virtcam_index(virtcam_line_srcs, VIRTCAM_NUM(virtcam_line_srcs), src);
+    if (idx < 0)
+        return VmbErrorInvalidValue;
+    cam->line_src[cam->line] = idx;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_get_trigline_src_list(AlliedCameraHandle_t handle, char ***srcs, VmbUint32_t *count)
+{
+    VIRTCAM_HANDLE(handle);
+    return virtcam_strlist(virtcam_line_srcs, VIRTCAM_NUM(virtcam_line_srcs), srcs, count);
+}
+
+static VmbError_t virtcam_get_indicator_luma(AlliedCameraHandle_t handle, VmbInt64_t *luma)
+{
+    VIRTCAM_HANDLE(handle);
+    *luma = cam->luma;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_set_indicator_luma(AlliedCameraHandle_t handle, VmbInt64_t luma)
+{
+    VIRTCAM_HANDLE(handle);
+    if (luma < 0 || luma > 10)
+        return VmbErrorInvalidValue;
+    cam->luma = luma;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_get_acq_framerate(AlliedCameraHandle_t handle, double *framerate)
+{
+    VIRTCAM_HANDLE(handle);
+    *framerate = cam->current_framerate();
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_set_acq_framerate(AlliedCameraHandle_t handle, double framerate)
+{
+    VIRTCAM_HANDLE(handle);
+    if (cam->framerate_auto)
+        return VmbErrorInvalidAccess;
+    if (framerate < VIRTCAM_MIN_FRAMERATE || framerate > cam->max_framerate())
+        return VmbErrorInvalidValue;
+    cam->framerate = framerate;
+    cam->update_rate();
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_get_acq_framerate_range(AlliedCameraHandle_t handle, double *minval, double *maxval, double *step)
+{
+    VIRTCAM_HANDLE(handle);
+    *minval = VIRTCAM_MIN_FRAMERATE;
+    *maxval = cam->max_framerate();
+    *step = 0;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_get_acq_framerate_auto(AlliedCameraHandle_t handle, bool *on)
+{
+    VIRTCAM_HANDLE(handle);
+    *on = cam->framerate_auto;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_set_acq_framerate_auto(AlliedCameraHandle_t handle, bool on)
+{
+    VIRTCAM_HANDLE(handle);
+    cam->framerate_auto = on;
+    cam->update_rate();
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_get_binning_factor(AlliedCameraHandle_t handle, VmbInt64_t *factor)
+{
+    VIRTCAM_HANDLE(handle);
+    *factor = cam->binning;
+    return VmbErrorSuccess;
+}
+
+// resets the region to the full binned sensor
+static VmbError_t virtcam_set_binning_factor(AlliedCameraHandle_t handle, VmbInt64_t factor)
+{
+    VIRTCAM_HANDLE(handle);
+    if (factor < 1 || factor > VIRTCAM_MAX_BINNING)
+        return VmbErrorInvalidValue;
+    if (cam->acquiring())
+        return VmbErrorInvalidAccess;
+    cam->binning = factor;
+    cam->ofx = cam->ofy = 0;
+    cam->width = cam->max_width();
+    cam->height = cam->max_height();
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_get_image_size(AlliedCameraHandle_t handle, VmbInt64_t *width, VmbInt64_t *height)
+{
+    VIRTCAM_HANDLE(handle);
+    *width = cam->width;
+    *height = cam->height;
+    return VmbErrorSuccess;
+}
+
+// rounded down to the increments, must fit next to the offset
+static VmbError_t virtcam_set_image_size(AlliedCameraHandle_t handle, VmbInt64_t width, VmbInt64_t height)
+{
+    VIRTCAM_HANDLE(handle);
+    width = width / VIRTCAM_WIDTH_INC * VIRTCAM_WIDTH_INC;
+    height = height / VIRTCAM_HEIGHT_INC * VIRTCAM_HEIGHT_INC;
+    if (width < VIRTCAM_WIDTH_INC || height < VIRTCAM_HEIGHT_INC || cam->ofx + width > cam->max_width() || cam->ofy + height > cam->max_height())
+        return VmbErrorInvalidValue;
+    if (cam->acquiring())
+        return VmbErrorInvalidAccess;
+    cam->width = width;
+    cam->height = height;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_get_image_ofst(AlliedCameraHandle_t handle, VmbInt64_t *x, VmbInt64_t *y)
+{
+    VIRTCAM_HANDLE(handle);
+    *x = cam->ofx;
+    *y = cam->ofy;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_set_image_ofst(AlliedCameraHandle_t handle, VmbInt64_t x, VmbInt64_t y)
+{
+    VIRTCAM_HANDLE(handle);
+    x = x / VIRTCAM_WIDTH_INC * VIRTCAM_WIDTH_INC;
+    y = y / VIRTCAM_HEIGHT_INC * VIRTCAM_HEIGHT_INC;
+    if (x < 0 || y < 0 || x + cam->width > cam->max_width() || y + cam->height > cam->max_height())
+        return VmbErrorInvalidValue;
+    cam->ofx = x;
+    cam->ofy = y;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_get_exposure_range_us(AlliedCameraHandle_t handle, double *minval, double *maxval, double *step)
+{
+    VIRTCAM_HANDLE(handle);
+    *minval = VIRTCAM_MIN_EXPOSURE_US;
+    *maxval = VIRTCAM_MAX_EXPOSURE_US;
+    *step = 1;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_get_exposure_us(AlliedCameraHandle_t handle, double *exposure)
+{
+    VIRTCAM_HANDLE(handle);
+    *exposure = cam->exposure_us;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_set_exposure_us(AlliedCameraHandle_t handle, double exposure)
+{
+    VIRTCAM_HANDLE(handle);
+    if (exposure < VIRTCAM_MIN_EXPOSURE_US || exposure > VIRTCAM_MAX_EXPOSURE_US)
+        return VmbErrorInvalidValue;
+    cam->exposure_us = exposure;
+    cam->update_rate();
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_get_temperature_src_list(AlliedCameraHandle_t handle, char ***srcs, VmbBool_t **supported, VmbUint32_t *count)
+{
+    VIRTCAM_HANDLE(handle);
+    uint32_t n = std::min((uint32_t)VIRTCAM_NUM(virtcam_temps), cam->spec.ntemps);
+    *srcs = (char **)malloc(std::max(n, 1u) * sizeof(char *));
+    *supported = (VmbBool_t *)malloc(std::max(n, 1u) * sizeof(VmbBool_t));
+    if (*srcs == NULL || *supported == NULL)
+        return VmbErrorResources;
+    for (uint32_t i = 0; i < n; i++)
+    {
+        (*srcs)[i] = (char *)virtcam_temps[i].name;
+        (*supported)[i] = true;
+    }
+    *count = n;
+    return VmbErrorSuccess;
+}
+
+static VmbError_t virtcam_set_temperature_src(AlliedCameraHandle_t handle, const char *src)
+{
+    VIRTCAM_HANDLE(handle);
+    for (uint32_t i = 0; i < std::min((uint32_t)VIRTCAM_NUM(virtcam_temps), cam->spec.ntemps); i++)
+    {
+        if (strcmp(virtcam_temps[i].name, src) == 0)
+        {
+            cam->temp_src = i;
+            return VmbErrorSuccess;
+        }
+    }
+    return VmbErrorInvalidValue;
+}
+
+static VmbError_t virtcam_get_temperature(AlliedCameraHandle_t handle, double *temp)
+{
+    VIRTCAM_HANDLE(handle);
+    *temp = cam->temperature(cam->temp_src);
+    return VmbErrorSuccess;
+}
+
+#undef VIRTCAM_HANDLE
+
+static const CameraBackend virtcam_backend = {
+    "Virtual",
+    virtcam_open_camera,
+    virtcam_close_camera,
+    virtcam_reset_camera,
+    virtcam_camera_acquiring,
+    virtcam_queue_capture,
+    virtcam_dequeue_capture,
+    virtcam_start_capture,
+    virtcam_stop_capture,
+    virtcam_get_link_speed,
+    virtcam_get_throughput_limit,
+    virtcam_set_throughput_limit,
+    virtcam_get_throughput_limit_range,
+    virtcam_get_image_format,
+    virtcam_set_image_format,
+    virtcam_get_image_format_list,
+    virtcam_get_sensor_bit_depth,
+    virtcam_set_sensor_bit_depth,
+    virtcam_get_sensor_bit_depth_list,
+    virtcam_get_trigline,
+    virtcam_set_trigline,
+    virtcam_get_triglines_list,
+    virtcam_set_trigline_mode,
+    virtcam_get_trigline_src,
+    virtcam_set_trigline_src,
+    virtcam_get_trigline_src_list,
+    virtcam_get_indicator_luma,
+    virtcam_set_indicator_luma,
+    virtcam_get_acq_framerate,
+    virtcam_set_acq_framerate,
+    virtcam_get_acq_framerate_range,
+    virtcam_get_acq_framerate_auto,
+    virtcam_set_acq_framerate_auto,
+    virtcam_get_binning_factor,
+    virtcam_set_binning_factor,
+    virtcam_get_image_size,
+    virtcam_set_image_size,
+    virtcam_get_image_ofst,
+    virtcam_set_image_ofst,
+    virtcam_get_exposure_range_us,
+    virtcam_get_exposure_us,
+    virtcam_set_exposure_us,
+    virtcam_get_temperature_src_list,
+    virtcam_set_temperature_src,
+    virtcam_get_temperature,
+};
+
+/**
+ * @brief The backend behind a camera ID string.
+ */
+static inline const CameraBackend *camback_find(const std::string &id)
+{
+    return virtcam_owns(id) ? &virtcam_backend : &vimba_backend;
+}